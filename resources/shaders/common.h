@@ -26,6 +26,67 @@ struct UniformParams
   float time;
   vec3  baseColor;
   bool animateLightColor;
+  mat4  projView;    // camera, read by vertex shaders of retained command buffers that are not re-recorded when it moves
+};
+
+// bounds of a cluster of mesh triangles, see src/render/meshlets.h
+struct MeshletInfo
+{
+  vec4 sphere;      // center.xyz, radius in mesh space
+  vec4 coneApex;    // xyz, w is unused
+  vec4 coneAxis;    // axis.xyz and cutoff in w: cluster is back-facing if dot(normalize(coneApex - eye), axis) >= cutoff
+  uint firstIndex;  // relative to the first index of the mesh
+  uint indexCount;
+  uint vertexCount;
+  uint pad;
+};
+
+// level of detail of a mesh, drawn with the vertices of the full mesh, see src/render/mesh_simplifier.h
+struct MeshLodInfo
+{
+  uint  firstIndex; // relative to the first index of the mesh, LOD 0 is the full mesh and starts at 0
+  uint  indexCount;
+  float error;      // estimated deviation from the full mesh in mesh space
+  uint  pad;
+};
+
+// mesh data used by GPU culling to write draw commands, see src/render/gpu_culler.h
+struct MeshDrawInfo
+{
+  uint firstIndex;   // in the index buffer of indexType
+  int  vertexOffset;
+  uint firstLod;     // in the table of MeshLodInfo of all meshes
+  uint lodsNum;
+  uint indexType;    // 0 - 32 bit indices, 1 - 16 bit
+};
+
+// world space bounds of an instance for GPU culling
+struct InstanceCullInfo
+{
+  vec3  boxMin;
+  uint  meshId;
+  vec3  boxMax;
+  float scale;       // largest scale of the model matrix, used to select LODs
+};
+
+#define CULL_FLAG_COMPACT 1u // visible commands are packed and counted, otherwise every instance has one in both index types
+#define CULL_FLAG_LOD     2u
+#define CULL_FLAG_OCCLUSION_EARLY 4u // draw instances visible in the last frame, see GpuCuller::CullPass
+#define CULL_FLAG_OCCLUSION_LATE  8u // test instances against the depth pyramid, draw the newly visible ones
+
+// counters of a view written by instance culling: draw counts of both index types, occluded instances, padding
+#define CULL_COUNTS_PER_VIEW 4u
+#define CULL_COUNT_OCCLUDED  2u
+
+// push constants of instance_cull.comp and instance_cull_occlusion.comp
+struct InstanceCullParams
+{
+  mat4 projView;     // frustum planes are taken from its rows
+  vec4 lodEye;       // camera position in xyz, screen scale divided by allowed LOD error in pixels in w
+  uint instancesNum;
+  uint capacity;     // draw commands per index type and view
+  uint view;
+  uint flags;        // CULL_FLAG_*
 };
 
 #endif //VK_GRAPHICS_BASIC_COMMON_H
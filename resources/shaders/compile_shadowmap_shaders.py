@@ -5,7 +5,9 @@ import pathlib
 if __name__ == '__main__':
     glslang_cmd = "glslangValidator"
 
-    shader_list = ["simple.vert", "quad.vert", "quad.frag", "simple_shadow.frag"]
+    shader_list = ["simple.vert", "simple_compact.vert", "simple_indirect.vert", "simple_compact_indirect.vert",
+                   "simple_instanced.vert", "simple_compact_instanced.vert", "instance_cull.comp",
+                   "quad.vert", "quad.frag", "simple_shadow.frag"]
 
     for shader in shader_list:
         subprocess.run([glslang_cmd, "-V", shader, "-o", "{}.spv".format(shader)])
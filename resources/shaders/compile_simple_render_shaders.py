@@ -5,7 +5,10 @@ import pathlib
 if __name__ == '__main__':
     glslang_cmd = "glslangValidator"
 
-    shader_list = ["simple.vert", "simple.frag"]
+    shader_list = ["simple.vert", "simple_compact.vert", "simple_indirect.vert", "simple_compact_indirect.vert",
+                   "simple_instanced.vert", "simple_compact_instanced.vert", "simple_retained.vert",
+                   "simple_compact_retained.vert", "instance_cull.comp",
+                   "instance_cull_occlusion.comp", "depth_pyramid.comp", "simple.frag"]
 
     for shader in shader_list:
         subprocess.run([glslang_cmd, "-V", shader, "-o", "{}.spv".format(shader)])
@@ -0,0 +1,164 @@
+#ifndef VK_GRAPHICS_BASIC_INSTANCE_CULL_H
+#define VK_GRAPHICS_BASIC_INSTANCE_CULL_H
+
+// body of instance_cull.comp and instance_cull_occlusion.comp (OCCLUSION_CULLING defined),
+// frustum culling and LOD selection of scene instances, writes indirect draw commands, see src/render/gpu_culler.h
+
+layout(local_size_x = 64) in;
+
+struct DrawCommand // VkDrawIndexedIndirectCommand
+{
+  uint indexCount;
+  uint instanceCount;
+  uint firstIndex;
+  int  vertexOffset;
+  uint firstInstance;
+};
+
+layout(std430, binding = 1) readonly buffer Instances { InstanceCullInfo instances[]; };
+layout(std430, binding = 2) readonly buffer Meshes    { MeshDrawInfo meshes[]; };
+layout(std430, binding = 3) readonly buffer Lods      { MeshLodInfo lods[]; };
+layout(std430, binding = 4) writeonly buffer Commands { DrawCommand commands[]; };
+layout(std430, binding = 5) buffer Counts             { uint drawCounts[]; }; // [view][CULL_COUNTS_PER_VIEW]
+
+layout(push_constant) uniform params_t
+{
+  InstanceCullParams params;
+};
+
+#ifdef OCCLUSION_CULLING
+layout(std430, binding = 6) buffer Visibility { uint visibility[]; }; // [view][instance slot], 1 if drawn in the last frame
+
+layout(set = 1, binding = 0) uniform sampler2D depthPyramid; // farthest depth of texels, see src/render/depth_pyramid.h
+
+// a box is hidden if its nearest point is farther than everything drawn in the pyramid texels covering its screen rectangle
+bool Occluded(vec3 boxMin, vec3 boxMax)
+{
+  vec2 rectMin    = vec2(1.0f);
+  vec2 rectMax    = vec2(0.0f);
+  float nearestZ  = 1.0f;
+  for(int c = 0; c < 8; ++c)
+  {
+    const vec3 corner = mix(boxMin, boxMax, bvec3((c & 1) != 0, (c & 2) != 0, (c & 4) != 0));
+    const vec4 clip   = params.projView * vec4(corner, 1.0f);
+    if(clip.w <= 0.0f) // the box crosses the camera plane
+      return false;
+
+    const vec3 ndc = clip.xyz / clip.w;
+    rectMin  = min(rectMin, ndc.xy * 0.5f + 0.5f);
+    rectMax  = max(rectMax, ndc.xy * 0.5f + 0.5f);
+    nearestZ = min(nearestZ, ndc.z);
+  }
+  rectMin = clamp(rectMin, vec2(0.0f), vec2(1.0f));
+  rectMax = clamp(rectMax, vec2(0.0f), vec2(1.0f));
+
+  // the level where the rectangle is not larger than a texel, so it touches at most 2x2 of them
+  const vec2 extent = (rectMax - rectMin) * vec2(textureSize(depthPyramid, 0));
+  const int  level  = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0f)))), 0, textureQueryLevels(depthPyramid) - 1);
+
+  const ivec2 levelSize = textureSize(depthPyramid, level);
+  const ivec2 first     = min(ivec2(rectMin * vec2(levelSize)), levelSize - 1);
+  const ivec2 last      = min(ivec2(rectMax * vec2(levelSize)), levelSize - 1);
+
+  float farthest = 0.0f;
+  for(int y = first.y; y <= last.y; ++y)
+    for(int x = first.x; x <= last.x; ++x)
+      farthest = max(farthest, texelFetch(depthPyramid, ivec2(x, y), level).x);
+
+  return nearestZ > farthest;
+}
+#endif
+
+void main()
+{
+  const uint instId = gl_GlobalInvocationID.x; // GPU instance slot, see SceneManager::GetInstanceGpuSlot
+  if(instId >= params.instancesNum)
+    return;
+
+  const InstanceCullInfo inst = instances[instId];
+
+  // clip planes (Gribb, Hartmann) as in FrustumCuller, rows of projView;
+  // a box is outside if its corner farthest along the plane normal is behind the plane
+  const mat4 m = transpose(params.projView);
+  const vec4 planes[6] = vec4[6](m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2]);
+  bool visible = true;
+  for(int p = 0; p < 6; ++p)
+  {
+    const vec4 plane    = planes[p];
+    const vec3 farthest = mix(inst.boxMin, inst.boxMax, greaterThanEqual(plane.xyz, vec3(0.0f)));
+    visible = visible && dot(plane.xyz, farthest) + plane.w >= 0.0f;
+  }
+
+  // two pass occlusion culling: the early pass draws what was visible in the last frame,
+  // the late one tests the rest against depth of the early pass and remembers visibility for the next frame
+  bool drawn = visible;
+#ifdef OCCLUSION_CULLING
+  const uint visibilityId = params.view * params.capacity + instId;
+  if((params.flags & CULL_FLAG_OCCLUSION_EARLY) != 0)
+    drawn = visible && visibility[visibilityId] != 0;
+  else if((params.flags & CULL_FLAG_OCCLUSION_LATE) != 0)
+  {
+    const bool wasDrawn = visible && visibility[visibilityId] != 0;
+    if(visible && Occluded(inst.boxMin, inst.boxMax))
+    {
+      visible = false;
+      atomicAdd(drawCounts[params.view * CULL_COUNTS_PER_VIEW + CULL_COUNT_OCCLUDED], 1);
+    }
+    visibility[visibilityId] = visible ? 1u : 0u;
+    drawn = visible && !wasDrawn;
+  }
+#endif
+
+  const MeshDrawInfo mesh = meshes[inst.meshId];
+
+  // the coarsest LOD whose error is small enough, same as mesh_simplifier::SelectLod
+  uint lod = 0;
+  if((params.flags & CULL_FLAG_LOD) != 0)
+  {
+    const vec3 eye       = params.lodEye.xyz;
+    const float distance = length(max(max(inst.boxMin - eye, eye - inst.boxMax), vec3(0.0f)));
+    if(distance > 0.0f)
+    {
+      const float errorScale = inst.scale * params.lodEye.w / distance;
+      for(uint l = mesh.lodsNum - 1; l > 0; --l)
+      {
+        if(lods[mesh.firstLod + l].error * errorScale <= 1.0f)
+        {
+          lod = l;
+          break;
+        }
+      }
+    }
+  }
+
+  const MeshLodInfo lodInfo = lods[mesh.firstLod + lod];
+
+  DrawCommand cmd;
+  cmd.indexCount    = lodInfo.indexCount;
+  cmd.instanceCount = 1;
+  cmd.firstIndex    = mesh.firstIndex + lodInfo.firstIndex;
+  cmd.vertexOffset  = mesh.vertexOffset;
+  cmd.firstInstance = instId; // vertex shader takes the instance matrix by gl_InstanceIndex
+
+  // commands of a view: capacity of them for 32 bit indices, then capacity for 16 bit ones
+  const uint firstCommand = params.view * 2 * params.capacity;
+  if((params.flags & CULL_FLAG_COMPACT) != 0)
+  {
+    if(drawn)
+    {
+      const uint slot = atomicAdd(drawCounts[params.view * CULL_COUNTS_PER_VIEW + mesh.indexType], 1);
+      commands[firstCommand + mesh.indexType * params.capacity + slot] = cmd;
+    }
+  }
+  else
+  {
+    // draw count is the number of instances, so every instance writes both of its commands
+    cmd.instanceCount = drawn ? 1 : 0;
+    commands[firstCommand + mesh.indexType * params.capacity + instId] = cmd;
+
+    cmd.instanceCount = 0;
+    commands[firstCommand + (1 - mesh.indexType) * params.capacity + instId] = cmd;
+  }
+}
+
+#endif //VK_GRAPHICS_BASIC_INSTANCE_CULL_H
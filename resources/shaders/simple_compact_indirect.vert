@@ -0,0 +1,47 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "unpack_attributes.h"
+
+// simple_compact.vert for instances drawn by GPU culling, model matrix is taken by instance index, see src/render/gpu_culler.h
+
+// compact_vertex layout, see src/render/compact_vertex.h
+layout(location = 0) in uvec4 vPacked;
+
+layout(push_constant) uniform params_t
+{
+    mat4 mProjView;
+} params;
+
+layout(std430, set = 1, binding = 0) readonly buffer InstanceMatrices
+{
+    mat4 instanceMatrices[]; // include dequantization of positions
+};
+
+
+layout (location = 0 ) out VS_OUT
+{
+    vec3 wPos;
+    vec3 wNorm;
+    vec3 wTangent;
+    vec2 texCoord;
+
+} vOut;
+
+out gl_PerVertex { vec4 gl_Position; };
+void main(void)
+{
+    const mat4 mModel = instanceMatrices[gl_InstanceIndex];
+    const vec3 pos  = vec3(unpackUnorm2x16(vPacked.x), unpackUnorm2x16(vPacked.y).x);
+    const vec3 norm = DecodeOctahedral(unpackSnorm2x16(vPacked.w));
+    const vec3 tang = DecodeOctahedral(unpackSnorm4x8(vPacked.y).zw);
+
+    // dequantization scale is uniform, so normal directions are not changed by it
+    vOut.wPos     = (mModel * vec4(pos, 1.0f)).xyz;
+    vOut.wNorm    = normalize(mat3(transpose(inverse(mModel))) * norm);
+    vOut.wTangent = normalize(mat3(transpose(inverse(mModel))) * tang);
+    vOut.texCoord = unpackHalf2x16(vPacked.z);
+
+    gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
+}
@@ -0,0 +1,48 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "common.h"
+#include "unpack_attributes.h"
+
+// simple_compact.vert for retained command buffers: the camera comes from the uniform buffer,
+// so draws recorded once stay valid when it moves; push constants keep the layout of simple.vert
+
+// compact_vertex layout, see src/render/compact_vertex.h
+layout(location = 0) in uvec4 vPacked;
+
+layout(push_constant) uniform params_t
+{
+    layout(offset = 64) mat4 mModel; // includes dequantization of positions
+} params;
+
+layout(binding = 0, set = 0) uniform AppData
+{
+    UniformParams Params;
+};
+
+
+layout (location = 0 ) out VS_OUT
+{
+    vec3 wPos;
+    vec3 wNorm;
+    vec3 wTangent;
+    vec2 texCoord;
+
+} vOut;
+
+out gl_PerVertex { vec4 gl_Position; };
+void main(void)
+{
+    const vec3 pos  = vec3(unpackUnorm2x16(vPacked.x), unpackUnorm2x16(vPacked.y).x);
+    const vec3 norm = DecodeOctahedral(unpackSnorm2x16(vPacked.w));
+    const vec3 tang = DecodeOctahedral(unpackSnorm4x8(vPacked.y).zw);
+
+    // dequantization scale is uniform, so normal directions are not changed by it
+    vOut.wPos     = (params.mModel * vec4(pos, 1.0f)).xyz;
+    vOut.wNorm    = normalize(mat3(transpose(inverse(params.mModel))) * norm);
+    vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * tang);
+    vOut.texCoord = unpackHalf2x16(vPacked.z);
+
+    gl_Position   = Params.projView * vec4(vOut.wPos, 1.0);
+}
@@ -20,6 +20,16 @@ vec3 DecodeNormal(uint a_data)
   return vec3(x, y, z);
 }
 
+// inverse of octahedral mapping of unit vectors to [-1, 1]^2
+vec3 DecodeOctahedral(vec2 a_enc)
+{
+  vec3 n = vec3(a_enc, 1.0f - abs(a_enc.x) - abs(a_enc.y));
+  const float t = max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.y += n.y >= 0.0f ? -t : t;
+  return normalize(n);
+}
+
 
 
 #endif// CHIMERA_UNPACK_ATTRIBUTES_H
@@ -3,8 +3,6 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
-#include <locale>
-#include <codecvt>
 
 #if defined(__ANDROID__)
 #define LOGE(...) \
@@ -13,24 +11,24 @@
 
 namespace hydra_xml
 {
-  #pragma warning(push)
-  #pragma warning(disable: 4996)
-  // Here we use codecvt_utf8 and other types depricated in C++17
-  // TODO: Replace it with another implementation.
   std::wstring s2ws(const std::string& str)
   {
-    using convert_typeX = std::codecvt_utf8<wchar_t>;
-    std::wstring_convert<convert_typeX, wchar_t> converterX;
-    return converterX.from_bytes(str);
+    return pugi::as_wide(str);
   }
 
   std::string ws2s(const std::wstring& wstr)
   {
-    using convert_typeX = std::codecvt_utf8<wchar_t>;
-    std::wstring_convert<convert_typeX, wchar_t> converterX;
-    return converterX.to_bytes(wstr);
+    return pugi::as_utf8(wstr);
+  }
+
+  std::string toUtf8(const pugi::char_t* a_str)
+  {
+#ifdef PUGIXML_WCHAR_MODE
+    return pugi::as_utf8(a_str);
+#else
+    return std::string(a_str);
+#endif
   }
-  #pragma warning(pop)
 
   void HydraScene::LogError(const std::string &msg)
   {
@@ -67,17 +65,17 @@ namespace hydra_xml
       return -1;
     }
 
-    auto pos = path.find_last_of(L'/');
+    auto pos = path.find_last_of('/');
     m_libraryRootDir = path.substr(0, pos);
 
-    auto texturesLib  = xmlDoc.child(L"textures_lib");
-    auto materialsLib = xmlDoc.child(L"materials_lib");
-    auto geometryLib  = xmlDoc.child(L"geometry_lib");
-    auto lightsLib    = xmlDoc.child(L"lights_lib");
+    auto texturesLib  = xmlDoc.child(PUGIXML_TEXT("textures_lib"));
+    auto materialsLib = xmlDoc.child(PUGIXML_TEXT("materials_lib"));
+    auto geometryLib  = xmlDoc.child(PUGIXML_TEXT("geometry_lib"));
+    auto lightsLib    = xmlDoc.child(PUGIXML_TEXT("lights_lib"));
 
-    auto cameraLib    = xmlDoc.child(L"cam_lib");
-    auto settingsNode = xmlDoc.child(L"render_lib");
-    auto sceneNode    = xmlDoc.child(L"scenes");
+    auto cameraLib    = xmlDoc.child(PUGIXML_TEXT("cam_lib"));
+    auto settingsNode = xmlDoc.child(PUGIXML_TEXT("render_lib"));
+    auto sceneNode    = xmlDoc.child(PUGIXML_TEXT("scenes"));
 
     if (texturesLib == nullptr || materialsLib == nullptr || lightsLib == nullptr || cameraLib == nullptr ||
         geometryLib == nullptr || settingsNode == nullptr || sceneNode == nullptr)
@@ -94,30 +92,36 @@ namespace hydra_xml
 #else
   int HydraScene::LoadState(const std::string &path)
   {
+#ifdef PUGIXML_WCHAR_MODE
     auto loaded = m_xmlDoc.load_file(path.c_str());
+#else
+    // document is parsed in place from a private writable mapping, DOM strings point straight into it
+    pugi::xml_parse_result loaded;
+    if(m_xmlFile.Open(path, true))
+      loaded = m_xmlDoc.load_buffer_inplace(m_xmlFile.Data(), m_xmlFile.Size(), pugi::parse_minimal | pugi::parse_escapes, pugi::encoding_utf8);
+    else
+      loaded.status = pugi::status_file_not_found;
+#endif
 
     if(!loaded)
     {
-      std::string  str(loaded.description());
-      std::wstring errorMsg(str.begin(), str.end());
-
       LogError("Error loading scene from: " + path);
-      LogError(ws2s(errorMsg));
+      LogError(loaded.description());
 
       return -1;
     }
 
-    auto pos = path.find_last_of(L'/');
+    auto pos = path.find_last_of('/');
     m_libraryRootDir = path.substr(0, pos);
 
-    m_texturesLib  = m_xmlDoc.child(L"textures_lib");
-    m_materialsLib = m_xmlDoc.child(L"materials_lib");
-    m_geometryLib  = m_xmlDoc.child(L"geometry_lib");
-    m_lightsLib    = m_xmlDoc.child(L"lights_lib");
+    m_texturesLib  = m_xmlDoc.child(PUGIXML_TEXT("textures_lib"));
+    m_materialsLib = m_xmlDoc.child(PUGIXML_TEXT("materials_lib"));
+    m_geometryLib  = m_xmlDoc.child(PUGIXML_TEXT("geometry_lib"));
+    m_lightsLib    = m_xmlDoc.child(PUGIXML_TEXT("lights_lib"));
 
-    m_cameraLib    = m_xmlDoc.child(L"cam_lib");
-    m_settingsNode = m_xmlDoc.child(L"render_lib");
-    m_sceneNode    = m_xmlDoc.child(L"scenes");
+    m_cameraLib    = m_xmlDoc.child(PUGIXML_TEXT("cam_lib"));
+    m_settingsNode = m_xmlDoc.child(PUGIXML_TEXT("render_lib"));
+    m_sceneNode    = m_xmlDoc.child(PUGIXML_TEXT("scenes"));
 
     if (m_texturesLib == nullptr || m_materialsLib == nullptr || m_lightsLib == nullptr || m_cameraLib == nullptr || m_geometryLib == nullptr || m_settingsNode == nullptr || m_sceneNode == nullptr)
     {
@@ -134,66 +138,189 @@ namespace hydra_xml
 
   void HydraScene::parseInstancedMeshes(pugi::xml_node a_scenelib, pugi::xml_node a_geomlib)
   {
+    constexpr uint32_t MESH_UNRESOLVED = uint32_t(-1);
+    constexpr uint32_t MESH_MISSING    = uint32_t(-2);
+
+    // geometry id -> geometry node and interned mesh index, which is resolved on first use of the mesh
+    struct GeomEntry
+    {
+      pugi::xml_node node;
+      uint32_t       meshIdx = MESH_UNRESOLVED;
+    };
+    std::unordered_map<uint32_t, GeomEntry> geomById;
+    for(pugi::xml_node geom = a_geomlib.first_child(); geom != nullptr; geom = geom.next_sibling())
+    {
+      auto idAttr = geom.attribute(PUGIXML_TEXT("id"));
+      if(idAttr != nullptr)
+        geomById.emplace(idAttr.as_uint(), GeomEntry{geom, MESH_UNRESOLVED});
+    }
+
     auto scene = a_scenelib.first_child();
     for (pugi::xml_node inst = scene.first_child(); inst != nullptr; inst = inst.next_sibling())
     {
-      if (std::wstring(inst.name()) == L"instance_light")
+      if (nameIs(inst, PUGIXML_TEXT("instance_light")))
         break;
 
-      auto mesh_id = inst.attribute(L"mesh_id").as_string();
-      auto matrix = std::wstring(inst.attribute(L"matrix").as_string());
+      auto meshIdAttr = inst.attribute(PUGIXML_TEXT("mesh_id"));
+      if(meshIdAttr == nullptr)
+        continue;
 
-      auto meshNode = a_geomlib.find_child_by_attribute(L"id", mesh_id);
+      auto pGeom = geomById.find(meshIdAttr.as_uint());
+      if(pGeom == geomById.end())
+        continue;
 
-      if(meshNode != nullptr)
+      GeomEntry &geom = pGeom->second;
+      if(geom.meshIdx == MESH_UNRESOLVED)
       {
-        auto meshLoc = ws2s(std::wstring(meshNode.attribute(L"loc").as_string()));
+        auto meshLoc = toUtf8(geom.node.attribute(PUGIXML_TEXT("loc")).as_string());
         meshLoc = m_libraryRootDir + "/" + meshLoc;
 
-#if not defined(__ANDROID__)
-        std::ifstream checkMesh(meshLoc);
-        if(!checkMesh.good())
-        {
-          LogError("Mesh not found at: " + meshLoc + ". Loader will skip it.");
-          continue;
-        }
+        auto pLoc = m_meshLocIds.find(meshLoc);
+        if(pLoc != m_meshLocIds.end())
+          geom.meshIdx = pLoc->second;
         else
         {
-          checkMesh.close();
-        }
+#if not defined(__ANDROID__)
+          std::ifstream checkMesh(meshLoc);
+          if(!checkMesh.good())
+          {
+            LogError("Mesh not found at: " + meshLoc + ". Loader will skip it.");
+            geom.meshIdx = MESH_MISSING;
+            continue;
+          }
 #endif
-
-        if(unique_meshes.find(meshLoc) == unique_meshes.end())
-        {
-          unique_meshes.emplace(meshLoc);
-          //m_meshloc.push_back(meshLoc);
+          geom.meshIdx = uint32_t(m_instancesPerMesh.size());
+          m_meshLocIds.emplace(meshLoc, geom.meshIdx);
+          m_instancesPerMesh.emplace_back();
         }
+      }
 
+      if(geom.meshIdx == MESH_MISSING)
+        continue;
 
-        if(m_instancesPerMeshLoc.find(meshLoc) != m_instancesPerMeshLoc.end())
-        {
-          m_instancesPerMeshLoc[meshLoc].push_back(float4x4FromString(matrix));
-        }
-        else
+      m_instancesPerMesh[geom.meshIdx].push_back(float4x4FromString(inst.attribute(PUGIXML_TEXT("matrix")).as_string()));
+    }
+  }
+
+  // Numbers in scene files are plain decimal floats, so they are parsed in place without streams,
+  // which allocate and consult locale for every attribute.
+  //
+  static inline bool isSpace(pugi::char_t c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+  static const pugi::char_t* parseFloat(const pugi::char_t* a_str, float &a_out)
+  {
+    // exactly representable powers of 10
+    static const double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    const pugi::char_t* p = a_str;
+    bool negative = false;
+    if(*p == '-' || *p == '+')
+      negative = (*p++ == '-');
+
+    uint64_t mantissa = 0;
+    int      exponent = 0;
+    int      digits   = 0;
+    bool     anyDigit = false;
+
+    for(; *p >= '0' && *p <= '9'; ++p, anyDigit = true)
+    {
+      if(digits < 19)
+      {
+        mantissa = mantissa * 10 + uint64_t(*p - '0');
+        digits += (mantissa != 0);
+      }
+      else
+        ++exponent;
+    }
+
+    if(*p == '.')
+    {
+      for(++p; *p >= '0' && *p <= '9'; ++p, anyDigit = true)
+      {
+        if(digits < 19)
         {
-          std::vector<LiteMath::float4x4> tmp = { float4x4FromString(matrix) };
-          m_instancesPerMeshLoc[meshLoc] = tmp;
+          mantissa = mantissa * 10 + uint64_t(*p - '0');
+          digits += (mantissa != 0);
+          --exponent;
         }
       }
     }
 
+    if(!anyDigit)
+      return nullptr;
+
+    if(*p == 'e' || *p == 'E')
+    {
+      const pugi::char_t* e = p + 1;
+      bool expNegative = false;
+      if(*e == '-' || *e == '+')
+        expNegative = (*e++ == '-');
 
+      if(*e >= '0' && *e <= '9')
+      {
+        int expValue = 0;
+        for(; *e >= '0' && *e <= '9'; ++e)
+          expValue = expValue < 10000 ? expValue * 10 + int(*e - '0') : expValue;
+        exponent += expNegative ? -expValue : expValue;
+        p = e;
+      }
+    }
+
+    double value = double(mantissa);
+    if(mantissa != 0)
+    {
+      // single multiplication or division is correctly rounded while both operands are exact
+      int absExp = exponent < 0 ? -exponent : exponent;
+      double scale = 1.0;
+      while(absExp > 22)
+      {
+        scale  *= pow10[22];
+        absExp -= 22;
+      }
+      scale *= pow10[absExp];
+      value = exponent < 0 ? value / scale : value * scale;
+    }
+
+    a_out = float(negative ? -value : value);
+    return p;
   }
 
-  LiteMath::float4x4 float4x4FromString(const std::wstring &matrix_str)
+  int readFloats(const pugi::char_t* a_str, float* a_out, int a_maxCount)
+  {
+    if(a_str == nullptr)
+      return 0;
+
+    int count = 0;
+    const pugi::char_t* p = a_str;
+    while(count < a_maxCount)
+    {
+      while(isSpace(*p))
+        ++p;
+
+      p = parseFloat(p, a_out[count]);
+      if(p == nullptr)
+        break;
+      ++count;
+    }
+
+    return count;
+  }
+
+  float readFloat(pugi::xml_text a_text, float a_default)
+  {
+    float res = a_default;
+    readFloats(a_text.get(), &res, 1);
+    return res;
+  }
+
+  LiteMath::float4x4 float4x4FromString(const pugi::char_t* matrix_str)
   {
     LiteMath::float4x4 result;
-    std::wstringstream inputStream(matrix_str);
-    
-    float data[16];
-    for(int i = 0; i < 16; i++)
-      inputStream >> data[i];
-    
+
+    float data[16] = {};
+    readFloats(matrix_str, data, 16);
+
     result.set_row(0, LiteMath::float4(data[0],data[1], data[2], data[3]));
     result.set_row(1, LiteMath::float4(data[4],data[5], data[6], data[7]));
     result.set_row(2, LiteMath::float4(data[8],data[9], data[10], data[11]));
@@ -202,35 +329,30 @@ namespace hydra_xml
     return result;
   }
 
+  LiteMath::float4x4 float4x4FromString(const pugi::string_t &matrix_str)
+  {
+    return float4x4FromString(matrix_str.c_str());
+  }
+
   LiteMath::float3 read3f(pugi::xml_attribute a_attr)
   {
-    LiteMath::float3 res(0, 0, 0);
-    const wchar_t* camPosStr = a_attr.as_string();
-    if (camPosStr != nullptr)
-    {
-      std::wstringstream inputStream(camPosStr);
-      inputStream >> res.x >> res.y >> res.z;
-    }
-    return res;
+    float data[3] = {0, 0, 0};
+    readFloats(a_attr.as_string(), data, 3);
+    return LiteMath::float3(data[0], data[1], data[2]);
   }
 
   LiteMath::float3 read3f(pugi::xml_node a_node)
   {
-    LiteMath::float3 res(0,0,0);
-    const wchar_t* camPosStr = a_node.text().as_string();
-    if (camPosStr != nullptr)
-    {
-      std::wstringstream inputStream(camPosStr);
-      inputStream >> res.x >> res.y >> res.z;
-    }
-    return res;
+    float data[3] = {0, 0, 0};
+    readFloats(a_node.text().as_string(), data, 3);
+    return LiteMath::float3(data[0], data[1], data[2]);
   }
 
   LiteMath::float3 readval3f(pugi::xml_node a_node)
   {
     float3 color;
-    if(a_node.attribute(L"val") != nullptr)
-      color = hydra_xml::read3f(a_node.attribute(L"val"));
+    if(a_node.attribute(PUGIXML_TEXT("val")) != nullptr)
+      color = hydra_xml::read3f(a_node.attribute(PUGIXML_TEXT("val")));
     else
       color = hydra_xml::read3f(a_node);
     return color;
@@ -238,13 +360,19 @@ namespace hydra_xml
 
   std::vector<LightInstance> HydraScene::InstancesLights(uint32_t a_sceneId) 
   {
-    auto sceneNode = m_sceneNode.child(L"scene");
+    auto sceneNode = m_sceneNode.child(PUGIXML_TEXT("scene"));
     if(a_sceneId != 0)
     {
-      std::wstringstream temp;
-      temp << a_sceneId;
-      std::wstring tempStr = temp.str();
-      sceneNode = m_sceneNode.find_child_by_attribute(L"id", tempStr.c_str());
+      sceneNode = pugi::xml_node();
+      for(auto node : m_sceneNode.children())
+      {
+        auto idAttr = node.attribute(PUGIXML_TEXT("id"));
+        if(idAttr != nullptr && idAttr.as_uint() == a_sceneId)
+        {
+          sceneNode = node;
+          break;
+        }
+      }
     }
 
     std::vector<pugi::xml_node> lights; 
@@ -256,14 +384,13 @@ namespace hydra_xml
     result.reserve(256);
 
     LightInstance inst;
-    for(auto instNode = sceneNode.child(L"instance_light"); instNode != nullptr; instNode = instNode.next_sibling())
+    for(auto instNode = sceneNode.child(PUGIXML_TEXT("instance_light")); instNode != nullptr; instNode = instNode.next_sibling())
     {
-      std::wstring nameStr = instNode.name();
-      if(nameStr != L"instance_light")
+      if(!nameIs(instNode, PUGIXML_TEXT("instance_light")))
         continue;
       inst.instNode  = instNode;
-      inst.instId    = instNode.attribute(L"id").as_uint();
-      inst.lightId   = instNode.attribute(L"light_id").as_uint(); 
+      inst.instId    = instNode.attribute(PUGIXML_TEXT("id")).as_uint();
+      inst.lightId   = instNode.attribute(PUGIXML_TEXT("light_id")).as_uint(); 
       inst.lightNode = lights[inst.lightId];
       result.push_back(inst);
     }
@@ -2,6 +2,7 @@
 #define HYDRAXML_H
 
 #include "pugixml.hpp"
+#include "mapped_file.h"
 #include "LiteMath.h"
 using namespace LiteMath;
 
@@ -19,11 +20,27 @@ namespace hydra_xml
 {
   std::wstring s2ws(const std::string& str);
   std::string  ws2s(const std::wstring& wstr);
-  LiteMath::float4x4 float4x4FromString(const std::wstring &matrix_str);
+  std::string  toUtf8(const pugi::char_t* a_str);
+  LiteMath::float4x4 float4x4FromString(const pugi::string_t &matrix_str);
+  LiteMath::float4x4 float4x4FromString(const pugi::char_t* matrix_str);
+  int                readFloats(const pugi::char_t* a_str, float* a_out, int a_maxCount);
+  float              readFloat(pugi::xml_text a_text, float a_default = 0.0f);
   LiteMath::float3   read3f(pugi::xml_attribute a_attr);
   LiteMath::float3   read3f(pugi::xml_node a_node);
   LiteMath::float3   readval3f(pugi::xml_node a_node);
 
+  // compares node name without constructing strings
+  inline bool nameIs(const pugi::xml_node &a_node, const pugi::char_t* a_name)
+  {
+    const pugi::char_t* name = a_node.name();
+    while(*name != 0 && *name == *a_name)
+    {
+      ++name;
+      ++a_name;
+    }
+    return *name == *a_name;
+  }
+
   /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
   /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
   /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -75,8 +92,8 @@ namespace hydra_xml
   
     std::string operator*() const 
     { 
-      auto attr    = m_iter->attribute(L"loc");
-      auto meshLoc = ws2s(std::wstring(attr.as_string()));
+      auto attr    = m_iter->attribute(PUGIXML_TEXT("loc"));
+      auto meshLoc = toUtf8(attr.as_string());
       return m_libraryRootDir + "/" + meshLoc;
     }
   
@@ -109,17 +126,17 @@ namespace hydra_xml
     Instance operator*() const 
     { 
       Instance inst;
-      inst.geomId = m_iter->attribute(L"mesh_id").as_uint();
-      inst.rmapId = m_iter->attribute(L"rmap_id").as_uint();
-      inst.matrix = float4x4FromString(m_iter->attribute(L"matrix").as_string());
+      inst.geomId = m_iter->attribute(PUGIXML_TEXT("mesh_id")).as_uint();
+      inst.rmapId = m_iter->attribute(PUGIXML_TEXT("rmap_id")).as_uint();
+      inst.matrix = float4x4FromString(m_iter->attribute(PUGIXML_TEXT("matrix")).as_string());
       return inst;
     }
   
-		const InstIterator& operator++() { do ++m_iter; while(m_iter != m_end && std::wstring(m_iter->name()) != L"instance"); return *this; }
-		InstIterator operator++(int)     { do m_iter++; while(m_iter != m_end && std::wstring(m_iter->name()) != L"instance"); return *this; }
+		const InstIterator& operator++() { do ++m_iter; while(m_iter != m_end && !nameIs(*m_iter, PUGIXML_TEXT("instance"))); return *this; }
+		InstIterator operator++(int)     { do m_iter++; while(m_iter != m_end && !nameIs(*m_iter, PUGIXML_TEXT("instance"))); return *this; }
   
-		const InstIterator& operator--() { do --m_iter; while(m_iter != m_end && std::wstring(m_iter->name()) != L"instance"); return *this; }
-		InstIterator operator--(int)     { do m_iter--; while(m_iter != m_end && std::wstring(m_iter->name()) != L"instance"); return *this; }
+		const InstIterator& operator--() { do --m_iter; while(m_iter != m_end && !nameIs(*m_iter, PUGIXML_TEXT("instance"))); return *this; }
+		InstIterator operator--(int)     { do m_iter--; while(m_iter != m_end && !nameIs(*m_iter, PUGIXML_TEXT("instance"))); return *this; }
   
   private:
     pugi::xml_node_iterator m_iter;
@@ -144,13 +161,13 @@ namespace hydra_xml
     Camera operator*() const 
     { 
       Camera cam = {};
-      cam.fov       = m_iter->child(L"fov").text().as_float(); 
-      cam.nearPlane = m_iter->child(L"nearClipPlane").text().as_float();
-      cam.farPlane  = m_iter->child(L"farClipPlane").text().as_float();  
+      cam.fov       = hydra_xml::readFloat(m_iter->child(PUGIXML_TEXT("fov")).text());
+      cam.nearPlane = hydra_xml::readFloat(m_iter->child(PUGIXML_TEXT("nearClipPlane")).text());
+      cam.farPlane  = hydra_xml::readFloat(m_iter->child(PUGIXML_TEXT("farClipPlane")).text());
       
-      LiteMath::float3 pos    = hydra_xml::read3f(m_iter->child(L"position"));
-      LiteMath::float3 lookAt = hydra_xml::read3f(m_iter->child(L"look_at"));
-      LiteMath::float3 up     = hydra_xml::read3f(m_iter->child(L"up"));
+      LiteMath::float3 pos    = hydra_xml::read3f(m_iter->child(PUGIXML_TEXT("position")));
+      LiteMath::float3 lookAt = hydra_xml::read3f(m_iter->child(PUGIXML_TEXT("look_at")));
+      LiteMath::float3 up     = hydra_xml::read3f(m_iter->child(PUGIXML_TEXT("up")));
       for(int i=0;i<3;i++)
       {
         cam.pos   [i] = pos[i];
@@ -203,8 +220,8 @@ namespace hydra_xml
     pugi::xml_object_range<LocIterator> TextureFiles() { return {LocIterator(m_texturesLib.begin(), m_libraryRootDir),
                                                                  LocIterator(m_texturesLib.end(), m_libraryRootDir)}; }
 
-    pugi::xml_object_range<InstIterator> InstancesGeom() { return {InstIterator(m_sceneNode.child(L"scene").child(L"instance"), m_sceneNode.child(L"scene").end()),
-                                                                   InstIterator(m_sceneNode.child(L"scene").end(), m_sceneNode.child(L"scene").end())}; }
+    pugi::xml_object_range<InstIterator> InstancesGeom() { return {InstIterator(m_sceneNode.child(PUGIXML_TEXT("scene")).child(PUGIXML_TEXT("instance")), m_sceneNode.child(PUGIXML_TEXT("scene")).end()),
+                                                                   InstIterator(m_sceneNode.child(PUGIXML_TEXT("scene")).end(), m_sceneNode.child(PUGIXML_TEXT("scene")).end())}; }
     
     std::vector<LightInstance> InstancesLights(uint32_t a_sceneId = 0);
 
@@ -213,19 +230,29 @@ namespace hydra_xml
 
     std::vector<LiteMath::float4x4> GetAllInstancesOfMeshLoc(const std::string& a_loc) const 
     { 
-      auto pFound = m_instancesPerMeshLoc.find(a_loc);
-      if(pFound == m_instancesPerMeshLoc.end())
+      auto pFound = m_meshLocIds.find(a_loc);
+      if(pFound == m_meshLocIds.end())
+        return {};
+      else
+        return m_instancesPerMesh[pFound->second]; 
+    }
+
+    // same as GetAllInstancesOfMeshLoc, but moves matrices out of the scene, next call for a_loc returns empty list
+    std::vector<LiteMath::float4x4> TakeAllInstancesOfMeshLoc(const std::string& a_loc)
+    {
+      auto pFound = m_meshLocIds.find(a_loc);
+      if(pFound == m_meshLocIds.end())
         return {};
       else
-        return pFound->second; 
+        return std::move(m_instancesPerMesh[pFound->second]);
     }
     
   private:
     void parseInstancedMeshes(pugi::xml_node a_scenelib, pugi::xml_node a_geomlib);
     void LogError(const std::string &msg);  
     
-    std::set<std::string> unique_meshes;
     std::string m_libraryRootDir;
+    MappedFile     m_xmlFile     ; // source of in place parsed document, must outlive m_xmlDoc
     pugi::xml_node m_texturesLib ; 
     pugi::xml_node m_materialsLib; 
     pugi::xml_node m_geometryLib ; 
@@ -235,7 +262,9 @@ namespace hydra_xml
     pugi::xml_node m_sceneNode   ; 
     pugi::xml_document m_xmlDoc;
 
-    std::unordered_map<std::string, std::vector<LiteMath::float4x4> > m_instancesPerMeshLoc;
+    // instanced meshes are interned: each unique mesh location gets an index into m_instancesPerMesh
+    std::unordered_map<std::string, uint32_t> m_meshLocIds;
+    std::vector<std::vector<LiteMath::float4x4> > m_instancesPerMesh;
   };
 
   
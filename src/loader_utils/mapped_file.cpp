@@ -0,0 +1,144 @@
+#include "mapped_file.h"
+
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile &&a_other) noexcept
+{
+  *this = std::move(a_other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&a_other) noexcept
+{
+  if(this != &a_other)
+  {
+    Close();
+    std::swap(m_data, a_other.m_data);
+    std::swap(m_size, a_other.m_size);
+#if defined(_WIN32)
+    std::swap(m_file, a_other.m_file);
+    std::swap(m_mapping, a_other.m_mapping);
+#endif
+  }
+  return *this;
+}
+
+#if defined(_WIN32)
+bool MappedFile::Open(const std::string &a_path, bool a_copyOnWrite)
+{
+  Close();
+
+  HANDLE file = CreateFileA(a_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if(file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+  if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, a_copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+  if(mapping == nullptr)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  void *data = MapViewOfFile(mapping, a_copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+  if(data == nullptr)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  m_file    = file;
+  m_mapping = mapping;
+  m_data    = static_cast<uint8_t *>(data);
+  m_size    = static_cast<size_t>(fileSize.QuadPart);
+  return true;
+}
+
+void MappedFile::Prefetch() const
+{
+  if(m_data == nullptr)
+    return;
+
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = m_data;
+  range.NumberOfBytes  = m_size;
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+void MappedFile::Close()
+{
+  if(m_data != nullptr)
+    UnmapViewOfFile(m_data);
+  if(m_mapping != nullptr)
+    CloseHandle(m_mapping);
+  if(m_file != nullptr)
+    CloseHandle(m_file);
+
+  m_data    = nullptr;
+  m_size    = 0;
+  m_mapping = nullptr;
+  m_file    = nullptr;
+}
+#else
+bool MappedFile::Open(const std::string &a_path, bool a_copyOnWrite)
+{
+  Close();
+
+  int fd = open(a_path.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+
+  struct stat st = {};
+  if(fstat(fd, &st) != 0 || st.st_size <= 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  const int prot = a_copyOnWrite ? (PROT_READ | PROT_WRITE) : PROT_READ;
+  void *data = mmap(nullptr, static_cast<size_t>(st.st_size), prot, MAP_PRIVATE, fd, 0);
+  close(fd); // mapping keeps its own reference to the file
+  if(data == MAP_FAILED)
+    return false;
+
+  // files are mostly read front to back exactly once
+  madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+  m_data = static_cast<uint8_t *>(data);
+  m_size = static_cast<size_t>(st.st_size);
+  return true;
+}
+
+void MappedFile::Prefetch() const
+{
+  if(m_data != nullptr)
+    madvise(m_data, m_size, MADV_WILLNEED);
+}
+
+void MappedFile::Close()
+{
+  if(m_data != nullptr)
+    munmap(m_data, m_size);
+
+  m_data = nullptr;
+  m_size = 0;
+}
+#endif
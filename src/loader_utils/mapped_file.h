@@ -0,0 +1,41 @@
+#ifndef VK_GRAPHICS_BASIC_MAPPED_FILE_H
+#define VK_GRAPHICS_BASIC_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// memory mapping of a whole file
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile() { Close(); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&a_other) noexcept;
+  MappedFile &operator=(MappedFile &&a_other) noexcept;
+
+  // a_copyOnWrite maps file privately with write access, changes are never written back to the file
+  bool Open(const std::string &a_path, bool a_copyOnWrite = false);
+  void Close();
+
+  bool IsOpen() const { return m_data != nullptr; }
+  const uint8_t *Data() const { return m_data; }
+  uint8_t *Data() { return m_data; }
+  size_t Size() const { return m_size; }
+
+  // asks OS to start reading file contents in the background, returns immediately
+  void Prefetch() const;
+
+private:
+  uint8_t *m_data = nullptr;
+  size_t m_size   = 0;
+#if defined(_WIN32)
+  void *m_file    = nullptr;
+  void *m_mapping = nullptr;
+#endif
+};
+
+#endif// VK_GRAPHICS_BASIC_MAPPED_FILE_H
@@ -15,7 +15,10 @@
 #define HEADER_PUGICONFIG_HPP
 
 // Uncomment this to enable wchar_t mode
+// (disabled by HYDRA_XML_UTF8, see option in the root CMakeLists.txt)
+#ifndef HYDRA_XML_UTF8
 #define PUGIXML_WCHAR_MODE
+#endif
 
 // Uncomment this to enable compact mode
 // #define PUGIXML_COMPACT
@@ -0,0 +1,63 @@
+#include "vsgf_mmap.h"
+
+#include <iostream>
+
+namespace vsgf
+{
+  bool MapMesh(const std::string &a_path, MappedFile &a_file, MeshView &a_view)
+  {
+    a_view = MeshView();
+
+    if(!a_file.Open(a_path))
+    {
+      std::cout << "[vsgf::MapMesh] can't open file " << a_path << std::endl;
+      return false;
+    }
+
+    if(a_file.Size() < sizeof(Header))
+    {
+      std::cout << "[vsgf::MapMesh] file is too small " << a_path << std::endl;
+      a_file.Close();
+      return false;
+    }
+
+    const Header &header = *reinterpret_cast<const Header *>(a_file.Data());
+
+    const uint64_t vertNum = header.verticesNum;
+    const uint64_t indNum  = header.indicesNum;
+
+    uint64_t expectedSize = sizeof(Header);
+    expectedSize += vertNum * 4 * sizeof(float);                                     // positions
+    expectedSize += (header.flags & HAS_NO_NORMALS) ? 0 : vertNum * 4 * sizeof(float); // normals
+    expectedSize += (header.flags & HAS_TANGENT) ? vertNum * 4 * sizeof(float) : 0;    // tangents
+    expectedSize += vertNum * 2 * sizeof(float);                                     // texture coordinates
+    expectedSize += indNum * sizeof(uint32_t);                                       // indices
+    expectedSize += (indNum / 3) * sizeof(uint32_t);                                 // material indices
+
+    if(expectedSize > a_file.Size())
+    {
+      std::cout << "[vsgf::MapMesh] file is truncated or has unknown layout " << a_path << std::endl;
+      a_file.Close();
+      return false;
+    }
+
+    const uint8_t *ptr = a_file.Data() + sizeof(Header);
+    auto take = [&ptr](uint64_t a_bytes) {
+      const uint8_t *res = ptr;
+      ptr += a_bytes;
+      return res;
+    };
+
+    a_view.header = header;
+    a_view.pos4f  = reinterpret_cast<const float *>(take(vertNum * 4 * sizeof(float)));
+    if(!(header.flags & HAS_NO_NORMALS))
+      a_view.norm4f = reinterpret_cast<const float *>(take(vertNum * 4 * sizeof(float)));
+    if(header.flags & HAS_TANGENT)
+      a_view.tang4f = reinterpret_cast<const float *>(take(vertNum * 4 * sizeof(float)));
+    a_view.texcoord2f = reinterpret_cast<const float *>(take(vertNum * 2 * sizeof(float)));
+    a_view.indices    = reinterpret_cast<const uint32_t *>(take(indNum * sizeof(uint32_t)));
+    a_view.matIndices = reinterpret_cast<const uint32_t *>(take((indNum / 3) * sizeof(uint32_t)));
+
+    return true;
+  }
+}
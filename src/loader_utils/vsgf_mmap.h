@@ -0,0 +1,48 @@
+#ifndef VK_GRAPHICS_BASIC_VSGF_MMAP_H
+#define VK_GRAPHICS_BASIC_VSGF_MMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "mapped_file.h"
+
+namespace vsgf
+{
+  enum HEADER_FLAGS : uint32_t
+  {
+    HAS_TANGENT    = 1,
+    UNUSED2        = 2,
+    UNUSED4        = 4,
+    HAS_NO_NORMALS = 8
+  };
+
+  struct Header
+  {
+    uint64_t fileSizeInBytes;
+    uint32_t verticesNum;
+    uint32_t indicesNum;
+    uint32_t materialsNum;
+    uint32_t flags;
+  };
+
+  // attribute streams of a mapped VSGF file, pointers stay valid while the file is mapped
+  struct MeshView
+  {
+    Header header = {};
+    const float *pos4f      = nullptr;
+    const float *norm4f     = nullptr; // nullptr if file has HAS_NO_NORMALS flag
+    const float *tang4f     = nullptr; // nullptr if file has no HAS_TANGENT flag
+    const float *texcoord2f = nullptr;
+    const uint32_t *indices    = nullptr;
+    const uint32_t *matIndices = nullptr;
+
+    uint32_t VerticesNum() const { return header.verticesNum; }
+    uint32_t IndicesNum() const { return header.indicesNum; }
+  };
+
+  // maps VSGF file and fills a_view with pointers into the mapping, no mesh data is copied
+  bool MapMesh(const std::string &a_path, MappedFile &a_file, MeshView &a_view);
+}
+
+#endif// VK_GRAPHICS_BASIC_VSGF_MMAP_H
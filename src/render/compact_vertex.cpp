@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "compact_vertex.h"
+
+namespace compact_vertex
+{
+  Quantization MakeQuantization(const LiteMath::Box4f &a_box)
+  {
+    Quantization res;
+    const LiteMath::float4 extent = a_box.boxMax - a_box.boxMin;
+    const float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+    if(!(maxExtent >= 0.0f)) // empty box
+      return res;
+
+    res.offset = LiteMath::to_float3(a_box.boxMin);
+    res.scale  = maxExtent > 0.0f ? maxExtent : 1.0f;
+    return res;
+  }
+
+  LiteMath::float4x4 DequantMatrix(const Quantization &a_quant)
+  {
+    return LiteMath::translate4x4(a_quant.offset) * LiteMath::scale4x4(LiteMath::float3(a_quant.scale));
+  }
+
+  uint16_t FloatToHalf(float a_val)
+  {
+    uint32_t bits;
+    memcpy(&bits, &a_val, sizeof(bits));
+    const uint32_t sign    = (bits >> 16) & 0x8000u;
+    const uint32_t absBits = bits & 0x7FFFFFFFu;
+
+    if(absBits >= 0x7F800000u) // inf or nan
+      return uint16_t(sign | 0x7C00u | (absBits > 0x7F800000u ? 0x0200u : 0u));
+    if(absBits >= 0x477FF000u) // rounds above the largest half
+      return uint16_t(sign | 0x7C00u);
+    if(absBits < 0x38800000u)  // denormal half
+    {
+      float absVal;
+      memcpy(&absVal, &absBits, sizeof(absVal));
+      return uint16_t(sign | uint32_t(std::nearbyint(absVal * 16777216.0f)));
+    }
+
+    // rebias exponent and round mantissa to nearest even
+    const uint32_t rounded = absBits + 0x0FFFu + ((absBits >> 13) & 1u);
+    return uint16_t(sign | ((rounded - 0x38000000u) >> 13));
+  }
+
+  static inline uint32_t ToUnorm16(float a_val)
+  {
+    return uint32_t(std::lround(std::min(std::max(a_val, 0.0f), 1.0f) * 65535.0f));
+  }
+
+  static inline uint32_t ToSnorm(float a_val, float a_max, uint32_t a_mask)
+  {
+    return uint32_t(int32_t(std::lround(std::min(std::max(a_val, -1.0f), 1.0f) * a_max))) & a_mask;
+  }
+
+  // maps unit vector onto octahedron unfolded to [-1, 1]^2, zero vectors are encoded as (0, 0)
+  static LiteMath::float2 OctEncode(const float *a_vec)
+  {
+    const float l1 = std::abs(a_vec[0]) + std::abs(a_vec[1]) + std::abs(a_vec[2]);
+    if(l1 == 0.0f)
+      return LiteMath::float2(0.0f, 0.0f);
+
+    LiteMath::float2 res(a_vec[0] / l1, a_vec[1] / l1);
+    if(a_vec[2] < 0.0f)
+    {
+      const LiteMath::float2 folded((1.0f - std::abs(res.y)) * (res.x >= 0.0f ? 1.0f : -1.0f),
+                                    (1.0f - std::abs(res.x)) * (res.y >= 0.0f ? 1.0f : -1.0f));
+      res = folded;
+    }
+    return res;
+  }
+
+  void PackVertex(const float *a_pos, const float *a_norm, const float *a_tang, const float *a_texCoord,
+    const Quantization &a_quant, uint32_t *a_dst)
+  {
+    const float invScale = 1.0f / a_quant.scale;
+    const uint32_t qx = ToUnorm16((a_pos[0] - a_quant.offset.x) * invScale);
+    const uint32_t qy = ToUnorm16((a_pos[1] - a_quant.offset.y) * invScale);
+    const uint32_t qz = ToUnorm16((a_pos[2] - a_quant.offset.z) * invScale);
+
+    const float zero[3] = {0.0f, 0.0f, 0.0f};
+    const LiteMath::float2 norm = OctEncode(a_norm != nullptr ? a_norm : zero);
+    const LiteMath::float2 tang = OctEncode(a_tang != nullptr ? a_tang : zero);
+
+    const uint32_t u = a_texCoord != nullptr ? FloatToHalf(a_texCoord[0]) : 0u;
+    const uint32_t v = a_texCoord != nullptr ? FloatToHalf(a_texCoord[1]) : 0u;
+
+    a_dst[0] = qx | (qy << 16);
+    a_dst[1] = qz | (ToSnorm(tang.x, 127.0f, 0xFFu) << 16) | (ToSnorm(tang.y, 127.0f, 0xFFu) << 24);
+    a_dst[2] = u | (v << 16);
+    a_dst[3] = ToSnorm(norm.x, 32767.0f, 0xFFFFu) | (ToSnorm(norm.y, 32767.0f, 0xFFFFu) << 16);
+  }
+}
+
+Mesh4U::Mesh4U()
+{
+  m_inputBinding.binding   = 0;
+  m_inputBinding.stride    = compact_vertex::VERTEX_SIZE;
+  m_inputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+  m_attribute.location = 0;
+  m_attribute.binding  = 0;
+  m_attribute.format   = VK_FORMAT_R32G32B32A32_UINT;
+  m_attribute.offset   = 0;
+}
+
+void Mesh4U::Append(const cmesh::SimpleMesh &meshData)
+{
+  const size_t vertNum = meshData.VerticesNum();
+
+  LiteMath::Box4f box;
+  for(size_t i = 0; i < vertNum; ++i)
+    box.include(LiteMath::float4(meshData.vPos4f.data() + i * 4));
+  const auto quant = compact_vertex::MakeQuantization(box);
+
+  const bool hasNorm = meshData.vNorm4f.size() >= vertNum * 4;
+  const bool hasTang = meshData.vTang4f.size() >= vertNum * 4;
+  const bool hasTex  = meshData.vTexCoord2f.size() >= vertNum * 2;
+
+  const size_t first = m_vertices.size();
+  m_vertices.resize(first + vertNum * 4);
+  for(size_t i = 0; i < vertNum; ++i)
+  {
+    compact_vertex::PackVertex(meshData.vPos4f.data() + i * 4,
+                               hasNorm ? meshData.vNorm4f.data() + i * 4 : nullptr,
+                               hasTang ? meshData.vTang4f.data() + i * 4 : nullptr,
+                               hasTex ? meshData.vTexCoord2f.data() + i * 2 : nullptr,
+                               quant, m_vertices.data() + first + i * 4);
+  }
+
+  m_indices.insert(m_indices.end(), meshData.indices.begin(), meshData.indices.end());
+}
+
+VkPipelineVertexInputStateCreateInfo Mesh4U::VertexInputLayout()
+{
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+  vertexInputInfo.sType                           = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputInfo.vertexBindingDescriptionCount   = 1;
+  vertexInputInfo.vertexAttributeDescriptionCount = 1;
+  vertexInputInfo.pVertexBindingDescriptions      = &m_inputBinding;
+  vertexInputInfo.pVertexAttributeDescriptions    = &m_attribute;
+
+  return vertexInputInfo;
+}
@@ -0,0 +1,65 @@
+#ifndef VK_GRAPHICS_BASIC_COMPACT_VERTEX_H
+#define VK_GRAPHICS_BASIC_COMPACT_VERTEX_H
+
+#include <cstdint>
+#include <vector>
+
+#include <geom/vk_mesh.h>
+#include "LiteMath.h"
+
+// 16 byte vertex format, decoded in simple_compact.vert:
+//   x - position.xy, unorm16 relative to the mesh quantization box
+//   y - position.z (low half) and octahedral tangent as two snorm8 (high half)
+//   z - texture coordinates as two half floats
+//   w - octahedral normal as two snorm16
+// Positions are quantized with the same scale on all axes, so dequantization is a translation and a uniform scale
+// that are folded into the model matrix without changing directions of transformed normals.
+//
+namespace compact_vertex
+{
+  constexpr uint32_t VERTEX_SIZE = 4 * sizeof(uint32_t);
+
+  // position = offset + scale * quantized position in [0, 1]
+  struct Quantization
+  {
+    LiteMath::float3 offset = LiteMath::float3(0.0f, 0.0f, 0.0f);
+    float scale = 1.0f;
+  };
+
+  Quantization MakeQuantization(const LiteMath::Box4f &a_box);
+  LiteMath::float4x4 DequantMatrix(const Quantization &a_quant);
+
+  // normal, tangent and texcoord may be nullptr
+  void PackVertex(const float *a_pos, const float *a_norm, const float *a_tang, const float *a_texCoord,
+    const Quantization &a_quant, uint32_t *a_dst);
+
+  uint16_t FloatToHalf(float a_val);
+}
+
+// IMeshData with compact_vertex layout, every appended mesh is quantized in the box of its positions
+struct Mesh4U : public IMeshData
+{
+  Mesh4U();
+
+  float*    VertexData() override { return reinterpret_cast<float*>(m_vertices.data()); }
+  uint32_t* IndexData()  override { return m_indices.data(); }
+
+  size_t VertexDataSize() override { return m_vertices.size() * sizeof(uint32_t); }
+  size_t IndexDataSize()  override { return m_indices.size() * sizeof(uint32_t); }
+
+  size_t SingleVertexSize() override { return compact_vertex::VERTEX_SIZE; }
+  size_t SingleIndexSize()  override { return sizeof(uint32_t); }
+
+  void Append(const cmesh::SimpleMesh &meshData) override;
+
+  VkPipelineVertexInputStateCreateInfo VertexInputLayout() override;
+
+private:
+  std::vector<uint32_t> m_vertices;
+  std::vector<uint32_t> m_indices;
+
+  VkVertexInputBindingDescription   m_inputBinding {};
+  VkVertexInputAttributeDescription m_attribute {};
+};
+
+#endif// VK_GRAPHICS_BASIC_COMPACT_VERTEX_H
@@ -0,0 +1,362 @@
+#include <algorithm>
+
+#include "depth_pyramid.h"
+#include "render_common.h"
+
+#include <vk_utils.h>
+#include <vk_pipeline.h>
+
+static const std::string PYRAMID_SHADER_PATH = "../resources/shaders/depth_pyramid.comp.spv";
+
+static uint32_t PreviousPowerOfTwo(uint32_t a_value)
+{
+  uint32_t result = 1;
+  while(result * 2 <= a_value)
+    result *= 2;
+  return result;
+}
+
+static VkImageView CreateView(VkDevice a_device, VkImage a_image, VkFormat a_format, VkImageAspectFlags a_aspect,
+  uint32_t a_firstLevel, uint32_t a_levelsNum)
+{
+  VkImageViewCreateInfo viewInfo = {};
+  viewInfo.sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image    = a_image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format   = a_format;
+  viewInfo.subresourceRange.aspectMask     = a_aspect;
+  viewInfo.subresourceRange.baseMipLevel   = a_firstLevel;
+  viewInfo.subresourceRange.levelCount     = a_levelsNum;
+  viewInfo.subresourceRange.baseArrayLayer = 0;
+  viewInfo.subresourceRange.layerCount     = 1;
+
+  VkImageView view = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateImageView(a_device, &viewInfo, nullptr, &view));
+  return view;
+}
+
+static VkImage CreateImage(VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_width, uint32_t a_height,
+  uint32_t a_levelsNum, VkFormat a_format, VkImageUsageFlags a_usage, VkDeviceMemory &a_mem)
+{
+  VkImageCreateInfo imageInfo = {};
+  imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+  imageInfo.format        = a_format;
+  imageInfo.extent        = VkExtent3D{a_width, a_height, 1};
+  imageInfo.mipLevels     = a_levelsNum;
+  imageInfo.arrayLayers   = 1;
+  imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage         = a_usage;
+  imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  VkImage image = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateImage(a_device, &imageInfo, nullptr, &image));
+
+  VkMemoryRequirements memReq;
+  vkGetImageMemoryRequirements(a_device, image, &memReq);
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize  = memReq.size;
+  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, a_physDevice);
+  VK_CHECK_RESULT(vkAllocateMemory(a_device, &allocateInfo, nullptr, &a_mem));
+  VK_CHECK_RESULT(vkBindImageMemory(a_device, image, a_mem, 0));
+  return image;
+}
+
+static bool HasStencil(VkFormat a_format)
+{
+  return a_format == VK_FORMAT_D32_SFLOAT_S8_UINT || a_format == VK_FORMAT_D24_UNORM_S8_UINT ||
+         a_format == VK_FORMAT_D16_UNORM_S8_UINT;
+}
+
+vk_utils::VulkanImageMem DepthPyramid::CreateDepthTexture(VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_width,
+  uint32_t a_height, VkFormat a_format)
+{
+  vk_utils::VulkanImageMem result = {};
+  result.format     = a_format;
+  result.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (HasStencil(a_format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0u);
+  result.image      = CreateImage(a_device, a_physDevice, a_width, a_height, 1, a_format,
+    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, result.mem);
+  result.view       = CreateView(a_device, result.image, a_format, result.aspectMask, 0, 1);
+  return result;
+}
+
+VkRenderPass DepthPyramid::CreateLoadRenderPass(VkDevice a_device, VkFormat a_colorFormat, VkFormat a_depthFormat)
+{
+  VkAttachmentDescription attachments[2] = {};
+  attachments[0].format         = a_colorFormat;
+  attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
+  attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_LOAD;
+  attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].initialLayout  = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  attachments[0].finalLayout    = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  attachments[1].format         = a_depthFormat;
+  attachments[1].samples        = VK_SAMPLE_COUNT_1_BIT;
+  attachments[1].loadOp         = VK_ATTACHMENT_LOAD_OP_LOAD;
+  attachments[1].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[1].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_LOAD;
+  attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[1].initialLayout  = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  attachments[1].finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference colorRef = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference depthRef = {1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+  VkSubpassDescription subpass = {};
+  subpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount    = 1;
+  subpass.pColorAttachments       = &colorRef;
+  subpass.pDepthStencilAttachment = &depthRef;
+
+  // color written by the pass before is loaded, depth is synchronized by CmdBuild
+  VkSubpassDependency dependency = {};
+  dependency.srcSubpass    = VK_SUBPASS_EXTERNAL;
+  dependency.dstSubpass    = 0;
+  dependency.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+  VkRenderPassCreateInfo renderPassInfo = {};
+  renderPassInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = 2;
+  renderPassInfo.pAttachments    = attachments;
+  renderPassInfo.subpassCount    = 1;
+  renderPassInfo.pSubpasses      = &subpass;
+  renderPassInfo.dependencyCount = 1;
+  renderPassInfo.pDependencies   = &dependency;
+
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateRenderPass(a_device, &renderPassInfo, nullptr, &renderPass));
+  return renderPass;
+}
+
+bool DepthPyramid::ShadersCompiled()
+{
+  return ShaderCompiled(PYRAMID_SHADER_PATH);
+}
+
+DepthPyramid::DepthPyramid(VkDevice a_device, VkPhysicalDevice a_physDevice) : m_device(a_device), m_physDevice(a_physDevice)
+{
+  VkDescriptorSetLayoutBinding bindings[2] = {};
+  bindings[0].binding         = 0;
+  bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[0].descriptorCount = 1;
+  bindings[0].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+  bindings[1].binding         = 1;
+  bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  bindings[1].descriptorCount = 1;
+  bindings[1].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+  layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 2;
+  layoutInfo.pBindings    = bindings;
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_dSetLayout));
+
+  // texels are fetched, so filtering does not matter
+  VkSamplerCreateInfo samplerInfo = {};
+  samplerInfo.sType        = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter    = VK_FILTER_NEAREST;
+  samplerInfo.minFilter    = VK_FILTER_NEAREST;
+  samplerInfo.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.maxLod       = 16.0f;
+  VK_CHECK_RESULT(vkCreateSampler(m_device, &samplerInfo, nullptr, &m_sampler));
+
+  vk_utils::ComputePipelineMaker maker;
+  maker.LoadShader(m_device, PYRAMID_SHADER_PATH);
+  m_pipelineLayout = maker.MakeLayout(m_device, {m_dSetLayout}, 4 * sizeof(uint32_t));
+  m_pipeline       = maker.MakePipeline(m_device);
+}
+
+DepthPyramid::~DepthPyramid()
+{
+  DestroyImage();
+
+  if(m_pipeline != VK_NULL_HANDLE)
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+  if(m_pipelineLayout != VK_NULL_HANDLE)
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+  if(m_sampler != VK_NULL_HANDLE)
+    vkDestroySampler(m_device, m_sampler, nullptr);
+  if(m_dSetLayout != VK_NULL_HANDLE)
+    vkDestroyDescriptorSetLayout(m_device, m_dSetLayout, nullptr);
+}
+
+void DepthPyramid::DestroyImage()
+{
+  if(m_dPool != VK_NULL_HANDLE)
+  {
+    vkDestroyDescriptorPool(m_device, m_dPool, nullptr);
+    m_dPool = VK_NULL_HANDLE;
+  }
+  m_levelSets.clear();
+
+  for(auto view : m_levelViews)
+    vkDestroyImageView(m_device, view, nullptr);
+  m_levelViews.clear();
+
+  for(auto *view : {&m_view, &m_depthView})
+  {
+    if(*view != VK_NULL_HANDLE)
+      vkDestroyImageView(m_device, *view, nullptr);
+    *view = VK_NULL_HANDLE;
+  }
+  if(m_image != VK_NULL_HANDLE)
+  {
+    vkDestroyImage(m_device, m_image, nullptr);
+    m_image = VK_NULL_HANDLE;
+  }
+  if(m_mem != VK_NULL_HANDLE)
+  {
+    vkFreeMemory(m_device, m_mem, nullptr);
+    m_mem = VK_NULL_HANDLE;
+  }
+  m_depthImage = VK_NULL_HANDLE;
+  m_width      = 0u;
+  m_height     = 0u;
+}
+
+void DepthPyramid::SetDepthBuffer(const vk_utils::VulkanImageMem &a_depth, uint32_t a_width, uint32_t a_height)
+{
+  // frames in flight may still read the old pyramid
+  vkDeviceWaitIdle(m_device);
+  DestroyImage();
+
+  m_depthImage  = a_depth.image;
+  m_depthAspect = a_depth.aspectMask;
+  m_depthView   = CreateView(m_device, a_depth.image, a_depth.format, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1);
+  m_depthWidth  = a_width;
+  m_depthHeight = a_height;
+
+  m_width  = PreviousPowerOfTwo(a_width);
+  m_height = PreviousPowerOfTwo(a_height);
+  uint32_t levelsNum = 1;
+  while((m_width >> levelsNum) > 0 || (m_height >> levelsNum) > 0)
+    ++levelsNum;
+
+  m_image = CreateImage(m_device, m_physDevice, m_width, m_height, levelsNum, VK_FORMAT_R32_SFLOAT,
+    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, m_mem);
+  m_view  = CreateView(m_device, m_image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, levelsNum);
+  for(uint32_t level = 0; level < levelsNum; ++level)
+    m_levelViews.push_back(CreateView(m_device, m_image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1));
+
+  VkDescriptorPoolSize poolSizes[2] = {{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelsNum},
+                                       {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          levelsNum}};
+  VkDescriptorPoolCreateInfo poolInfo = {};
+  poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets       = levelsNum;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes    = poolSizes;
+  VK_CHECK_RESULT(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_dPool));
+
+  std::vector<VkDescriptorSetLayout> layouts(levelsNum, m_dSetLayout);
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool     = m_dPool;
+  allocInfo.descriptorSetCount = levelsNum;
+  allocInfo.pSetLayouts        = layouts.data();
+  m_levelSets.resize(levelsNum);
+  VK_CHECK_RESULT(vkAllocateDescriptorSets(m_device, &allocInfo, m_levelSets.data()));
+
+  for(uint32_t level = 0; level < levelsNum; ++level)
+  {
+    VkDescriptorImageInfo srcInfo = {};
+    srcInfo.sampler     = m_sampler;
+    srcInfo.imageView   = level == 0 ? m_depthView : m_levelViews[level - 1];
+    srcInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+    VkDescriptorImageInfo dstInfo = {};
+    dstInfo.imageView   = m_levelViews[level];
+    dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet writes[2] = {};
+    for(uint32_t i = 0; i < 2; ++i)
+    {
+      writes[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[i].dstSet          = m_levelSets[level];
+      writes[i].dstBinding      = i;
+      writes[i].descriptorCount = 1;
+    }
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo     = &srcInfo;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].pImageInfo     = &dstInfo;
+    vkUpdateDescriptorSets(m_device, 2, writes, 0, nullptr);
+  }
+}
+
+void DepthPyramid::CmdBuild(VkCommandBuffer a_cmdBuf)
+{
+  if(m_image == VK_NULL_HANDLE)
+    return;
+
+  // depth writes of the pass before -> reads here, previous contents of the pyramid are discarded,
+  // but reads of them by culling of the previous frame must be done before they are overwritten
+  VkImageMemoryBarrier barriers[2] = {};
+  barriers[0].sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barriers[0].srcAccessMask       = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  barriers[0].dstAccessMask       = VK_ACCESS_SHADER_READ_BIT;
+  barriers[0].oldLayout           = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  barriers[0].newLayout           = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[0].image               = m_depthImage;
+  barriers[0].subresourceRange    = {m_depthAspect, 0, 1, 0, 1};
+
+  barriers[1].sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barriers[1].srcAccessMask       = VK_ACCESS_SHADER_READ_BIT;
+  barriers[1].dstAccessMask       = VK_ACCESS_SHADER_WRITE_BIT;
+  barriers[1].oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[1].newLayout           = VK_IMAGE_LAYOUT_GENERAL;
+  barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barriers[1].image               = m_image;
+  barriers[1].subresourceRange    = {VK_IMAGE_ASPECT_COLOR_BIT, 0, LevelsNum(), 0, 1};
+
+  vkCmdPipelineBarrier(a_cmdBuf, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+  vkCmdBindPipeline(a_cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+
+  uint32_t srcWidth  = m_depthWidth;
+  uint32_t srcHeight = m_depthHeight;
+  for(uint32_t level = 0; level < LevelsNum(); ++level)
+  {
+    const uint32_t dstWidth  = std::max(m_width  >> level, 1u);
+    const uint32_t dstHeight = std::max(m_height >> level, 1u);
+    const uint32_t sizes[4]  = {srcWidth, srcHeight, dstWidth, dstHeight};
+
+    vkCmdBindDescriptorSets(a_cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_levelSets[level], 0, nullptr);
+    vkCmdPushConstants(a_cmdBuf, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(sizes), sizes);
+    vkCmdDispatch(a_cmdBuf, (dstWidth + GROUP_SIZE - 1) / GROUP_SIZE, (dstHeight + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+
+    // the next level reads this one, culling reads all of them after the last
+    VkMemoryBarrier barrier = {};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(a_cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+      0, nullptr, 0, nullptr);
+
+    srcWidth  = dstWidth;
+    srcHeight = dstHeight;
+  }
+
+  // depth is tested again by the pass drawing the newly visible instances
+  barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  barriers[0].oldLayout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  barriers[0].newLayout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  vkCmdPipelineBarrier(a_cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, barriers);
+}
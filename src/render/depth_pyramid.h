@@ -0,0 +1,80 @@
+#ifndef VK_GRAPHICS_BASIC_DEPTH_PYRAMID_H
+#define VK_GRAPHICS_BASIC_DEPTH_PYRAMID_H
+
+#include <cstdint>
+#include <vector>
+
+#include "volk.h"
+#include <vk_images.h>
+
+// Hierarchical depth (HiZ) of a depth buffer for occlusion culling: every texel of a level keeps the farthest depth
+// of the texels it covers, so a box whose nearest depth is larger than the texels under its screen rectangle is hidden.
+// The first level is the largest power of two not above the screen size, the rest halve it down to 1x1;
+// levels are built by depth_pyramid.comp, one dispatch per level.
+//
+class DepthPyramid
+{
+public:
+  static constexpr uint32_t GROUP_SIZE = 8; // local_size_x and local_size_y of depth_pyramid.comp
+
+  // depth buffer that can also be sampled by shaders, so that the pyramid can be built from it
+  static vk_utils::VulkanImageMem CreateDepthTexture(VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_width,
+    uint32_t a_height, VkFormat a_format);
+  // render pass compatible with vk_utils::createDefaultRenderPass that keeps color and depth,
+  // so that drawing continues in the same framebuffer after the pyramid is built
+  static VkRenderPass CreateLoadRenderPass(VkDevice a_device, VkFormat a_colorFormat, VkFormat a_depthFormat);
+
+  // false with a warning if depth_pyramid.comp is not compiled to SPIR-V
+  static bool ShadersCompiled();
+
+  DepthPyramid(VkDevice a_device, VkPhysicalDevice a_physDevice);
+  ~DepthPyramid();
+
+  DepthPyramid(const DepthPyramid &) = delete;
+  DepthPyramid &operator=(const DepthPyramid &) = delete;
+
+  // (re)creates the pyramid for a depth buffer made by CreateDepthTexture, must be called again when it is recreated
+  void SetDepthBuffer(const vk_utils::VulkanImageMem &a_depth, uint32_t a_width, uint32_t a_height);
+
+  // records building of the pyramid outside of a render pass; the depth buffer must be in
+  // VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL after depth writes, it is returned to it afterwards;
+  // the pyramid is left in VK_IMAGE_LAYOUT_GENERAL ready for compute shader reads
+  void CmdBuild(VkCommandBuffer a_cmdBuf);
+
+  // view of all levels and a nearest sampler for texelFetch
+  VkImageView GetView()    const { return m_view; }
+  VkSampler   GetSampler() const { return m_sampler; }
+  uint32_t    Width()      const { return m_width; }
+  uint32_t    Height()     const { return m_height; }
+  uint32_t    LevelsNum()  const { return (uint32_t)m_levelViews.size(); }
+
+private:
+  void DestroyImage();
+
+  VkDevice m_device         = VK_NULL_HANDLE;
+  VkPhysicalDevice m_physDevice = VK_NULL_HANDLE;
+
+  VkDescriptorSetLayout m_dSetLayout = VK_NULL_HANDLE;
+  VkPipelineLayout m_pipelineLayout  = VK_NULL_HANDLE;
+  VkPipeline       m_pipeline        = VK_NULL_HANDLE;
+  VkSampler        m_sampler         = VK_NULL_HANDLE;
+
+  VkImage  m_depthImage     = VK_NULL_HANDLE; // depth buffer the pyramid is built from
+  VkImageAspectFlags m_depthAspect = 0;       // all of its aspects, layout transitions need them
+  VkImageView m_depthView   = VK_NULL_HANDLE; // its depth aspect, the buffer view may include stencil
+  uint32_t m_depthWidth     = 0u;
+  uint32_t m_depthHeight    = 0u;
+
+  VkImage  m_image          = VK_NULL_HANDLE;
+  VkDeviceMemory m_mem      = VK_NULL_HANDLE;
+  VkImageView m_view        = VK_NULL_HANDLE;
+  std::vector<VkImageView> m_levelViews;
+  uint32_t m_width          = 0u;
+  uint32_t m_height         = 0u;
+
+  // set of level i reads level i - 1 (the depth buffer for level 0) and writes level i
+  VkDescriptorPool m_dPool  = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> m_levelSets;
+};
+
+#endif// VK_GRAPHICS_BASIC_DEPTH_PYRAMID_H
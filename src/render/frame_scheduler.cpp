@@ -0,0 +1,226 @@
+#include <cassert>
+#include <cstring>
+
+#include "frame_scheduler.h"
+
+#include <vk_swapchain.h>
+#include <vk_utils.h>
+
+// instances are created for Vulkan 1.1, so timeline semaphores come from the extension and its entry points
+// are used instead of the core ones
+
+void FrameScheduler::SetupDevice(VkPhysicalDevice a_physDevice, std::vector<const char*> &a_extensions,
+  VkPhysicalDeviceTimelineSemaphoreFeatures &a_features)
+{
+  uint32_t extensionsNum = 0;
+  vkEnumerateDeviceExtensionProperties(a_physDevice, nullptr, &extensionsNum, nullptr);
+  std::vector<VkExtensionProperties> extensions(extensionsNum);
+  vkEnumerateDeviceExtensionProperties(a_physDevice, nullptr, &extensionsNum, extensions.data());
+
+  bool supported = false;
+  for(const auto &ext : extensions)
+  {
+    if(strcmp(ext.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0)
+    {
+      supported = true;
+      break;
+    }
+  }
+  // the feature is mandatory for devices exposing the extension
+  if(!supported)
+    RUN_TIME_ERROR("[FrameScheduler::SetupDevice] VK_KHR_timeline_semaphore is not supported");
+
+  a_extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+  a_features = {};
+  a_features.sType             = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+  a_features.timelineSemaphore = VK_TRUE;
+}
+
+FrameScheduler::FrameScheduler(VkDevice a_device, uint32_t a_framesInFlight) : m_device(a_device)
+{
+  assert(a_framesInFlight > 0);
+  m_frameValues.assign(a_framesInFlight, 0);
+
+  VkSemaphoreTypeCreateInfo typeInfo = {};
+  typeInfo.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue  = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &typeInfo;
+  for(auto &semaphore : m_timelines)
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore));
+}
+
+FrameScheduler::~FrameScheduler()
+{
+  WaitIdle();
+  DestroySwapchainSync();
+  for(auto semaphore : m_timelines)
+    vkDestroySemaphore(m_device, semaphore, nullptr);
+}
+
+void FrameScheduler::CreateSwapchainSync(uint32_t a_imagesNum)
+{
+  DestroySwapchainSync();
+
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  m_imageAvailable.resize(m_frameValues.size());
+  for(auto &semaphore : m_imageAvailable)
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore));
+  m_renderingFinished.resize(a_imagesNum);
+  for(auto &semaphore : m_renderingFinished)
+    VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore));
+
+  // frames keep their values, the device is idle, so all of them are retired
+  m_imageValues.assign(a_imagesNum, 0);
+}
+
+void FrameScheduler::DestroySwapchainSync()
+{
+  for(auto semaphore : m_imageAvailable)
+    vkDestroySemaphore(m_device, semaphore, nullptr);
+  m_imageAvailable.clear();
+  for(auto semaphore : m_renderingFinished)
+    vkDestroySemaphore(m_device, semaphore, nullptr);
+  m_renderingFinished.clear();
+  m_imageValues.clear();
+}
+
+Milestone FrameScheduler::Submit(Timeline a_timeline, VkQueue a_queue, const std::vector<VkCommandBuffer> &a_cmdBufs,
+  const std::vector<MilestoneWait> &a_waits)
+{
+  return SubmitImpl(a_timeline, a_queue, a_cmdBufs, a_waits, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+Milestone FrameScheduler::SubmitImpl(Timeline a_timeline, VkQueue a_queue, const std::vector<VkCommandBuffer> &a_cmdBufs,
+  const std::vector<MilestoneWait> &a_waits, VkSemaphore a_binaryWait, VkSemaphore a_binarySignal)
+{
+  const uint32_t timelineId = uint32_t(a_timeline);
+  const uint64_t value      = m_lastValues[timelineId] + 1;
+
+  // values of binary semaphores are ignored
+  std::vector<VkSemaphore>          waitSemaphores;
+  std::vector<uint64_t>             waitValues;
+  std::vector<VkPipelineStageFlags> waitStages;
+  waitSemaphores.reserve(a_waits.size() + 1);
+  waitValues.reserve(a_waits.size() + 1);
+  waitStages.reserve(a_waits.size() + 1);
+  if(a_binaryWait != VK_NULL_HANDLE)
+  {
+    waitSemaphores.push_back(a_binaryWait);
+    waitValues.push_back(0);
+    waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+  }
+  for(const auto &wait : a_waits)
+  {
+    // already reached values need no semaphore wait
+    if(wait.milestone.value == 0 || IsReached(wait.milestone))
+      continue;
+    waitSemaphores.push_back(m_timelines[uint32_t(wait.milestone.timeline)]);
+    waitValues.push_back(wait.milestone.value);
+    waitStages.push_back(wait.stage);
+  }
+
+  VkSemaphore signalSemaphores[2] = {m_timelines[timelineId], a_binarySignal};
+  uint64_t    signalValues[2]     = {value, 0};
+  const uint32_t signalNum        = a_binarySignal != VK_NULL_HANDLE ? 2 : 1;
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+  timelineInfo.sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount   = uint32_t(waitValues.size());
+  timelineInfo.pWaitSemaphoreValues      = waitValues.data();
+  timelineInfo.signalSemaphoreValueCount = signalNum;
+  timelineInfo.pSignalSemaphoreValues    = signalValues;
+
+  VkSubmitInfo submitInfo = {};
+  submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext                = &timelineInfo;
+  submitInfo.waitSemaphoreCount   = uint32_t(waitSemaphores.size());
+  submitInfo.pWaitSemaphores      = waitSemaphores.data();
+  submitInfo.pWaitDstStageMask    = waitStages.data();
+  submitInfo.commandBufferCount   = uint32_t(a_cmdBufs.size());
+  submitInfo.pCommandBuffers      = a_cmdBufs.data();
+  submitInfo.signalSemaphoreCount = signalNum;
+  submitInfo.pSignalSemaphores    = signalSemaphores;
+
+  VK_CHECK_RESULT(vkQueueSubmit(a_queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+  m_lastValues[timelineId] = value;
+  return {a_timeline, value};
+}
+
+Milestone FrameScheduler::LastSubmitted(Timeline a_timeline) const
+{
+  return {a_timeline, m_lastValues[uint32_t(a_timeline)]};
+}
+
+uint64_t FrameScheduler::Completed(Timeline a_timeline) const
+{
+  uint64_t value = 0;
+  VK_CHECK_RESULT(vkGetSemaphoreCounterValueKHR(m_device, m_timelines[uint32_t(a_timeline)], &value));
+  return value;
+}
+
+bool FrameScheduler::IsReached(const Milestone &a_milestone) const
+{
+  return a_milestone.value == 0 || Completed(a_milestone.timeline) >= a_milestone.value;
+}
+
+void FrameScheduler::Wait(const Milestone &a_milestone) const
+{
+  if(a_milestone.value == 0)
+    return;
+  assert(a_milestone.value <= m_lastValues[uint32_t(a_milestone.timeline)]);
+
+  VkSemaphoreWaitInfo waitInfo = {};
+  waitInfo.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores    = &m_timelines[uint32_t(a_milestone.timeline)];
+  waitInfo.pValues        = &a_milestone.value;
+  VK_CHECK_RESULT(vkWaitSemaphoresKHR(m_device, &waitInfo, UINT64_MAX));
+}
+
+void FrameScheduler::WaitIdle() const
+{
+  VkSemaphoreWaitInfo waitInfo = {};
+  waitInfo.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = TIMELINES_NUM;
+  waitInfo.pSemaphores    = m_timelines.data();
+  waitInfo.pValues        = m_lastValues.data();
+  VK_CHECK_RESULT(vkWaitSemaphoresKHR(m_device, &waitInfo, UINT64_MAX));
+}
+
+VkResult FrameScheduler::AcquireFrame(VulkanSwapChain &a_swapchain, uint32_t &a_imageIdx)
+{
+  // unlike a fence there is nothing to reset, so a failed acquire leaves the slot ready for the next attempt
+  Wait({Timeline::GRAPHICS, m_frameValues[m_currentFrame]});
+
+  VkResult result = a_swapchain.AcquireNextImage(m_imageAvailable[m_currentFrame], &a_imageIdx);
+  if(result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+    return result;
+
+  // images may be acquired out of order, per image resources may still be used by a frame of another slot
+  Wait({Timeline::GRAPHICS, m_imageValues[a_imageIdx]});
+  return result;
+}
+
+Milestone FrameScheduler::SubmitFrame(VkQueue a_queue, uint32_t a_imageIdx, const std::vector<VkCommandBuffer> &a_cmdBufs,
+  const std::vector<MilestoneWait> &a_waits)
+{
+  const Milestone frame = SubmitImpl(Timeline::GRAPHICS, a_queue, a_cmdBufs, a_waits,
+    m_imageAvailable[m_currentFrame], m_renderingFinished[a_imageIdx]);
+
+  m_frameValues[m_currentFrame] = frame.value;
+  m_imageValues[a_imageIdx]     = frame.value;
+  m_lastFrameValue              = frame.value;
+  m_currentFrame                = (m_currentFrame + 1) % FramesInFlight();
+  return frame;
+}
+
+VkResult FrameScheduler::PresentFrame(VulkanSwapChain &a_swapchain, VkQueue a_queue, uint32_t a_imageIdx)
+{
+  return a_swapchain.QueuePresent(a_queue, a_imageIdx, m_renderingFinished[a_imageIdx]);
+}
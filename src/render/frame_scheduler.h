@@ -0,0 +1,104 @@
+#ifndef VK_GRAPHICS_BASIC_FRAME_SCHEDULER_H
+#define VK_GRAPHICS_BASIC_FRAME_SCHEDULER_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "volk.h"
+
+class VulkanSwapChain;
+
+enum class Timeline : uint32_t
+{
+  GRAPHICS = 0,
+  TRANSFER,
+  COMPUTE,
+  COUNT
+};
+
+// point on a timeline, reached when the submission that signals a_value has completed;
+// value 0 is reached from the start
+struct Milestone
+{
+  Timeline timeline = Timeline::GRAPHICS;
+  uint64_t value    = 0;
+};
+
+// GPU side wait of a submission for a milestone of another (or the same) timeline
+struct MilestoneWait
+{
+  Milestone milestone;
+  VkPipelineStageFlags stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+};
+
+// One timeline semaphore per kind of queue work. Every submission made through the scheduler signals the next value
+// of its timeline, so any submission can be waited for by the CPU (Wait, IsReached) or by other submissions on
+// the GPU (MilestoneWait) without fences and without waiting for whole queues.
+// Frames are submitted on the graphics timeline: a frame slot is reused once the frame recorded in it
+// FramesInFlight() frames ago is retired. Swapchain acquire and present can not use timeline semaphores,
+// so the binary ones are kept here too.
+// All submissions of a timeline must go to the same queue. Not thread safe, submit from the render thread.
+//
+class FrameScheduler
+{
+public:
+  // adds VK_KHR_timeline_semaphore to a_extensions and fills a_features, which must be passed to
+  // vk_utils::createLogicalDevice as pNextFeatures; must be called before the logical device is created
+  static void SetupDevice(VkPhysicalDevice a_physDevice, std::vector<const char*> &a_extensions,
+    VkPhysicalDeviceTimelineSemaphoreFeatures &a_features);
+
+  FrameScheduler(VkDevice a_device, uint32_t a_framesInFlight);
+  ~FrameScheduler();
+
+  FrameScheduler(const FrameScheduler &) = delete;
+  FrameScheduler &operator=(const FrameScheduler &) = delete;
+
+  // acquire and present semaphores, the device must be idle when they are recreated with the swapchain
+  void CreateSwapchainSync(uint32_t a_imagesNum);
+  void DestroySwapchainSync();
+
+  // submits a_cmdBufs to a_queue after a_waits are reached, returns the milestone reached when they complete
+  Milestone Submit(Timeline a_timeline, VkQueue a_queue, const std::vector<VkCommandBuffer> &a_cmdBufs,
+    const std::vector<MilestoneWait> &a_waits = {});
+
+  Milestone LastSubmitted(Timeline a_timeline) const;
+  uint64_t  Completed(Timeline a_timeline) const;
+  bool      IsReached(const Milestone &a_milestone) const;
+  void      Wait(const Milestone &a_milestone) const;
+  // waits for everything submitted through the scheduler, other queue work is not waited for
+  void      WaitIdle() const;
+
+  uint32_t  FramesInFlight() const { return uint32_t(m_frameValues.size()); }
+  // slot of the frame being recorded, selects per frame resources
+  uint32_t  CurrentFrame() const { return m_currentFrame; }
+  // reached when all submitted frames are retired, so per frame resources shared by all slots may be changed
+  Milestone LastFrame() const { return {Timeline::GRAPHICS, m_lastFrameValue}; }
+
+  // waits until the current slot is retired and acquires the next image, returns the result of the acquire
+  VkResult  AcquireFrame(VulkanSwapChain &a_swapchain, uint32_t &a_imageIdx);
+  // submits the frame on the graphics timeline and moves to the next slot
+  Milestone SubmitFrame(VkQueue a_queue, uint32_t a_imageIdx, const std::vector<VkCommandBuffer> &a_cmdBufs,
+    const std::vector<MilestoneWait> &a_waits = {});
+  VkResult  PresentFrame(VulkanSwapChain &a_swapchain, VkQueue a_queue, uint32_t a_imageIdx);
+
+private:
+  Milestone SubmitImpl(Timeline a_timeline, VkQueue a_queue, const std::vector<VkCommandBuffer> &a_cmdBufs,
+    const std::vector<MilestoneWait> &a_waits, VkSemaphore a_binaryWait, VkSemaphore a_binarySignal);
+
+  static constexpr uint32_t TIMELINES_NUM = uint32_t(Timeline::COUNT);
+
+  VkDevice m_device = VK_NULL_HANDLE;
+  std::array<VkSemaphore, TIMELINES_NUM> m_timelines {};
+  std::array<uint64_t, TIMELINES_NUM>    m_lastValues {};
+
+  uint32_t m_currentFrame   = 0;
+  uint64_t m_lastFrameValue = 0;
+  std::vector<uint64_t> m_frameValues; // graphics value of the frame last submitted in every slot
+  std::vector<uint64_t> m_imageValues; // graphics value of the frame that rendered to every swapchain image last
+
+  std::vector<VkSemaphore> m_imageAvailable;    // per frame in flight
+  std::vector<VkSemaphore> m_renderingFinished; // per swapchain image, its presentation may outlast the frame
+};
+
+#endif// VK_GRAPHICS_BASIC_FRAME_SCHEDULER_H
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "frustum_culler.h"
+#include "../utils/parallel_for.h"
+
+#if defined(FRUSTUM_CULLER_AVX2)
+  #include <immintrin.h>
+#elif defined(FRUSTUM_CULLER_SSE)
+  #include <emmintrin.h>
+#endif
+
+void FrustumCuller::Clear()
+{
+  m_minX.clear(); m_minY.clear(); m_minZ.clear();
+  m_maxX.clear(); m_maxY.clear(); m_maxZ.clear();
+  m_boxesNum = 0;
+}
+
+void FrustumCuller::SetBoxes(const LiteMath::Box4f *a_boxes, uint32_t a_boxesNum)
+{
+  Clear();
+  const size_t padded = (size_t(a_boxesNum) + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+  for(auto *arr : {&m_minX, &m_minY, &m_minZ, &m_maxX, &m_maxY, &m_maxZ})
+    arr->assign(padded, 0.0f);
+
+  m_boxesNum = a_boxesNum;
+  for(uint32_t i = 0; i < a_boxesNum; ++i)
+    SetBox(i, a_boxes[i]);
+}
+
+void FrustumCuller::AddBox(const LiteMath::Box4f &a_box)
+{
+  if(m_boxesNum == m_minX.size())
+  {
+    for(auto *arr : {&m_minX, &m_minY, &m_minZ, &m_maxX, &m_maxY, &m_maxZ})
+      arr->resize(arr->size() + SIMD_WIDTH, 0.0f);
+  }
+  SetBox(m_boxesNum++, a_box);
+}
+
+void FrustumCuller::SetBox(uint32_t a_id, const LiteMath::Box4f &a_box)
+{
+  assert(a_id < m_boxesNum);
+  m_minX[a_id] = a_box.boxMin.x;
+  m_minY[a_id] = a_box.boxMin.y;
+  m_minZ[a_id] = a_box.boxMin.z;
+  m_maxX[a_id] = a_box.boxMax.x;
+  m_maxY[a_id] = a_box.boxMax.y;
+  m_maxZ[a_id] = a_box.boxMax.z;
+}
+
+LiteMath::Box4f FrustumCuller::GetBox(uint32_t a_id) const
+{
+  assert(a_id < m_boxesNum);
+  return LiteMath::Box4f(LiteMath::float4(m_minX[a_id], m_minY[a_id], m_minZ[a_id], 1.0f),
+                         LiteMath::float4(m_maxX[a_id], m_maxY[a_id], m_maxZ[a_id], 1.0f));
+}
+
+uint32_t FrustumCuller::CullRange(const LiteMath::float4 *a_planes, uint32_t a_first, uint32_t a_last, uint32_t *a_dst) const
+{
+  // a box is outside if its corner farthest along the plane normal is behind the plane,
+  // which corner it is depends only on signs of the normal, so coordinates are picked per plane up front
+  const float *xs[6], *ys[6], *zs[6];
+  for(int p = 0; p < 6; ++p)
+  {
+    xs[p] = a_planes[p].x >= 0.0f ? m_maxX.data() : m_minX.data();
+    ys[p] = a_planes[p].y >= 0.0f ? m_maxY.data() : m_minY.data();
+    zs[p] = a_planes[p].z >= 0.0f ? m_maxZ.data() : m_minZ.data();
+  }
+
+  // ids are written without branches: every lane is stored and the output advances only for visible ones,
+  // so no more than the ids of boxes before the current group are ever written
+  uint32_t visible = 0;
+  uint32_t i = a_first;
+
+#if defined(FRUSTUM_CULLER_AVX2)
+  __m256 px[6], py[6], pz[6], pw[6];
+  for(int p = 0; p < 6; ++p)
+  {
+    px[p] = _mm256_set1_ps(a_planes[p].x);
+    py[p] = _mm256_set1_ps(a_planes[p].y);
+    pz[p] = _mm256_set1_ps(a_planes[p].z);
+    pw[p] = _mm256_set1_ps(a_planes[p].w);
+  }
+  for(; i < a_last; i += 8)
+  {
+    __m256 outside = _mm256_setzero_ps();
+    for(int p = 0; p < 6; ++p)
+    {
+      __m256 dist = _mm256_add_ps(_mm256_mul_ps(px[p], _mm256_loadu_ps(xs[p] + i)), pw[p]);
+      dist = _mm256_add_ps(_mm256_mul_ps(py[p], _mm256_loadu_ps(ys[p] + i)), dist);
+      dist = _mm256_add_ps(_mm256_mul_ps(pz[p], _mm256_loadu_ps(zs[p] + i)), dist);
+      outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+    uint32_t mask = ~uint32_t(_mm256_movemask_ps(outside)) & 0xFFu;
+    if(a_last - i < 8)
+      mask &= (1u << (a_last - i)) - 1u;
+    for(uint32_t k = 0; k < 8; ++k)
+    {
+      a_dst[visible] = i + k;
+      visible += (mask >> k) & 1u;
+    }
+  }
+#elif defined(FRUSTUM_CULLER_SSE)
+  __m128 px[6], py[6], pz[6], pw[6];
+  for(int p = 0; p < 6; ++p)
+  {
+    px[p] = _mm_set1_ps(a_planes[p].x);
+    py[p] = _mm_set1_ps(a_planes[p].y);
+    pz[p] = _mm_set1_ps(a_planes[p].z);
+    pw[p] = _mm_set1_ps(a_planes[p].w);
+  }
+  for(; i < a_last; i += 4)
+  {
+    __m128 outside = _mm_setzero_ps();
+    for(int p = 0; p < 6; ++p)
+    {
+      __m128 dist = _mm_add_ps(_mm_mul_ps(px[p], _mm_loadu_ps(xs[p] + i)), pw[p]);
+      dist = _mm_add_ps(_mm_mul_ps(py[p], _mm_loadu_ps(ys[p] + i)), dist);
+      dist = _mm_add_ps(_mm_mul_ps(pz[p], _mm_loadu_ps(zs[p] + i)), dist);
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, _mm_setzero_ps()));
+    }
+    uint32_t mask = ~uint32_t(_mm_movemask_ps(outside)) & 0xFu;
+    if(a_last - i < 4)
+      mask &= (1u << (a_last - i)) - 1u;
+    for(uint32_t k = 0; k < 4; ++k)
+    {
+      a_dst[visible] = i + k;
+      visible += (mask >> k) & 1u;
+    }
+  }
+#else
+  for(; i < a_last; ++i)
+  {
+    bool inside = true;
+    for(int p = 0; p < 6; ++p)
+      inside = inside && a_planes[p].x * xs[p][i] + a_planes[p].y * ys[p][i] + a_planes[p].z * zs[p][i] + a_planes[p].w >= 0.0f;
+    a_dst[visible] = i;
+    visible += inside ? 1u : 0u;
+  }
+#endif
+
+  return visible;
+}
+
+void FrustumCuller::QueryFrustum(const LiteMath::float4x4 &a_projView, std::vector<uint32_t> &a_ids, uint32_t a_boxesNum,
+  uint32_t a_threadsNum) const
+{
+  const uint32_t boxesNum = std::min(a_boxesNum, m_boxesNum);
+  if(boxesNum == 0)
+    return;
+
+  // clip planes (Gribb, Hartmann), near plane is taken for -w <= z so it works with both depth ranges
+  const LiteMath::float4 rows[4] = {a_projView.get_row(0), a_projView.get_row(1), a_projView.get_row(2), a_projView.get_row(3)};
+  const LiteMath::float4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                                      rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2]};
+
+  // every chunk writes its ids at the position of its first box, the last one may write one id past the end
+  const size_t base = a_ids.size();
+  a_ids.resize(base + boxesNum + 1);
+  uint32_t *dst = a_ids.data() + base;
+
+  const uint32_t chunksNum = (boxesNum + THREAD_CHUNK - 1) / THREAD_CHUNK;
+  if(chunksNum == 1)
+  {
+    a_ids.resize(base + CullRange(planes, 0, boxesNum, dst));
+    return;
+  }
+
+  std::vector<uint32_t> counts(chunksNum);
+  ParallelFor(chunksNum, a_threadsNum, [&](uint32_t chunk)
+  {
+    const uint32_t first = chunk * THREAD_CHUNK;
+    counts[chunk] = CullRange(planes, first, std::min(boxesNum, first + THREAD_CHUNK), dst + first);
+  });
+
+  uint32_t visible = counts[0];
+  for(uint32_t chunk = 1; chunk < chunksNum; ++chunk)
+  {
+    memmove(dst + visible, dst + size_t(chunk) * THREAD_CHUNK, counts[chunk] * sizeof(uint32_t));
+    visible += counts[chunk];
+  }
+  a_ids.resize(base + visible);
+}
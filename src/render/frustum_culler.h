@@ -0,0 +1,57 @@
+#ifndef VK_GRAPHICS_BASIC_FRUSTUM_CULLER_H
+#define VK_GRAPHICS_BASIC_FRUSTUM_CULLER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "LiteMath.h"
+
+#if defined(__AVX2__)
+  #define FRUSTUM_CULLER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define FRUSTUM_CULLER_SSE
+#endif
+
+// Brute force frustum culling of boxes stored as structure of arrays (minX[], minY[], ... ).
+// Unlike InstanceBvh it has no structure to go stale, so it suits scenes where many instances move every frame.
+// Boxes are tested 8 at a time with AVX2 (build with VK_GRAPHICS_BASIC_AVX2), 4 with SSE or one by one elsewhere;
+// large queries are split between threads.
+//
+class FrustumCuller
+{
+public:
+#if defined(FRUSTUM_CULLER_AVX2)
+  static constexpr uint32_t SIMD_WIDTH = 8;
+#elif defined(FRUSTUM_CULLER_SSE)
+  static constexpr uint32_t SIMD_WIDTH = 4;
+#else
+  static constexpr uint32_t SIMD_WIDTH = 1;
+#endif
+  // boxes tested by one thread at a time, smaller queries are not split
+  static constexpr uint32_t THREAD_CHUNK = 32 * 1024;
+
+  void Clear();
+  void SetBoxes(const LiteMath::Box4f *a_boxes, uint32_t a_boxesNum);
+  void AddBox(const LiteMath::Box4f &a_box);
+  void SetBox(uint32_t a_id, const LiteMath::Box4f &a_box);
+
+  LiteMath::Box4f GetBox(uint32_t a_id) const;
+  uint32_t BoxesNum() const { return m_boxesNum; }
+
+  // appends ids of boxes among the first a_boxesNum that intersect view frustum of a_projView
+  // (clip space -w <= x, y, z <= w) in increasing order; a_threadsNum = 0 - use all hardware threads
+  void QueryFrustum(const LiteMath::float4x4 &a_projView, std::vector<uint32_t> &a_ids, uint32_t a_boxesNum = UINT32_MAX,
+    uint32_t a_threadsNum = 0) const;
+
+private:
+  // writes ids of visible boxes of [a_first, a_last) to a_dst and returns their number,
+  // a_first must be a multiple of SIMD_WIDTH
+  uint32_t CullRange(const LiteMath::float4 *a_planes, uint32_t a_first, uint32_t a_last, uint32_t *a_dst) const;
+
+  // padded to a multiple of SIMD_WIDTH, padding boxes are never reported
+  std::vector<float> m_minX, m_minY, m_minZ;
+  std::vector<float> m_maxX, m_maxY, m_maxZ;
+  uint32_t m_boxesNum = 0;
+};
+
+#endif// VK_GRAPHICS_BASIC_FRUSTUM_CULLER_H
@@ -0,0 +1,381 @@
+#include <cassert>
+#include <cstring>
+
+#include "gpu_culler.h"
+#include "scene_mgr.h"
+#include "depth_pyramid.h"
+#include "render_common.h"
+#include "../../resources/shaders/common.h"
+
+#include <vk_buffers.h>
+#include <vk_pipeline.h>
+#include <vk_utils.h>
+
+static constexpr uint32_t INDEX_TYPES_NUM = 2; // 32 and 16 bit, in the order of MeshDrawInfo::indexType
+static constexpr uint32_t BINDINGS_NUM    = 7;
+
+static const std::string CULL_SHADER_PATH           = "../resources/shaders/instance_cull.comp.spv";
+static const std::string CULL_OCCLUSION_SHADER_PATH = "../resources/shaders/instance_cull_occlusion.comp.spv";
+
+bool GpuCuller::SetupDevice(VkPhysicalDevice a_physDevice, VkPhysicalDeviceFeatures &a_features,
+  std::vector<const char*> &a_extensions, bool &a_drawIndirectCount)
+{
+  VkPhysicalDeviceFeatures supported = {};
+  vkGetPhysicalDeviceFeatures(a_physDevice, &supported);
+  if(!supported.multiDrawIndirect || !supported.drawIndirectFirstInstance)
+  {
+    vk_utils::logWarning("[GpuCuller::SetupDevice] multiDrawIndirect or drawIndirectFirstInstance is not supported, GPU culling is disabled");
+    return false;
+  }
+  a_features.multiDrawIndirect         = VK_TRUE;
+  a_features.drawIndirectFirstInstance = VK_TRUE;
+
+  uint32_t extensionsNum = 0;
+  vkEnumerateDeviceExtensionProperties(a_physDevice, nullptr, &extensionsNum, nullptr);
+  std::vector<VkExtensionProperties> extensions(extensionsNum);
+  vkEnumerateDeviceExtensionProperties(a_physDevice, nullptr, &extensionsNum, extensions.data());
+
+  a_drawIndirectCount = false;
+  for(const auto &ext : extensions)
+  {
+    if(strcmp(ext.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+    {
+      a_extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+      a_drawIndirectCount = true;
+      break;
+    }
+  }
+  return true;
+}
+
+bool GpuCuller::ShadersCompiled()
+{
+  return ShaderCompiled(CULL_SHADER_PATH);
+}
+
+bool GpuCuller::OcclusionShadersCompiled()
+{
+  return ShaderCompiled(CULL_OCCLUSION_SHADER_PATH);
+}
+
+GpuCuller::GpuCuller(VkDevice a_device, VkPhysicalDevice a_physDevice, bool a_drawIndirectCount, uint32_t a_viewsNum) :
+  m_device(a_device), m_physDevice(a_physDevice), m_drawIndirectCount(a_drawIndirectCount), m_viewsNum(a_viewsNum)
+{
+  assert(m_viewsNum <= 32); // m_visibilityValid bits
+
+  // the set is rewritten when the scene buffers change, so it is made by hand instead of DescriptorMaker,
+  // which needs the buffers to create the layout; binding 0 (instance matrices) is read by vertex shaders only
+  VkDescriptorSetLayoutBinding bindings[BINDINGS_NUM] = {};
+  for(uint32_t i = 0; i < BINDINGS_NUM; ++i)
+  {
+    bindings[i].binding         = i;
+    bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags      = i == 0 ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+  layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = BINDINGS_NUM;
+  layoutInfo.pBindings    = bindings;
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_dSetLayout));
+
+  // the second set is the depth pyramid of occlusion culling
+  VkDescriptorPoolSize poolSizes[2] = {{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         BINDINGS_NUM},
+                                       {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}};
+  VkDescriptorPoolCreateInfo poolInfo = {};
+  poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets       = 2;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes    = poolSizes;
+  VK_CHECK_RESULT(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_dPool));
+
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool     = m_dPool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts        = &m_dSetLayout;
+  VK_CHECK_RESULT(vkAllocateDescriptorSets(m_device, &allocInfo, &m_dSet));
+
+  vk_utils::ComputePipelineMaker maker;
+  maker.LoadShader(m_device, CULL_SHADER_PATH);
+  m_pipelineLayout = maker.MakeLayout(m_device, {m_dSetLayout}, sizeof(InstanceCullParams));
+  m_pipeline       = maker.MakePipeline(m_device);
+
+  const VkDeviceSize readbackSize = m_viewsNum * CULL_COUNTS_PER_VIEW * sizeof(uint32_t);
+  VkMemoryRequirements memReq;
+  m_readbackBuf = vk_utils::createBuffer(m_device, readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, &memReq);
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize  = memReq.size;
+  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_physDevice);
+  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_readbackMem));
+  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_readbackBuf, m_readbackMem, 0));
+
+  void *pMapped = nullptr;
+  VK_CHECK_RESULT(vkMapMemory(m_device, m_readbackMem, 0, readbackSize, 0, &pMapped));
+  memset(pMapped, 0, readbackSize);
+  m_pReadback = static_cast<const uint32_t *>(pMapped);
+}
+
+GpuCuller::~GpuCuller()
+{
+  DestroyDrawBuffers();
+
+  if(m_readbackBuf != VK_NULL_HANDLE)
+    vkDestroyBuffer(m_device, m_readbackBuf, nullptr);
+  if(m_readbackMem != VK_NULL_HANDLE)
+    vkFreeMemory(m_device, m_readbackMem, nullptr);
+  if(m_occlusionPipeline != VK_NULL_HANDLE)
+    vkDestroyPipeline(m_device, m_occlusionPipeline, nullptr);
+  if(m_occlusionPipelineLayout != VK_NULL_HANDLE)
+    vkDestroyPipelineLayout(m_device, m_occlusionPipelineLayout, nullptr);
+  if(m_pyramidSetLayout != VK_NULL_HANDLE)
+    vkDestroyDescriptorSetLayout(m_device, m_pyramidSetLayout, nullptr);
+  if(m_pipeline != VK_NULL_HANDLE)
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+  if(m_pipelineLayout != VK_NULL_HANDLE)
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+  if(m_dPool != VK_NULL_HANDLE)
+    vkDestroyDescriptorPool(m_device, m_dPool, nullptr);
+  if(m_dSetLayout != VK_NULL_HANDLE)
+    vkDestroyDescriptorSetLayout(m_device, m_dSetLayout, nullptr);
+}
+
+void GpuCuller::DestroyDrawBuffers()
+{
+  if(m_drawBuf != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_drawBuf, nullptr);
+    m_drawBuf = VK_NULL_HANDLE;
+  }
+  if(m_countBuf != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_countBuf, nullptr);
+    m_countBuf = VK_NULL_HANDLE;
+  }
+  if(m_visibilityBuf != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_visibilityBuf, nullptr);
+    m_visibilityBuf = VK_NULL_HANDLE;
+  }
+  if(m_drawMem != VK_NULL_HANDLE)
+  {
+    vkFreeMemory(m_device, m_drawMem, nullptr);
+    m_drawMem = VK_NULL_HANDLE;
+  }
+  m_capacity        = 0u;
+  m_visibilityValid = 0u;
+}
+
+void GpuCuller::UpdateSceneBuffers(const SceneManager &a_scnMgr)
+{
+  if(a_scnMgr.GetInstanceCullInfoBuffer() == m_sceneInstancesBuf && a_scnMgr.GpuInstancesCapacity() == m_capacity)
+    return;
+
+  // happens once per loaded scene, frames in flight may still use the set and the draw buffers
+  vkDeviceWaitIdle(m_device);
+  DestroyDrawBuffers();
+
+  m_capacity          = a_scnMgr.GpuInstancesCapacity();
+  m_sceneInstancesBuf = a_scnMgr.GetInstanceCullInfoBuffer();
+
+  const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  m_drawBuf  = vk_utils::createBuffer(m_device, VkDeviceSize(m_viewsNum) * INDEX_TYPES_NUM * m_capacity *
+                                                sizeof(VkDrawIndexedIndirectCommand), usage);
+  m_countBuf = vk_utils::createBuffer(m_device, m_viewsNum * CULL_COUNTS_PER_VIEW * sizeof(uint32_t),
+                                      usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+  m_visibilityBuf = vk_utils::createBuffer(m_device, VkDeviceSize(m_viewsNum) * m_capacity * sizeof(uint32_t),
+                                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_drawMem  = vk_utils::allocateAndBindWithPadding(m_device, m_physDevice, {m_drawBuf, m_countBuf, m_visibilityBuf});
+
+  const VkBuffer buffers[BINDINGS_NUM] = {a_scnMgr.GetInstanceMatricesBuffer(), a_scnMgr.GetInstanceCullInfoBuffer(),
+                                          a_scnMgr.GetMeshInfoBuffer(), a_scnMgr.GetLodBuffer(), m_drawBuf, m_countBuf,
+                                          m_visibilityBuf};
+  VkDescriptorBufferInfo bufferInfos[BINDINGS_NUM] = {};
+  VkWriteDescriptorSet writes[BINDINGS_NUM] = {};
+  for(uint32_t i = 0; i < BINDINGS_NUM; ++i)
+  {
+    bufferInfos[i].buffer = buffers[i];
+    bufferInfos[i].offset = 0;
+    bufferInfos[i].range  = VK_WHOLE_SIZE;
+
+    writes[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet          = m_dSet;
+    writes[i].dstBinding      = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].pBufferInfo     = &bufferInfos[i];
+  }
+  vkUpdateDescriptorSets(m_device, BINDINGS_NUM, writes, 0, nullptr);
+}
+
+void GpuCuller::UpdatePyramidSet(const DepthPyramid &a_pyramid)
+{
+  if(m_occlusionPipeline == VK_NULL_HANDLE)
+  {
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding         = 0;
+    binding.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings    = &binding;
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_pyramidSetLayout));
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool     = m_dPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts        = &m_pyramidSetLayout;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(m_device, &allocInfo, &m_pyramidSet));
+
+    vk_utils::ComputePipelineMaker maker;
+    maker.LoadShader(m_device, CULL_OCCLUSION_SHADER_PATH);
+    m_occlusionPipelineLayout = maker.MakeLayout(m_device, {m_dSetLayout, m_pyramidSetLayout}, sizeof(InstanceCullParams));
+    m_occlusionPipeline       = maker.MakePipeline(m_device);
+  }
+
+  // DepthPyramid::SetDepthBuffer waits for the device before the view changes, so the set is not in use
+  if(a_pyramid.GetView() == m_pyramidView)
+    return;
+  m_pyramidView = a_pyramid.GetView();
+
+  VkDescriptorImageInfo imageInfo = {};
+  imageInfo.sampler     = a_pyramid.GetSampler();
+  imageInfo.imageView   = a_pyramid.GetView();
+  imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+  VkWriteDescriptorSet write = {};
+  write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet          = m_pyramidSet;
+  write.dstBinding      = 0;
+  write.descriptorCount = 1;
+  write.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo      = &imageInfo;
+  vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+}
+
+void GpuCuller::CmdCull(VkCommandBuffer a_cmdBuf, const SceneManager &a_scnMgr, uint32_t a_view,
+  const LiteMath::float4x4 &a_projView, const LiteMath::float3 &a_lodEye, float a_lodScale, CullPass a_pass,
+  const DepthPyramid *a_pPyramid)
+{
+  assert(a_view < m_viewsNum);
+  const uint32_t instancesNum = a_scnMgr.GpuInstancesNum();
+  if(instancesNum == 0)
+    return;
+  UpdateSceneBuffers(a_scnMgr);
+
+  // both occlusion passes bind the pyramid, the late one reads it
+  const bool occlusion = a_pass != CullPass::FRUSTUM;
+  assert(!occlusion || a_pPyramid != nullptr);
+  if(occlusion)
+    UpdatePyramidSet(*a_pPyramid);
+
+  // commands of the previous pass may still be read by its draws, its counts by the readback copy
+  // and visibility written by the last late pass is read now
+  VkMemoryBarrier barrier = {};
+  barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(a_cmdBuf,
+    VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+    VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+  // draw counts of both index types and occluded instances
+  vkCmdFillBuffer(a_cmdBuf, m_countBuf, a_view * CULL_COUNTS_PER_VIEW * sizeof(uint32_t),
+    CULL_COUNTS_PER_VIEW * sizeof(uint32_t), 0);
+
+  // visibility is unknown if the view was not culled with occlusion in the last frame, the early pass then draws nothing
+  const uint32_t viewBit = 1u << a_view;
+  if(a_pass == CullPass::OCCLUSION_EARLY && (m_visibilityValid & viewBit) == 0)
+    vkCmdFillBuffer(a_cmdBuf, m_visibilityBuf, VkDeviceSize(a_view) * m_capacity * sizeof(uint32_t),
+      m_capacity * sizeof(uint32_t), 0);
+  if(a_pass == CullPass::OCCLUSION_LATE)
+    m_visibilityValid |= viewBit;
+  else if(a_pass == CullPass::FRUSTUM)
+    m_visibilityValid &= ~viewBit;
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(a_cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+    0, nullptr, 0, nullptr);
+
+  InstanceCullParams params = {};
+  params.projView     = a_projView;
+  params.lodEye       = LiteMath::float4(a_lodEye.x, a_lodEye.y, a_lodEye.z, a_lodScale);
+  params.instancesNum = instancesNum;
+  params.capacity     = m_capacity;
+  params.view         = a_view;
+  params.flags        = (m_drawIndirectCount ? CULL_FLAG_COMPACT : 0u) | (a_lodScale > 0.0f ? CULL_FLAG_LOD : 0u);
+  if(a_pass == CullPass::OCCLUSION_EARLY)
+    params.flags |= CULL_FLAG_OCCLUSION_EARLY;
+  else if(a_pass == CullPass::OCCLUSION_LATE)
+    params.flags |= CULL_FLAG_OCCLUSION_LATE;
+
+  const VkPipelineLayout layout = occlusion ? m_occlusionPipelineLayout : m_pipelineLayout;
+  const VkDescriptorSet sets[2] = {m_dSet, m_pyramidSet};
+  vkCmdBindPipeline(a_cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, occlusion ? m_occlusionPipeline : m_pipeline);
+  vkCmdBindDescriptorSets(a_cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, occlusion ? 2 : 1, sets, 0, nullptr);
+  vkCmdPushConstants(a_cmdBuf, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+  vkCmdDispatch(a_cmdBuf, (instancesNum + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(a_cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+  if(a_pass == CullPass::OCCLUSION_LATE)
+  {
+    VkBufferCopy region = {};
+    region.srcOffset = a_view * CULL_COUNTS_PER_VIEW * sizeof(uint32_t);
+    region.dstOffset = region.srcOffset;
+    region.size      = CULL_COUNTS_PER_VIEW * sizeof(uint32_t);
+    vkCmdCopyBuffer(a_cmdBuf, m_countBuf, m_readbackBuf, 1, &region);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(a_cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier,
+      0, nullptr, 0, nullptr);
+  }
+}
+
+uint32_t GpuCuller::GetOccludedNum(uint32_t a_view) const
+{
+  assert(a_view < m_viewsNum);
+  return m_pReadback[a_view * CULL_COUNTS_PER_VIEW + CULL_COUNT_OCCLUDED];
+}
+
+void GpuCuller::CmdDraw(VkCommandBuffer a_cmdBuf, const SceneManager &a_scnMgr, uint32_t a_view, VkPipelineLayout a_layout,
+  uint32_t a_setIdx)
+{
+  assert(a_view < m_viewsNum);
+  const uint32_t instancesNum = a_scnMgr.GpuInstancesNum();
+  if(instancesNum == 0 || m_drawBuf == VK_NULL_HANDLE)
+    return;
+
+  vkCmdBindDescriptorSets(a_cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, a_layout, a_setIdx, 1, &m_dSet, 0, nullptr);
+
+  const VkIndexType indexTypes[INDEX_TYPES_NUM] = {VK_INDEX_TYPE_UINT32, VK_INDEX_TYPE_UINT16};
+  for(uint32_t type = 0; type < INDEX_TYPES_NUM; ++type)
+  {
+    const uint32_t region = a_view * INDEX_TYPES_NUM + type;
+    const VkDeviceSize drawOffset  = VkDeviceSize(region) * m_capacity * sizeof(VkDrawIndexedIndirectCommand);
+    const VkDeviceSize countOffset = (a_view * CULL_COUNTS_PER_VIEW + type) * sizeof(uint32_t);
+
+    vkCmdBindIndexBuffer(a_cmdBuf, a_scnMgr.GetIndexBuffer(indexTypes[type]), 0, indexTypes[type]);
+    if(m_drawIndirectCount)
+    {
+      vkCmdDrawIndexedIndirectCountKHR(a_cmdBuf, m_drawBuf, drawOffset, m_countBuf, countOffset, instancesNum,
+        sizeof(VkDrawIndexedIndirectCommand));
+    }
+    else
+      vkCmdDrawIndexedIndirect(a_cmdBuf, m_drawBuf, drawOffset, instancesNum, sizeof(VkDrawIndexedIndirectCommand));
+  }
+}
@@ -0,0 +1,108 @@
+#ifndef VK_GRAPHICS_BASIC_GPU_CULLER_H
+#define VK_GRAPHICS_BASIC_GPU_CULLER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "volk.h"
+#include "LiteMath.h"
+
+struct SceneManager;
+class DepthPyramid;
+
+// GPU driven drawing of scene instances: instance_cull.comp tests instance boxes against the view frustum,
+// selects their LODs and writes one VkDrawIndexedIndirectCommand per visible instance,
+// the frame then draws them with two indirect draws (one per index type), so CPU cost does not depend on instance count.
+// Instance matrices are read by vertex shaders by gl_InstanceIndex from binding 0 of the culler descriptor set.
+// With VK_KHR_draw_indirect_count visible commands are packed and counted on the GPU,
+// without it every instance gets a command and culled ones are drawn with zero instances.
+// Several views (e.g. a shadow map and the camera) have separate commands, so they can be culled in one frame.
+// Two pass occlusion culling (instance_cull_occlusion.comp) keeps per view visibility of the last frame:
+// the early pass draws instances visible in it, then the late pass tests the others against the depth pyramid
+// of the early pass, draws the newly visible ones and stores visibility for the next frame.
+//
+class GpuCuller
+{
+public:
+  static constexpr uint32_t GROUP_SIZE = 64; // local_size_x of instance_cull.comp
+
+  enum class CullPass
+  {
+    FRUSTUM,         // frustum culling only
+    OCCLUSION_EARLY, // instances in the frustum that were visible in the last frame
+    OCCLUSION_LATE,  // the rest of instances in the frustum that are not hidden in the depth pyramid
+  };
+
+  // enables device features and extensions needed for GPU culling if the device supports them,
+  // must be called after the physical device is chosen and before the logical device is created;
+  // returns false if GPU culling can not be used
+  static bool SetupDevice(VkPhysicalDevice a_physDevice, VkPhysicalDeviceFeatures &a_features,
+    std::vector<const char*> &a_extensions, bool &a_drawIndirectCount);
+  // false with a warning if instance_cull.comp is not compiled to SPIR-V
+  static bool ShadersCompiled();
+  // false with a warning if instance_cull_occlusion.comp is not compiled, CullPass::OCCLUSION_* need it
+  static bool OcclusionShadersCompiled();
+
+  GpuCuller(VkDevice a_device, VkPhysicalDevice a_physDevice, bool a_drawIndirectCount, uint32_t a_viewsNum = 1);
+  ~GpuCuller();
+
+  GpuCuller(const GpuCuller &) = delete;
+  GpuCuller &operator=(const GpuCuller &) = delete;
+
+  // layout of the set to bind for CmdDraw, instance matrices are at binding 0
+  VkDescriptorSetLayout GetDescriptorSetLayout() const { return m_dSetLayout; }
+  bool DrawIndirectCountEnabled() const { return m_drawIndirectCount; }
+
+  // records culling of instances in GPU instance buffers of the scene for a_view, must be called outside of render pass
+  // after SceneManager::CmdUpdateInstances; a_lodScale is screen scale divided by allowed LOD error in pixels, 0 - LOD 0 only
+  void CmdCull(VkCommandBuffer a_cmdBuf, const SceneManager &a_scnMgr, uint32_t a_view, const LiteMath::float4x4 &a_projView,
+    const LiteMath::float3 &a_lodEye, float a_lodScale, CullPass a_pass = CullPass::FRUSTUM,
+    const DepthPyramid *a_pPyramid = nullptr);
+  // records draws of instances culled for a_view; pipeline whose layout has GetDescriptorSetLayout() at a_setIdx
+  // and the scene vertex buffer must be bound
+  void CmdDraw(VkCommandBuffer a_cmdBuf, const SceneManager &a_scnMgr, uint32_t a_view, VkPipelineLayout a_layout,
+    uint32_t a_setIdx);
+
+  // instances hidden in the depth pyramid by the last finished OCCLUSION_LATE pass of a_view
+  uint32_t GetOccludedNum(uint32_t a_view) const;
+
+private:
+  // draw buffers are sized for all GPU instances of the scene and point to its buffers, both change with the scene
+  void UpdateSceneBuffers(const SceneManager &a_scnMgr);
+  void DestroyDrawBuffers();
+  // occlusion pipeline and the pyramid set are created on first use, most frames do not need them
+  void UpdatePyramidSet(const DepthPyramid &a_pyramid);
+
+  VkDevice m_device         = VK_NULL_HANDLE;
+  VkPhysicalDevice m_physDevice = VK_NULL_HANDLE;
+  bool     m_drawIndirectCount = false;
+  uint32_t m_viewsNum       = 1u;
+
+  VkDescriptorSetLayout m_dSetLayout = VK_NULL_HANDLE;
+  VkDescriptorPool m_dPool  = VK_NULL_HANDLE;
+  VkDescriptorSet  m_dSet   = VK_NULL_HANDLE;
+  VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+  VkPipeline       m_pipeline       = VK_NULL_HANDLE;
+
+  VkDescriptorSetLayout m_pyramidSetLayout = VK_NULL_HANDLE;
+  VkDescriptorSet  m_pyramidSet     = VK_NULL_HANDLE;
+  VkImageView      m_pyramidView    = VK_NULL_HANDLE; // pyramid the set was written for
+  VkPipelineLayout m_occlusionPipelineLayout = VK_NULL_HANDLE;
+  VkPipeline       m_occlusionPipeline       = VK_NULL_HANDLE;
+
+  // [view][index type][m_capacity] commands, [view][CULL_COUNTS_PER_VIEW] counts and [view][m_capacity] visibility
+  VkBuffer m_drawBuf        = VK_NULL_HANDLE;
+  VkBuffer m_countBuf       = VK_NULL_HANDLE;
+  VkBuffer m_visibilityBuf  = VK_NULL_HANDLE;
+  VkDeviceMemory m_drawMem  = VK_NULL_HANDLE;
+  uint32_t m_capacity       = 0u;
+  VkBuffer m_sceneInstancesBuf = VK_NULL_HANDLE; // scene buffer the descriptor set was written for
+  uint32_t m_visibilityValid = 0u; // bit per view, set if its visibility was written by the last cull of the view
+
+  // counts of late passes are copied here to show the number of occluded instances
+  VkBuffer m_readbackBuf    = VK_NULL_HANDLE;
+  VkDeviceMemory m_readbackMem = VK_NULL_HANDLE;
+  const uint32_t *m_pReadback  = nullptr;
+};
+
+#endif// VK_GRAPHICS_BASIC_GPU_CULLER_H
@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+#include "gpu_profiler.h"
+
+#include <vk_utils.h>
+
+GpuProfiler::GpuProfiler(VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_queueFamilyIdx,
+  uint32_t a_framesInFlight, uint32_t a_maxScopes, uint32_t a_historySize) : m_device(a_device), m_historySize(a_historySize)
+{
+  assert(a_framesInFlight > 0 && a_maxScopes > 0 && a_historySize > 0);
+
+  uint32_t familiesNum = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physDevice, &familiesNum, nullptr);
+  std::vector<VkQueueFamilyProperties> families(familiesNum);
+  vkGetPhysicalDeviceQueueFamilyProperties(a_physDevice, &familiesNum, families.data());
+
+  const uint32_t validBits = a_queueFamilyIdx < familiesNum ? families[a_queueFamilyIdx].timestampValidBits : 0;
+  if(validBits == 0)
+  {
+    vk_utils::logWarning("[GpuProfiler] the queue family has no timestamps, GPU profiling is disabled");
+    return;
+  }
+  m_timestampMask = validBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << validBits) - 1;
+
+  VkPhysicalDeviceProperties props = {};
+  vkGetPhysicalDeviceProperties(a_physDevice, &props);
+  m_nsPerTick = props.limits.timestampPeriod;
+
+  // the whole frame is a scope too, every scope takes a begin and an end query
+  m_queriesPerSet = 2 * (a_maxScopes + 1);
+  m_sets.resize(a_framesInFlight + 1);
+
+  VkQueryPoolCreateInfo poolInfo = {};
+  poolInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = m_queriesPerSet * uint32_t(m_sets.size());
+  VK_CHECK_RESULT(vkCreateQueryPool(m_device, &poolInfo, nullptr, &m_queryPool));
+
+  m_scopeNames  = {"total"};
+  m_scopeDepths = {0};
+  m_history.resize(m_historySize);
+}
+
+GpuProfiler::~GpuProfiler()
+{
+  if(m_queryPool != VK_NULL_HANDLE)
+    vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+}
+
+uint32_t GpuProfiler::ScopeId(const char *a_name)
+{
+  // there are a few scopes, so a linear search is cheaper than hashing the name
+  for(uint32_t i = 0; i < m_scopeNames.size(); ++i)
+  {
+    if(strcmp(m_scopeNames[i].c_str(), a_name) == 0)
+      return i;
+  }
+  m_scopeNames.emplace_back(a_name);
+  m_scopeDepths.push_back(0);
+  return uint32_t(m_scopeNames.size() - 1);
+}
+
+void GpuProfiler::CmdBeginFrame(VkCommandBuffer a_cmdBuff)
+{
+  if(!Supported())
+    return;
+  assert(!m_frameOpen);
+
+  m_currentSet = uint32_t(m_frame % m_sets.size());
+  QuerySet &set = m_sets[m_currentSet];
+  ReadBack(set, m_currentSet);
+
+  set.frame       = m_frame++;
+  set.queriesUsed = 0;
+  set.records.clear();
+  m_openScopes.clear();
+
+  vkCmdResetQueryPool(a_cmdBuff, m_queryPool, m_currentSet * m_queriesPerSet, m_queriesPerSet);
+  m_frameOpen = true;
+  CmdBeginScope(a_cmdBuff, m_scopeNames[0].c_str());
+}
+
+void GpuProfiler::CmdBeginScope(VkCommandBuffer a_cmdBuff, const char *a_name)
+{
+  if(!Supported() || !m_frameOpen)
+    return;
+
+  // both queries are taken at once, so every query of the set that is read back has been written
+  QuerySet &set = m_sets[m_currentSet];
+  if(set.queriesUsed + 2 > m_queriesPerSet)
+  {
+    m_openScopes.push_back(UINT32_MAX);
+    return;
+  }
+
+  ScopeRecord record = {};
+  record.scope      = ScopeId(a_name);
+  record.depth      = uint32_t(m_openScopes.size());
+  record.beginQuery = set.queriesUsed++;
+  record.endQuery   = set.queriesUsed++;
+
+  // bottom of pipe: the scope starts when the work recorded before it has finished,
+  // so sibling scopes do not overlap and add up to their parent
+  vkCmdWriteTimestamp(a_cmdBuff, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool,
+                      m_currentSet * m_queriesPerSet + record.beginQuery);
+
+  m_openScopes.push_back(uint32_t(set.records.size()));
+  set.records.push_back(record);
+}
+
+void GpuProfiler::CmdEndScope(VkCommandBuffer a_cmdBuff)
+{
+  if(!Supported() || !m_frameOpen || m_openScopes.empty())
+    return;
+
+  const uint32_t recordId = m_openScopes.back();
+  m_openScopes.pop_back();
+  if(recordId == UINT32_MAX)
+    return;
+
+  const ScopeRecord &record = m_sets[m_currentSet].records[recordId];
+  vkCmdWriteTimestamp(a_cmdBuff, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool,
+                      m_currentSet * m_queriesPerSet + record.endQuery);
+}
+
+void GpuProfiler::CmdEndFrame(VkCommandBuffer a_cmdBuff)
+{
+  if(!Supported() || !m_frameOpen)
+    return;
+
+  // scopes left open are closed with the frame
+  while(!m_openScopes.empty())
+    CmdEndScope(a_cmdBuff);
+  m_frameOpen = false;
+}
+
+void GpuProfiler::ReadBack(QuerySet &a_set, uint32_t a_setId)
+{
+  if(a_set.queriesUsed == 0)
+    return;
+
+  m_results.resize(a_set.queriesUsed);
+  // no VK_QUERY_RESULT_WAIT_BIT, results that are not available yet are dropped
+  const VkResult result = vkGetQueryPoolResults(m_device, m_queryPool, a_setId * m_queriesPerSet, a_set.queriesUsed,
+    m_results.size() * sizeof(uint64_t), m_results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  a_set.queriesUsed = 0;
+  if(result == VK_NOT_READY)
+    return;
+  VK_CHECK_RESULT(result);
+
+  FrameTimings &timings = m_history[m_historyNext];
+  timings.frame = a_set.frame;
+  timings.scopeMs.assign(m_scopeNames.size(), -1.0f);
+  for(const auto &record : a_set.records)
+  {
+    const uint64_t ticks = (m_results[record.endQuery] - m_results[record.beginQuery]) & m_timestampMask;
+    const float ms       = float(double(ticks) * m_nsPerTick * 1e-6);
+
+    // a scope opened several times in a frame is summed up
+    float &scopeMs = timings.scopeMs[record.scope];
+    scopeMs = scopeMs < 0.0f ? ms : scopeMs + ms;
+    m_scopeDepths[record.scope] = record.depth;
+  }
+
+  m_historyNext  = (m_historyNext + 1) % m_historySize;
+  m_historyCount = std::min(m_historyCount + 1, m_historySize);
+  m_statsDirty   = true;
+}
+
+const std::vector<GpuProfiler::ScopeStats> &GpuProfiler::GetStats()
+{
+  if(!m_statsDirty)
+    return m_stats;
+  m_statsDirty = false;
+
+  m_stats.resize(m_scopeNames.size());
+  std::vector<float> samples;
+  samples.reserve(m_historyCount);
+  for(uint32_t scope = 0; scope < m_scopeNames.size(); ++scope)
+  {
+    ScopeStats &stats = m_stats[scope];
+    stats = {};
+    stats.name  = m_scopeNames[scope];
+    stats.depth = m_scopeDepths[scope];
+
+    samples.clear();
+    for(uint32_t i = 0; i < m_historyCount; ++i)
+    {
+      const FrameTimings &timings = m_history[(m_historyNext + m_historySize - m_historyCount + i) % m_historySize];
+      if(scope < timings.scopeMs.size() && timings.scopeMs[scope] >= 0.0f)
+        samples.push_back(timings.scopeMs[scope]);
+    }
+    if(samples.empty())
+      continue;
+
+    stats.samplesNum = uint32_t(samples.size());
+    stats.lastMs     = samples.back();
+
+    double sum = 0.0;
+    for(float ms : samples)
+      sum += ms;
+    stats.avgMs = float(sum / double(samples.size()));
+
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](float a_p) { return samples[size_t(a_p * float(samples.size() - 1) + 0.5f)]; };
+    stats.p50Ms = percentile(0.50f);
+    stats.p95Ms = percentile(0.95f);
+    stats.p99Ms = percentile(0.99f);
+    stats.maxMs = samples.back();
+  }
+  return m_stats;
+}
+
+bool GpuProfiler::Dump(const std::string &a_path) const
+{
+  std::ofstream out(a_path);
+  if(!out.is_open())
+  {
+    vk_utils::logWarning("[GpuProfiler::Dump] can't open " + a_path);
+    return false;
+  }
+
+  const bool json = a_path.size() >= 5 && a_path.compare(a_path.size() - 5, 5, ".json") == 0;
+  auto quoted = [](const std::string &a_str)
+  {
+    std::string res = "\"";
+    for(char c : a_str)
+    {
+      if(c == '"' || c == '\\')
+        res += '\\';
+      res += c;
+    }
+    return res + "\"";
+  };
+
+  // times in milliseconds, frames in submission order
+  if(json)
+  {
+    out << "{\n  \"units\": \"ms\",\n  \"scopes\": [";
+    for(size_t i = 0; i < m_scopeNames.size(); ++i)
+      out << (i == 0 ? "" : ", ") << quoted(m_scopeNames[i]);
+    out << "],\n  \"frames\": [";
+  }
+  else
+  {
+    out << "frame";
+    for(const auto &name : m_scopeNames)
+      out << "," << quoted(name);
+    out << "\n";
+  }
+
+  for(uint32_t i = 0; i < m_historyCount; ++i)
+  {
+    const FrameTimings &timings = m_history[(m_historyNext + m_historySize - m_historyCount + i) % m_historySize];
+    if(json)
+    {
+      out << (i == 0 ? "\n" : ",\n") << "    {\"frame\": " << timings.frame;
+      for(size_t scope = 0; scope < timings.scopeMs.size(); ++scope)
+      {
+        if(timings.scopeMs[scope] >= 0.0f)
+          out << ", " << quoted(m_scopeNames[scope]) << ": " << timings.scopeMs[scope];
+      }
+      out << "}";
+    }
+    else
+    {
+      // scopes not measured in the frame are left empty
+      out << timings.frame;
+      for(size_t scope = 0; scope < m_scopeNames.size(); ++scope)
+      {
+        out << ",";
+        if(scope < timings.scopeMs.size() && timings.scopeMs[scope] >= 0.0f)
+          out << timings.scopeMs[scope];
+      }
+      out << "\n";
+    }
+  }
+
+  if(json)
+    out << "\n  ]\n}\n";
+  return out.good();
+}
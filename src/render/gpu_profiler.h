@@ -0,0 +1,107 @@
+#ifndef VK_GRAPHICS_BASIC_GPU_PROFILER_H
+#define VK_GRAPHICS_BASIC_GPU_PROFILER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "volk.h"
+
+// GPU time of named scopes (passes) measured with timestamp queries.
+// Every frame writes its timestamps to its own set of queries, a set is read back when it is reused
+// FramesInFlight + 1 frames later. The frame has retired by then, so the readback never waits for the GPU,
+// a set whose results are still not available is dropped. Statistics are kept for the last a_historySize frames.
+//
+class GpuProfiler
+{
+public:
+  struct ScopeStats
+  {
+    std::string name;
+    uint32_t depth      = 0; // nesting level, the whole frame is 0
+    uint32_t samplesNum = 0; // frames of the history the scope was measured in
+    float lastMs = 0.0f;
+    float avgMs  = 0.0f;
+    float p50Ms  = 0.0f;
+    float p95Ms  = 0.0f;
+    float p99Ms  = 0.0f;
+    float maxMs  = 0.0f;
+  };
+
+  // a_queueFamilyIdx is the family of the queue that executes profiled command buffers
+  GpuProfiler(VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_queueFamilyIdx, uint32_t a_framesInFlight,
+    uint32_t a_maxScopes = 32, uint32_t a_historySize = 256);
+  ~GpuProfiler();
+
+  GpuProfiler(const GpuProfiler &) = delete;
+  GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+  // false if the queue family has no timestamps, all commands are ignored then
+  bool Supported() const { return m_timestampMask != 0; }
+
+  // recorded first in the frame, outside of render passes: reads back the set of an old frame and resets it
+  void CmdBeginFrame(VkCommandBuffer a_cmdBuff);
+  // scopes may nest and may begin and end in different command buffers of the frame, submitted in order;
+  // they can not be recorded inside render passes that execute secondary command buffers
+  void CmdBeginScope(VkCommandBuffer a_cmdBuff, const char *a_name);
+  void CmdEndScope(VkCommandBuffer a_cmdBuff);
+  // recorded last in the frame, closes scopes left open
+  void CmdEndFrame(VkCommandBuffer a_cmdBuff);
+
+  // per scope statistics over the history, the first one is the whole frame
+  const std::vector<ScopeStats> &GetStats();
+  // writes GPU time of every scope in every frame of the history, JSON if a_path ends with ".json", CSV otherwise
+  bool Dump(const std::string &a_path) const;
+
+private:
+  struct ScopeRecord
+  {
+    uint32_t scope;
+    uint32_t depth;
+    uint32_t beginQuery;
+    uint32_t endQuery;
+  };
+
+  struct QuerySet
+  {
+    uint64_t frame       = 0;
+    uint32_t queriesUsed = 0;
+    std::vector<ScopeRecord> records;
+  };
+
+  struct FrameTimings
+  {
+    uint64_t frame = 0;
+    std::vector<float> scopeMs; // by scope id, negative if the scope was not measured in the frame
+  };
+
+  uint32_t ScopeId(const char *a_name);
+  void ReadBack(QuerySet &a_set, uint32_t a_setId);
+
+  VkDevice    m_device    = VK_NULL_HANDLE;
+  VkQueryPool m_queryPool = VK_NULL_HANDLE;
+  uint64_t m_timestampMask  = 0;
+  double   m_nsPerTick      = 1.0;
+  uint32_t m_queriesPerSet  = 0;
+
+  std::vector<QuerySet> m_sets;
+  uint64_t m_frame        = 0;
+  uint32_t m_currentSet   = 0;
+  bool     m_frameOpen    = false;
+  std::vector<uint32_t> m_openScopes; // records of the current set
+
+  std::vector<std::string> m_scopeNames;
+  std::vector<uint32_t>    m_scopeDepths;
+  std::vector<uint64_t>    m_results;
+
+  // ring of the last read back frames
+  std::vector<FrameTimings> m_history;
+  uint32_t m_historySize  = 0;
+  uint32_t m_historyNext  = 0;
+  uint32_t m_historyCount = 0;
+
+  std::vector<ScopeStats> m_stats;
+  bool m_statsDirty = true;
+};
+
+#endif// VK_GRAPHICS_BASIC_GPU_PROFILER_H
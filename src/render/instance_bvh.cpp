@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <limits>
+
+#include "instance_bvh.h"
+
+using LiteMath::float3;
+using LiteMath::float4;
+
+static inline float HalfArea(const float3 &a_min, const float3 &a_max)
+{
+  const float3 d = LiteMath::max(a_max - a_min, float3(0.0f, 0.0f, 0.0f));
+  return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+struct BinBounds
+{
+  float3 boxMin = float3(+std::numeric_limits<float>::infinity());
+  float3 boxMax = float3(-std::numeric_limits<float>::infinity());
+  uint32_t count = 0;
+
+  void Include(const float3 &a_min, const float3 &a_max)
+  {
+    boxMin = LiteMath::min(boxMin, a_min);
+    boxMax = LiteMath::max(boxMax, a_max);
+  }
+  void Include(const BinBounds &a_other)
+  {
+    boxMin = LiteMath::min(boxMin, a_other.boxMin);
+    boxMax = LiteMath::max(boxMax, a_other.boxMax);
+    count += a_other.count;
+  }
+};
+
+void InstanceBvh::Clear()
+{
+  m_nodes.clear();
+  m_ids.clear();
+  m_boxes.clear();
+}
+
+void InstanceBvh::Build(const LiteMath::Box4f *a_boxes, uint32_t a_boxesNum)
+{
+  Clear();
+  if(a_boxesNum == 0)
+    return;
+
+  // boxes are partitioned in place together with their ids, so that every node reads a contiguous range
+  struct Prim
+  {
+    float3 boxMin;
+    float3 boxMax;
+    float3 center;
+    uint32_t id;
+  };
+  std::vector<Prim> prims(a_boxesNum);
+  for(uint32_t i = 0; i < a_boxesNum; ++i)
+  {
+    prims[i].boxMin = LiteMath::to_float3(a_boxes[i].boxMin);
+    prims[i].boxMax = LiteMath::to_float3(a_boxes[i].boxMax);
+    prims[i].center = 0.5f * (prims[i].boxMin + prims[i].boxMax);
+    prims[i].id     = i;
+  }
+
+  auto setBounds = [](Node &a_node, const BinBounds &a_bounds) {
+    for(int k = 0; k < 3; ++k)
+    {
+      a_node.boxMin[k] = a_bounds.boxMin[k];
+      a_node.boxMax[k] = a_bounds.boxMax[k];
+    }
+  };
+  auto rangeBounds = [&](uint32_t a_first, uint32_t a_count) {
+    BinBounds bounds;
+    for(uint32_t i = a_first; i < a_first + a_count; ++i)
+      bounds.Include(prims[i].boxMin, prims[i].boxMax);
+    bounds.count = a_count;
+    return bounds;
+  };
+
+  m_nodes.reserve(2 * size_t(a_boxesNum) / MAX_LEAF_SIZE + 1);
+  m_nodes.push_back(Node{{}, 0u, {}, a_boxesNum, 0u});
+  setBounds(m_nodes[0], rangeBounds(0, a_boxesNum));
+
+  std::vector<uint32_t> stack = {0u};
+  while(!stack.empty())
+  {
+    const uint32_t nodeIdx = stack.back();
+    stack.pop_back();
+
+    const uint32_t first = m_nodes[nodeIdx].first;
+    const uint32_t count = m_nodes[nodeIdx].count;
+    if(count <= MAX_LEAF_SIZE)
+      continue;
+
+    BinBounds centerBounds;
+    for(uint32_t i = first; i < first + count; ++i)
+      centerBounds.Include(prims[i].center, prims[i].center);
+
+    // SAH cost of a split: area weighted box counts of both children (traversal cost is the same for all splits),
+    // the best split is taken even if it is worse than a leaf to keep leaves small
+    int bestAxis      = -1;
+    uint32_t bestBin  = 0;
+    float bestCost    = std::numeric_limits<float>::infinity();
+    BinBounds bestLeft, bestRight;
+
+    // boxes are binned along all axes in one pass
+    const float3 extent   = centerBounds.boxMax - centerBounds.boxMin;
+    const float3 binScale = float3(extent.x > 0.0f ? float(SAH_BINS) / extent.x : 0.0f,
+                                   extent.y > 0.0f ? float(SAH_BINS) / extent.y : 0.0f,
+                                   extent.z > 0.0f ? float(SAH_BINS) / extent.z : 0.0f);
+    BinBounds bins[3][SAH_BINS];
+    for(uint32_t i = first; i < first + count; ++i)
+    {
+      const Prim &prim = prims[i];
+      const float3 binPos = (prim.center - centerBounds.boxMin) * binScale;
+      for(int axis = 0; axis < 3; ++axis)
+      {
+        BinBounds &bin = bins[axis][std::min(SAH_BINS - 1, uint32_t(binPos[axis]))];
+        bin.Include(prim.boxMin, prim.boxMax);
+        bin.count++;
+      }
+    }
+
+    for(int axis = 0; axis < 3; ++axis)
+    {
+      if(!(extent[axis] > 0.0f))
+        continue;
+
+      BinBounds right[SAH_BINS];
+      for(uint32_t b = SAH_BINS - 1; b > 0; --b)
+      {
+        right[b] = b + 1 < SAH_BINS ? right[b + 1] : BinBounds();
+        right[b].Include(bins[axis][b]);
+      }
+
+      BinBounds left;
+      for(uint32_t b = 0; b + 1 < SAH_BINS; ++b)
+      {
+        left.Include(bins[axis][b]);
+        if(left.count == 0 || left.count == count)
+          continue;
+        const float cost = HalfArea(left.boxMin, left.boxMax) * float(left.count) +
+                           HalfArea(right[b + 1].boxMin, right[b + 1].boxMax) * float(right[b + 1].count);
+        if(cost < bestCost)
+        {
+          bestCost  = cost;
+          bestAxis  = axis;
+          bestBin   = b;
+          bestLeft  = left;
+          bestRight = right[b + 1];
+        }
+      }
+    }
+
+    Prim *begin = prims.data() + first;
+    Prim *end   = begin + count;
+    Prim *mid   = begin;
+    if(bestAxis >= 0)
+    {
+      mid = std::partition(begin, end, [&](const Prim &a_prim) {
+        return std::min(SAH_BINS - 1, uint32_t((a_prim.center[bestAxis] - centerBounds.boxMin[bestAxis]) * binScale[bestAxis])) <= bestBin;
+      });
+    }
+    // all centers coincide, boxes are split in halves
+    if(mid == begin || mid == end)
+    {
+      mid       = begin + count / 2;
+      bestLeft  = rangeBounds(first, count / 2);
+      bestRight = rangeBounds(first + count / 2, count - count / 2);
+    }
+
+    const uint32_t leftCount = uint32_t(mid - begin);
+    const uint32_t leftIdx   = (uint32_t)m_nodes.size();
+    m_nodes[nodeIdx].left = leftIdx;
+    m_nodes.push_back(Node{{}, first, {}, leftCount, 0u});
+    m_nodes.push_back(Node{{}, first + leftCount, {}, count - leftCount, 0u});
+    setBounds(m_nodes[leftIdx], bestLeft);
+    setBounds(m_nodes[leftIdx + 1], bestRight);
+
+    stack.push_back(leftIdx + 1);
+    stack.push_back(leftIdx);
+  }
+
+  m_ids.resize(a_boxesNum);
+  m_boxes.resize(a_boxesNum);
+  for(uint32_t i = 0; i < a_boxesNum; ++i)
+  {
+    m_ids[i]   = prims[i].id;
+    m_boxes[i] = a_boxes[prims[i].id];
+  }
+}
+
+void InstanceBvh::Refit(const LiteMath::Box4f *a_boxes)
+{
+  for(size_t i = 0; i < m_ids.size(); ++i)
+    m_boxes[i] = a_boxes[m_ids[i]];
+
+  // children are always stored after their parent
+  for(size_t n = m_nodes.size(); n-- > 0;)
+  {
+    Node &node = m_nodes[n];
+    BinBounds bounds;
+    if(node.left == 0)
+    {
+      for(uint32_t i = node.first; i < node.first + node.count; ++i)
+        bounds.Include(LiteMath::to_float3(m_boxes[i].boxMin), LiteMath::to_float3(m_boxes[i].boxMax));
+    }
+    else
+    {
+      for(uint32_t c = node.left; c < node.left + 2; ++c)
+        bounds.Include(float3(m_nodes[c].boxMin), float3(m_nodes[c].boxMax));
+    }
+    for(int k = 0; k < 3; ++k)
+    {
+      node.boxMin[k] = bounds.boxMin[k];
+      node.boxMax[k] = bounds.boxMax[k];
+    }
+  }
+}
+
+void InstanceBvh::QueryFrustum(const LiteMath::float4x4 &a_projView, std::vector<uint32_t> &a_ids) const
+{
+  if(m_nodes.empty())
+    return;
+
+  // clip planes (Gribb, Hartmann), near plane is taken for -w <= z so it works with both depth ranges
+  const float4 rows[4] = {a_projView.get_row(0), a_projView.get_row(1), a_projView.get_row(2), a_projView.get_row(3)};
+  const float4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                            rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2]};
+  constexpr uint32_t ALL_PLANES = (1u << 6) - 1;
+
+  // returns false if the box is outside of one of the planes in a_mask,
+  // planes that have the box completely on their inner side are removed from a_mask
+  auto testBox = [&](const float *a_min, const float *a_max, uint32_t &a_mask) {
+    for(uint32_t p = 0; p < 6; ++p)
+    {
+      if((a_mask & (1u << p)) == 0)
+        continue;
+      const float4 &pl = planes[p];
+      const float farthest = pl.x * (pl.x >= 0.0f ? a_max[0] : a_min[0]) + pl.y * (pl.y >= 0.0f ? a_max[1] : a_min[1]) +
+                             pl.z * (pl.z >= 0.0f ? a_max[2] : a_min[2]) + pl.w;
+      if(farthest < 0.0f)
+        return false;
+      const float nearest = pl.x * (pl.x >= 0.0f ? a_min[0] : a_max[0]) + pl.y * (pl.y >= 0.0f ? a_min[1] : a_max[1]) +
+                            pl.z * (pl.z >= 0.0f ? a_min[2] : a_max[2]) + pl.w;
+      if(nearest >= 0.0f)
+        a_mask &= ~(1u << p);
+    }
+    return true;
+  };
+
+  struct StackEntry
+  {
+    uint32_t node;
+    uint32_t planes;
+  };
+  std::vector<StackEntry> stack;
+  stack.reserve(64);
+  stack.push_back({0u, ALL_PLANES});
+
+  while(!stack.empty())
+  {
+    const StackEntry entry = stack.back();
+    stack.pop_back();
+
+    const Node &node = m_nodes[entry.node];
+    uint32_t mask = entry.planes;
+    if(!testBox(node.boxMin, node.boxMax, mask))
+      continue;
+
+    if(mask == 0)
+    {
+      a_ids.insert(a_ids.end(), m_ids.begin() + node.first, m_ids.begin() + node.first + node.count);
+      continue;
+    }
+
+    if(node.left != 0)
+    {
+      stack.push_back({node.left + 1, mask});
+      stack.push_back({node.left, mask});
+      continue;
+    }
+
+    for(uint32_t i = node.first; i < node.first + node.count; ++i)
+    {
+      uint32_t boxMask = mask;
+      if(testBox(m_boxes[i].boxMin.M, m_boxes[i].boxMax.M, boxMask))
+        a_ids.push_back(m_ids[i]);
+    }
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef VK_GRAPHICS_BASIC_INSTANCE_BVH_H
+#define VK_GRAPHICS_BASIC_INSTANCE_BVH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "LiteMath.h"
+
+// Bounding volume hierarchy over world space boxes of scene instances, used for hierarchical frustum culling.
+// Built top-down with the surface area heuristic evaluated over binned box centroids.
+// Moved boxes are handled by refitting node bounds with the same topology, which stays correct
+// but loses quality when boxes move far, so the tree should be rebuilt after big changes.
+//
+class InstanceBvh
+{
+public:
+  void Build(const LiteMath::Box4f *a_boxes, uint32_t a_boxesNum);
+  // a_boxes must contain the same number of boxes as were used to build the tree
+  void Refit(const LiteMath::Box4f *a_boxes);
+  void Clear();
+
+  // appends ids of boxes that intersect view frustum of a_projView (clip space -w <= x, y, z <= w),
+  // subtrees that are completely inside of the frustum are appended without testing their boxes
+  void QueryFrustum(const LiteMath::float4x4 &a_projView, std::vector<uint32_t> &a_ids) const;
+
+  uint32_t BoxesNum() const { return (uint32_t)m_ids.size(); }
+  uint32_t NodesNum() const { return (uint32_t)m_nodes.size(); }
+
+  static constexpr uint32_t MAX_LEAF_SIZE = 4;
+  static constexpr uint32_t SAH_BINS      = 16;
+
+private:
+  // every node covers boxes m_ids[first, first + count), children of inner nodes are stored next to each other
+  // after their parent, so nodes can be refitted in reverse order
+  struct Node
+  {
+    float boxMin[3];
+    uint32_t first;
+    float boxMax[3];
+    uint32_t count;
+    uint32_t left; // 0 for leaves, right child is left + 1
+  };
+
+  std::vector<Node> m_nodes;
+  std::vector<uint32_t> m_ids;
+  std::vector<LiteMath::Box4f> m_boxes; // boxes in m_ids order
+};
+
+#endif// VK_GRAPHICS_BASIC_INSTANCE_BVH_H
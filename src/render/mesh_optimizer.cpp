@@ -0,0 +1,525 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "mesh_optimizer.h"
+#include "../utils/parallel_for.h"
+
+namespace mesh_optimizer
+{
+  CacheStats AnalyzeVertexCache(const uint32_t *a_indices, size_t a_indNum, uint32_t a_vertNum, uint32_t a_cacheSize)
+  {
+    CacheStats res;
+    if(a_indNum < 3)
+      return res;
+
+    // vertex is in the FIFO if it was pushed less than a_cacheSize pushes ago
+    std::vector<uint32_t> pushedAt(a_vertNum, 0u);
+    uint32_t pushes     = a_cacheSize + 1;
+    uint32_t referenced = 0;
+    for(size_t i = 0; i < a_indNum; ++i)
+    {
+      const uint32_t v = a_indices[i];
+      assert(v < a_vertNum);
+      if(pushedAt[v] == 0)
+        referenced++;
+      if(pushes - pushedAt[v] > a_cacheSize)
+      {
+        pushedAt[v] = pushes++;
+        res.transformed++;
+      }
+    }
+
+    res.acmr = float(res.transformed) / float(a_indNum / 3);
+    res.atvr = float(res.transformed) / float(referenced);
+    return res;
+  }
+
+  uint32_t WeldVertices(const std::vector<VertexStream> &a_streams, uint32_t a_vertNum, std::vector<uint32_t> &a_remap)
+  {
+    auto hashVertex = [&](uint32_t v) {
+      uint32_t hash = 2166136261u;
+      for(const auto &stream : a_streams)
+      {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(stream.data + size_t(v) * stream.components);
+        for(size_t i = 0; i < stream.components * sizeof(float); ++i)
+          hash = (hash ^ bytes[i]) * 16777619u;
+      }
+      return hash;
+    };
+    auto equalVertices = [&](uint32_t a, uint32_t b) {
+      for(const auto &stream : a_streams)
+      {
+        const size_t size = stream.components * sizeof(float);
+        if(memcmp(stream.data + size_t(a) * stream.components, stream.data + size_t(b) * stream.components, size) != 0)
+          return false;
+      }
+      return true;
+    };
+
+    // open addressing table of vertex ids, power of two size with load factor below 0.5
+    size_t tableSize = 1;
+    while(tableSize < size_t(a_vertNum) * 2)
+      tableSize *= 2;
+    std::vector<uint32_t> table(tableSize, UINT32_MAX);
+
+    a_remap.resize(a_vertNum);
+    uint32_t uniqueNum = 0;
+    for(uint32_t v = 0; v < a_vertNum; ++v)
+    {
+      size_t slot = hashVertex(v) & (tableSize - 1);
+      while(table[slot] != UINT32_MAX && !equalVertices(table[slot], v))
+        slot = (slot + 1) & (tableSize - 1);
+
+      if(table[slot] == UINT32_MAX)
+      {
+        table[slot] = v;
+        a_remap[v]  = uniqueNum++;
+      }
+      else
+        a_remap[v] = a_remap[table[slot]];
+    }
+
+    return uniqueNum;
+  }
+
+  void ReorderTriangles(uint32_t *a_indices, size_t a_indNum, const std::vector<uint32_t> &a_order)
+  {
+    std::vector<uint32_t> src(a_indices, a_indices + a_indNum);
+    for(size_t t = 0; t < a_order.size(); ++t)
+      memcpy(a_indices + t * 3, src.data() + size_t(a_order[t]) * 3, 3 * sizeof(uint32_t));
+  }
+
+  // Forsyth, "Linear-Speed Vertex Cache Optimisation":
+  // greedily emits the triangle with the best score, vertex scores favor recently used vertices
+  // and vertices with few remaining triangles. Returns new triangle order.
+  static std::vector<uint32_t> VertexCacheOrder(const uint32_t *a_indices, size_t a_indNum, uint32_t a_vertNum)
+  {
+    constexpr int   CACHE_SIZE        = 32;
+    constexpr float CACHE_DECAY_POWER = 1.5f;
+    constexpr float LAST_TRI_SCORE    = 0.75f;
+    constexpr float VALENCE_SCALE     = 2.0f;
+    constexpr float VALENCE_POWER     = 0.5f;
+    constexpr uint32_t MAX_VALENCE    = 64;
+
+    static const auto tables = []() {
+      std::pair<std::array<float, CACHE_SIZE>, std::array<float, MAX_VALENCE>> res;
+      for(int i = 0; i < CACHE_SIZE; ++i)
+      {
+        res.first[i] = i < 3 ? LAST_TRI_SCORE :
+          std::pow(1.0f - float(i - 3) / float(CACHE_SIZE - 3), CACHE_DECAY_POWER);
+      }
+      res.second[0] = 0.0f;
+      for(uint32_t i = 1; i < MAX_VALENCE; ++i)
+        res.second[i] = VALENCE_SCALE * std::pow(float(i), -VALENCE_POWER);
+      return res;
+    }();
+    const auto &cacheScores   = tables.first;
+    const auto &valenceScores = tables.second;
+
+    const uint32_t trisNum = uint32_t(a_indNum / 3);
+
+    // triangles adjacent to each vertex, live ones are kept in front
+    std::vector<uint32_t> liveTris(a_vertNum, 0u);
+    for(size_t i = 0; i < a_indNum; ++i)
+      liveTris[a_indices[i]]++;
+    std::vector<uint32_t> adjOffsets(a_vertNum + 1, 0u);
+    for(uint32_t v = 0; v < a_vertNum; ++v)
+      adjOffsets[v + 1] = adjOffsets[v] + liveTris[v];
+    std::vector<uint32_t> adjTris(a_indNum);
+    {
+      std::vector<uint32_t> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+      for(size_t i = 0; i < a_indNum; ++i)
+        adjTris[fill[a_indices[i]]++] = uint32_t(i / 3);
+    }
+
+    std::vector<int> cachePos(a_vertNum, -1);
+    auto vertexScore = [&](uint32_t v) {
+      if(liveTris[v] == 0)
+        return -1.0f;
+      const float cacheScore = cachePos[v] >= 0 ? cacheScores[cachePos[v]] : 0.0f;
+      return cacheScore + valenceScores[std::min(liveTris[v], MAX_VALENCE - 1)];
+    };
+
+    std::vector<float> vertScores(a_vertNum);
+    for(uint32_t v = 0; v < a_vertNum; ++v)
+      vertScores[v] = vertexScore(v);
+    std::vector<float> triScores(trisNum);
+    for(uint32_t t = 0; t < trisNum; ++t)
+      triScores[t] = vertScores[a_indices[t * 3 + 0]] + vertScores[a_indices[t * 3 + 1]] + vertScores[a_indices[t * 3 + 2]];
+
+    std::vector<bool> emitted(trisNum, false);
+    std::vector<uint32_t> order;
+    order.reserve(trisNum);
+
+    std::vector<uint32_t> cache, newCache;
+    cache.reserve(CACHE_SIZE + 3);
+    newCache.reserve(CACHE_SIZE + 3);
+
+    uint32_t bestTri   = 0;
+    uint32_t nextInput = 0; // restart point when cache has no candidates
+    while(order.size() < trisNum)
+    {
+      if(bestTri == UINT32_MAX)
+      {
+        while(emitted[nextInput])
+          nextInput++;
+        bestTri = nextInput;
+      }
+
+      order.push_back(bestTri);
+      emitted[bestTri] = true;
+
+      // emitted triangle goes to the front of the LRU cache
+      newCache.clear();
+      for(int k = 0; k < 3; ++k)
+      {
+        const uint32_t v = a_indices[bestTri * 3 + k];
+        if(std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+          newCache.push_back(v);
+
+        uint32_t *adj = adjTris.data() + adjOffsets[v];
+        auto it = std::find(adj, adj + liveTris[v], bestTri);
+        assert(it != adj + liveTris[v]);
+        std::swap(*it, adj[liveTris[v] - 1]);
+        liveTris[v]--;
+      }
+      for(uint32_t v : cache)
+      {
+        if(std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+          newCache.push_back(v);
+      }
+
+      // vertices pushed out of the cache lose cache score
+      for(size_t i = CACHE_SIZE; i < newCache.size(); ++i)
+        cachePos[newCache[i]] = -1;
+      if(newCache.size() > CACHE_SIZE)
+        newCache.resize(CACHE_SIZE);
+      for(size_t i = 0; i < newCache.size(); ++i)
+        cachePos[newCache[i]] = int(i);
+
+      auto updateVertex = [&](uint32_t v) {
+        const float score = vertexScore(v);
+        const float delta = score - vertScores[v];
+        vertScores[v] = score;
+        const uint32_t *adj = adjTris.data() + adjOffsets[v];
+        for(uint32_t i = 0; i < liveTris[v]; ++i)
+          triScores[adj[i]] += delta;
+      };
+      for(uint32_t v : cache) // vertices pushed out are always from the old cache
+      {
+        if(cachePos[v] < 0)
+          updateVertex(v);
+      }
+      for(uint32_t v : newCache)
+        updateVertex(v);
+
+      // next triangle is searched only among triangles of cached vertices
+      bestTri = UINT32_MAX;
+      float bestScore = -1.0f;
+      for(uint32_t v : newCache)
+      {
+        const uint32_t *adj = adjTris.data() + adjOffsets[v];
+        for(uint32_t i = 0; i < liveTris[v]; ++i)
+        {
+          if(triScores[adj[i]] > bestScore)
+          {
+            bestScore = triScores[adj[i]];
+            bestTri   = adj[i];
+          }
+        }
+      }
+
+      std::swap(cache, newCache);
+    }
+
+    return order;
+  }
+
+  void OptimizeVertexCache(uint32_t *a_indices, size_t a_indNum, uint32_t a_vertNum)
+  {
+    ReorderTriangles(a_indices, a_indNum, VertexCacheOrder(a_indices, a_indNum, a_vertNum));
+  }
+
+  // Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw":
+  // cache optimized sequence is split into clusters that barely change ACMR when drawn in any order,
+  // clusters facing outwards from the mesh center are drawn first, so they occlude the rest.
+  static std::vector<uint32_t> OverdrawOrder(const uint32_t *a_indices, size_t a_indNum, const float *a_pos4f,
+    uint32_t a_vertNum, float a_threshold)
+  {
+    const uint32_t trisNum = uint32_t(a_indNum / 3);
+
+    std::vector<uint32_t> pushedAt(a_vertNum, 0u);
+    uint32_t pushes = 0;
+    auto resetCache = [&]() { pushes += STATS_CACHE_SIZE + 1; };
+    auto triMisses  = [&](uint32_t t) {
+      uint32_t misses = 0;
+      for(int k = 0; k < 3; ++k)
+      {
+        const uint32_t v = a_indices[t * 3 + k];
+        if(pushes - pushedAt[v] > STATS_CACHE_SIZE)
+        {
+          pushedAt[v] = pushes++;
+          misses++;
+        }
+      }
+      return misses;
+    };
+
+    // hard boundaries: triangles not sharing anything with the cache contents, i.e. where the cache restarts
+    std::vector<uint32_t> hardStarts;
+    resetCache();
+    for(uint32_t t = 0; t < trisNum; ++t)
+    {
+      if(triMisses(t) == 3)
+        hardStarts.push_back(t);
+    }
+    hardStarts.push_back(trisNum);
+
+    // soft boundaries: split hard clusters wherever running ACMR is already close to ACMR of the whole cluster
+    std::vector<uint32_t> clusterStarts;
+    for(size_t h = 0; h + 1 < hardStarts.size(); ++h)
+    {
+      const uint32_t start = hardStarts[h];
+      const uint32_t end   = hardStarts[h + 1];
+
+      resetCache();
+      uint32_t clusterMisses = 0;
+      for(uint32_t t = start; t < end; ++t)
+        clusterMisses += triMisses(t);
+      const float clusterThreshold = a_threshold * float(clusterMisses) / float(end - start);
+
+      resetCache();
+      clusterStarts.push_back(start);
+      uint32_t runningMisses = 0, runningTris = 0;
+      for(uint32_t t = start; t < end; ++t)
+      {
+        runningMisses += triMisses(t);
+        runningTris++;
+        if(t + 1 < end && float(runningMisses) / float(runningTris) <= clusterThreshold)
+        {
+          clusterStarts.push_back(t + 1);
+          resetCache();
+          runningMisses = 0;
+          runningTris   = 0;
+        }
+      }
+    }
+    const uint32_t clustersNum = uint32_t(clusterStarts.size());
+    clusterStarts.push_back(trisNum);
+
+    // area weighted centroid and normal of every cluster
+    auto pos = [&](uint32_t v) { return a_pos4f + size_t(v) * 4; };
+    std::vector<float> clusterCenters(size_t(clustersNum) * 3, 0.0f);
+    std::vector<float> clusterNormals(size_t(clustersNum) * 3, 0.0f);
+    float meshCenter[3] = {0.0f, 0.0f, 0.0f};
+    float meshArea      = 0.0f;
+    for(uint32_t c = 0; c < clustersNum; ++c)
+    {
+      float center[3] = {0.0f, 0.0f, 0.0f};
+      float normal[3] = {0.0f, 0.0f, 0.0f};
+      float area      = 0.0f;
+      for(uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+      {
+        const float *p0 = pos(a_indices[t * 3 + 0]);
+        const float *p1 = pos(a_indices[t * 3 + 1]);
+        const float *p2 = pos(a_indices[t * 3 + 2]);
+        const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        const float n[3]  = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        const float triArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        for(int k = 0; k < 3; ++k)
+        {
+          center[k] += (p0[k] + p1[k] + p2[k]) * (triArea / 3.0f);
+          normal[k] += n[k];
+        }
+        area += triArea;
+      }
+
+      const float invArea = area == 0.0f ? 0.0f : 1.0f / area;
+      const float normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+      const float invNormalLength = normalLength == 0.0f ? 0.0f : 1.0f / normalLength;
+      for(int k = 0; k < 3; ++k)
+      {
+        meshCenter[k] += center[k];
+        clusterCenters[c * 3 + k] = center[k] * invArea;
+        clusterNormals[c * 3 + k] = normal[k] * invNormalLength;
+      }
+      meshArea += area;
+    }
+    for(int k = 0; k < 3; ++k)
+      meshCenter[k] = meshArea == 0.0f ? 0.0f : meshCenter[k] / meshArea;
+
+    std::vector<float> sortKeys(clustersNum);
+    for(uint32_t c = 0; c < clustersNum; ++c)
+    {
+      sortKeys[c] = 0.0f;
+      for(int k = 0; k < 3; ++k)
+        sortKeys[c] += (clusterCenters[c * 3 + k] - meshCenter[k]) * clusterNormals[c * 3 + k];
+    }
+
+    std::vector<uint32_t> clusterOrder(clustersNum);
+    std::iota(clusterOrder.begin(), clusterOrder.end(), 0u);
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(),
+      [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> order;
+    order.reserve(trisNum);
+    for(uint32_t c : clusterOrder)
+    {
+      for(uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+        order.push_back(t);
+    }
+    return order;
+  }
+
+  void OptimizeOverdraw(uint32_t *a_indices, size_t a_indNum, const float *a_pos4f, uint32_t a_vertNum, float a_threshold)
+  {
+    ReorderTriangles(a_indices, a_indNum, OverdrawOrder(a_indices, a_indNum, a_pos4f, a_vertNum, a_threshold));
+  }
+
+  uint32_t OptimizeVertexFetch(uint32_t *a_indices, size_t a_indNum, uint32_t a_vertNum, std::vector<uint32_t> &a_remap)
+  {
+    a_remap.assign(a_vertNum, UINT32_MAX);
+    uint32_t usedNum = 0;
+    for(size_t i = 0; i < a_indNum; ++i)
+    {
+      uint32_t &newIdx = a_remap[a_indices[i]];
+      if(newIdx == UINT32_MAX)
+        newIdx = usedNum++;
+      a_indices[i] = newIdx;
+    }
+    return usedNum;
+  }
+
+  Result Optimize(const MeshInput &a_mesh, const Settings &a_settings)
+  {
+    assert(a_mesh.pos4f != nullptr && a_mesh.indices != nullptr);
+    assert(a_mesh.indNum % 3 == 0);
+
+    Result res;
+    res.indices.assign(a_mesh.indices, a_mesh.indices + a_mesh.indNum);
+    res.vertices.resize(a_mesh.vertNum);
+    std::iota(res.vertices.begin(), res.vertices.end(), 0u);
+    res.triangleOrder.resize(a_mesh.indNum / 3);
+    std::iota(res.triangleOrder.begin(), res.triangleOrder.end(), 0u);
+    res.before = AnalyzeVertexCache(a_mesh.indices, a_mesh.indNum, a_mesh.vertNum);
+
+    uint32_t vertNum = a_mesh.vertNum;
+    std::vector<uint32_t> remap;
+
+    if(a_settings.weld)
+    {
+      std::vector<VertexStream> streams;
+      if(a_mesh.weldKey != nullptr)
+        streams.push_back({a_mesh.weldKey, a_mesh.weldKeyComponents});
+      else
+      {
+        streams.push_back({a_mesh.pos4f, 4});
+        if(a_mesh.norm4f != nullptr)
+          streams.push_back({a_mesh.norm4f, 4});
+        if(a_mesh.tang4f != nullptr)
+          streams.push_back({a_mesh.tang4f, 4});
+        if(a_mesh.texcoord2f != nullptr)
+          streams.push_back({a_mesh.texcoord2f, 2});
+      }
+
+      vertNum = WeldVertices(streams, a_mesh.vertNum, remap);
+      if(vertNum != a_mesh.vertNum)
+      {
+        std::vector<uint32_t> welded(vertNum);
+        for(uint32_t v = a_mesh.vertNum; v-- > 0;)
+          welded[remap[v]] = v; // first copy of every vertex is kept
+        res.vertices = std::move(welded);
+        for(auto &idx : res.indices)
+          idx = remap[idx];
+      }
+    }
+
+    auto applyOrder = [&](const std::vector<uint32_t> &order) {
+      ReorderTriangles(res.indices.data(), res.indices.size(), order);
+      std::vector<uint32_t> triangleOrder(order.size());
+      for(size_t t = 0; t < order.size(); ++t)
+        triangleOrder[t] = res.triangleOrder[order[t]];
+      res.triangleOrder = std::move(triangleOrder);
+    };
+
+    if(a_settings.vertexCache)
+      applyOrder(VertexCacheOrder(res.indices.data(), res.indices.size(), vertNum));
+
+    if(a_settings.overdraw)
+    {
+      std::vector<float> positions(size_t(vertNum) * 4);
+      for(uint32_t v = 0; v < vertNum; ++v)
+        memcpy(positions.data() + size_t(v) * 4, a_mesh.pos4f + size_t(res.vertices[v]) * 4, 4 * sizeof(float));
+      applyOrder(OverdrawOrder(res.indices.data(), res.indices.size(), positions.data(), vertNum, a_settings.overdrawThreshold));
+    }
+
+    if(a_settings.vertexFetch)
+    {
+      const uint32_t usedNum = OptimizeVertexFetch(res.indices.data(), res.indices.size(), vertNum, remap);
+      std::vector<uint32_t> vertices(usedNum);
+      for(uint32_t v = 0; v < vertNum; ++v)
+      {
+        if(remap[v] != UINT32_MAX)
+          vertices[remap[v]] = res.vertices[v];
+      }
+      res.vertices = std::move(vertices);
+      vertNum      = usedNum;
+    }
+
+    res.after = AnalyzeVertexCache(res.indices.data(), res.indices.size(), vertNum);
+    return res;
+  }
+
+  std::vector<Result> OptimizeBatch(uint32_t a_meshesNum, const std::function<MeshInput(uint32_t)> &a_getMesh,
+    const Settings &a_settings, uint32_t a_threadsNum)
+  {
+    std::vector<Result> res(a_meshesNum);
+    ParallelFor(a_meshesNum, a_threadsNum, [&](uint32_t i) { res[i] = Optimize(a_getMesh(i), a_settings); });
+    return res;
+  }
+
+  MeshInput MakeInput(const cmesh::SimpleMesh &a_mesh)
+  {
+    MeshInput res;
+    res.pos4f      = a_mesh.vPos4f.data();
+    res.norm4f     = a_mesh.vNorm4f.empty() ? nullptr : a_mesh.vNorm4f.data();
+    res.tang4f     = a_mesh.vTang4f.empty() ? nullptr : a_mesh.vTang4f.data();
+    res.texcoord2f = a_mesh.vTexCoord2f.empty() ? nullptr : a_mesh.vTexCoord2f.data();
+    res.indices    = a_mesh.indices.data();
+    res.vertNum    = uint32_t(a_mesh.VerticesNum());
+    res.indNum     = uint32_t(a_mesh.IndicesNum());
+    return res;
+  }
+
+  cmesh::SimpleMesh ApplyResult(const Result &a_result, const cmesh::SimpleMesh &a_mesh)
+  {
+    auto gather = [&](const std::vector<float> &src, std::vector<float> &dst, size_t components) {
+      if(src.empty())
+        return;
+      dst.resize(a_result.vertices.size() * components);
+      for(size_t v = 0; v < a_result.vertices.size(); ++v)
+        memcpy(dst.data() + v * components, src.data() + a_result.vertices[v] * components, components * sizeof(float));
+    };
+
+    cmesh::SimpleMesh res;
+    gather(a_mesh.vPos4f, res.vPos4f, 4);
+    gather(a_mesh.vNorm4f, res.vNorm4f, 4);
+    gather(a_mesh.vTang4f, res.vTang4f, 4);
+    gather(a_mesh.vTexCoord2f, res.vTexCoord2f, 2);
+    res.indices.assign(a_result.indices.begin(), a_result.indices.end());
+
+    if(!a_mesh.matIndices.empty())
+    {
+      res.matIndices.resize(a_result.triangleOrder.size());
+      for(size_t t = 0; t < a_result.triangleOrder.size(); ++t)
+        res.matIndices[t] = a_mesh.matIndices[a_result.triangleOrder[t]];
+    }
+    return res;
+  }
+}
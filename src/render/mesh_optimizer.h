@@ -0,0 +1,101 @@
+#ifndef VK_GRAPHICS_BASIC_MESH_OPTIMIZER_H
+#define VK_GRAPHICS_BASIC_MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <geom/cmesh.h>
+
+// CPU side optimization of indexed triangle meshes for vertex processing:
+// vertex welding, post-transform vertex cache ordering (Forsyth), overdraw-aware ordering of triangle clusters
+// (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw") and vertex fetch ordering.
+// Functions are thread safe, OptimizeBatch processes several meshes in parallel.
+//
+namespace mesh_optimizer
+{
+  // vertex cache efficiency measured with a FIFO cache:
+  // ACMR - transformed vertices per triangle (0.5 at best, 3 at worst),
+  // ATVR - transformed vertices per referenced vertex (1 at best)
+  struct CacheStats
+  {
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+    uint64_t transformed = 0;
+  };
+
+  constexpr uint32_t STATS_CACHE_SIZE = 16;
+
+  CacheStats AnalyzeVertexCache(const uint32_t *a_indices, size_t a_indNum, uint32_t a_vertNum,
+    uint32_t a_cacheSize = STATS_CACHE_SIZE);
+
+  // one attribute stream of a mesh, vertices are merged only if all of their streams are bitwise equal
+  struct VertexStream
+  {
+    const float *data   = nullptr;
+    uint32_t components = 0; // floats per vertex
+  };
+
+  // a_remap[i] receives new index of vertex i, returns number of unique vertices
+  uint32_t WeldVertices(const std::vector<VertexStream> &a_streams, uint32_t a_vertNum, std::vector<uint32_t> &a_remap);
+
+  // new triangle i is triangle a_order[i]
+  void ReorderTriangles(uint32_t *a_indices, size_t a_indNum, const std::vector<uint32_t> &a_order);
+
+  // reorder triangles in place
+  void OptimizeVertexCache(uint32_t *a_indices, size_t a_indNum, uint32_t a_vertNum);
+  void OptimizeOverdraw(uint32_t *a_indices, size_t a_indNum, const float *a_pos4f, uint32_t a_vertNum,
+    float a_threshold = 1.05f);
+
+  // renumbers vertices in order of first use, a_remap[i] receives new index of vertex i (UINT32_MAX if unused),
+  // returns number of used vertices
+  uint32_t OptimizeVertexFetch(uint32_t *a_indices, size_t a_indNum, uint32_t a_vertNum, std::vector<uint32_t> &a_remap);
+
+  struct MeshInput
+  {
+    const float *pos4f      = nullptr;
+    const float *norm4f     = nullptr; // optional
+    const float *tang4f     = nullptr; // optional
+    const float *texcoord2f = nullptr; // optional
+    const uint32_t *indices = nullptr;
+    uint32_t vertNum = 0;
+    uint32_t indNum  = 0;
+
+    // optional vertices in the format they are drawn with (e.g. with quantized normals),
+    // if set, welding compares them instead of the attributes above
+    const float *weldKey       = nullptr;
+    uint32_t weldKeyComponents = 0;
+  };
+
+  struct Settings
+  {
+    bool weld        = true;
+    bool vertexCache = true;
+    bool overdraw    = true;
+    bool vertexFetch = true;
+    float overdrawThreshold = 1.05f; // allowed ACMR growth when splitting triangles into clusters
+  };
+
+  struct Result
+  {
+    std::vector<uint32_t> indices;       // refer to new vertices
+    std::vector<uint32_t> vertices;      // new vertex i is input vertex vertices[i]
+    std::vector<uint32_t> triangleOrder; // new triangle i is input triangle triangleOrder[i]
+    CacheStats before;
+    CacheStats after;
+  };
+
+  // runs all enabled steps, input is not modified
+  Result Optimize(const MeshInput &a_mesh, const Settings &a_settings = Settings());
+
+  // optimizes a_meshesNum meshes returned by a_getMesh on a_threadsNum threads (0 - all hardware threads)
+  std::vector<Result> OptimizeBatch(uint32_t a_meshesNum, const std::function<MeshInput(uint32_t)> &a_getMesh,
+    const Settings &a_settings = Settings(), uint32_t a_threadsNum = 0);
+
+  MeshInput MakeInput(const cmesh::SimpleMesh &a_mesh);
+  // returns a_mesh with vertices, indices and material indices reordered according to a_result
+  cmesh::SimpleMesh ApplyResult(const Result &a_result, const cmesh::SimpleMesh &a_mesh);
+}
+
+#endif// VK_GRAPHICS_BASIC_MESH_OPTIMIZER_H
@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "mesh_simplifier.h"
+#include "mesh_optimizer.h"
+
+namespace mesh_simplifier
+{
+  using LiteMath::float3;
+
+  // symmetric 4x4 matrix of summed squared distances to weighted planes
+  struct Quadric
+  {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+
+    void AddPlane(const float3 &n, float d, double w)
+    {
+      a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+      a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+      a22 += w * n.z * n.z; a23 += w * n.z * d;
+      a33 += w * d * d;
+      weight += w;
+    }
+
+    void Add(const Quadric &q)
+    {
+      a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+      a11 += q.a11; a12 += q.a12; a13 += q.a13;
+      a22 += q.a22; a23 += q.a23;
+      a33 += q.a33;
+      weight += q.weight;
+    }
+
+    // root mean square distance from p to the planes
+    float Error(const float3 &p) const
+    {
+      const double x = p.x, y = p.y, z = p.z;
+      const double r = a00 * x * x + 2.0 * (a01 * x * y + a02 * x * z + a03 * x) +
+                       a11 * y * y + 2.0 * (a12 * y * z + a13 * y) +
+                       a22 * z * z + 2.0 * a23 * z + a33;
+      return weight > 0.0 ? float(std::sqrt(std::max(r, 0.0) / weight)) : 0.0f;
+    }
+  };
+
+  enum class VertexKind : uint8_t
+  {
+    MANIFOLD, // may move to any neighbour
+    BORDER,   // lies on an open border, may move along it only
+    LOCKED    // has non-manifold edges
+  };
+
+  static inline uint64_t EdgeKey(uint32_t a, uint32_t b)
+  {
+    return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+  }
+
+  static inline float3 TriNormal(const float3 &p0, const float3 &p1, const float3 &p2)
+  {
+    return LiteMath::cross(p1 - p0, p2 - p0);
+  }
+
+  struct Collapse
+  {
+    uint32_t from;
+    uint32_t to;
+    float error;
+  };
+
+  // squared distance between attributes of two vertices
+  static float AttributeDistance(const mesh_optimizer::MeshInput &a_mesh, uint32_t a, uint32_t b)
+  {
+    float res = 0.0f;
+    if(a_mesh.norm4f != nullptr)
+    {
+      const float3 d = float3(a_mesh.norm4f + size_t(a) * 4) - float3(a_mesh.norm4f + size_t(b) * 4);
+      res += LiteMath::dot(d, d);
+    }
+    if(a_mesh.texcoord2f != nullptr)
+    {
+      const float du = a_mesh.texcoord2f[size_t(a) * 2 + 0] - a_mesh.texcoord2f[size_t(b) * 2 + 0];
+      const float dv = a_mesh.texcoord2f[size_t(a) * 2 + 1] - a_mesh.texcoord2f[size_t(b) * 2 + 1];
+      res += du * du + dv * dv;
+    }
+    return res;
+  }
+
+  std::vector<uint32_t> Simplify(const mesh_optimizer::MeshInput &a_mesh, size_t a_targetIndNum, float a_targetError,
+    float *a_resultError)
+  {
+    const uint32_t *a_indices = a_mesh.indices;
+    const size_t a_indNum     = a_mesh.indNum;
+    const float *a_pos4f      = a_mesh.pos4f;
+    const uint32_t a_vertNum  = a_mesh.vertNum;
+    assert(a_indNum % 3 == 0);
+
+    // topology is built over positions, vertices differing only by attributes are wedges of one position
+    std::vector<uint32_t> posIds;
+    const uint32_t posNum = mesh_optimizer::WeldVertices({{a_pos4f, 4}}, a_vertNum, posIds);
+    std::vector<float3> positions(posNum);
+    for(uint32_t v = 0; v < a_vertNum; ++v)
+      positions[posIds[v]] = float3(a_pos4f + size_t(v) * 4);
+
+    std::vector<Quadric> quadrics(posNum);
+    std::vector<uint32_t> result(a_indices, a_indices + a_indNum);
+    std::vector<uint32_t> wedgeRemap(a_vertNum);
+    for(uint32_t v = 0; v < a_vertNum; ++v)
+      wedgeRemap[v] = v;
+
+    // border edges are kept in place by planes orthogonal to their triangles
+    constexpr float BORDER_WEIGHT = 10.0f;
+    std::vector<uint64_t> edges;
+    std::vector<std::pair<uint64_t, uint32_t>> edgeCounts;
+    auto countEdges = [&]() {
+      edges.clear();
+      for(size_t t = 0; t < result.size(); t += 3)
+      {
+        const uint32_t a = posIds[result[t + 0]], b = posIds[result[t + 1]], c = posIds[result[t + 2]];
+        edges.push_back(EdgeKey(a, b));
+        edges.push_back(EdgeKey(b, c));
+        edges.push_back(EdgeKey(c, a));
+      }
+      std::sort(edges.begin(), edges.end());
+      edgeCounts.clear();
+      for(size_t i = 0; i < edges.size();)
+      {
+        size_t j = i;
+        while(j < edges.size() && edges[j] == edges[i])
+          ++j;
+        edgeCounts.emplace_back(edges[i], uint32_t(j - i));
+        i = j;
+      }
+    };
+    auto edgeCount = [&](uint32_t a, uint32_t b) {
+      const uint64_t key = EdgeKey(a, b);
+      auto it = std::lower_bound(edgeCounts.begin(), edgeCounts.end(), std::make_pair(key, 0u));
+      return (it != edgeCounts.end() && it->first == key) ? it->second : 0u;
+    };
+
+    countEdges();
+    for(size_t t = 0; t < result.size(); t += 3)
+    {
+      const uint32_t ids[3] = {posIds[result[t + 0]], posIds[result[t + 1]], posIds[result[t + 2]]};
+      const float3 p[3] = {positions[ids[0]], positions[ids[1]], positions[ids[2]]};
+      float3 n = TriNormal(p[0], p[1], p[2]);
+      const float area = LiteMath::length(n);
+      if(area == 0.0f)
+        continue;
+      n = n / area;
+      for(uint32_t k = 0; k < 3; ++k)
+        quadrics[ids[k]].AddPlane(n, -LiteMath::dot(n, p[0]), area);
+
+      for(uint32_t k = 0; k < 3; ++k)
+      {
+        const uint32_t a = ids[k], b = ids[(k + 1) % 3];
+        if(edgeCount(a, b) != 1)
+          continue;
+        const float3 edge = p[(k + 1) % 3] - p[k];
+        const float len   = LiteMath::length(edge);
+        if(len == 0.0f)
+          continue;
+        const float3 bn = LiteMath::normalize(LiteMath::cross(edge, n));
+        const double w  = double(len) * len * BORDER_WEIGHT;
+        quadrics[a].AddPlane(bn, -LiteMath::dot(bn, p[k]), w);
+        quadrics[b].AddPlane(bn, -LiteMath::dot(bn, p[k]), w);
+      }
+    }
+
+    std::vector<VertexKind> kinds(posNum);
+    std::vector<uint32_t> fanOffsets(posNum + 1), fanTris;
+    std::vector<uint8_t> locked(posNum);
+    std::vector<Collapse> collapses;
+    std::vector<std::pair<uint32_t, uint32_t>> partners;
+    std::vector<uint32_t> neighboursFrom, neighboursTo, targetWedges;
+    float maxError = 0.0f;
+
+    // attribute seams are kept while possible, then wedges without a counterpart are moved to the closest
+    // wedge of the target position, e.g. for flat shaded meshes where every triangle has its own vertices
+    bool keepSeams = true;
+
+    while(result.size() > a_targetIndNum)
+    {
+      std::fill(kinds.begin(), kinds.end(), VertexKind::MANIFOLD);
+      for(const auto &e : edgeCounts)
+      {
+        const uint32_t a = uint32_t(e.first >> 32), b = uint32_t(e.first);
+        const VertexKind kind = e.second == 1 ? VertexKind::BORDER : (e.second > 2 ? VertexKind::LOCKED : VertexKind::MANIFOLD);
+        kinds[a] = std::max(kinds[a], kind);
+        kinds[b] = std::max(kinds[b], kind);
+      }
+
+      // triangles around every position
+      std::fill(fanOffsets.begin(), fanOffsets.end(), 0u);
+      for(uint32_t idx : result)
+        fanOffsets[posIds[idx] + 1]++;
+      for(uint32_t p = 0; p < posNum; ++p)
+        fanOffsets[p + 1] += fanOffsets[p];
+      fanTris.resize(result.size());
+      {
+        std::vector<uint32_t> fill(fanOffsets.begin(), fanOffsets.end() - 1);
+        for(size_t i = 0; i < result.size(); ++i)
+          fanTris[fill[posIds[result[i]]]++] = uint32_t(i / 3);
+      }
+
+      collapses.clear();
+      for(const auto &e : edgeCounts)
+      {
+        const uint32_t a = uint32_t(e.first >> 32), b = uint32_t(e.first);
+        if(a == b)
+          continue;
+        auto allowed = [&](uint32_t from, uint32_t to) {
+          return kinds[from] == VertexKind::MANIFOLD ||
+                 (kinds[from] == VertexKind::BORDER && kinds[to] != VertexKind::MANIFOLD && e.second == 1);
+        };
+        const bool ab = allowed(a, b), ba = allowed(b, a);
+        if(!ab && !ba)
+          continue;
+        const float errAB = ab ? quadrics[a].Error(positions[b]) : INFINITY;
+        const float errBA = ba ? quadrics[b].Error(positions[a]) : INFINITY;
+        collapses.push_back(errAB <= errBA ? Collapse{a, b, errAB} : Collapse{b, a, errBA});
+      }
+      std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) { return x.error < y.error; });
+
+      // a collapse removes about two triangles, vertices around a collapse are not touched again in this pass,
+      // so checks of other collapses stay valid
+      const size_t trianglesToRemove = (result.size() - a_targetIndNum + 2) / 3;
+      const size_t collapseGoal      = std::max<size_t>(1, trianglesToRemove / 2);
+      std::fill(locked.begin(), locked.end(), uint8_t(0));
+
+      size_t applied = 0;
+      for(const Collapse &c : collapses)
+      {
+        if(applied >= collapseGoal || c.error > a_targetError)
+          break;
+        if(locked[c.from] || locked[c.to])
+          continue;
+
+        // every wedge of the moved position must have a unique wedge of the target position in a shared triangle,
+        // otherwise the collapse would cross an attribute seam
+        partners.clear();
+        bool valid = true;
+        for(uint32_t f = fanOffsets[c.from]; f < fanOffsets[c.from + 1] && valid; ++f)
+        {
+          const uint32_t *tri = result.data() + size_t(fanTris[f]) * 3;
+          uint32_t wedge = UINT32_MAX, target = UINT32_MAX;
+          for(uint32_t k = 0; k < 3; ++k)
+          {
+            if(posIds[tri[k]] == c.from)
+              wedge = tri[k];
+            else if(posIds[tri[k]] == c.to)
+              target = tri[k];
+          }
+          auto it = std::find_if(partners.begin(), partners.end(), [wedge](const auto &p) { return p.first == wedge; });
+          if(it == partners.end())
+            partners.emplace_back(wedge, target);
+          else if(it->second == UINT32_MAX)
+            it->second = target;
+          else if(target != UINT32_MAX && target != it->second)
+            valid = !keepSeams;
+        }
+        targetWedges.clear();
+        for(auto &p : partners)
+        {
+          if(p.second != UINT32_MAX || !valid)
+            continue;
+          if(keepSeams)
+          {
+            valid = false;
+            break;
+          }
+          if(targetWedges.empty())
+          {
+            for(uint32_t f = fanOffsets[c.to]; f < fanOffsets[c.to + 1]; ++f)
+              for(uint32_t k = 0; k < 3; ++k)
+                if(posIds[result[size_t(fanTris[f]) * 3 + k]] == c.to)
+                  targetWedges.push_back(result[size_t(fanTris[f]) * 3 + k]);
+          }
+          float best = INFINITY;
+          for(uint32_t w : targetWedges)
+          {
+            const float dist = AttributeDistance(a_mesh, p.first, w);
+            if(dist < best)
+            {
+              best     = dist;
+              p.second = w;
+            }
+          }
+        }
+
+        // triangles that remain must not flip
+        for(uint32_t f = fanOffsets[c.from]; f < fanOffsets[c.from + 1] && valid; ++f)
+        {
+          const uint32_t *tri = result.data() + size_t(fanTris[f]) * 3;
+          const uint32_t ids[3] = {posIds[tri[0]], posIds[tri[1]], posIds[tri[2]]};
+          if(ids[0] == c.to || ids[1] == c.to || ids[2] == c.to)
+            continue;
+          float3 p[3] = {positions[ids[0]], positions[ids[1]], positions[ids[2]]};
+          const float3 before = TriNormal(p[0], p[1], p[2]);
+          for(uint32_t k = 0; k < 3; ++k)
+            p[k] = ids[k] == c.from ? positions[c.to] : p[k];
+          valid = LiteMath::dot(before, TriNormal(p[0], p[1], p[2])) > 0.0f;
+        }
+
+        // link condition: common neighbours must be exactly the opposite vertices of the collapsed edge,
+        // otherwise the result is not manifold
+        if(valid)
+        {
+          auto gather = [&](uint32_t pos, std::vector<uint32_t> &dst) {
+            dst.clear();
+            for(uint32_t f = fanOffsets[pos]; f < fanOffsets[pos + 1]; ++f)
+              for(uint32_t k = 0; k < 3; ++k)
+                dst.push_back(posIds[result[size_t(fanTris[f]) * 3 + k]]);
+            std::sort(dst.begin(), dst.end());
+            dst.erase(std::unique(dst.begin(), dst.end()), dst.end());
+          };
+          gather(c.from, neighboursFrom);
+          gather(c.to, neighboursTo);
+          uint32_t common = 0;
+          for(size_t i = 0, j = 0; i < neighboursFrom.size() && j < neighboursTo.size();)
+          {
+            if(neighboursFrom[i] < neighboursTo[j])
+              ++i;
+            else if(neighboursFrom[i] > neighboursTo[j])
+              ++j;
+            else
+            {
+              common += (neighboursFrom[i] != c.from && neighboursFrom[i] != c.to) ? 1u : 0u;
+              ++i;
+              ++j;
+            }
+          }
+          valid = common <= edgeCount(c.from, c.to);
+        }
+
+        if(!valid)
+          continue;
+
+        for(const auto &p : partners)
+          wedgeRemap[p.first] = p.second;
+        quadrics[c.to].Add(quadrics[c.from]);
+        for(uint32_t f = fanOffsets[c.from]; f < fanOffsets[c.from + 1]; ++f)
+          for(uint32_t k = 0; k < 3; ++k)
+            locked[posIds[result[size_t(fanTris[f]) * 3 + k]]] = 1;
+        maxError = std::max(maxError, c.error);
+        applied++;
+      }
+
+      if(applied == 0 && !keepSeams)
+        break;
+      // passes that keep seams are stopped once they make little progress
+      if(keepSeams && applied * 16 < collapseGoal)
+        keepSeams = false;
+      if(applied == 0)
+        continue;
+
+      // remap moved wedges and drop triangles that became degenerate
+      size_t written = 0;
+      for(size_t t = 0; t < result.size(); t += 3)
+      {
+        const uint32_t a = wedgeRemap[result[t + 0]], b = wedgeRemap[result[t + 1]], c = wedgeRemap[result[t + 2]];
+        if(posIds[a] == posIds[b] || posIds[b] == posIds[c] || posIds[c] == posIds[a])
+          continue;
+        result[written + 0] = a;
+        result[written + 1] = b;
+        result[written + 2] = c;
+        written += 3;
+      }
+      result.resize(written);
+      countEdges();
+    }
+
+    if(a_resultError != nullptr)
+      *a_resultError = maxError;
+    return result;
+  }
+
+  LodChain BuildLodChain(const mesh_optimizer::MeshInput &a_mesh, const LodSettings &a_settings)
+  {
+    const uint32_t *a_indices = a_mesh.indices;
+    const size_t a_indNum     = a_mesh.indNum;
+    const float *a_pos4f      = a_mesh.pos4f;
+    const uint32_t a_vertNum  = a_mesh.vertNum;
+
+    LodChain res;
+    res.lods.push_back(MeshLodInfo{0u, uint32_t(a_indNum), 0.0f, 0u});
+
+    LiteMath::Box4f box;
+    for(uint32_t v = 0; v < a_vertNum; ++v)
+      box.include(LiteMath::float4(a_pos4f + size_t(v) * 4));
+    const LiteMath::float4 extent = box.boxMax - box.boxMin;
+    const float maxError = a_settings.maxError * std::max(extent.x, std::max(extent.y, extent.z));
+
+    // every LOD is simplified from the previous one, so its error is bounded by the sum of errors of the steps
+    std::vector<uint32_t> prev(a_indices, a_indices + a_indNum);
+    float prevError = 0.0f;
+    while(res.lods.size() < a_settings.maxLods && prev.size() > a_settings.minIndices && prevError < maxError)
+    {
+      const size_t target = size_t(float(prev.size() / 3) * a_settings.reduction) * 3;
+      float error = 0.0f;
+      mesh_optimizer::MeshInput input = a_mesh;
+      input.indices = prev.data();
+      input.indNum  = uint32_t(prev.size());
+      std::vector<uint32_t> lod = Simplify(input, target, maxError - prevError, &error);
+      if(lod.empty() || lod.size() * 10 > prev.size() * 9)
+        break;
+
+      mesh_optimizer::OptimizeVertexCache(lod.data(), lod.size(), a_vertNum);
+
+      const MeshLodInfo info = {uint32_t(a_indNum + res.indices.size()), uint32_t(lod.size()), prevError + error, 0u};
+      res.lods.push_back(info);
+      res.indices.insert(res.indices.end(), lod.begin(), lod.end());
+
+      prev      = std::move(lod);
+      prevError = info.error;
+    }
+
+    return res;
+  }
+
+  float ScreenScale(float a_fovYDegrees, uint32_t a_screenHeight)
+  {
+    return float(a_screenHeight) / (2.0f * std::tan(0.5f * a_fovYDegrees * LiteMath::DEG_TO_RAD));
+  }
+
+  float MatrixScale(const LiteMath::float4x4 &a_model)
+  {
+    float scale = 0.0f;
+    for(int j = 0; j < 3; ++j)
+      scale = std::max(scale, LiteMath::length(float3(a_model(0, j), a_model(1, j), a_model(2, j))));
+    return scale;
+  }
+
+  uint32_t SelectLod(const MeshLodInfo *a_lods, uint32_t a_lodsNum, const LiteMath::float4x4 &a_model,
+    const LiteMath::Box4f &a_instBox, const LiteMath::float3 &a_camPos, float a_screenScale, float a_maxPixelError)
+  {
+    // distance to the closest point of the instance box, LOD 0 is used inside of it
+    const float3 boxMin = LiteMath::to_float3(a_instBox.boxMin);
+    const float3 boxMax = LiteMath::to_float3(a_instBox.boxMax);
+    const float3 delta  = LiteMath::max(LiteMath::max(boxMin - a_camPos, a_camPos - boxMax), float3(0.0f, 0.0f, 0.0f));
+    const float distance = LiteMath::length(delta);
+    if(distance <= 0.0f)
+      return 0;
+
+    const float pixelsPerUnit = MatrixScale(a_model) * a_screenScale / distance;
+    for(uint32_t lod = a_lodsNum; lod-- > 1;)
+    {
+      if(a_lods[lod].error * pixelsPerUnit <= a_maxPixelError)
+        return lod;
+    }
+    return 0;
+  }
+}
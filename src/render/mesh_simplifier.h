@@ -0,0 +1,54 @@
+#ifndef VK_GRAPHICS_BASIC_MESH_SIMPLIFIER_H
+#define VK_GRAPHICS_BASIC_MESH_SIMPLIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "LiteMath.h"
+#include "mesh_optimizer.h"
+#include "../resources/shaders/common.h"
+
+// Mesh simplification by edge collapses ordered by quadric error metrics (Garland and Heckbert, "Surface Simplification
+// Using Quadric Error Metrics"). Collapses move a vertex onto its neighbour, so simplified meshes reuse original vertices
+// and levels of detail differ only by their index ranges.
+// Vertices split by attributes (normal or UV seams) are collapsed along the seam while possible, open borders and
+// non-manifold vertices are preserved. Only positions, normals and texture coordinates of a_mesh are used.
+//
+namespace mesh_simplifier
+{
+  // returns indices of simplified mesh with at most a_targetIndNum indices, or the smallest one reachable
+  // without exceeding a_targetError (distance in mesh space); a_resultError receives estimated error if not nullptr
+  std::vector<uint32_t> Simplify(const mesh_optimizer::MeshInput &a_mesh, size_t a_targetIndNum, float a_targetError,
+    float *a_resultError = nullptr);
+
+  constexpr uint32_t MAX_LODS = 5;
+
+  struct LodSettings
+  {
+    uint32_t maxLods    = MAX_LODS; // including full mesh
+    float reduction     = 0.5f;     // triangles of next LOD relative to previous one
+    float maxError      = 0.05f;    // relative to the largest mesh extent
+    uint32_t minIndices = 3 * 64;   // meshes and LODs smaller than that are not simplified further
+  };
+
+  struct LodChain
+  {
+    std::vector<MeshLodInfo> lods;    // lods[0] is the input mesh
+    std::vector<uint32_t>    indices; // indices of lods[1..], firstIndex of LOD i is a_indNum + offset in this array
+  };
+
+  LodChain BuildLodChain(const mesh_optimizer::MeshInput &a_mesh, const LodSettings &a_settings = LodSettings());
+
+  // screen height in pixels / (2 * tan(fovY / 2)), converts angular size to pixels for SelectLod
+  float ScreenScale(float a_fovYDegrees, uint32_t a_screenHeight);
+
+  // largest scale along the axes of a_model, mesh space LOD errors are multiplied by it
+  float MatrixScale(const LiteMath::float4x4 &a_model);
+
+  // coarsest LOD whose error projected to the screen does not exceed a_maxPixelError
+  uint32_t SelectLod(const MeshLodInfo *a_lods, uint32_t a_lodsNum, const LiteMath::float4x4 &a_model,
+    const LiteMath::Box4f &a_instBox, const LiteMath::float3 &a_camPos, float a_screenScale, float a_maxPixelError);
+}
+
+#endif// VK_GRAPHICS_BASIC_MESH_SIMPLIFIER_H
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "meshlets.h"
+#include "mesh_optimizer.h"
+
+namespace meshlets
+{
+  using LiteMath::float3;
+  using LiteMath::float4;
+
+  static float3 Pos(const float *a_pos4f, uint32_t a_vert) { return float3(a_pos4f + size_t(a_vert) * 4); }
+
+  // bounding sphere of the cluster vertices and a cone containing normals of its triangles, see
+  // Zeux, "Meshlet culling" and Wihlidal, "Optimizing the Graphics Pipeline with Compute" for the cone test
+  static MeshletInfo ComputeBounds(const BuildInput &a_mesh, const uint32_t *a_triangles, uint32_t a_trisNum,
+    const std::vector<uint32_t> &a_vertices, uint32_t a_firstIndex)
+  {
+    MeshletInfo res = {};
+    res.firstIndex  = a_firstIndex;
+    res.indexCount  = a_trisNum * 3;
+    res.vertexCount = uint32_t(a_vertices.size());
+
+    float3 boxMin = Pos(a_mesh.pos4f, a_vertices[0]);
+    float3 boxMax = boxMin;
+    for(uint32_t v : a_vertices)
+    {
+      boxMin = LiteMath::min(boxMin, Pos(a_mesh.pos4f, v));
+      boxMax = LiteMath::max(boxMax, Pos(a_mesh.pos4f, v));
+    }
+    const float3 center = (boxMin + boxMax) * 0.5f;
+    float radius = 0.0f;
+    for(uint32_t v : a_vertices)
+      radius = std::max(radius, LiteMath::length(Pos(a_mesh.pos4f, v) - center));
+    res.sphere = LiteMath::to_float4(center, radius);
+
+    // normals are oriented by shading normals, so the test does not depend on winding of the source data
+    std::vector<float3> normals;
+    normals.reserve(a_trisNum);
+    float3 axis(0.0f, 0.0f, 0.0f);
+    for(uint32_t i = 0; i < a_trisNum; ++i)
+    {
+      const uint32_t *tri = a_mesh.indices + size_t(a_triangles[i]) * 3;
+      const float3 p0 = Pos(a_mesh.pos4f, tri[0]);
+      float3 n = LiteMath::cross(Pos(a_mesh.pos4f, tri[1]) - p0, Pos(a_mesh.pos4f, tri[2]) - p0);
+      const float area = LiteMath::length(n);
+      if(area == 0.0f)
+        continue;
+      n = n / area;
+
+      if(a_mesh.norm4f != nullptr)
+      {
+        const float3 shading = Pos(a_mesh.norm4f, tri[0]) + Pos(a_mesh.norm4f, tri[1]) + Pos(a_mesh.norm4f, tri[2]);
+        if(LiteMath::dot(n, shading) < 0.0f)
+          n = n * -1.0f;
+      }
+      normals.push_back(n);
+      axis += n;
+    }
+
+    // cutoff above 1 disables the cone test
+    constexpr float NO_CONE = 2.0f;
+    res.coneApex = LiteMath::to_float4(center, 0.0f);
+    res.coneAxis = float4(0.0f, 0.0f, 1.0f, NO_CONE);
+
+    const float axisLength = LiteMath::length(axis);
+    if(normals.empty() || axisLength == 0.0f)
+      return res;
+    axis = axis / axisLength;
+
+    float minDot = 1.0f;
+    for(const auto &n : normals)
+      minDot = std::min(minDot, LiteMath::dot(n, axis));
+    // cones wider than ~85 degrees cull almost nothing
+    if(minDot <= 0.1f)
+      return res;
+
+    // apex is moved back along the axis until it is behind planes of all triangles
+    float maxT = 0.0f;
+    uint32_t normalIdx = 0;
+    for(uint32_t i = 0; i < a_trisNum; ++i)
+    {
+      const uint32_t *tri = a_mesh.indices + size_t(a_triangles[i]) * 3;
+      const float3 p0 = Pos(a_mesh.pos4f, tri[0]);
+      if(LiteMath::length(LiteMath::cross(Pos(a_mesh.pos4f, tri[1]) - p0, Pos(a_mesh.pos4f, tri[2]) - p0)) == 0.0f)
+        continue;
+      const float3 &n = normals[normalIdx++];
+      maxT = std::max(maxT, LiteMath::dot(p0 - center, n) / LiteMath::dot(n, axis));
+    }
+
+    res.coneApex = LiteMath::to_float4(center - axis * maxT, 0.0f);
+    res.coneAxis = LiteMath::to_float4(axis, std::sqrt(1.0f - minDot * minDot));
+    return res;
+  }
+
+  BuildResult Build(const BuildInput &a_mesh, uint32_t a_maxVertices, uint32_t a_maxTriangles)
+  {
+    assert(a_maxVertices >= 3 && a_maxTriangles >= 1);
+    assert(a_mesh.indNum % 3 == 0);
+    const uint32_t trisNum = a_mesh.indNum / 3;
+
+    BuildResult res;
+    res.triangleOrder.reserve(trisNum);
+    if(trisNum == 0)
+      return res;
+
+    // triangles are connected through positions, so seams of other attributes do not split clusters
+    std::vector<uint32_t> posIds;
+    const uint32_t posNum = mesh_optimizer::WeldVertices({{a_mesh.pos4f, 4}}, a_mesh.vertNum, posIds);
+
+    std::vector<uint32_t> adjOffsets(posNum + 1, 0u);
+    for(uint32_t i = 0; i < a_mesh.indNum; ++i)
+      adjOffsets[posIds[a_mesh.indices[i]] + 1]++;
+    for(uint32_t p = 0; p < posNum; ++p)
+      adjOffsets[p + 1] += adjOffsets[p];
+    std::vector<uint32_t> adjTris(a_mesh.indNum);
+    {
+      std::vector<uint32_t> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+      for(uint32_t i = 0; i < a_mesh.indNum; ++i)
+        adjTris[fill[posIds[a_mesh.indices[i]]]++] = i / 3;
+    }
+
+    std::vector<bool> used(trisNum, false);
+    std::vector<bool> inMeshlet(a_mesh.vertNum, false);
+    std::vector<uint32_t> vertices;
+    std::vector<uint32_t> triangles;
+    float3 centerSum(0.0f, 0.0f, 0.0f);
+
+    auto centroid = [&](uint32_t t) {
+      const uint32_t *tri = a_mesh.indices + size_t(t) * 3;
+      return (Pos(a_mesh.pos4f, tri[0]) + Pos(a_mesh.pos4f, tri[1]) + Pos(a_mesh.pos4f, tri[2])) * (1.0f / 3.0f);
+    };
+    auto newVertices = [&](uint32_t t) {
+      const uint32_t *tri = a_mesh.indices + size_t(t) * 3;
+      uint32_t added = inMeshlet[tri[0]] ? 0 : 1;
+      added += (inMeshlet[tri[1]] || tri[1] == tri[0]) ? 0 : 1;
+      added += (inMeshlet[tri[2]] || tri[2] == tri[0] || tri[2] == tri[1]) ? 0 : 1;
+      return added;
+    };
+    auto addTriangle = [&](uint32_t t) {
+      used[t] = true;
+      triangles.push_back(t);
+      centerSum += centroid(t);
+      for(int k = 0; k < 3; ++k)
+      {
+        const uint32_t v = a_mesh.indices[size_t(t) * 3 + k];
+        if(!inMeshlet[v])
+        {
+          inMeshlet[v] = true;
+          vertices.push_back(v);
+        }
+      }
+    };
+    auto closeMeshlet = [&]() {
+      res.meshlets.push_back(ComputeBounds(a_mesh, triangles.data(), uint32_t(triangles.size()), vertices,
+        uint32_t(res.triangleOrder.size()) * 3));
+      res.triangleOrder.insert(res.triangleOrder.end(), triangles.begin(), triangles.end());
+      for(uint32_t v : vertices)
+        inMeshlet[v] = false;
+      vertices.clear();
+      triangles.clear();
+      centerSum = float3(0.0f, 0.0f, 0.0f);
+    };
+
+    uint32_t nextSeed = 0;
+    while(res.triangleOrder.size() + triangles.size() < trisNum)
+    {
+      if(triangles.empty())
+      {
+        while(used[nextSeed])
+          nextSeed++;
+        addTriangle(nextSeed);
+      }
+      else
+      {
+        // adjacent triangle adding the fewest vertices, the closest one to the cluster center on ties
+        const float3 center = centerSum / float(triangles.size());
+        uint32_t best      = UINT32_MAX;
+        uint32_t bestNew   = 4;
+        float    bestDist2 = 0.0f;
+        for(uint32_t v : vertices)
+        {
+          const uint32_t p = posIds[v];
+          for(uint32_t i = adjOffsets[p]; i < adjOffsets[p + 1]; ++i)
+          {
+            const uint32_t t = adjTris[i];
+            if(used[t])
+              continue;
+            const uint32_t added = newVertices(t);
+            if(vertices.size() + added > a_maxVertices || added > bestNew)
+              continue;
+            const float3 d    = centroid(t) - center;
+            const float dist2 = LiteMath::dot(d, d);
+            if(added < bestNew || dist2 < bestDist2)
+            {
+              best      = t;
+              bestNew   = added;
+              bestDist2 = dist2;
+            }
+          }
+        }
+
+        if(best == UINT32_MAX)
+          closeMeshlet();
+        else
+          addTriangle(best);
+      }
+
+      if(triangles.size() == a_maxTriangles)
+        closeMeshlet();
+    }
+    if(!triangles.empty())
+      closeMeshlet();
+
+    return res;
+  }
+
+  void ClusterCuller::SetView(const LiteMath::float4x4 &a_projView, const LiteMath::float4 &a_eye)
+  {
+    m_projView = a_projView;
+    m_eye      = a_eye;
+  }
+
+  void ClusterCuller::SetInstance(const LiteMath::float4x4 &a_model)
+  {
+    // clip planes in mesh space (Gribb, Hartmann), near plane is taken for -w <= z so it works with both depth ranges
+    const LiteMath::float4x4 m = m_projView * a_model;
+    const float4 rows[4] = {m.get_row(0), m.get_row(1), m.get_row(2), m.get_row(3)};
+    m_planes[0] = rows[3] + rows[0];
+    m_planes[1] = rows[3] - rows[0];
+    m_planes[2] = rows[3] + rows[1];
+    m_planes[3] = rows[3] - rows[1];
+    m_planes[4] = rows[3] + rows[2];
+    m_planes[5] = rows[3] - rows[2];
+    for(auto &plane : m_planes)
+    {
+      const float len = LiteMath::length(LiteMath::to_float3(plane));
+      if(len > 0.0f)
+        plane = plane / len;
+    }
+
+    // frustum and back face tests are invariant to affine transforms, so clusters are tested in mesh space
+    m_localEye = LiteMath::inverse4x4(a_model) * m_eye;
+  }
+
+  bool ClusterCuller::BoxVisible(const LiteMath::Box4f &a_box) const
+  {
+    for(const auto &plane : m_planes)
+    {
+      const float3 farthest(plane.x >= 0.0f ? a_box.boxMax.x : a_box.boxMin.x,
+                            plane.y >= 0.0f ? a_box.boxMax.y : a_box.boxMin.y,
+                            plane.z >= 0.0f ? a_box.boxMax.z : a_box.boxMin.z);
+      if(LiteMath::dot(LiteMath::to_float3(plane), farthest) + plane.w < 0.0f)
+        return false;
+    }
+    return true;
+  }
+
+  bool ClusterCuller::ClusterVisible(const MeshletInfo &a_meshlet) const
+  {
+    const float3 center = LiteMath::to_float3(a_meshlet.sphere);
+    for(const auto &plane : m_planes)
+    {
+      if(LiteMath::dot(LiteMath::to_float3(plane), center) + plane.w < -a_meshlet.sphere.w)
+        return false;
+    }
+
+    const float cutoff = a_meshlet.coneAxis.w;
+    if(!coneCulling || cutoff > 1.0f)
+      return true;
+
+    const float3 view = m_localEye.w != 0.0f ?
+      LiteMath::to_float3(a_meshlet.coneApex) - LiteMath::to_float3(m_localEye) / m_localEye.w :
+      LiteMath::to_float3(m_localEye);
+    const float viewLength = LiteMath::length(view);
+    return LiteMath::dot(view, LiteMath::to_float3(a_meshlet.coneAxis)) < cutoff * viewLength;
+  }
+
+  uint32_t ClusterCuller::AppendVisibleRanges(const MeshletInfo *a_meshlets, uint32_t a_meshletsNum,
+    std::vector<LiteMath::uint2> &a_ranges) const
+  {
+    const size_t firstRange = a_ranges.size();
+    uint32_t visible = 0;
+    for(uint32_t i = 0; i < a_meshletsNum; ++i)
+    {
+      const MeshletInfo &meshlet = a_meshlets[i];
+      if(!ClusterVisible(meshlet))
+        continue;
+
+      visible++;
+      if(a_ranges.size() > firstRange && a_ranges.back().x + a_ranges.back().y == meshlet.firstIndex)
+        a_ranges.back().y += meshlet.indexCount;
+      else
+        a_ranges.emplace_back(meshlet.firstIndex, meshlet.indexCount);
+    }
+    return visible;
+  }
+}
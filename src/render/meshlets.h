@@ -0,0 +1,66 @@
+#ifndef VK_GRAPHICS_BASIC_MESHLETS_H
+#define VK_GRAPHICS_BASIC_MESHLETS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "LiteMath.h"
+#include "../resources/shaders/common.h"
+
+// Meshlets are small clusters of mesh triangles stored contiguously in the index buffer,
+// each with a bounding sphere and a cone bounding its triangle normals.
+// Clusters outside of the view frustum or facing away from the viewer are rejected on the CPU
+// and the rest are drawn as ranges of the mesh index buffer.
+//
+namespace meshlets
+{
+  constexpr uint32_t MAX_VERTICES  = 64;
+  constexpr uint32_t MAX_TRIANGLES = 124;
+
+  struct BuildInput
+  {
+    const float *pos4f      = nullptr;
+    const float *norm4f     = nullptr; // optional, orients cones if winding does not match shading normals
+    const uint32_t *indices = nullptr;
+    uint32_t vertNum = 0;
+    uint32_t indNum  = 0;
+  };
+
+  struct BuildResult
+  {
+    std::vector<MeshletInfo> meshlets;
+    std::vector<uint32_t> triangleOrder; // new triangle i is input triangle triangleOrder[i]
+  };
+
+  // greedily grows clusters from adjacent triangles that add the fewest new vertices
+  BuildResult Build(const BuildInput &a_mesh, uint32_t a_maxVertices = MAX_VERTICES, uint32_t a_maxTriangles = MAX_TRIANGLES);
+
+  class ClusterCuller
+  {
+  public:
+    // a_eye is the camera position (w = 1) or the direction it looks along for orthographic projections (w = 0)
+    void SetView(const LiteMath::float4x4 &a_projView, const LiteMath::float4 &a_eye);
+    void SetInstance(const LiteMath::float4x4 &a_model);
+
+    bool BoxVisible(const LiteMath::Box4f &a_box) const;
+    bool ClusterVisible(const MeshletInfo &a_meshlet) const;
+
+    // appends ranges (firstIndex, indexCount) of visible clusters, adjacent ones are merged
+    // and returns number of visible clusters
+    uint32_t AppendVisibleRanges(const MeshletInfo *a_meshlets, uint32_t a_meshletsNum, std::vector<LiteMath::uint2> &a_ranges) const;
+
+    // back-facing clusters are kept when disabled, e.g. for pipelines without back face culling
+    bool coneCulling = true;
+
+  private:
+    LiteMath::float4x4 m_projView;
+    LiteMath::float4 m_eye;
+
+    // in mesh space of current instance
+    LiteMath::float4 m_planes[6];
+    LiteMath::float4 m_localEye;
+  };
+}
+
+#endif// VK_GRAPHICS_BASIC_MESHLETS_H
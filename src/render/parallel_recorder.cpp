@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#include "parallel_recorder.h"
+#include "../utils/parallel_for.h"
+
+#include <vk_utils.h>
+
+ParallelRecorder::ParallelRecorder(VkDevice a_device, uint32_t a_queueFamilyIdx, uint32_t a_framesInFlight,
+  uint32_t a_threadsNum) : m_device(a_device)
+{
+  const uint32_t threadsNum = a_threadsNum == 0 ? DefaultWorkerThreadsNum() : a_threadsNum;
+  m_threadMs.resize(threadsNum, 0.0f);
+
+  // pools are reset as a whole, so buffers need no individual reset
+  VkCommandPoolCreateInfo poolInfo = {};
+  poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  poolInfo.queueFamilyIndex = a_queueFamilyIdx;
+
+  m_frames.resize(a_framesInFlight, std::vector<ThreadFrame>(threadsNum));
+  for(auto &frame : m_frames)
+    for(auto &thread : frame)
+      VK_CHECK_RESULT(vkCreateCommandPool(m_device, &poolInfo, nullptr, &thread.pool));
+
+  // thread 0 is the calling one
+  for(uint32_t t = 1; t < threadsNum; ++t)
+    m_workers.emplace_back(&ParallelRecorder::WorkerLoop, this, t);
+}
+
+ParallelRecorder::~ParallelRecorder()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_jobStarted.notify_all();
+  for(auto &worker : m_workers)
+    worker.join();
+
+  for(auto &frame : m_frames)
+    for(auto &thread : frame)
+      vkDestroyCommandPool(m_device, thread.pool, nullptr);
+}
+
+void ParallelRecorder::BeginFrame(uint32_t a_frame)
+{
+  assert(a_frame < m_frames.size());
+  for(auto &thread : m_frames[a_frame])
+  {
+    VK_CHECK_RESULT(vkResetCommandPool(m_device, thread.pool, 0));
+    thread.used = 0u;
+  }
+  for(auto &ms : m_threadMs)
+    ms = 0.0f;
+  m_recordMs = 0.0f;
+}
+
+void ParallelRecorder::CmdExecute(VkCommandBuffer a_primary, uint32_t a_frame, VkRenderPass a_renderPass,
+  VkFramebuffer a_framebuffer, uint32_t a_itemsNum, const RecordFunc &a_record)
+{
+  assert(a_frame < m_frames.size());
+  if(a_itemsNum == 0)
+    return;
+
+  const auto start = std::chrono::high_resolution_clock::now();
+
+  m_inheritance = {};
+  m_inheritance.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  m_inheritance.renderPass  = a_renderPass;
+  m_inheritance.subpass     = 0;
+  m_inheritance.framebuffer = a_framebuffer;
+
+  const uint32_t maxChunks = ThreadsNum() * CHUNKS_PER_THREAD;
+  m_pRecord    = &a_record;
+  m_frame      = a_frame;
+  m_itemsNum   = a_itemsNum;
+  m_chunkItems = std::max((a_itemsNum + maxChunks - 1) / maxChunks, MIN_CHUNK_ITEMS);
+  m_chunksNum  = (a_itemsNum + m_chunkItems - 1) / m_chunkItems;
+  m_nextChunk  = 0u;
+  m_chunkBuffers.assign(m_chunksNum, VK_NULL_HANDLE);
+
+  // a single chunk is not worth waking the workers up
+  const bool parallel = !m_workers.empty() && m_chunksNum > 1;
+  if(parallel)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_workersBusy = (uint32_t)m_workers.size();
+      ++m_jobId;
+    }
+    m_jobStarted.notify_all();
+  }
+
+  RecordChunks(0);
+
+  if(parallel)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobFinished.wait(lock, [this]() { return m_workersBusy == 0; });
+  }
+
+  vkCmdExecuteCommands(a_primary, m_chunksNum, m_chunkBuffers.data());
+  m_pRecord = nullptr;
+
+  m_recordMs += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void ParallelRecorder::WorkerLoop(uint32_t a_thread)
+{
+  uint64_t lastJob = 0u;
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_jobStarted.wait(lock, [&]() { return m_stop || m_jobId != lastJob; });
+      if(m_stop)
+        return;
+      lastJob = m_jobId;
+    }
+
+    RecordChunks(a_thread);
+
+    bool last = false;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      last = --m_workersBusy == 0;
+    }
+    if(last)
+      m_jobFinished.notify_one();
+  }
+}
+
+void ParallelRecorder::RecordChunks(uint32_t a_thread)
+{
+  const auto start = std::chrono::high_resolution_clock::now();
+  ThreadFrame &frame = m_frames[m_frame][a_thread];
+
+  for(uint32_t chunk = m_nextChunk++; chunk < m_chunksNum; chunk = m_nextChunk++)
+  {
+    if(frame.used == frame.buffers.size())
+    {
+      VkCommandBufferAllocateInfo allocInfo = {};
+      allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.commandPool        = frame.pool;
+      allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+      allocInfo.commandBufferCount = 1;
+
+      VkCommandBuffer cmdBuf = VK_NULL_HANDLE;
+      VK_CHECK_RESULT(vkAllocateCommandBuffers(m_device, &allocInfo, &cmdBuf));
+      frame.buffers.push_back(cmdBuf);
+    }
+    VkCommandBuffer cmdBuf = frame.buffers[frame.used++];
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &m_inheritance;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuf, &beginInfo));
+
+    const uint32_t first = chunk * m_chunkItems;
+    (*m_pRecord)(cmdBuf, first, std::min(first + m_chunkItems, m_itemsNum), a_thread);
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuf));
+    m_chunkBuffers[chunk] = cmdBuf;
+  }
+
+  m_threadMs[a_thread] += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
@@ -0,0 +1,89 @@
+#ifndef VK_GRAPHICS_BASIC_PARALLEL_RECORDER_H
+#define VK_GRAPHICS_BASIC_PARALLEL_RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "volk.h"
+
+// Records draws of a render pass on several threads: items (e.g. visible instances) are split into chunks,
+// every chunk is recorded into a secondary command buffer by one of the persistent worker threads
+// (the calling thread works too) and the primary buffer executes them in chunk order.
+// Every thread has its own command pool per frame in flight, so pools are never shared between threads
+// and all buffers of a frame are recycled at once by BeginFrame.
+//
+class ParallelRecorder
+{
+public:
+  // records items [a_first, a_end) into a_cmdBuf, which is already begun inside of the render pass;
+  // no state is inherited from the primary buffer, so pipeline, descriptor sets, vertex buffers, viewport and scissor
+  // must be set again; a_thread < ThreadsNum() identifies per thread scratch data of the caller
+  using RecordFunc = std::function<void(VkCommandBuffer a_cmdBuf, uint32_t a_first, uint32_t a_end, uint32_t a_thread)>;
+
+  // a_threadsNum = 0 - one thread per hardware thread
+  ParallelRecorder(VkDevice a_device, uint32_t a_queueFamilyIdx, uint32_t a_framesInFlight, uint32_t a_threadsNum = 0);
+  ~ParallelRecorder();
+
+  ParallelRecorder(const ParallelRecorder &) = delete;
+  ParallelRecorder &operator=(const ParallelRecorder &) = delete;
+
+  uint32_t ThreadsNum() const { return (uint32_t)m_threadMs.size(); }
+
+  // recycles secondary buffers of a_frame, command buffers recorded for it before must not be pending anymore
+  void BeginFrame(uint32_t a_frame);
+
+  // records a_itemsNum items into secondary buffers for subpass 0 of a_renderPass and executes them in a_primary,
+  // the pass must be begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS; may be called several times per frame
+  void CmdExecute(VkCommandBuffer a_primary, uint32_t a_frame, VkRenderPass a_renderPass, VkFramebuffer a_framebuffer,
+    uint32_t a_itemsNum, const RecordFunc &a_record);
+
+  // time every thread spent recording since the last BeginFrame and wall time of it
+  float ThreadRecordMs(uint32_t a_thread) const { return m_threadMs[a_thread]; }
+  float RecordMs() const { return m_recordMs; }
+
+private:
+  // chunks per thread, more than one evens out threads whose items are more expensive to record
+  static constexpr uint32_t CHUNKS_PER_THREAD = 4;
+  static constexpr uint32_t MIN_CHUNK_ITEMS   = 64;
+
+  struct ThreadFrame
+  {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> buffers;
+    uint32_t used = 0u;
+  };
+
+  void WorkerLoop(uint32_t a_thread);
+  void RecordChunks(uint32_t a_thread);
+
+  VkDevice m_device = VK_NULL_HANDLE;
+  std::vector<std::vector<ThreadFrame>> m_frames; // [frame][thread]
+
+  // current job, written by the calling thread before workers are woken up
+  VkCommandBufferInheritanceInfo m_inheritance = {};
+  const RecordFunc *m_pRecord = nullptr;
+  uint32_t m_frame      = 0u;
+  uint32_t m_itemsNum   = 0u;
+  uint32_t m_chunkItems = 0u;
+  uint32_t m_chunksNum  = 0u;
+  std::atomic<uint32_t> m_nextChunk {0u};
+  std::vector<VkCommandBuffer> m_chunkBuffers;
+
+  std::vector<std::thread> m_workers;
+  std::mutex m_mutex;
+  std::condition_variable m_jobStarted;
+  std::condition_variable m_jobFinished;
+  uint64_t m_jobId       = 0u;
+  uint32_t m_workersBusy = 0u;
+  bool m_stop            = false;
+
+  std::vector<float> m_threadMs;
+  float m_recordMs = 0.0f;
+};
+
+#endif// VK_GRAPHICS_BASIC_PARALLEL_RECORDER_H
@@ -5,7 +5,9 @@
 #include "vk_utils.h"
 #include "utils/Camera.h"
 #include <cstring>
+#include <fstream>
 #include <memory>
+#include <string>
 
 struct AppInput
 {
@@ -49,8 +51,23 @@ public:
   virtual void LoadScene(const char* path, bool transpose_inst_matrices) = 0;
   virtual void DrawFrame(float a_time, DrawMode a_mode) = 0;
 
+  // LoadScene may return before the scene is fully loaded, the rest of it appears while frames are drawn
+  virtual float GetLoadProgress() const { return 1.0f; }
+  // true once after the render has replaced its camera by itself (e.g. with a scene camera which became known during loading)
+  virtual bool CameraWasReset() { return false; }
+
   virtual ~IRender() = default;
 
 };
 
+// SPIR-V is built from GLSL by the compile_*_shaders.py scripts in resources/shaders;
+// optional features check for their shaders and stay off with a warning instead of failing to load them
+inline bool ShaderCompiled(const std::string &a_spvPath)
+{
+  if(std::ifstream(a_spvPath, std::ios::binary).good())
+    return true;
+  vk_utils::logWarning("[ShaderCompiled] " + a_spvPath + " is missing, run the compile script in resources/shaders");
+  return false;
+}
+
 #endif//CHIMERA_RENDER_COMMON_H
@@ -0,0 +1,289 @@
+#include "scene_cache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace scene_cache
+{
+  static constexpr uint32_t CACHE_MAGIC   = 0x43534B56; // "VKSC"
+  static constexpr uint32_t CACHE_VERSION = 3;
+  static constexpr uint64_t SECTION_ALIGN = 64;
+
+  struct FileHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t settingsKey;
+    uint32_t sourcesNum;
+    uint32_t stringsSize;
+    uint32_t vertexSize;
+    uint32_t indexSize;
+    uint32_t meshesNum;
+    uint32_t instancesNum;
+    uint32_t camerasNum;
+    uint32_t meshletsNum;
+    uint32_t lodsNum;
+    uint64_t totalVertices;
+    uint64_t totalIndices;
+    uint64_t fileSize;
+    float sceneBboxMin[4];
+    float sceneBboxMax[4];
+  };
+
+  struct SourceRecord
+  {
+    uint64_t size;
+    int64_t  mtime;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+  };
+
+  // byte offsets of file sections, computed from counts in the header
+  struct Layout
+  {
+    uint64_t sources;
+    uint64_t strings;
+    uint64_t meshes;
+    uint64_t meshBboxes;
+    uint64_t meshMeshlets;
+    uint64_t meshlets;
+    uint64_t meshLods;
+    uint64_t lods;
+    uint64_t instanceMeshIds;
+    uint64_t instanceMatrices;
+    uint64_t instanceBboxes;
+    uint64_t cameras;
+    uint64_t vertices;
+    uint64_t indices;
+    uint64_t end;
+  };
+
+  static uint64_t AlignUp(uint64_t a_value) { return (a_value + SECTION_ALIGN - 1) / SECTION_ALIGN * SECTION_ALIGN; }
+
+  static Layout ComputeLayout(const FileHeader &h)
+  {
+    Layout l;
+    l.sources          = AlignUp(sizeof(FileHeader));
+    l.strings          = AlignUp(l.sources + uint64_t(h.sourcesNum) * sizeof(SourceRecord));
+    l.meshes           = AlignUp(l.strings + h.stringsSize);
+    l.meshBboxes       = AlignUp(l.meshes + uint64_t(h.meshesNum) * sizeof(MeshRecord));
+    l.meshMeshlets     = AlignUp(l.meshBboxes + uint64_t(h.meshesNum) * sizeof(LiteMath::Box4f));
+    l.meshlets         = AlignUp(l.meshMeshlets + uint64_t(h.meshesNum) * sizeof(LiteMath::uint2));
+    l.meshLods         = AlignUp(l.meshlets + uint64_t(h.meshletsNum) * sizeof(MeshletInfo));
+    l.lods             = AlignUp(l.meshLods + uint64_t(h.meshesNum) * sizeof(LiteMath::uint2));
+    l.instanceMeshIds  = AlignUp(l.lods + uint64_t(h.lodsNum) * sizeof(MeshLodInfo));
+    l.instanceMatrices = AlignUp(l.instanceMeshIds + uint64_t(h.instancesNum) * sizeof(uint32_t));
+    l.instanceBboxes   = AlignUp(l.instanceMatrices + uint64_t(h.instancesNum) * sizeof(LiteMath::float4x4));
+    l.cameras          = AlignUp(l.instanceBboxes + uint64_t(h.instancesNum) * sizeof(LiteMath::Box4f));
+    l.vertices         = AlignUp(l.cameras + uint64_t(h.camerasNum) * sizeof(hydra_xml::Camera));
+    l.indices          = AlignUp(l.vertices + h.totalVertices * h.vertexSize);
+    l.end              = l.indices + h.totalIndices * h.indexSize;
+    return l;
+  }
+
+  bool StampFile(const std::string &a_path, SourceStamp &a_stamp)
+  {
+    std::error_code ec;
+    const auto size  = std::filesystem::file_size(a_path, ec);
+    if(ec)
+      return false;
+    const auto mtime = std::filesystem::last_write_time(a_path, ec);
+    if(ec)
+      return false;
+
+    a_stamp.path  = a_path;
+    a_stamp.size  = size;
+    a_stamp.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    return true;
+  }
+
+  std::string CachePath(const std::string &a_scenePath)
+  {
+    return a_scenePath + ".cache";
+  }
+
+  bool Open(const std::string &a_cachePath, uint32_t a_settingsKey, MappedFile &a_file, SceneView &a_view)
+  {
+    a_view = SceneView();
+
+    if(!a_file.Open(a_cachePath))
+      return false;
+
+    auto reject = [&](const char *a_reason) {
+      std::cout << "[scene_cache::Open] ignoring " << a_cachePath << ": " << a_reason << std::endl;
+      a_file.Close();
+      return false;
+    };
+
+    if(a_file.Size() < sizeof(FileHeader))
+      return reject("file is too small");
+
+    const uint8_t *base = a_file.Data();
+    const FileHeader &h = *reinterpret_cast<const FileHeader *>(base);
+    if(h.magic != CACHE_MAGIC || h.version != CACHE_VERSION)
+      return reject("unknown format version");
+    if(h.settingsKey != a_settingsKey)
+      return reject("written with different settings");
+
+    const Layout l = ComputeLayout(h);
+    if(h.fileSize != a_file.Size() || l.end != a_file.Size())
+      return reject("file is truncated");
+
+    const auto *sources = reinterpret_cast<const SourceRecord *>(base + l.sources);
+    const char *strings = reinterpret_cast<const char *>(base + l.strings);
+    for(uint32_t i = 0; i < h.sourcesNum; ++i)
+    {
+      if(uint64_t(sources[i].pathOffset) + sources[i].pathLength > h.stringsSize)
+        return reject("corrupted source table");
+
+      SourceStamp stamp;
+      const std::string path(strings + sources[i].pathOffset, sources[i].pathLength);
+      if(!StampFile(path, stamp) || stamp.size != sources[i].size || stamp.mtime != sources[i].mtime)
+        return reject(("source file was changed: " + path).c_str());
+    }
+
+    a_view.vertexSize       = h.vertexSize;
+    a_view.indexSize        = h.indexSize;
+    a_view.meshesNum        = h.meshesNum;
+    a_view.instancesNum     = h.instancesNum;
+    a_view.camerasNum       = h.camerasNum;
+    a_view.meshletsNum      = h.meshletsNum;
+    a_view.lodsNum          = h.lodsNum;
+    a_view.totalVertices    = h.totalVertices;
+    a_view.totalIndices     = h.totalIndices;
+    a_view.meshes           = reinterpret_cast<const MeshRecord *>(base + l.meshes);
+    a_view.meshBboxes       = reinterpret_cast<const LiteMath::Box4f *>(base + l.meshBboxes);
+    a_view.meshMeshlets     = reinterpret_cast<const LiteMath::uint2 *>(base + l.meshMeshlets);
+    a_view.meshlets         = reinterpret_cast<const MeshletInfo *>(base + l.meshlets);
+    a_view.meshLods         = reinterpret_cast<const LiteMath::uint2 *>(base + l.meshLods);
+    a_view.lods             = reinterpret_cast<const MeshLodInfo *>(base + l.lods);
+    a_view.instanceMeshIds  = reinterpret_cast<const uint32_t *>(base + l.instanceMeshIds);
+    a_view.instanceMatrices = reinterpret_cast<const LiteMath::float4x4 *>(base + l.instanceMatrices);
+    a_view.instanceBboxes   = reinterpret_cast<const LiteMath::Box4f *>(base + l.instanceBboxes);
+    a_view.cameras          = reinterpret_cast<const hydra_xml::Camera *>(base + l.cameras);
+    a_view.sceneBbox        = LiteMath::Box4f(LiteMath::float4(h.sceneBboxMin), LiteMath::float4(h.sceneBboxMax));
+    a_view.vertices         = base + l.vertices;
+    a_view.indices          = base + l.indices;
+
+    return true;
+  }
+
+  static void WriteAt(std::ofstream &a_out, uint64_t a_offset, const void *a_data, uint64_t a_size)
+  {
+    // zero padding up to the section start
+    static const char zeros[SECTION_ALIGN] = {};
+    const uint64_t pos = static_cast<uint64_t>(a_out.tellp());
+    assert(a_offset >= pos && a_offset - pos <= SECTION_ALIGN);
+    a_out.write(zeros, static_cast<std::streamsize>(a_offset - pos));
+    if(a_size > 0)
+      a_out.write(static_cast<const char *>(a_data), static_cast<std::streamsize>(a_size));
+  }
+
+  static void WriteGeometry(std::ofstream &a_out, const SceneView &a_view, bool a_indices, const PackFunc &a_pack)
+  {
+    const uint32_t elemSize  = a_indices ? a_view.indexSize : a_view.vertexSize;
+    const uint32_t chunkElems = (4 * 1024 * 1024) / elemSize;
+    std::vector<uint8_t> scratch(uint64_t(chunkElems) * elemSize);
+
+    for(uint32_t meshId = 0; meshId < a_view.meshesNum; ++meshId)
+    {
+      const uint32_t num = a_indices ? a_view.meshes[meshId].indNum : a_view.meshes[meshId].vertNum;
+      for(uint32_t first = 0; first < num; first += chunkElems)
+      {
+        const uint32_t count = std::min(chunkElems, num - first);
+        a_pack(meshId, first, count, scratch.data());
+        a_out.write(reinterpret_cast<const char *>(scratch.data()), static_cast<std::streamsize>(uint64_t(count) * elemSize));
+      }
+    }
+  }
+
+  bool Write(const std::string &a_cachePath, uint32_t a_settingsKey, const std::vector<SourceStamp> &a_sources,
+    const SceneView &a_view, const PackFunc &a_packVertices, const PackFunc &a_packIndices)
+  {
+    std::vector<SourceRecord> sources(a_sources.size());
+    std::string strings;
+    for(size_t i = 0; i < a_sources.size(); ++i)
+    {
+      sources[i].size       = a_sources[i].size;
+      sources[i].mtime      = a_sources[i].mtime;
+      sources[i].pathOffset = static_cast<uint32_t>(strings.size());
+      sources[i].pathLength = static_cast<uint32_t>(a_sources[i].path.size());
+      strings += a_sources[i].path;
+    }
+
+    FileHeader h = {};
+    h.magic         = CACHE_MAGIC;
+    h.version       = CACHE_VERSION;
+    h.settingsKey   = a_settingsKey;
+    h.sourcesNum    = static_cast<uint32_t>(sources.size());
+    h.stringsSize   = static_cast<uint32_t>(strings.size());
+    h.vertexSize    = a_view.vertexSize;
+    h.indexSize     = a_view.indexSize;
+    h.meshesNum     = a_view.meshesNum;
+    h.instancesNum  = a_view.instancesNum;
+    h.camerasNum    = a_view.camerasNum;
+    h.meshletsNum   = a_view.meshletsNum;
+    h.lodsNum       = a_view.lodsNum;
+    h.totalVertices = a_view.totalVertices;
+    h.totalIndices  = a_view.totalIndices;
+    for(int i = 0; i < 4; ++i)
+    {
+      h.sceneBboxMin[i] = a_view.sceneBbox.boxMin[i];
+      h.sceneBboxMax[i] = a_view.sceneBbox.boxMax[i];
+    }
+
+    const Layout l = ComputeLayout(h);
+    h.fileSize = l.end;
+
+    // write to a temporary file first, so that other processes never see partially written cache
+    const auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    const std::string tmpPath = a_cachePath + ".tmp" + std::to_string(stamp);
+    {
+      std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+      if(!out.is_open())
+        return false;
+
+      WriteAt(out, 0, &h, sizeof(h));
+      WriteAt(out, l.sources, sources.data(), sources.size() * sizeof(SourceRecord));
+      WriteAt(out, l.strings, strings.data(), strings.size());
+      WriteAt(out, l.meshes, a_view.meshes, uint64_t(a_view.meshesNum) * sizeof(MeshRecord));
+      WriteAt(out, l.meshBboxes, a_view.meshBboxes, uint64_t(a_view.meshesNum) * sizeof(LiteMath::Box4f));
+      WriteAt(out, l.meshMeshlets, a_view.meshMeshlets, uint64_t(a_view.meshesNum) * sizeof(LiteMath::uint2));
+      WriteAt(out, l.meshlets, a_view.meshlets, uint64_t(a_view.meshletsNum) * sizeof(MeshletInfo));
+      WriteAt(out, l.meshLods, a_view.meshLods, uint64_t(a_view.meshesNum) * sizeof(LiteMath::uint2));
+      WriteAt(out, l.lods, a_view.lods, uint64_t(a_view.lodsNum) * sizeof(MeshLodInfo));
+      WriteAt(out, l.instanceMeshIds, a_view.instanceMeshIds, uint64_t(a_view.instancesNum) * sizeof(uint32_t));
+      WriteAt(out, l.instanceMatrices, a_view.instanceMatrices, uint64_t(a_view.instancesNum) * sizeof(LiteMath::float4x4));
+      WriteAt(out, l.instanceBboxes, a_view.instanceBboxes, uint64_t(a_view.instancesNum) * sizeof(LiteMath::Box4f));
+      WriteAt(out, l.cameras, a_view.cameras, uint64_t(a_view.camerasNum) * sizeof(hydra_xml::Camera));
+
+      WriteAt(out, l.vertices, nullptr, 0);
+      WriteGeometry(out, a_view, false, a_packVertices);
+      WriteAt(out, l.indices, nullptr, 0);
+      WriteGeometry(out, a_view, true, a_packIndices);
+
+      if(!out.good() || static_cast<uint64_t>(out.tellp()) != l.end)
+      {
+        out.close();
+        std::error_code ec;
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+      }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, a_cachePath, ec);
+    if(ec)
+    {
+      std::filesystem::remove(tmpPath, ec);
+      return false;
+    }
+
+    return true;
+  }
+}
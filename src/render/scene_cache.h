@@ -0,0 +1,78 @@
+#ifndef VK_GRAPHICS_BASIC_SCENE_CACHE_H
+#define VK_GRAPHICS_BASIC_SCENE_CACHE_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "LiteMath.h"
+#include "../loader_utils/hydraxml.h"
+#include "../loader_utils/vsgf_mmap.h"
+#include "../resources/shaders/common.h"
+
+// Binary cache of a loaded scene: merged vertex and index data, mesh, meshlet and LOD tables, instances and cameras.
+// Cache is stored next to the scene file and is valid while sizes and modification times
+// of the scene file and all of its meshes stay the same.
+//
+namespace scene_cache
+{
+  struct SourceStamp
+  {
+    std::string path;
+    uint64_t size  = 0;
+    int64_t  mtime = 0;
+  };
+
+  bool StampFile(const std::string &a_path, SourceStamp &a_stamp);
+
+  struct MeshRecord
+  {
+    uint32_t vertNum;
+    uint32_t indNum; // indices of all LODs
+    uint32_t vertexOffset;
+    uint32_t indexOffset;
+  };
+
+  // scene contents, pointers refer either to the mapped cache file or to the caller's data
+  struct SceneView
+  {
+    uint32_t vertexSize   = 0;
+    uint32_t indexSize    = 0;
+    uint32_t meshesNum    = 0;
+    uint32_t instancesNum = 0;
+    uint32_t camerasNum   = 0;
+    uint32_t meshletsNum  = 0;
+    uint32_t lodsNum      = 0;
+    uint64_t totalVertices = 0;
+    uint64_t totalIndices  = 0;
+
+    const MeshRecord         *meshes           = nullptr;
+    const LiteMath::Box4f    *meshBboxes       = nullptr;
+    const LiteMath::uint2    *meshMeshlets     = nullptr; // first meshlet and meshlets count of every mesh
+    const MeshletInfo        *meshlets         = nullptr;
+    const LiteMath::uint2    *meshLods         = nullptr; // first LOD and LODs count of every mesh
+    const MeshLodInfo        *lods             = nullptr;
+    const uint32_t           *instanceMeshIds  = nullptr;
+    const LiteMath::float4x4 *instanceMatrices = nullptr;
+    const LiteMath::Box4f    *instanceBboxes   = nullptr;
+    const hydra_xml::Camera  *cameras          = nullptr;
+    LiteMath::Box4f sceneBbox;
+
+    const uint8_t *vertices = nullptr; // totalVertices * vertexSize bytes
+    const uint8_t *indices  = nullptr; // totalIndices * indexSize bytes
+  };
+
+  std::string CachePath(const std::string &a_scenePath);
+
+  // maps cache file and checks that it was written with the same a_settingsKey from current versions of its sources
+  bool Open(const std::string &a_cachePath, uint32_t a_settingsKey, MappedFile &a_file, SceneView &a_view);
+
+  // fills a_dst with a_num vertices (or indices) of mesh a_meshId starting from a_first
+  using PackFunc = std::function<void(uint32_t a_meshId, uint32_t a_first, uint32_t a_num, void *a_dst)>;
+
+  // writes cache, a_view.vertices and a_view.indices are ignored, geometry is requested through pack functions
+  bool Write(const std::string &a_cachePath, uint32_t a_settingsKey, const std::vector<SourceStamp> &a_sources,
+    const SceneView &a_view, const PackFunc &a_packVertices, const PackFunc &a_packIndices);
+}
+
+#endif// VK_GRAPHICS_BASIC_SCENE_CACHE_H
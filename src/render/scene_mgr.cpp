@@ -1,9 +1,19 @@
 #include <map>
 #include <array>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
 #include "scene_mgr.h"
 #include "vk_utils.h"
 #include "vk_buffers.h"
 #include "../loader_utils/hydraxml.h"
+#include "../utils/parallel_for.h"
+#include "staging_uploader.h"
+#include "mesh_optimizer.h"
+#include "meshlets.h"
+#include "mesh_simplifier.h"
 
 
 VkTransformMatrixKHR transformMatrixFromFloat4x4(const LiteMath::float4x4 &m)
@@ -20,6 +30,11 @@ VkTransformMatrixKHR transformMatrixFromFloat4x4(const LiteMath::float4x4 &m)
   return transformMatrix;
 }
 
+static inline VkDeviceSize IndexSize(VkIndexType a_type)
+{
+  return a_type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
 SceneManager::SceneManager(VkDevice a_device, VkPhysicalDevice a_physDevice,
   uint32_t a_transferQId, uint32_t a_graphicsQId, bool debug) : m_device(a_device), m_physDevice(a_physDevice),
                  m_transferQId(a_transferQId), m_graphicsQId(a_graphicsQId), m_debug(debug)
@@ -28,12 +43,37 @@ SceneManager::SceneManager(VkDevice a_device, VkPhysicalDevice a_physDevice,
   vkGetDeviceQueue(m_device, m_graphicsQId, 0, &m_graphicsQ);
   VkDeviceSize scratchMemSize = 64 * 1024 * 1024;
   m_pCopyHelper = std::make_shared<vk_utils::PingPongCopyHelper>(m_physDevice, m_device, m_transferQ, m_transferQId, scratchMemSize);
+  m_stagingSize = scratchMemSize;
   m_pMeshData   = std::make_shared<Mesh8F>();
 
 }
 
+SceneManager::~SceneManager()
+{
+  DestroyScene();
+}
+
 bool SceneManager::LoadSceneXML(const std::string &scenePath, bool transpose)
 {
+  std::vector<scene_cache::SourceStamp> cacheSources;
+  if(!ImportScene(scenePath, transpose, cacheSources))
+    return false;
+
+  if(!cacheSources.empty())
+    SaveSceneCache(scenePath, transpose, cacheSources);
+
+  LoadGeoDataOnGPU();
+  m_loadStage = SceneLoadStage::DONE;
+
+  return true;
+}
+
+bool SceneManager::ImportScene(const std::string &scenePath, bool transpose, std::vector<scene_cache::SourceStamp> &a_cacheSources)
+{
+  a_cacheSources.clear();
+  if(m_useSceneCache && LoadSceneCache(scenePath, transpose))
+    return true;
+
   auto hscene_main = std::make_shared<hydra_xml::HydraScene>();
   auto res         = hscene_main->LoadState(scenePath);
 
@@ -43,10 +83,70 @@ bool SceneManager::LoadSceneXML(const std::string &scenePath, bool transpose)
     return false;
   }
 
+  std::vector<std::string> meshLocs;
   for(auto loc : hscene_main->MeshFiles())
+    meshLocs.push_back(loc);
+
+  // sources are stamped before reading, so that cache never claims newer versions than were actually loaded
+  std::vector<scene_cache::SourceStamp> cacheSources(meshLocs.size() + 1);
+  bool canWriteCache = m_useSceneCache && m_meshInfos.empty() && m_instanceInfos.empty();
+  canWriteCache = canWriteCache && scene_cache::StampFile(scenePath, cacheSources[0]);
+  for(size_t i = 0; i < meshLocs.size() && canWriteCache; ++i)
+    canWriteCache = scene_cache::StampFile(meshLocs[i], cacheSources[i + 1]);
+
+  // meshes are mapped and their bboxes are computed on worker threads,
+  // merging is done here in library order, so mesh ids are the same as with serial loading
+  auto mappedMeshes = MapMeshes(meshLocs);
+
+  // meshes with the same contents are uploaded once, duplicates are not added to the mesh table
+  // and their instances refer to the first copy
+  std::unordered_map<uint64_t, std::vector<uint32_t>> meshesByHash;
+  std::vector<uint32_t> firstCopy(meshLocs.size());
+  std::vector<uint32_t> uniqueMeshes;
+  for(uint32_t i = 0; i < (uint32_t)meshLocs.size(); ++i)
   {
-    auto meshId    = AddMeshFromFile(loc);
-    auto instances = hscene_main->GetAllInstancesOfMeshLoc(loc); 
+    if(!mappedMeshes[i].file.IsOpen() || mappedMeshes[i].view.VerticesNum() == 0)
+      RUN_TIME_ERROR(("can't load mesh at " + meshLocs[i]).c_str());
+
+    firstCopy[i] = UINT32_MAX;
+    if(m_dedupMeshes)
+    {
+      auto &sameHash = meshesByHash[mappedMeshes[i].contentHash];
+      firstCopy[i] = FindDuplicateMesh(mappedMeshes, i, sameHash);
+      if(firstCopy[i] == UINT32_MAX)
+        sameHash.push_back(i);
+    }
+    if(firstCopy[i] == UINT32_MAX)
+    {
+      firstCopy[i] = i;
+      uniqueMeshes.push_back(i);
+    }
+  }
+
+  if(m_optimizeMeshes && !m_cancelLoading)
+    OptimizeMappedMeshes(mappedMeshes, meshLocs, uniqueMeshes);
+  if(!m_cancelLoading)
+    BuildMappedMeshlets(mappedMeshes, uniqueMeshes);
+
+  std::vector<uint32_t> meshIds(meshLocs.size(), UINT32_MAX);
+  for(size_t i = 0; i < meshLocs.size(); ++i)
+  {
+    const auto &loc = meshLocs[i];
+
+    uint32_t meshId = UINT32_MAX;
+    if(firstCopy[i] == i)
+      meshId = AddMappedMesh(std::move(mappedMeshes[i]));
+    else
+    {
+      meshId = meshIds[firstCopy[i]];
+      m_duplicateMeshes++;
+      m_savedVertexBytes += uint64_t(m_meshInfos[meshId].m_vertNum) * m_pMeshData->SingleVertexSize();
+      m_savedIndexBytes  += uint64_t(MeshIndicesNum(meshId)) * IndexSize(m_meshIndexTypes[meshId]);
+      mappedMeshes[i].file.Close();
+    }
+    meshIds[i] = meshId;
+
+    auto instances = hscene_main->TakeAllInstancesOfMeshLoc(loc);
     for(size_t j = 0; j < instances.size(); ++j)
     {
       if(transpose)
@@ -61,12 +161,334 @@ bool SceneManager::LoadSceneXML(const std::string &scenePath, bool transpose)
     m_sceneCameras.push_back(cam);
   }
 
-  LoadGeoDataOnGPU();
-  hscene_main = nullptr;
+  if(m_duplicateMeshes > 0)
+  {
+    std::cout << "[SceneManager::LoadSceneXML] " << m_duplicateMeshes << " duplicate meshes, saved "
+              << m_savedVertexBytes << " bytes of vertex and " << m_savedIndexBytes << " bytes of index memory" << std::endl;
+  }
+
+  if(canWriteCache)
+    a_cacheSources = std::move(cacheSources);
+
+  if(m_instanceCulling == InstanceCulling::BVH)
+    UpdateInstanceBvh();
 
   return true;
 }
 
+void SceneManager::LoadSceneXMLAsync(const std::string &scenePath, bool transpose)
+{
+  StopLoading();
+
+  // resident instances are tracked as a prefix of instances added mesh by mesh, which holds only for a new scene
+  if(!m_meshInfos.empty() || !m_instanceInfos.empty())
+  {
+    vk_utils::logWarning("[SceneManager::LoadSceneXMLAsync] scene is not empty, loading synchronously");
+    LoadSceneXML(scenePath, transpose);
+    return;
+  }
+
+  m_loadStage         = SceneLoadStage::IMPORTING;
+  m_loadThreadDone    = false;
+  m_cancelLoading     = false;
+  m_loadFailed        = false;
+  m_meshesImported    = 0u;
+  m_residentMeshes    = 0u;
+  m_residentInstances = 0u;
+  m_loadError.clear();
+
+  m_loadThread = std::thread(&SceneManager::LoadSceneInBackground, this, scenePath, transpose);
+}
+
+void SceneManager::LoadSceneInBackground(const std::string &scenePath, bool transpose)
+{
+  try
+  {
+    std::vector<scene_cache::SourceStamp> cacheSources;
+    if(!ImportScene(scenePath, transpose, cacheSources))
+      RUN_TIME_ERROR("LoadSceneXML error");
+
+    if(!m_cancelLoading)
+    {
+      // render thread may read geometry written by the transfer queue at any moment,
+      // so buffers are shared by both queue families instead of being transferred at the end
+      CreateGeoBuffers(true);
+      m_pAsyncUploader = std::make_unique<StagingUploader>(m_device, m_physDevice, m_transferQ, m_transferQId,
+        m_stagingSize / 4, 4);
+      m_pAsyncUploader->SetScheduler(m_pScheduler);
+      m_pAsyncUploader->EnableDeferredSubmit();
+      m_loadStage = SceneLoadStage::UPLOADING;
+
+      // mapped meshes are kept until the cache is written, so that it does not read them from disk again
+      UploadMeshes(*m_pAsyncUploader, cacheSources.empty());
+      m_pAsyncUploader->Finish();
+
+      if(!cacheSources.empty() && !m_cancelLoading)
+        SaveSceneCache(scenePath, transpose, cacheSources);
+    }
+  }
+  catch(const std::exception &e)
+  {
+    m_loadError  = e.what();
+    m_loadFailed = true;
+  }
+
+  ReleaseMeshSources();
+  m_loadThreadDone = true;
+}
+
+bool SceneManager::UpdateLoading()
+{
+  const SceneLoadStage stage = m_loadStage;
+  if(stage != SceneLoadStage::IMPORTING && stage != SceneLoadStage::UPLOADING)
+    return false;
+
+  const uint32_t residentBefore = m_residentInstances;
+  if(stage == SceneLoadStage::UPLOADING)
+  {
+    const uint32_t residentMeshes = m_pAsyncUploader->SubmitReady();
+
+    // instances are added mesh by mesh on import, so resident ones always form a prefix
+    uint32_t residentInstances = residentBefore;
+    while(residentInstances < m_instanceInfos.size() && m_instanceInfos[residentInstances].mesh_id < residentMeshes)
+      ++residentInstances;
+
+    m_residentMeshes    = residentMeshes;
+    m_residentInstances = residentInstances;
+  }
+
+  if(m_loadThreadDone && (m_loadFailed || m_pAsyncUploader->Done()))
+  {
+    m_loadThread.join();
+    if(m_pAsyncUploader != nullptr && m_loadFailed)
+      m_pAsyncUploader->Cancel();
+    m_pAsyncUploader = nullptr;
+
+    if(m_loadFailed)
+    {
+      // called from the render thread every frame, so the failure is reported instead of thrown
+      m_loadStage = SceneLoadStage::FAILED;
+      vk_utils::logWarning("[SceneManager::LoadSceneXMLAsync] " + m_loadError);
+      return false;
+    }
+
+    m_residentMeshes    = MeshesNum();
+    m_residentInstances = InstancesNum();
+    m_loadStage         = SceneLoadStage::DONE;
+  }
+
+  return m_residentInstances != residentBefore;
+}
+
+void SceneManager::StopLoading()
+{
+  if(!m_loadThread.joinable())
+    return;
+
+  m_cancelLoading = true;
+
+  // loading thread may wait for staging memory which is recycled only by the render thread
+  while(!m_loadThreadDone)
+  {
+    if(m_loadStage == SceneLoadStage::UPLOADING)
+      m_pAsyncUploader->Cancel();
+    std::this_thread::yield();
+  }
+  m_loadThread.join();
+
+  if(m_pAsyncUploader != nullptr)
+    m_pAsyncUploader->Cancel();
+  m_pAsyncUploader = nullptr;
+
+  // copies that were not submitted yet are dropped
+  m_loadStage = SceneLoadStage::FAILED;
+}
+
+bool SceneManager::IsLoading() const
+{
+  const SceneLoadStage stage = m_loadStage;
+  return stage == SceneLoadStage::IMPORTING || stage == SceneLoadStage::UPLOADING;
+}
+
+uint32_t SceneManager::ResidentInstancesNum() const
+{
+  const SceneLoadStage stage = m_loadStage;
+  if(stage == SceneLoadStage::NONE || stage == SceneLoadStage::DONE)
+    return InstancesNum();
+  return m_residentInstances;
+}
+
+uint32_t SceneManager::GpuInstancesNum() const
+{
+  const SceneLoadStage stage = m_loadStage;
+  if(stage == SceneLoadStage::NONE || stage == SceneLoadStage::DONE)
+    return m_gpuInstancesNum;
+
+  const uint32_t residentMeshes = m_residentMeshes;
+  if(residentMeshes == 0)
+    return 0;
+  return residentMeshes < m_meshGpuInstances.size() ? m_meshGpuInstances[residentMeshes].x : m_gpuInstancesNum;
+}
+
+SceneLoadProgress SceneManager::GetLoadProgress() const
+{
+  SceneLoadProgress res;
+  res.stage = m_loadStage;
+  if(res.stage != SceneLoadStage::IMPORTING)
+  {
+    res.duplicateMeshes  = m_duplicateMeshes;
+    res.savedVertexBytes = m_savedVertexBytes;
+    res.savedIndexBytes  = m_savedIndexBytes;
+  }
+  switch(res.stage)
+  {
+  case SceneLoadStage::IMPORTING:
+    break;
+  case SceneLoadStage::UPLOADING:
+  case SceneLoadStage::FAILED:
+    res.meshesTotal       = MeshesNum();
+    res.meshesImported    = m_meshesImported;
+    res.meshesResident    = m_residentMeshes;
+    res.instancesTotal    = InstancesNum();
+    res.instancesResident = m_residentInstances;
+    break;
+  default:
+    res.meshesTotal       = MeshesNum();
+    res.meshesImported    = res.meshesTotal;
+    res.meshesResident    = res.meshesTotal;
+    res.instancesTotal    = InstancesNum();
+    res.instancesResident = res.instancesTotal;
+    break;
+  }
+  return res;
+}
+
+void SceneManager::SetCompactVerticesEnabled(bool a_enable)
+{
+  if(a_enable == m_compactVertices)
+    return;
+
+  if(!m_meshInfos.empty() || IsLoading())
+  {
+    vk_utils::logWarning("[SceneManager::SetCompactVerticesEnabled] vertex format can't be changed after meshes were added");
+    return;
+  }
+
+  m_compactVertices = a_enable;
+  if(m_compactVertices)
+    m_pMeshData = std::make_shared<Mesh4U>();
+  else
+    m_pMeshData = std::make_shared<Mesh8F>();
+}
+
+compact_vertex::Quantization SceneManager::MeshQuantization(const LiteMath::Box4f &meshBox) const
+{
+  return m_compactVertices ? compact_vertex::MakeQuantization(meshBox) : compact_vertex::Quantization();
+}
+
+uint32_t SceneManager::SceneCacheKey(bool transpose) const
+{
+  return (transpose ? 1u : 0u) | uint32_t(m_pMeshData->SingleVertexSize() << 1) | uint32_t(m_pMeshData->SingleIndexSize() << 16) |
+    (m_buildLods ? 1u << 29 : 0u) | (m_optimizeMeshes ? 1u << 30 : 0u) | (m_dedupMeshes ? 1u << 31 : 0u);
+}
+
+bool SceneManager::LoadSceneCache(const std::string &scenePath, bool transpose)
+{
+  if(!m_meshInfos.empty() || !m_instanceInfos.empty())
+    return false;
+
+  scene_cache::SceneView view;
+  if(!scene_cache::Open(scene_cache::CachePath(scenePath), SceneCacheKey(transpose), m_cacheFile, view))
+    return false;
+
+  m_cacheVertices = view.vertices;
+  m_cacheIndices  = reinterpret_cast<const uint32_t *>(view.indices);
+
+  for(uint32_t i = 0; i < view.meshesNum; ++i)
+  {
+    MeshSource source;
+    source.type       = MeshSourceType::SCENE_CACHE;
+    source.vertOffset = view.meshes[i].vertexOffset;
+    source.idxOffset  = view.meshes[i].indexOffset;
+    m_meshSources.push_back(source);
+
+    // cached meshes come from VSGF files and were quantized in their bounding boxes, see AddMappedMesh
+    AddMeshInfo(view.meshes[i].vertNum, view.meshes[i].indNum, view.meshBboxes[i], MeshQuantization(view.meshBboxes[i]),
+      view.meshlets + view.meshMeshlets[i].x, view.meshMeshlets[i].y, view.lods + view.meshLods[i].x, view.meshLods[i].y);
+  }
+
+  m_instanceMatrices.assign(view.instanceMatrices, view.instanceMatrices + view.instancesNum);
+  m_instanceBboxes.assign(view.instanceBboxes, view.instanceBboxes + view.instancesNum);
+  m_instanceInfos.resize(view.instancesNum);
+  for(uint32_t i = 0; i < view.instancesNum; ++i)
+  {
+    m_instanceInfos[i].inst_id       = i;
+    m_instanceInfos[i].mesh_id       = view.instanceMeshIds[i];
+    m_instanceInfos[i].renderMark    = true;
+    m_instanceInfos[i].instBufOffset = i * sizeof(LiteMath::float4x4);
+  }
+  sceneBbox = view.sceneBbox;
+
+  m_instanceCuller.SetBoxes(m_instanceBboxes.data(), (uint32_t)m_instanceBboxes.size());
+
+  m_sceneCameras.assign(view.cameras, view.cameras + view.camerasNum);
+
+  if(m_instanceCulling == InstanceCulling::BVH)
+    UpdateInstanceBvh();
+
+  return true;
+}
+
+void SceneManager::SaveSceneCache(const std::string &scenePath, bool transpose, const std::vector<scene_cache::SourceStamp> &sources)
+{
+  // cache keeps 32 bit indices of all meshes in one array, they are compacted again on upload
+  std::vector<scene_cache::MeshRecord> meshes(m_meshInfos.size());
+  uint32_t cacheIndices = 0u;
+  for(size_t i = 0; i < m_meshInfos.size(); ++i)
+  {
+    const uint32_t indNum = MeshIndicesNum(uint32_t(i));
+    meshes[i] = {m_meshInfos[i].m_vertNum, indNum, m_meshInfos[i].m_vertexOffset, cacheIndices};
+    cacheIndices += indNum;
+  }
+
+  std::vector<uint32_t> instanceMeshIds(m_instanceInfos.size());
+  for(size_t i = 0; i < m_instanceInfos.size(); ++i)
+    instanceMeshIds[i] = m_instanceInfos[i].mesh_id;
+
+  scene_cache::SceneView view;
+  view.vertexSize       = (uint32_t)m_pMeshData->SingleVertexSize();
+  view.indexSize        = (uint32_t)m_pMeshData->SingleIndexSize();
+  view.meshesNum        = (uint32_t)meshes.size();
+  view.instancesNum     = (uint32_t)m_instanceInfos.size();
+  view.camerasNum       = (uint32_t)m_sceneCameras.size();
+  view.meshletsNum      = (uint32_t)m_meshlets.size();
+  view.lodsNum          = (uint32_t)m_lods.size();
+  view.totalVertices    = m_totalVertices;
+  view.totalIndices     = cacheIndices;
+  view.meshes           = meshes.data();
+  view.meshBboxes       = m_meshBboxes.data();
+  view.meshMeshlets     = m_meshMeshlets.data();
+  view.meshlets         = m_meshlets.data();
+  view.meshLods         = m_meshLodRanges.data();
+  view.lods             = m_lods.data();
+  view.instanceMeshIds  = instanceMeshIds.data();
+  view.instanceMatrices = m_instanceMatrices.data();
+  view.instanceBboxes   = m_instanceBboxes.data();
+  view.cameras          = m_sceneCameras.data();
+  view.sceneBbox        = sceneBbox;
+
+  auto packVertices = [this](uint32_t meshId, uint32_t first, uint32_t num, void *dst) {
+    PackMeshVertices(meshId, first, num, static_cast<float *>(dst));
+  };
+  auto packIndices = [this](uint32_t meshId, uint32_t first, uint32_t num, void *dst) {
+    PackMeshIndices(meshId, first, num, static_cast<uint32_t *>(dst));
+  };
+
+  const std::string cachePath = scene_cache::CachePath(scenePath);
+  if(!scene_cache::Write(cachePath, SceneCacheKey(transpose), sources, view, packVertices, packIndices))
+    vk_utils::logWarning("[SceneManager::SaveSceneCache] can't write scene cache to " + cachePath);
+}
+
 hydra_xml::Camera SceneManager::GetCamera(uint32_t camId) const
 {
   if(camId >= m_sceneCameras.size())
@@ -127,47 +549,446 @@ void SceneManager::LoadSingleTriangle()
 
 
 
+// FNV-1a over 64 bit words, only used to find candidates for byte comparison
+static uint64_t HashBytes(const uint8_t *data, size_t size)
+{
+  constexpr uint64_t FNV_PRIME = 1099511628211ull;
+  uint64_t hash = 14695981039346656037ull;
+
+  size_t i = 0;
+  for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * FNV_PRIME;
+  }
+  for(; i < size; ++i)
+    hash = (hash ^ data[i]) * FNV_PRIME;
+
+  return hash;
+}
+
+static LiteMath::Box4f CalcMeshBbox(const float *pos4f, size_t vertNum)
+{
+  Box4f meshBox;
+  for (size_t i = 0; i < vertNum; ++i) {
+    meshBox.include(reinterpret_cast<const float4*>(pos4f)[i]);
+  }
+  return meshBox;
+}
+
+std::vector<SceneManager::MappedMesh> SceneManager::MapMeshes(const std::vector<std::string> &meshPaths) const
+{
+  std::vector<MappedMesh> res(meshPaths.size());
+
+  ParallelFor((uint32_t)meshPaths.size(), m_importThreads, [&](uint32_t i)
+  {
+    //@TODO: other file formats
+    if(vsgf::MapMesh(meshPaths[i], res[i].file, res[i].view))
+    {
+      res[i].bbox = CalcMeshBbox(res[i].view.pos4f, res[i].view.VerticesNum());
+      if(m_dedupMeshes)
+        res[i].contentHash = HashBytes(res[i].file.Data(), res[i].file.Size());
+    }
+  });
+
+  return res;
+}
+
+uint32_t SceneManager::FindDuplicateMesh(const std::vector<MappedMesh> &meshes, uint32_t meshIdx, const std::vector<uint32_t> &candidates)
+{
+  const MappedFile &file = meshes[meshIdx].file;
+  for(uint32_t idx : candidates)
+  {
+    const MappedFile &other = meshes[idx].file;
+    if(other.Size() == file.Size() && memcmp(other.Data(), file.Data(), file.Size()) == 0)
+      return idx;
+  }
+  return UINT32_MAX;
+}
+
+static void PackVSGFVertices(const vsgf::MeshView &view, const uint32_t *a_vertices, uint32_t firstVert, uint32_t vertNum, float *dst);
+
+void SceneManager::OptimizeMappedMeshes(std::vector<MappedMesh> &meshes, const std::vector<std::string> &meshPaths,
+  const std::vector<uint32_t> &meshIdx) const
+{
+  const size_t vertSize = m_pMeshData->SingleVertexSize();
+
+  std::vector<mesh_optimizer::Result> results(meshIdx.size());
+  ParallelFor((uint32_t)meshIdx.size(), m_importThreads, [&](uint32_t i)
+  {
+    const vsgf::MeshView &view = meshes[meshIdx[i]].view;
+
+    // vertices are welded by their packed contents, source attributes differ more often than quantized ones
+    std::vector<float> packed(view.VerticesNum() * vertSize / sizeof(float));
+    PackVSGFVertices(view, nullptr, 0, view.VerticesNum(), packed.data());
+
+    mesh_optimizer::MeshInput input;
+    input.pos4f             = view.pos4f;
+    input.indices           = view.indices;
+    input.vertNum           = view.VerticesNum();
+    input.indNum            = view.IndicesNum();
+    input.weldKey           = packed.data();
+    input.weldKeyComponents = uint32_t(vertSize / sizeof(float));
+    results[i] = mesh_optimizer::Optimize(input);
+  });
+
+  // vertex shader invocations estimated with a FIFO cache of STATS_CACHE_SIZE entries
+  constexpr uint32_t REPORT_MIN_TRIANGLES = 10000;
+  uint64_t vertsBefore = 0, vertsAfter = 0, transformedBefore = 0, transformedAfter = 0, trianglesNum = 0;
+  for(size_t i = 0; i < meshIdx.size(); ++i)
+  {
+    MappedMesh &mesh = meshes[meshIdx[i]];
+    const auto &res  = results[i];
+    const uint32_t meshTriangles = mesh.view.IndicesNum() / 3;
+    if(meshTriangles >= REPORT_MIN_TRIANGLES)
+    {
+      std::cout << "[SceneManager::OptimizeMappedMeshes] " << meshPaths[meshIdx[i]] << ": " << meshTriangles << " triangles, vertices "
+                << mesh.view.VerticesNum() << " -> " << res.vertices.size() << ", ACMR " << res.before.acmr << " -> " << res.after.acmr
+                << ", ATVR " << res.before.atvr << " -> " << res.after.atvr << std::endl;
+    }
+
+    vertsBefore       += mesh.view.VerticesNum();
+    vertsAfter        += res.vertices.size();
+    transformedBefore += res.before.transformed;
+    transformedAfter  += res.after.transformed;
+    trianglesNum      += meshTriangles;
+
+    mesh.vertices = std::move(results[i].vertices);
+    mesh.indices  = std::move(results[i].indices);
+  }
+
+  if(trianglesNum > 0)
+  {
+    std::cout << "[SceneManager::OptimizeMappedMeshes] " << meshIdx.size() << " meshes, vertices " << vertsBefore << " -> " << vertsAfter
+              << ", ACMR " << float(transformedBefore) / float(trianglesNum) << " -> " << float(transformedAfter) / float(trianglesNum)
+              << std::endl;
+  }
+}
+
+void SceneManager::BuildMappedMeshlets(std::vector<MappedMesh> &meshes, const std::vector<uint32_t> &meshIdx) const
+{
+  ParallelFor((uint32_t)meshIdx.size(), m_importThreads, [&](uint32_t i)
+  {
+    MappedMesh &mesh = meshes[meshIdx[i]];
+    const vsgf::MeshView &view = mesh.view;
+    if(mesh.indices.empty())
+      mesh.indices.assign(view.indices, view.indices + view.IndicesNum());
+
+    meshlets::BuildInput input;
+    input.pos4f   = view.pos4f;
+    input.norm4f  = view.norm4f;
+    input.indices = mesh.indices.data();
+    input.vertNum = mesh.VerticesNum();
+    input.indNum  = mesh.IndicesNum();
+
+    // optimized meshes refer to a subset of view vertices
+    std::vector<float> positions, normals, texCoords;
+    const float *texCoord2f = view.texcoord2f;
+    if(!mesh.vertices.empty())
+    {
+      positions.resize(mesh.vertices.size() * 4);
+      normals.resize(view.norm4f != nullptr ? mesh.vertices.size() * 4 : 0);
+      texCoords.resize(m_buildLods ? mesh.vertices.size() * 2 : 0);
+      for(size_t v = 0; v < mesh.vertices.size(); ++v)
+      {
+        memcpy(positions.data() + v * 4, view.pos4f + size_t(mesh.vertices[v]) * 4, 4 * sizeof(float));
+        if(!normals.empty())
+          memcpy(normals.data() + v * 4, view.norm4f + size_t(mesh.vertices[v]) * 4, 4 * sizeof(float));
+        if(!texCoords.empty())
+          memcpy(texCoords.data() + v * 2, view.texcoord2f + size_t(mesh.vertices[v]) * 2, 2 * sizeof(float));
+      }
+      input.pos4f  = positions.data();
+      input.norm4f = normals.empty() ? nullptr : normals.data();
+      texCoord2f   = texCoords.data();
+    }
+
+    auto built = meshlets::Build(input);
+    mesh_optimizer::ReorderTriangles(mesh.indices.data(), mesh.indices.size(), built.triangleOrder);
+    mesh.meshlets = std::move(built.meshlets);
+
+    if(m_buildLods)
+    {
+      mesh_optimizer::MeshInput lodInput;
+      lodInput.pos4f      = input.pos4f;
+      lodInput.norm4f     = input.norm4f;
+      lodInput.texcoord2f = texCoord2f;
+      lodInput.indices    = mesh.indices.data();
+      lodInput.vertNum    = input.vertNum;
+      lodInput.indNum     = input.indNum;
+
+      auto chain = mesh_simplifier::BuildLodChain(lodInput);
+      mesh.indices.insert(mesh.indices.end(), chain.indices.begin(), chain.indices.end());
+      mesh.lods = std::move(chain.lods);
+    }
+  });
+}
+
 uint32_t SceneManager::AddMeshFromFile(const std::string& meshPath)
 {
   //@TODO: other file formats
-  auto data = cmesh::LoadMeshFromVSGF(meshPath.c_str());
-
-  if(data.VerticesNum() == 0)
+  MappedMesh mesh;
+  if(!vsgf::MapMesh(meshPath, mesh.file, mesh.view) || mesh.view.VerticesNum() == 0)
     RUN_TIME_ERROR(("can't load mesh at " + meshPath).c_str());
 
-  return AddMeshFromData(data);
+  mesh.bbox = CalcMeshBbox(mesh.view.pos4f, mesh.view.VerticesNum());
+
+  std::vector<MappedMesh> meshes(1);
+  meshes[0] = std::move(mesh);
+  if(m_optimizeMeshes)
+    OptimizeMappedMeshes(meshes, {meshPath}, {0u});
+  BuildMappedMeshlets(meshes, {0u});
+
+  return AddMappedMesh(std::move(meshes[0]));
+}
+
+uint32_t SceneManager::AddMappedMesh(MappedMesh &&mesh)
+{
+  assert(mesh.view.VerticesNum() > 0);
+  assert(mesh.view.IndicesNum() > 0);
+
+  MeshSource source;
+  source.type     = MeshSourceType::MAPPED_VSGF;
+  source.mappedId = (uint32_t)m_mappedMeshes.size();
+  m_meshSources.push_back(source);
+
+  const uint32_t meshId = AddMeshInfo(mesh.VerticesNum(), mesh.IndicesNum(), mesh.bbox, MeshQuantization(mesh.bbox),
+    mesh.meshlets.data(), (uint32_t)mesh.meshlets.size(), mesh.lods.data(), (uint32_t)mesh.lods.size());
+  m_mappedMeshes.push_back(std::move(mesh));
+
+  return meshId;
 }
 
 uint32_t SceneManager::AddMeshFromData(cmesh::SimpleMesh &meshData)
+{
+  return AddMeshFromData(meshData, CalcMeshBbox(meshData.vPos4f.data(), meshData.VerticesNum()));
+}
+
+uint32_t SceneManager::AddMeshFromData(cmesh::SimpleMesh &meshData, const LiteMath::Box4f &meshBox)
 {
   assert(meshData.VerticesNum() > 0);
   assert(meshData.IndicesNum() > 0);
 
-  m_pMeshData->Append(meshData);
+  MeshSource source;
+  source.type       = MeshSourceType::MESH_DATA;
+  source.vertOffset = uint32_t(m_pMeshData->VertexDataSize() / m_pMeshData->SingleVertexSize());
+  source.idxOffset  = uint32_t(m_pMeshData->IndexDataSize()  / m_pMeshData->SingleIndexSize());
+  m_meshSources.push_back(source);
+
+  // caller's mesh is not modified, triangles of the copy are reordered by meshlets
+  cmesh::SimpleMesh mesh = m_optimizeMeshes ?
+    mesh_optimizer::ApplyResult(mesh_optimizer::Optimize(mesh_optimizer::MakeInput(meshData)), meshData) : meshData;
+
+  meshlets::BuildInput input;
+  input.pos4f   = mesh.vPos4f.data();
+  input.norm4f  = mesh.vNorm4f.empty() ? nullptr : mesh.vNorm4f.data();
+  input.indices = mesh.indices.data();
+  input.vertNum = (uint32_t)mesh.VerticesNum();
+  input.indNum  = (uint32_t)mesh.IndicesNum();
+  const auto built = meshlets::Build(input);
+  mesh_optimizer::ReorderTriangles(mesh.indices.data(), mesh.indices.size(), built.triangleOrder);
+  if(mesh.matIndices.size() == built.triangleOrder.size())
+  {
+    const std::vector<uint32_t> matIndices(mesh.matIndices.begin(), mesh.matIndices.end());
+    for(size_t t = 0; t < built.triangleOrder.size(); ++t)
+      mesh.matIndices[t] = matIndices[built.triangleOrder[t]];
+  }
+
+  // indices of coarser LODs are stored right after the full mesh, they have no material indices
+  std::vector<MeshLodInfo> lods;
+  if(m_buildLods)
+  {
+    auto chain = mesh_simplifier::BuildLodChain(mesh_optimizer::MakeInput(mesh));
+    mesh.indices.insert(mesh.indices.end(), chain.indices.begin(), chain.indices.end());
+    lods = std::move(chain.lods);
+  }
+
+  m_pMeshData->Append(mesh);
+
+  // Mesh4U quantizes in the box of mesh positions, which may differ from meshBox given by the caller
+  const auto quant = MeshQuantization(CalcMeshBbox(mesh.vPos4f.data(), mesh.VerticesNum()));
+  return AddMeshInfo((uint32_t)mesh.VerticesNum(), (uint32_t)mesh.IndicesNum(), meshBox, quant, built.meshlets.data(),
+    (uint32_t)built.meshlets.size(), lods.data(), (uint32_t)lods.size());
+}
+
+uint32_t SceneManager::AddMeshInfo(uint32_t vertNum, uint32_t indNum, const LiteMath::Box4f &meshBox,
+  const compact_vertex::Quantization &quant, const MeshletInfo *meshlets, uint32_t meshletsNum,
+  const MeshLodInfo *lods, uint32_t lodsNum)
+{
+  // indices are relative to the first mesh vertex, so they fit in 16 bits if the mesh is small enough
+  const VkIndexType indexType = vertNum <= 65536 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+  uint32_t &totalIndices      = indexType == VK_INDEX_TYPE_UINT16 ? m_totalIndices16 : m_totalIndices;
+
+  const MeshLodInfo fullMesh = {0u, indNum, 0.0f, 0u};
+  if(lodsNum == 0)
+  {
+    lods    = &fullMesh;
+    lodsNum = 1;
+  }
+  assert(lods[lodsNum - 1].firstIndex + lods[lodsNum - 1].indexCount == indNum);
 
   MeshInfo info;
-  info.m_vertNum = (uint32_t)meshData.VerticesNum();
-  info.m_indNum  = (uint32_t)meshData.IndicesNum();
+  info.m_vertNum = vertNum;
+  info.m_indNum  = lods[0].indexCount;
 
   info.m_vertexOffset = m_totalVertices;
-  info.m_indexOffset  = m_totalIndices;
+  info.m_indexOffset  = totalIndices;
 
   info.m_vertexBufOffset = info.m_vertexOffset * m_pMeshData->SingleVertexSize();
-  info.m_indexBufOffset  = info.m_indexOffset  * m_pMeshData->SingleIndexSize();
+  info.m_indexBufOffset  = info.m_indexOffset  * IndexSize(indexType);
 
-  m_totalVertices += (uint32_t)meshData.VerticesNum();
-  m_totalIndices  += (uint32_t)meshData.IndicesNum();
+  m_totalVertices += vertNum;
+  totalIndices    += indNum;
 
   m_meshInfos.push_back(info);
-  Box4f meshBox;
-  for (uint32_t i = 0; i < meshData.VerticesNum(); ++i) {
-    meshBox.include(reinterpret_cast<float4*>(meshData.vPos4f.data())[i]);
-  }
+  m_meshIndexTypes.push_back(indexType);
   m_meshBboxes.push_back(meshBox);
+  m_meshQuants.push_back(quant);
+
+  m_meshMeshlets.emplace_back((uint32_t)m_meshlets.size(), meshletsNum);
+  m_meshlets.insert(m_meshlets.end(), meshlets, meshlets + meshletsNum);
+
+  m_meshLodRanges.emplace_back((uint32_t)m_lods.size(), lodsNum);
+  m_lods.insert(m_lods.end(), lods, lods + lodsNum);
 
   return (uint32_t)m_meshInfos.size() - 1;
 }
 
+uint32_t SceneManager::MeshIndicesNum(uint32_t meshId) const
+{
+  assert(meshId < m_meshLodRanges.size());
+  const MeshLodInfo &last = m_lods[m_meshLodRanges[meshId].x + m_meshLodRanges[meshId].y - 1];
+  return last.firstIndex + last.indexCount;
+}
+
+// same packing as in Mesh8F, see DecodeNormal in unpack_attributes.h
+static inline uint32_t EncodeNormal(const float *n)
+{
+  const int x = (int)(n[0] * 32767.0f);
+  const int y = (int)(n[1] * 32767.0f);
+
+  const uint32_t sign = (n[2] >= 0.0f) ? 0u : 1u;
+  const uint32_t sx   = ((uint32_t)(x & 0xfffe) | sign);
+  const uint32_t sy   = ((uint32_t)(y & 0xffff) << 16);
+
+  return (sx | sy);
+}
+
+static inline float AsFloat(uint32_t a_bits)
+{
+  float res;
+  memcpy(&res, &a_bits, sizeof(float));
+  return res;
+}
+
+// Mesh8F layout: (pos.xyz, normal) (uv, tangent, unused), a_vertices optionally maps packed vertices to view vertices
+static void PackVSGFVertices(const vsgf::MeshView &view, const uint32_t *a_vertices, uint32_t firstVert, uint32_t vertNum, float *dst)
+{
+  const float zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for(uint32_t j = firstVert; j < firstVert + vertNum; ++j)
+  {
+    const size_t i    = a_vertices != nullptr ? a_vertices[j] : j;
+    const float *pos  = view.pos4f + i * 4;
+    const float *norm = view.norm4f != nullptr ? view.norm4f + i * 4 : zero;
+    const float *tang = view.tang4f != nullptr ? view.tang4f + i * 4 : zero;
+
+    dst[0] = pos[0];
+    dst[1] = pos[1];
+    dst[2] = pos[2];
+    dst[3] = AsFloat(EncodeNormal(norm));
+    dst[4] = view.texcoord2f[i * 2 + 0];
+    dst[5] = view.texcoord2f[i * 2 + 1];
+    dst[6] = AsFloat(EncodeNormal(tang));
+    dst[7] = 0.0f;
+    dst += 8;
+  }
+}
+
+static void PackVSGFVerticesCompact(const vsgf::MeshView &view, const uint32_t *a_vertices, const compact_vertex::Quantization &quant,
+  uint32_t firstVert, uint32_t vertNum, uint32_t *dst)
+{
+  for(uint32_t j = firstVert; j < firstVert + vertNum; ++j)
+  {
+    const size_t i = a_vertices != nullptr ? a_vertices[j] : j;
+    compact_vertex::PackVertex(view.pos4f + i * 4,
+                               view.norm4f != nullptr ? view.norm4f + i * 4 : nullptr,
+                               view.tang4f != nullptr ? view.tang4f + i * 4 : nullptr,
+                               view.texcoord2f + i * 2, quant, dst);
+    dst += 4;
+  }
+}
+
+void SceneManager::PackMeshVertices(uint32_t meshId, uint32_t firstVert, uint32_t vertNum, float *dst) const
+{
+  assert(meshId < m_meshSources.size());
+  assert(firstVert + vertNum <= m_meshInfos[meshId].m_vertNum);
+
+  const auto &source = m_meshSources[meshId];
+  const size_t vertSize = m_pMeshData->SingleVertexSize();
+
+  if(source.type == MeshSourceType::MESH_DATA)
+  {
+    const auto *src = reinterpret_cast<const uint8_t *>(m_pMeshData->VertexData());
+    memcpy(dst, src + (source.vertOffset + firstVert) * vertSize, vertNum * vertSize);
+    return;
+  }
+
+  if(source.type == MeshSourceType::SCENE_CACHE)
+  {
+    assert(m_cacheVertices != nullptr);
+    memcpy(dst, m_cacheVertices + size_t(source.vertOffset + firstVert) * vertSize, vertNum * vertSize);
+    return;
+  }
+
+  assert(source.mappedId < m_mappedMeshes.size());
+  const MappedMesh &mesh = m_mappedMeshes[source.mappedId];
+  const uint32_t *vertices = mesh.vertices.empty() ? nullptr : mesh.vertices.data();
+  if(m_compactVertices)
+    PackVSGFVerticesCompact(mesh.view, vertices, m_meshQuants[meshId], firstVert, vertNum, reinterpret_cast<uint32_t *>(dst));
+  else
+    PackVSGFVertices(mesh.view, vertices, firstVert, vertNum, dst);
+}
+
+const uint32_t *SceneManager::MeshSourceIndices(uint32_t meshId) const
+{
+  assert(meshId < m_meshSources.size());
+
+  const auto &source = m_meshSources[meshId];
+  const uint32_t *src = nullptr;
+  switch(source.type)
+  {
+  case MeshSourceType::MESH_DATA:
+    src = m_pMeshData->IndexData() + source.idxOffset;
+    break;
+  case MeshSourceType::MAPPED_VSGF:
+    assert(source.mappedId < m_mappedMeshes.size());
+    src = m_mappedMeshes[source.mappedId].indices.empty() ? m_mappedMeshes[source.mappedId].view.indices :
+                                                            m_mappedMeshes[source.mappedId].indices.data();
+    break;
+  case MeshSourceType::SCENE_CACHE:
+    assert(m_cacheIndices != nullptr);
+    src = m_cacheIndices + source.idxOffset;
+    break;
+  }
+  return src;
+}
+
+void SceneManager::PackMeshIndices(uint32_t meshId, uint32_t firstInd, uint32_t indNum, uint32_t *dst) const
+{
+  assert(firstInd + indNum <= MeshIndicesNum(meshId));
+  memcpy(dst, MeshSourceIndices(meshId) + firstInd, indNum * sizeof(uint32_t));
+}
+
+void SceneManager::PackMeshIndices16(uint32_t meshId, uint32_t firstInd, uint32_t indNum, uint16_t *dst) const
+{
+  assert(firstInd + indNum <= MeshIndicesNum(meshId));
+  assert(m_meshIndexTypes[meshId] == VK_INDEX_TYPE_UINT16);
+
+  const uint32_t *src = MeshSourceIndices(meshId) + firstInd;
+  for(uint32_t i = 0; i < indNum; ++i)
+    dst[i] = static_cast<uint16_t>(src[i]);
+}
+
 uint32_t SceneManager::InstanceMesh(const uint32_t meshId, const LiteMath::float4x4 &matrix, bool markForRender)
 {
   assert(meshId < m_meshInfos.size());
@@ -183,6 +1004,16 @@ uint32_t SceneManager::InstanceMesh(const uint32_t meshId, const LiteMath::float
 
   m_instanceInfos.push_back(info);
 
+  const Box4f instBox = CalcInstanceBbox(meshId, matrix);
+  sceneBbox.include(instBox);
+  m_instanceBboxes.push_back(instBox);
+  m_instanceCuller.AddBox(instBox);
+
+  return info.inst_id;
+}
+
+LiteMath::Box4f SceneManager::CalcInstanceBbox(uint32_t meshId, const LiteMath::float4x4 &matrix) const
+{
   Box4f instBox;
   for (uint32_t i = 0; i < 8; ++i) {
     float4 corner = float4(
@@ -193,10 +1024,206 @@ uint32_t SceneManager::InstanceMesh(const uint32_t meshId, const LiteMath::float
     );
     instBox.include(matrix * corner);
   }
-  sceneBbox.include(instBox);
-  m_instanceBboxes.push_back(instBox);
+  return instBox;
+}
 
-  return info.inst_id;
+void SceneManager::SetInstanceMatrix(uint32_t instId, const LiteMath::float4x4 &matrix)
+{
+  assert(instId < m_instanceInfos.size());
+
+  {
+    std::lock_guard<std::mutex> lock(m_instancesMutex);
+    m_instanceMatrices[instId] = matrix;
+    m_instanceBboxes[instId]   = CalcInstanceBbox(m_instanceInfos[instId].mesh_id, matrix);
+  }
+  sceneBbox.include(m_instanceBboxes[instId]);
+  m_instanceCuller.SetBox(instId, m_instanceBboxes[instId]);
+  m_instanceBvhDirty = true;
+  m_movedInstances.push_back(instId);
+  ++m_instancesVersion;
+}
+
+InstanceCullInfo SceneManager::GetInstanceCullInfo(uint32_t instId) const
+{
+  InstanceCullInfo info;
+  info.boxMin = LiteMath::to_float3(m_instanceBboxes[instId].boxMin);
+  info.meshId = m_instanceInfos[instId].mesh_id;
+  info.boxMax = LiteMath::to_float3(m_instanceBboxes[instId].boxMax);
+  info.scale  = mesh_simplifier::MatrixScale(m_instanceMatrices[instId]);
+  return info;
+}
+
+LiteMath::float4x4 SceneManager::GetInstanceDrawMatrix(uint32_t instId) const
+{
+  return m_instanceMatrices[instId] * GetMeshDequantMatrix(m_instanceInfos[instId].mesh_id);
+}
+
+void SceneManager::CmdUpdateInstances(VkCommandBuffer a_cmdBuf)
+{
+  // instance buffers are written by the loading thread until resident instances appear
+  if(m_movedInstances.empty() || GpuInstancesNum() == 0)
+    return;
+
+  std::sort(m_movedInstances.begin(), m_movedInstances.end());
+  m_movedInstances.erase(std::unique(m_movedInstances.begin(), m_movedInstances.end()), m_movedInstances.end());
+  m_movedInstances.erase(std::lower_bound(m_movedInstances.begin(), m_movedInstances.end(), m_gpuInstancesNum), m_movedInstances.end());
+  if(m_movedInstances.empty())
+    return;
+
+  // previous frames may still read the buffers, matrices are also read as instance vertex attributes
+  const VkPipelineStageFlags readStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  VkMemoryBarrier barrier = {};
+  barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(a_cmdBuf, readStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+  for(uint32_t instId : m_movedInstances)
+  {
+    const InstanceCullInfo cullInfo  = GetInstanceCullInfo(instId);
+    const LiteMath::float4x4 matrix = GetInstanceDrawMatrix(instId);
+    const uint32_t slot = GetInstanceGpuSlot(instId);
+    vkCmdUpdateBuffer(a_cmdBuf, m_instanceCullInfoBuf, slot * sizeof(InstanceCullInfo), sizeof(cullInfo), &cullInfo);
+    vkCmdUpdateBuffer(a_cmdBuf, m_instanceMatricesBuffer, slot * sizeof(LiteMath::float4x4), sizeof(matrix), &matrix);
+  }
+  m_movedInstances.clear();
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  vkCmdPipelineBarrier(a_cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, readStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void SceneManager::AssignGpuInstanceSlots()
+{
+  // counting sort of instances by mesh, order of instances of one mesh is kept
+  m_meshGpuInstances.assign(m_meshInfos.size(), LiteMath::uint2(0u, 0u));
+  for(const auto &info : m_instanceInfos)
+    m_meshGpuInstances[info.mesh_id].y++;
+
+  uint32_t firstSlot = 0;
+  for(auto &range : m_meshGpuInstances)
+  {
+    range.x    = firstSlot;
+    firstSlot += range.y;
+  }
+
+  std::vector<uint32_t> filled(m_meshInfos.size(), 0u);
+  m_gpuSlotInstances.resize(m_instanceInfos.size());
+  for(uint32_t i = 0; i < m_instanceInfos.size(); ++i)
+  {
+    const uint32_t meshId = m_instanceInfos[i].mesh_id;
+    const uint32_t slot   = m_meshGpuInstances[meshId].x + filled[meshId]++;
+    m_gpuSlotInstances[slot]         = i;
+    m_instanceInfos[i].instBufOffset = slot * sizeof(LiteMath::float4x4);
+  }
+  m_gpuInstancesNum = (uint32_t)m_instanceInfos.size();
+}
+
+void SceneManager::AppendInstancedDraws(const uint32_t *a_instIds, const uint32_t *a_lods, uint32_t a_instNum,
+  std::vector<InstancedDraw> &a_draws)
+{
+  const uint32_t gpuInstancesNum = GpuInstancesNum();
+  m_instancedDrawKeys.clear();
+  for(uint32_t i = 0; i < a_instNum; ++i)
+  {
+    if(a_instIds[i] >= m_gpuInstancesNum)
+      continue;
+    const uint32_t slot = GetInstanceGpuSlot(a_instIds[i]);
+    if(slot < gpuInstancesNum)
+      m_instancedDrawKeys.emplace_back(slot, a_lods != nullptr ? a_lods[i] : 0u);
+  }
+  std::sort(m_instancedDrawKeys.begin(), m_instancedDrawKeys.end(),
+    [](const LiteMath::uint2 &a, const LiteMath::uint2 &b) { return a.x < b.x; });
+
+  const size_t firstDraw = a_draws.size();
+  for(const auto &key : m_instancedDrawKeys)
+  {
+    const uint32_t meshId = m_instanceInfos[m_gpuSlotInstances[key.x]].mesh_id;
+    if(a_draws.size() > firstDraw)
+    {
+      InstancedDraw &last = a_draws.back();
+      if(last.meshId == meshId && last.firstInstance + last.instanceCount == key.x &&
+         last.firstIndex == m_meshInfos[meshId].m_indexOffset + m_lods[m_meshLodRanges[meshId].x + key.y].firstIndex)
+      {
+        last.instanceCount++;
+        continue;
+      }
+    }
+
+    const MeshLodInfo &lod = m_lods[m_meshLodRanges[meshId].x + key.y];
+    InstancedDraw draw;
+    draw.meshId        = meshId;
+    draw.firstIndex    = m_meshInfos[meshId].m_indexOffset + lod.firstIndex;
+    draw.indexCount    = lod.indexCount;
+    draw.firstInstance = key.x;
+    draw.instanceCount = 1;
+    a_draws.push_back(draw);
+  }
+}
+
+VkPipelineVertexInputStateCreateInfo SceneManager::GetInstancedPipelineVertexInputStateCreateInfo()
+{
+  VkPipelineVertexInputStateCreateInfo info = m_pMeshData->VertexInputLayout();
+  m_instancedInputBindings.assign(info.pVertexBindingDescriptions, info.pVertexBindingDescriptions + info.vertexBindingDescriptionCount);
+  m_instancedInputAttributes.assign(info.pVertexAttributeDescriptions,
+    info.pVertexAttributeDescriptions + info.vertexAttributeDescriptionCount);
+
+  VkVertexInputBindingDescription instanceBinding = {};
+  instanceBinding.binding   = INSTANCE_MATRIX_BINDING;
+  instanceBinding.stride    = sizeof(LiteMath::float4x4);
+  instanceBinding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+  m_instancedInputBindings.push_back(instanceBinding);
+
+  // mat4 attribute takes a location per column
+  for(uint32_t col = 0; col < 4; ++col)
+  {
+    VkVertexInputAttributeDescription attribute = {};
+    attribute.location = INSTANCE_MATRIX_LOCATION + col;
+    attribute.binding  = INSTANCE_MATRIX_BINDING;
+    attribute.format   = VK_FORMAT_R32G32B32A32_SFLOAT;
+    attribute.offset   = col * sizeof(LiteMath::float4);
+    m_instancedInputAttributes.push_back(attribute);
+  }
+
+  info.vertexBindingDescriptionCount   = (uint32_t)m_instancedInputBindings.size();
+  info.pVertexBindingDescriptions      = m_instancedInputBindings.data();
+  info.vertexAttributeDescriptionCount = (uint32_t)m_instancedInputAttributes.size();
+  info.pVertexAttributeDescriptions    = m_instancedInputAttributes.data();
+  return info;
+}
+
+void SceneManager::UpdateInstanceBvh()
+{
+  if(m_instanceBvh.BoxesNum() != m_instanceBboxes.size())
+    m_instanceBvh.Build(m_instanceBboxes.data(), (uint32_t)m_instanceBboxes.size());
+  else if(m_instanceBvhDirty)
+    m_instanceBvh.Refit(m_instanceBboxes.data());
+  m_instanceBvhDirty = false;
+}
+
+void SceneManager::GetVisibleInstances(const LiteMath::float4x4 &a_projView, std::vector<uint32_t> &a_instIds)
+{
+  // instance tables are written by the loading thread until resident instances appear
+  const uint32_t residentNum = ResidentInstancesNum();
+  if(residentNum == 0)
+    return;
+
+  if(m_instanceCulling == InstanceCulling::BRUTE_FORCE)
+  {
+    m_instanceCuller.QueryFrustum(a_projView, a_instIds, residentNum, m_importThreads);
+    return;
+  }
+
+  UpdateInstanceBvh();
+
+  const size_t first = a_instIds.size();
+  m_instanceBvh.QueryFrustum(a_projView, a_instIds);
+  if(residentNum < InstancesNum())
+  {
+    a_instIds.erase(std::remove_if(a_instIds.begin() + first, a_instIds.end(), [residentNum](uint32_t id) { return id >= residentNum; }),
+      a_instIds.end());
+  }
 }
 
 void SceneManager::MarkInstance(const uint32_t instId)
@@ -213,28 +1240,195 @@ void SceneManager::UnmarkInstance(const uint32_t instId)
 
 void SceneManager::LoadGeoDataOnGPU()
 {
-  VkDeviceSize vertexBufSize = m_pMeshData->VertexDataSize();
-  VkDeviceSize indexBufSize  = m_pMeshData->IndexDataSize();
-  VkDeviceSize infoBufSize   = m_meshInfos.size() * sizeof(uint32_t) * 2;
+  CreateGeoBuffers(false);
+
+  {
+    constexpr uint32_t STAGING_CHUNKS = 4;
+    StagingUploader uploader(m_device, m_physDevice, m_transferQ, m_transferQId, m_stagingSize / STAGING_CHUNKS, STAGING_CHUNKS);
+    uploader.SetOwnershipTransfer(m_graphicsQ, m_graphicsQId);
+
+    UploadMeshes(uploader, true);
+    uploader.Flush();
+  }
+
+  ReleaseMeshSources();
+}
+
+void SceneManager::CreateGeoBuffers(bool a_concurrentSharing)
+{
+  const VkDeviceSize vertSize = m_pMeshData->SingleVertexSize();
+
+  // any of index buffers may be empty, but zero sized buffers are not allowed
+  VkDeviceSize vertexBufSize  = m_totalVertices * vertSize;
+  VkDeviceSize indexBufSize   = std::max(m_totalIndices, 1u) * IndexSize(VK_INDEX_TYPE_UINT32);
+  VkDeviceSize indexBufSize16 = std::max(m_totalIndices16, 2u) * IndexSize(VK_INDEX_TYPE_UINT16);
+  VkDeviceSize infoBufSize    = std::max<size_t>(m_meshInfos.size(), 1) * sizeof(MeshDrawInfo);
+  VkDeviceSize meshletBufSize = std::max<size_t>(m_meshlets.size(), 1) * sizeof(MeshletInfo);
+  VkDeviceSize lodBufSize     = std::max<size_t>(m_lods.size(), 1) * sizeof(MeshLodInfo);
+  VkDeviceSize cullInfoBufSize = std::max<size_t>(m_instanceInfos.size(), 1) * sizeof(InstanceCullInfo);
+  VkDeviceSize matricesBufSize = std::max<size_t>(m_instanceInfos.size(), 1) * sizeof(LiteMath::float4x4);
+  const VkBufferUsageFlags storageUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  AssignGpuInstanceSlots();
 
-  m_geoVertBuf  = vk_utils::createBuffer(m_device, vertexBufSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-  m_geoIdxBuf   = vk_utils::createBuffer(m_device, indexBufSize,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-  m_meshInfoBuf = vk_utils::createBuffer(m_device, infoBufSize,   VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  if(a_concurrentSharing && m_transferQId != m_graphicsQId)
+  {
+    const uint32_t queueFamilies[2] = {m_transferQId, m_graphicsQId};
+    auto createSharedBuffer = [&](VkDeviceSize size, VkBufferUsageFlags usage) {
+      VkBufferCreateInfo bufferInfo = {};
+      bufferInfo.sType                 = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      bufferInfo.size                  = size;
+      bufferInfo.usage                 = usage;
+      bufferInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+      bufferInfo.queueFamilyIndexCount = 2;
+      bufferInfo.pQueueFamilyIndices   = queueFamilies;
+
+      VkBuffer buf = VK_NULL_HANDLE;
+      VK_CHECK_RESULT(vkCreateBuffer(m_device, &bufferInfo, nullptr, &buf));
+      return buf;
+    };
+    m_geoVertBuf  = createSharedBuffer(vertexBufSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_geoIdxBuf   = createSharedBuffer(indexBufSize,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_geoIdxBuf16 = createSharedBuffer(indexBufSize16, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_meshInfoBuf = createSharedBuffer(infoBufSize,    storageUsage);
+    m_meshletBuf  = createSharedBuffer(meshletBufSize, storageUsage);
+    m_lodBuf      = createSharedBuffer(lodBufSize,     storageUsage);
+    m_instanceCullInfoBuf    = createSharedBuffer(cullInfoBufSize, storageUsage);
+    m_instanceMatricesBuffer = createSharedBuffer(matricesBufSize, storageUsage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  }
+  else
+  {
+    m_geoVertBuf  = vk_utils::createBuffer(m_device, vertexBufSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_geoIdxBuf   = vk_utils::createBuffer(m_device, indexBufSize,  VK_BUFFER_USAGE_INDEX_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_geoIdxBuf16 = vk_utils::createBuffer(m_device, indexBufSize16, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_meshInfoBuf = vk_utils::createBuffer(m_device, infoBufSize,    storageUsage);
+    m_meshletBuf  = vk_utils::createBuffer(m_device, meshletBufSize, storageUsage);
+    m_lodBuf      = vk_utils::createBuffer(m_device, lodBufSize,     storageUsage);
+    m_instanceCullInfoBuf    = vk_utils::createBuffer(m_device, cullInfoBufSize, storageUsage);
+    m_instanceMatricesBuffer = vk_utils::createBuffer(m_device, matricesBufSize, storageUsage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  }
 
   VkMemoryAllocateFlags allocFlags {};
 
-  m_geoMemAlloc = vk_utils::allocateAndBindWithPadding(m_device, m_physDevice, {m_geoVertBuf, m_geoIdxBuf, m_meshInfoBuf}, allocFlags);
+  m_geoMemAlloc = vk_utils::allocateAndBindWithPadding(m_device, m_physDevice, {m_geoVertBuf, m_geoIdxBuf, m_geoIdxBuf16, m_meshInfoBuf,
+    m_meshletBuf, m_lodBuf, m_instanceCullInfoBuf, m_instanceMatricesBuffer}, allocFlags);
+}
+
+void SceneManager::UploadMeshes(StagingUploader &uploader, bool a_releaseSources)
+{
+  const VkDeviceSize vertSize = m_pMeshData->SingleVertexSize();
+
+  // tables may exceed a staging chunk for big scenes, a_write(first, count, dst) fills a part of one
+  auto uploadTable = [&uploader](VkBuffer a_buf, size_t a_count, VkDeviceSize a_elemSize, const auto &a_write) {
+    const uint32_t maxPerCopy = uint32_t(uploader.Capacity() / a_elemSize);
+    for(uint32_t first = 0; first < a_count; first += maxPerCopy)
+    {
+      const uint32_t count = std::min(maxPerCopy, uint32_t(a_count - first));
+      a_write(first, count, uploader.Reserve(a_buf, first * a_elemSize, count * a_elemSize));
+    }
+  };
+
+  // mesh and instance tables are uploaded before geometry, so they are resident together with the first mesh
+  uploadTable(m_meshInfoBuf, m_meshInfos.size(), sizeof(MeshDrawInfo), [this](uint32_t first, uint32_t count, void *dst) {
+    auto *infos = static_cast<MeshDrawInfo *>(dst);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+      const MeshInfo &m = m_meshInfos[first + i];
+      infos[i].firstIndex   = m.m_indexOffset;
+      infos[i].vertexOffset = int(m.m_vertexOffset);
+      infos[i].firstLod     = m_meshLodRanges[first + i].x;
+      infos[i].lodsNum      = m_meshLodRanges[first + i].y;
+      infos[i].indexType    = m_meshIndexTypes[first + i] == VK_INDEX_TYPE_UINT16 ? 1u : 0u;
+    }
+  });
+  uploadTable(m_meshletBuf, m_meshlets.size(), sizeof(MeshletInfo), [this](uint32_t first, uint32_t count, void *dst) {
+    memcpy(dst, m_meshlets.data() + first, count * sizeof(MeshletInfo));
+  });
+  uploadTable(m_lodBuf, m_lods.size(), sizeof(MeshLodInfo), [this](uint32_t first, uint32_t count, void *dst) {
+    memcpy(dst, m_lods.data() + first, count * sizeof(MeshLodInfo));
+  });
+  // instances moved by the render thread meanwhile stay in m_movedInstances, CmdUpdateInstances copies them again
+  // once the tables are resident, so the copies below can not overwrite newer matrices
+  uploadTable(m_instanceCullInfoBuf, m_instanceInfos.size(), sizeof(InstanceCullInfo), [this](uint32_t first, uint32_t count, void *dst) {
+    std::lock_guard<std::mutex> lock(m_instancesMutex);
+    for(uint32_t i = 0; i < count; ++i)
+      static_cast<InstanceCullInfo *>(dst)[i] = GetInstanceCullInfo(m_gpuSlotInstances[first + i]);
+  });
+  uploadTable(m_instanceMatricesBuffer, m_instanceInfos.size(), sizeof(LiteMath::float4x4), [this](uint32_t first, uint32_t count, void *dst) {
+    std::lock_guard<std::mutex> lock(m_instancesMutex);
+    for(uint32_t i = 0; i < count; ++i)
+      static_cast<LiteMath::float4x4 *>(dst)[i] = GetInstanceDrawMatrix(m_gpuSlotInstances[first + i]);
+  });
+
+  // Meshes are streamed through a ring of staging chunks on the transfer queue:
+  // while GPU copies one chunk, next meshes are packed straight from mapped files into another one,
+  // and the OS reads a few meshes ahead in the background.
+  // Each mapped file may be released right after its data is packed, so host memory is bounded by the ring size.
+  constexpr uint32_t PREFETCH_AHEAD = 4;
+  constexpr uint32_t PACK_BLOCK     = 64 * 1024;
+
+  const uint32_t maxVertsPerCopy = uint32_t(uploader.Capacity() / vertSize);
+  const uint32_t meshesNum       = (uint32_t)m_meshInfos.size();
+
+  auto prefetchMesh = [this](uint32_t meshId) {
+    const auto &source = m_meshSources[meshId];
+    if(source.type == MeshSourceType::MAPPED_VSGF)
+      m_mappedMeshes[source.mappedId].file.Prefetch();
+  };
+  m_cacheFile.Prefetch();
+  for(uint32_t meshId = 0; meshId < std::min(PREFETCH_AHEAD, meshesNum); ++meshId)
+    prefetchMesh(meshId);
 
-  std::vector<LiteMath::uint2> mesh_info_tmp;
-  for(const auto& m : m_meshInfos)
+  for(uint32_t meshId = 0; meshId < meshesNum && !m_cancelLoading; ++meshId)
   {
-    mesh_info_tmp.emplace_back(m.m_indexOffset, m.m_vertexOffset);
+    if(meshId + PREFETCH_AHEAD < meshesNum)
+      prefetchMesh(meshId + PREFETCH_AHEAD);
+
+    const auto &info = m_meshInfos[meshId];
+    for(uint32_t first = 0; first < info.m_vertNum; first += maxVertsPerCopy)
+    {
+      const uint32_t count = std::min(maxVertsPerCopy, info.m_vertNum - first);
+      auto *dst = static_cast<uint8_t *>(uploader.Reserve(m_geoVertBuf, info.m_vertexBufOffset + first * vertSize, count * vertSize));
+
+      // large meshes are packed by several threads
+      const uint32_t blocksNum = (count + PACK_BLOCK - 1) / PACK_BLOCK;
+      ParallelFor(blocksNum, m_importThreads, [&](uint32_t block)
+      {
+        const uint32_t blockFirst = block * PACK_BLOCK;
+        const uint32_t blockCount = std::min(PACK_BLOCK, count - blockFirst);
+        PackMeshVertices(meshId, first + blockFirst, blockCount, reinterpret_cast<float *>(dst + blockFirst * vertSize));
+      });
+    }
+
+    const bool indices16 = m_meshIndexTypes[meshId] == VK_INDEX_TYPE_UINT16;
+    const VkDeviceSize indSize    = IndexSize(m_meshIndexTypes[meshId]);
+    const uint32_t maxIndsPerCopy = uint32_t(uploader.Capacity() / indSize);
+    const uint32_t indNum         = MeshIndicesNum(meshId);
+    for(uint32_t first = 0; first < indNum; first += maxIndsPerCopy)
+    {
+      const uint32_t count = std::min(maxIndsPerCopy, indNum - first);
+      void *dst = uploader.Reserve(GetIndexBuffer(m_meshIndexTypes[meshId]), info.m_indexBufOffset + first * indSize, count * indSize);
+      if(indices16)
+        PackMeshIndices16(meshId, first, count, static_cast<uint16_t *>(dst));
+      else
+        PackMeshIndices(meshId, first, count, static_cast<uint32_t *>(dst));
+    }
+
+    const auto &source = m_meshSources[meshId];
+    if(a_releaseSources && source.type == MeshSourceType::MAPPED_VSGF)
+      m_mappedMeshes[source.mappedId].file.Close();
+
+    uploader.SetProgress(meshId + 1);
+    m_meshesImported = meshId + 1;
   }
+}
 
-  m_pCopyHelper->UpdateBuffer(m_geoVertBuf, 0, m_pMeshData->VertexData(), vertexBufSize);
-  m_pCopyHelper->UpdateBuffer(m_geoIdxBuf,  0, m_pMeshData->IndexData(), indexBufSize);
-  if(!mesh_info_tmp.empty())
-    m_pCopyHelper->UpdateBuffer(m_meshInfoBuf,  0, mesh_info_tmp.data(), mesh_info_tmp.size() * sizeof(mesh_info_tmp[0]));
+void SceneManager::ReleaseMeshSources()
+{
+  // mapped files are not needed once their data is on the GPU
+  m_mappedMeshes.clear();
+  m_cacheFile.Close();
+  m_cacheVertices = nullptr;
+  m_cacheIndices  = nullptr;
 }
 
 void SceneManager::DrawMarkedInstances()
@@ -244,6 +1438,8 @@ void SceneManager::DrawMarkedInstances()
 
 void SceneManager::DestroyScene()
 {
+  StopLoading();
+
   if(m_geoVertBuf != VK_NULL_HANDLE)
   {
     vkDestroyBuffer(m_device, m_geoVertBuf, nullptr);
@@ -256,12 +1452,36 @@ void SceneManager::DestroyScene()
     m_geoIdxBuf = VK_NULL_HANDLE;
   }
 
+  if(m_geoIdxBuf16 != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_geoIdxBuf16, nullptr);
+    m_geoIdxBuf16 = VK_NULL_HANDLE;
+  }
+
   if(m_meshInfoBuf != VK_NULL_HANDLE)
   {
     vkDestroyBuffer(m_device, m_meshInfoBuf, nullptr);
     m_meshInfoBuf = VK_NULL_HANDLE;
   }
 
+  if(m_meshletBuf != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_meshletBuf, nullptr);
+    m_meshletBuf = VK_NULL_HANDLE;
+  }
+
+  if(m_lodBuf != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_lodBuf, nullptr);
+    m_lodBuf = VK_NULL_HANDLE;
+  }
+
+  if(m_instanceCullInfoBuf != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_instanceCullInfoBuf, nullptr);
+    m_instanceCullInfoBuf = VK_NULL_HANDLE;
+  }
+
   if(m_instanceMatricesBuffer != VK_NULL_HANDLE)
   {
     vkDestroyBuffer(m_device, m_instanceMatricesBuffer, nullptr);
@@ -277,7 +1497,29 @@ void SceneManager::DestroyScene()
   m_pCopyHelper = nullptr;
 
   m_meshInfos.clear();
+  m_meshIndexTypes.clear();
+  m_meshBboxes.clear();
+  m_meshQuants.clear();
+  m_meshMeshlets.clear();
+  m_meshlets.clear();
+  m_meshLodRanges.clear();
+  m_lods.clear();
+  m_meshSources.clear();
+  m_mappedMeshes.clear();
+  m_cacheFile.Close();
   m_pMeshData = nullptr;
   m_instanceInfos.clear();
   m_instanceMatrices.clear();
+  m_instanceBboxes.clear();
+  m_instanceBvh.Clear();
+  m_instanceBvhDirty = false;
+  m_instanceCuller.Clear();
+  m_movedInstances.clear();
+  m_gpuSlotInstances.clear();
+  m_meshGpuInstances.clear();
+  m_gpuInstancesNum  = 0u;
+  m_duplicateMeshes  = 0u;
+  m_savedVertexBytes = 0u;
+  m_savedIndexBytes  = 0u;
+  m_loadStage = SceneLoadStage::NONE;
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #ifndef CHIMERA_SCENE_MGR_H
 #define CHIMERA_SCENE_MGR_H
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <geom/vk_mesh.h>
@@ -8,76 +12,329 @@
 #include <vk_copy.h>
 
 #include "../loader_utils/hydraxml.h"
+#include "../loader_utils/vsgf_mmap.h"
+#include "scene_cache.h"
+#include "compact_vertex.h"
+#include "instance_bvh.h"
+#include "frustum_culler.h"
 #include "../resources/shaders/common.h"
 
 struct InstanceInfo
 {
   uint32_t inst_id = 0u;
   uint32_t mesh_id = 0u;
-  VkDeviceSize instBufOffset = 0u;
+  VkDeviceSize instBufOffset = 0u; // of the matrix in GPU instance buffers, past their end for instances added after loading
   bool renderMark = false;
 };
 
+// instances of one mesh with the same LOD in consecutive GPU instance slots, drawn with one instanced draw
+struct InstancedDraw
+{
+  uint32_t meshId;
+  uint32_t firstIndex;    // in the index buffer of the mesh index type
+  uint32_t indexCount;
+  uint32_t firstInstance; // GPU instance slot
+  uint32_t instanceCount;
+};
+
+class StagingUploader;
+class FrameScheduler;
+
+enum class SceneLoadStage : uint32_t
+{
+  NONE,      // no scene was loaded
+  IMPORTING, // scene and mesh files are being read, nothing can be drawn yet
+  UPLOADING, // instances and cameras are known, meshes become resident one by one
+  DONE,
+  FAILED
+};
+
+// how GetVisibleInstances finds instances in view frustum
+enum class InstanceCulling : uint32_t
+{
+  BVH,        // hierarchical, cheapest when few instances are visible and instances rarely move
+  BRUTE_FORCE // every bbox is tested with SIMD on all cores, nothing to rebuild when instances move
+};
+
+struct SceneLoadProgress
+{
+  SceneLoadStage stage = SceneLoadStage::NONE;
+  uint32_t meshesTotal       = 0u;
+  uint32_t meshesImported    = 0u; // written to staging memory
+  uint32_t meshesResident    = 0u; // copied to GPU buffers
+  uint32_t instancesTotal    = 0u;
+  uint32_t instancesResident = 0u;
+
+  // meshes whose files had the same contents as an already imported one
+  uint32_t duplicateMeshes  = 0u;
+  uint64_t savedVertexBytes = 0u;
+  uint64_t savedIndexBytes  = 0u;
+};
+
 struct SceneManager
 {
   SceneManager(VkDevice a_device, VkPhysicalDevice a_physDevice, uint32_t a_transferQId, uint32_t a_graphicsQId,
     bool debug = false);
-  ~SceneManager() { DestroyScene(); }
+  ~SceneManager();
 
   bool LoadSceneXML(const std::string &scenePath, bool transpose = true);
+
+  // Starts loading the scene on a background thread and returns immediately.
+  // UpdateLoading() must then be called from the render thread (e.g. once per frame) until IsLoading() is false,
+  // all queue submissions are done there. Instances [0, ResidentInstancesNum()) can be drawn meanwhile,
+  // other getters are valid once stage is UPLOADING.
+  void LoadSceneXMLAsync(const std::string &scenePath, bool transpose = true);
+  // returns true if more instances became resident; if loading failed the stage becomes FAILED,
+  // instances that were resident stay drawable and GetLoadError() tells what went wrong
+  bool UpdateLoading();
+  bool IsLoading() const;
+  SceneLoadProgress GetLoadProgress() const;
+  // valid once the stage is FAILED
+  const std::string &GetLoadError() const { return m_loadError; }
+  // asynchronous uploads are submitted on the transfer timeline of a_pScheduler instead of being tracked by fences,
+  // a_pScheduler must outlive the manager
+  void SetFrameScheduler(FrameScheduler *a_pScheduler) { m_pScheduler = a_pScheduler; }
+
   void LoadSingleTriangle();
 
   uint32_t AddMeshFromFile(const std::string& meshPath);
   uint32_t AddMeshFromData(cmesh::SimpleMesh &meshData);
+  uint32_t AddMeshFromData(cmesh::SimpleMesh &meshData, const LiteMath::Box4f &meshBox);
 
   uint32_t InstanceMesh(uint32_t meshId, const LiteMath::float4x4 &matrix, bool markForRender = true);
 
   void MarkInstance(uint32_t instId);
   void UnmarkInstance(uint32_t instId);
+  // updates instance bbox, instance BVH (if used) is refitted on next GetVisibleInstances,
+  // GPU instance buffers are updated by CmdUpdateInstances
+  void SetInstanceMatrix(uint32_t instId, const LiteMath::float4x4 &matrix);
+  // records copies of instances moved since the last call to GPU instance buffers, must be called outside of render pass
+  void CmdUpdateInstances(VkCommandBuffer a_cmdBuf);
+
+  // appends ids of resident instances whose bboxes intersect view frustum of a_projView;
+  // with InstanceCulling::BVH instance BVH is built after loading and rebuilt or refitted here if instances were added or moved since,
+  // with InstanceCulling::BRUTE_FORCE ids come in increasing order
+  void GetVisibleInstances(const LiteMath::float4x4 &a_projView, std::vector<uint32_t> &a_instIds);
+  // appends instanced draws of a_instIds (resident instances) with LODs a_lods (nullptr - LOD 0 for all):
+  // instances in consecutive GPU instance slots of the same mesh and LOD are merged into one draw,
+  // so a mesh whose instances are all visible with one LOD takes one draw; instances added after loading are skipped
+  void AppendInstancedDraws(const uint32_t *a_instIds, const uint32_t *a_lods, uint32_t a_instNum, std::vector<InstancedDraw> &a_draws);
 
   void DrawMarkedInstances();
 
   void DestroyScene();
 
   VkPipelineVertexInputStateCreateInfo GetPipelineVertexInputStateCreateInfo() { return m_pMeshData->VertexInputLayout();}
+  // vertex layout plus per instance model matrix from GetInstanceMatricesBuffer() bound at INSTANCE_MATRIX_BINDING,
+  // its columns are at locations INSTANCE_MATRIX_LOCATION .. +3; valid until the next call
+  VkPipelineVertexInputStateCreateInfo GetInstancedPipelineVertexInputStateCreateInfo();
+  static constexpr uint32_t INSTANCE_MATRIX_BINDING  = 1;
+  static constexpr uint32_t INSTANCE_MATRIX_LOCATION = 4;
 
   VkBuffer GetVertexBuffer() const { return m_geoVertBuf; }
-  VkBuffer GetIndexBuffer()  const { return m_geoIdxBuf; }
+  // meshes with less than 65537 vertices are drawn from 16 bit index buffer, other ones from 32 bit,
+  // MeshInfo index offsets count indices of the buffer the mesh is stored in
+  VkBuffer GetIndexBuffer(VkIndexType a_type = VK_INDEX_TYPE_UINT32) const { return a_type == VK_INDEX_TYPE_UINT16 ? m_geoIdxBuf16 : m_geoIdxBuf; }
+  VkIndexType GetMeshIndexType(uint32_t meshId) const {assert(meshId < m_meshIndexTypes.size()); return m_meshIndexTypes[meshId];}
+  // storage buffers for GPU culling: MeshDrawInfo and MeshLodInfo of meshes, InstanceCullInfo of instances
+  // and their matrices multiplied by dequantization matrices of their meshes;
+  // instance buffers are indexed by GPU instance slots, which are grouped by mesh, matrices are also a vertex buffer
   VkBuffer GetMeshInfoBuffer()  const { return m_meshInfoBuf; }
+  VkBuffer GetLodBuffer()       const { return m_lodBuf; }
+  VkBuffer GetInstanceCullInfoBuffer() const { return m_instanceCullInfoBuf; }
+  VkBuffer GetInstanceMatricesBuffer() const { return m_instanceMatricesBuffer; }
+  VkBuffer GetMeshletBuffer()   const { return m_meshletBuf; }
   std::shared_ptr<vk_utils::ICopyEngine> GetCopyHelper() { return  m_pCopyHelper; }
 
   uint32_t MeshesNum() const {return (uint32_t)m_meshInfos.size();}
   uint32_t InstancesNum() const {return (uint32_t)m_instanceInfos.size();}
+  // number of instances whose geometry is on the GPU, differs from InstancesNum() only while loading
+  uint32_t ResidentInstancesNum() const;
+  // incremented by SetInstanceMatrix, so that draws recorded with instance matrices can tell they are stale
+  uint32_t InstancesVersion() const { return m_instancesVersion; }
+  // resident instances that are in GPU instance buffers, i.e. all but the ones added after the scene was loaded;
+  // slots are sorted by mesh and meshes become resident in order, so resident slots are [0, GpuInstancesNum())
+  uint32_t GpuInstancesNum() const;
+  // size of GPU instance buffers, known once GpuInstancesNum() is not zero
+  uint32_t GpuInstancesCapacity() const { return m_gpuInstancesNum; }
+  uint32_t GetInstanceGpuSlot(uint32_t instId) const {assert(instId < m_instanceInfos.size()); return uint32_t(m_instanceInfos[instId].instBufOffset / sizeof(LiteMath::float4x4));}
+  // first GPU instance slot and instances count of the mesh
+  LiteMath::uint2 GetMeshGpuInstances(uint32_t meshId) const {assert(meshId < m_meshGpuInstances.size()); return m_meshGpuInstances[meshId];}
 
   hydra_xml::Camera GetCamera(uint32_t camId) const;
   MeshInfo GetMeshInfo(uint32_t meshId) const {assert(meshId < m_meshInfos.size()); return m_meshInfos[meshId];}
   LiteMath::Box4f GetMeshBbox(uint32_t meshId) const {assert(meshId < m_meshBboxes.size()); return m_meshBboxes[meshId];}
+  // maps positions stored in the vertex buffer to mesh space, model matrix of the instance should be multiplied by it
+  LiteMath::float4x4 GetMeshDequantMatrix(uint32_t meshId) const {assert(meshId < m_meshQuants.size()); return compact_vertex::DequantMatrix(m_meshQuants[meshId]);}
+  // first meshlet and meshlets count, meshlet index ranges are relative to the first index of the mesh
+  LiteMath::uint2 GetMeshMeshlets(uint32_t meshId) const {assert(meshId < m_meshMeshlets.size()); return m_meshMeshlets[meshId];}
+  const MeshletInfo *GetMeshlets() const {return m_meshlets.data();}
+  uint32_t MeshletsNum() const {return (uint32_t)m_meshlets.size();}
+  // first LOD and LODs count, every mesh has at least LOD 0 that is the full mesh
+  LiteMath::uint2 GetMeshLods(uint32_t meshId) const {assert(meshId < m_meshLodRanges.size()); return m_meshLodRanges[meshId];}
+  const MeshLodInfo *GetLods() const {return m_lods.data();}
   InstanceInfo GetInstanceInfo(uint32_t instId) const {assert(instId < m_instanceInfos.size()); return m_instanceInfos[instId];}
   LiteMath::Box4f GetInstanceBbox(uint32_t instId) const {assert(instId < m_instanceBboxes.size()); return m_instanceBboxes[instId];}
   LiteMath::float4x4 GetInstanceMatrix(uint32_t instId) const {assert(instId < m_instanceMatrices.size()); return m_instanceMatrices[instId];}
   LiteMath::Box4f GetSceneBbox() const {return sceneBbox;}
 
+  // number of threads used to import meshes in LoadSceneXML, 0 - use all hardware threads
+  void SetImportThreadsNum(uint32_t a_threadsNum) { m_importThreads = a_threadsNum; }
+
+  // LoadSceneXML writes binary cache next to the scene file and uses it on next loads while sources are unchanged
+  void SetSceneCacheEnabled(bool a_enable) { m_useSceneCache = a_enable; }
+
+  // LoadSceneXML uploads meshes with identical file contents once, instances of duplicates refer to the first copy
+  void SetMeshDeduplicationEnabled(bool a_enable) { m_dedupMeshes = a_enable; }
+
+  // imported meshes are welded and reordered for vertex cache, overdraw and vertex fetch, see mesh_optimizer.h
+  void SetMeshOptimizationEnabled(bool a_enable) { m_optimizeMeshes = a_enable; }
+
+  // vertices are stored in 16 byte compact_vertex format (drawn with simple_compact.vert) instead of Mesh8F,
+  // must be set before any mesh is added
+  void SetCompactVerticesEnabled(bool a_enable);
+  bool CompactVerticesEnabled() const { return m_compactVertices; }
+
+  // imported meshes get simplified levels of detail that follow the full mesh in the index buffer, see mesh_simplifier.h
+  void SetMeshLodsEnabled(bool a_enable) { m_buildLods = a_enable; }
+
+  // brute force culling is split between SetImportThreadsNum threads
+  void SetInstanceCulling(InstanceCulling a_culling) { m_instanceCulling = a_culling; }
+  InstanceCulling GetInstanceCulling() const { return m_instanceCulling; }
+
 private:
   void LoadGeoDataOnGPU();
 
+  // fills mesh and instance tables from scene cache or scene file, no GPU work is done;
+  // a_cacheSources is left empty if scene cache should not be written
+  bool ImportScene(const std::string &scenePath, bool transpose, std::vector<scene_cache::SourceStamp> &a_cacheSources);
+  void CreateGeoBuffers(bool a_concurrentSharing);
+  void UploadMeshes(StagingUploader &uploader, bool a_releaseSources);
+  void ReleaseMeshSources();
+
+  void LoadSceneInBackground(const std::string &scenePath, bool transpose);
+  void StopLoading();
+
+  // VSGF file mapped to memory, its attribute streams are packed straight into staging memory on upload
+  struct MappedMesh
+  {
+    MappedFile file;
+    vsgf::MeshView   view;
+    LiteMath::Box4f  bbox;
+    uint64_t contentHash = 0; // hash of the whole file, computed only if deduplication is enabled
+
+    // set by mesh optimizer: i-th vertex is view vertex vertices[i], indices refer to the new vertices
+    std::vector<uint32_t> vertices;
+    std::vector<uint32_t> indices; // indices of LOD 0 followed by the ones of coarser LODs
+    std::vector<MeshletInfo> meshlets;
+    std::vector<MeshLodInfo> lods;
+
+    uint32_t VerticesNum() const { return vertices.empty() ? view.VerticesNum() : (uint32_t)vertices.size(); }
+    uint32_t IndicesNum() const { return indices.empty() ? view.IndicesNum() : (uint32_t)indices.size(); }
+  };
+  std::vector<MappedMesh> MapMeshes(const std::vector<std::string> &meshPaths) const;
+  // meshIdx - indices of meshes to optimize in meshes and meshPaths
+  void OptimizeMappedMeshes(std::vector<MappedMesh> &meshes, const std::vector<std::string> &meshPaths,
+    const std::vector<uint32_t> &meshIdx) const;
+  // splits meshes into meshlets, their triangles are reordered so that every meshlet is a contiguous index range,
+  // and builds LOD chains if they are enabled
+  void BuildMappedMeshlets(std::vector<MappedMesh> &meshes, const std::vector<uint32_t> &meshIdx) const;
+  uint32_t AddMappedMesh(MappedMesh &&mesh);
+  static uint32_t FindDuplicateMesh(const std::vector<MappedMesh> &meshes, uint32_t meshIdx, const std::vector<uint32_t> &candidates);
+  // indNum counts indices of all LODs, a mesh without LODs (lodsNum = 0) gets a single one
+  uint32_t AddMeshInfo(uint32_t vertNum, uint32_t indNum, const LiteMath::Box4f &meshBox,
+    const compact_vertex::Quantization &quant, const MeshletInfo *meshlets, uint32_t meshletsNum,
+    const MeshLodInfo *lods, uint32_t lodsNum);
+  // indices of the mesh stored in index buffer, MeshInfo::m_indNum counts only LOD 0
+  uint32_t MeshIndicesNum(uint32_t meshId) const;
+
+  void PackMeshVertices(uint32_t meshId, uint32_t firstVert, uint32_t vertNum, float *dst) const;
+  // indices of the mesh source, relative to the first mesh vertex
+  const uint32_t *MeshSourceIndices(uint32_t meshId) const;
+  void PackMeshIndices(uint32_t meshId, uint32_t firstInd, uint32_t indNum, uint32_t *dst) const;
+  void PackMeshIndices16(uint32_t meshId, uint32_t firstInd, uint32_t indNum, uint16_t *dst) const;
+
+  compact_vertex::Quantization MeshQuantization(const LiteMath::Box4f &meshBox) const;
+
+  void UpdateInstanceBvh();
+  LiteMath::Box4f CalcInstanceBbox(uint32_t meshId, const LiteMath::float4x4 &matrix) const;
+  InstanceCullInfo GetInstanceCullInfo(uint32_t instId) const;
+  LiteMath::float4x4 GetInstanceDrawMatrix(uint32_t instId) const;
+  void AssignGpuInstanceSlots();
+
+  bool LoadSceneCache(const std::string &scenePath, bool transpose);
+  void SaveSceneCache(const std::string &scenePath, bool transpose, const std::vector<scene_cache::SourceStamp> &sources);
+  uint32_t SceneCacheKey(bool transpose) const;
+
+  // where mesh data is taken from on upload
+  enum class MeshSourceType { MESH_DATA, MAPPED_VSGF, SCENE_CACHE };
+  struct MeshSource
+  {
+    MeshSourceType type = MeshSourceType::MESH_DATA;
+    uint32_t mappedId   = UINT32_MAX; // index in m_mappedMeshes
+    uint32_t vertOffset = 0u;         // offsets in m_pMeshData or in scene cache geometry
+    uint32_t idxOffset  = 0u;
+  };
+  std::vector<MeshSource> m_meshSources = {};
+  std::vector<MappedMesh> m_mappedMeshes = {};
+
+  MappedFile m_cacheFile;
+  const uint8_t  *m_cacheVertices = nullptr;
+  const uint32_t *m_cacheIndices  = nullptr;
+  bool m_useSceneCache = true;
+
+  bool m_dedupMeshes = true;
+  uint32_t m_duplicateMeshes  = 0u;
+  uint64_t m_savedVertexBytes = 0u;
+  uint64_t m_savedIndexBytes  = 0u;
+
+  bool m_optimizeMeshes = false;
+  bool m_compactVertices = false;
+  bool m_buildLods = false;
+
   std::vector<MeshInfo> m_meshInfos = {};
+  std::vector<VkIndexType> m_meshIndexTypes = {};
   std::vector<LiteMath::Box4f> m_meshBboxes = {};
+  std::vector<compact_vertex::Quantization> m_meshQuants = {}; // identity unless vertices are compact
+  std::vector<LiteMath::uint2> m_meshMeshlets = {};
+  std::vector<MeshletInfo> m_meshlets = {};
+  std::vector<LiteMath::uint2> m_meshLodRanges = {};
+  std::vector<MeshLodInfo> m_lods = {};
   std::shared_ptr<IMeshData> m_pMeshData = nullptr;
 
   std::vector<InstanceInfo> m_instanceInfos = {};
   std::vector<LiteMath::Box4f> m_instanceBboxes = {};
   std::vector<LiteMath::float4x4> m_instanceMatrices = {};
+  InstanceBvh m_instanceBvh;
+  bool m_instanceBvhDirty = false; // bboxes were changed after the BVH was built
+  FrustumCuller m_instanceCuller;    // copy of m_instanceBboxes as structure of arrays, always up to date
+  InstanceCulling m_instanceCulling = InstanceCulling::BVH;
+  std::vector<uint32_t> m_movedInstances; // GPU instance buffers are not updated for them yet, owned by the render thread
+  // the loading thread reads instance matrices and bboxes for GPU instance buffers while the render thread may move instances
+  std::mutex m_instancesMutex;
+  uint32_t m_instancesVersion = 0u;
 
   std::vector<hydra_xml::Camera> m_sceneCameras = {};
   LiteMath::Box4f sceneBbox;
 
   uint32_t m_totalVertices = 0u;
   uint32_t m_totalIndices  = 0u;
+  uint32_t m_totalIndices16 = 0u;
 
   VkBuffer m_geoVertBuf = VK_NULL_HANDLE;
   VkBuffer m_geoIdxBuf  = VK_NULL_HANDLE;
+  VkBuffer m_geoIdxBuf16 = VK_NULL_HANDLE;
   VkBuffer m_meshInfoBuf  = VK_NULL_HANDLE;
+  VkBuffer m_meshletBuf   = VK_NULL_HANDLE;
+  VkBuffer m_lodBuf       = VK_NULL_HANDLE;
+  VkBuffer m_instanceCullInfoBuf    = VK_NULL_HANDLE;
   VkBuffer m_instanceMatricesBuffer = VK_NULL_HANDLE;
+  uint32_t m_gpuInstancesNum = 0u; // instances in m_instanceCullInfoBuf and m_instanceMatricesBuffer
+  std::vector<uint32_t> m_gpuSlotInstances;       // instance id of every GPU instance slot
+  std::vector<LiteMath::uint2> m_meshGpuInstances; // first slot and count of every mesh
+  std::vector<LiteMath::uint2> m_instancedDrawKeys; // slot and LOD, scratch of AppendInstancedDraws
+  std::vector<VkVertexInputBindingDescription>   m_instancedInputBindings;
+  std::vector<VkVertexInputAttributeDescription> m_instancedInputAttributes;
   VkDeviceMemory m_geoMemAlloc = VK_NULL_HANDLE;
 
   VkDevice m_device = VK_NULL_HANDLE;
@@ -88,6 +345,22 @@ private:
   uint32_t m_graphicsQId = UINT32_MAX;
   VkQueue m_graphicsQ = VK_NULL_HANDLE;
   std::shared_ptr<vk_utils::ICopyEngine> m_pCopyHelper;
+  VkDeviceSize m_stagingSize = 64 * 1024 * 1024;
+
+  uint32_t m_importThreads = 0u;
+
+  // asynchronous loading, m_loadStage publishes tables written by the loading thread
+  std::thread m_loadThread;
+  std::atomic<SceneLoadStage> m_loadStage {SceneLoadStage::NONE};
+  std::unique_ptr<StagingUploader> m_pAsyncUploader;
+  FrameScheduler *m_pScheduler = nullptr;
+  std::atomic<bool> m_loadThreadDone {false};
+  std::atomic<bool> m_cancelLoading  {false};
+  bool m_loadFailed = false;
+  std::string m_loadError;
+  std::atomic<uint32_t> m_meshesImported    {0u};
+  std::atomic<uint32_t> m_residentMeshes    {0u};
+  std::atomic<uint32_t> m_residentInstances {0u};
 
   bool m_debug = false;
   // for debugging
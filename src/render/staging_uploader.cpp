@@ -0,0 +1,382 @@
+#include "staging_uploader.h"
+
+#include <algorithm>
+
+#include "vk_utils.h"
+#include "vk_buffers.h"
+
+static VkFence CreateFence(VkDevice a_device)
+{
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = 0;
+
+  VkFence fence = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkCreateFence(a_device, &fenceInfo, nullptr, &fence));
+  return fence;
+}
+
+StagingUploader::StagingUploader(VkDevice a_device, VkPhysicalDevice a_physDevice, VkQueue a_queue,
+  uint32_t a_queueFamilyIdx, VkDeviceSize a_chunkSize, uint32_t a_chunksNum) : m_device(a_device), m_queue(a_queue),
+  m_queueFamilyIdx(a_queueFamilyIdx), m_chunkSize(a_chunkSize)
+{
+  assert(a_chunksNum > 0);
+
+  VkMemoryRequirements memReq;
+  m_stagingBuf = vk_utils::createBuffer(m_device, m_chunkSize * a_chunksNum, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &memReq);
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.pNext           = nullptr;
+  allocateInfo.allocationSize  = memReq.size;
+  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, a_physDevice);
+
+  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_stagingMem));
+  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_stagingBuf, m_stagingMem, 0));
+
+  void *pMapped = nullptr;
+  VK_CHECK_RESULT(vkMapMemory(m_device, m_stagingMem, 0, m_chunkSize * a_chunksNum, 0, &pMapped));
+  m_pMapped = static_cast<uint8_t *>(pMapped);
+
+  m_cmdPool = vk_utils::createCommandPool(m_device, a_queueFamilyIdx, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  auto cmdBufs = vk_utils::createCommandBuffers(m_device, m_cmdPool, a_chunksNum);
+
+  m_chunks.resize(a_chunksNum);
+  for(uint32_t i = 0; i < a_chunksNum; ++i)
+  {
+    m_chunks[i].offset = i * m_chunkSize;
+    m_chunks[i].cmdBuf = cmdBufs[i];
+    m_chunks[i].fence  = CreateFence(m_device);
+  }
+}
+
+StagingUploader::~StagingUploader()
+{
+  if(m_deferred)
+  {
+    for(auto &chunk : m_chunks)
+      WaitChunk(chunk);
+  }
+  else
+    Flush();
+
+  for(auto &chunk : m_chunks)
+    vkDestroyFence(m_device, chunk.fence, nullptr);
+  vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
+
+  if(m_dstCmdPool != VK_NULL_HANDLE)
+  {
+    vkDestroyFence(m_device, m_acquireFence, nullptr);
+    vkDestroySemaphore(m_device, m_releaseSemaphore, nullptr);
+    vkDestroyCommandPool(m_device, m_dstCmdPool, nullptr);
+  }
+
+  vkUnmapMemory(m_device, m_stagingMem);
+  vkDestroyBuffer(m_device, m_stagingBuf, nullptr);
+  vkFreeMemory(m_device, m_stagingMem, nullptr);
+}
+
+void StagingUploader::SetOwnershipTransfer(VkQueue a_dstQueue, uint32_t a_dstQueueFamilyIdx)
+{
+  assert(!m_deferred);
+  if(a_dstQueueFamilyIdx == m_queueFamilyIdx || m_dstCmdPool != VK_NULL_HANDLE)
+    return;
+
+  m_dstQueue          = a_dstQueue;
+  m_dstQueueFamilyIdx = a_dstQueueFamilyIdx;
+  m_dstCmdPool        = vk_utils::createCommandPool(m_device, a_dstQueueFamilyIdx, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  m_acquireCmdBuf     = vk_utils::createCommandBuffers(m_device, m_dstCmdPool, 1)[0];
+  m_releaseCmdBuf     = vk_utils::createCommandBuffers(m_device, m_cmdPool, 1)[0];
+  m_acquireFence      = CreateFence(m_device);
+
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_releaseSemaphore));
+}
+
+void *StagingUploader::Reserve(VkBuffer a_dst, VkDeviceSize a_dstOffset, VkDeviceSize a_size)
+{
+  assert(a_size <= m_chunkSize);
+
+  // keep 16 byte alignment of staging offsets, so callers may write vectors into returned memory
+  VkDeviceSize offset = vk_utils::getPaddedSize(m_used, 16);
+  if(offset + a_size > m_chunkSize)
+  {
+    SubmitCurrentChunk();
+    offset = 0;
+  }
+
+  Chunk &chunk = m_chunks[m_currentChunk];
+
+  // merge with previous region if data goes to the adjacent part of the same buffer
+  if(!chunk.pending.empty() && chunk.pending.back().dst == a_dst && offset == m_used
+     && chunk.pending.back().region.dstOffset + chunk.pending.back().region.size == a_dstOffset)
+  {
+    chunk.pending.back().region.size += a_size;
+  }
+  else
+  {
+    PendingCopy copy;
+    copy.dst              = a_dst;
+    copy.region.srcOffset = chunk.offset + offset;
+    copy.region.dstOffset = a_dstOffset;
+    copy.region.size      = a_size;
+    chunk.pending.push_back(copy);
+  }
+
+  if(std::find(m_writtenBuffers.begin(), m_writtenBuffers.end(), a_dst) == m_writtenBuffers.end())
+    m_writtenBuffers.push_back(a_dst);
+
+  m_used = offset + a_size;
+  return m_pMapped + chunk.offset + offset;
+}
+
+void StagingUploader::WaitChunk(Chunk &a_chunk)
+{
+  if(!a_chunk.inFlight)
+    return;
+
+  if(m_pScheduler != nullptr)
+    m_pScheduler->Wait(a_chunk.milestone);
+  else
+  {
+    VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &a_chunk.fence, VK_TRUE, UINT64_MAX));
+    VK_CHECK_RESULT(vkResetFences(m_device, 1, &a_chunk.fence));
+  }
+  a_chunk.inFlight = false;
+  a_chunk.pending.clear();
+}
+
+bool StagingUploader::ChunkCompleted(const Chunk &a_chunk) const
+{
+  if(m_pScheduler != nullptr)
+    return m_pScheduler->IsReached(a_chunk.milestone);
+  return vkGetFenceStatus(m_device, a_chunk.fence) == VK_SUCCESS;
+}
+
+void StagingUploader::SubmitCurrentChunk()
+{
+  if(m_deferred)
+  {
+    HandOverCurrentChunk();
+    return;
+  }
+
+  Chunk &chunk = m_chunks[m_currentChunk];
+  if(chunk.pending.empty())
+    return;
+
+  SubmitChunk(chunk);
+
+  // continue with the next chunk, waiting only if GPU has not finished copying from it yet
+  m_currentChunk = (m_currentChunk + 1) % uint32_t(m_chunks.size());
+  m_used         = 0;
+  WaitChunk(m_chunks[m_currentChunk]);
+}
+
+void StagingUploader::SubmitChunk(Chunk &chunk)
+{
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VK_CHECK_RESULT(vkResetCommandBuffer(chunk.cmdBuf, 0));
+  VK_CHECK_RESULT(vkBeginCommandBuffer(chunk.cmdBuf, &beginInfo));
+  for(const auto &copy : chunk.pending)
+    vkCmdCopyBuffer(chunk.cmdBuf, m_stagingBuf, copy.dst, 1, &copy.region);
+  VK_CHECK_RESULT(vkEndCommandBuffer(chunk.cmdBuf));
+
+  if(m_pScheduler != nullptr)
+    chunk.milestone = m_pScheduler->Submit(Timeline::TRANSFER, m_queue, {chunk.cmdBuf});
+  else
+  {
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers    = &chunk.cmdBuf;
+
+    VK_CHECK_RESULT(vkQueueSubmit(m_queue, 1, &submitInfo, chunk.fence));
+  }
+  chunk.inFlight = true;
+}
+
+void StagingUploader::EnableDeferredSubmit()
+{
+  assert(m_used == 0 && m_chunks[m_currentChunk].pending.empty());
+  m_deferred = true;
+}
+
+void StagingUploader::HandOverCurrentChunk()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  Chunk &chunk = m_chunks[m_currentChunk];
+  if(chunk.pending.empty())
+    return;
+
+  if(m_cancelled)
+    chunk.pending.clear();
+  else
+  {
+    chunk.ready    = true;
+    chunk.progress = m_progress;
+    m_readyChunks.push_back(m_currentChunk);
+  }
+
+  m_currentChunk = (m_currentChunk + 1) % uint32_t(m_chunks.size());
+  m_used         = 0;
+
+  const Chunk &next = m_chunks[m_currentChunk];
+  m_chunkFreed.wait(lock, [this, &next]() { return m_cancelled || (!next.ready && !next.inFlight); });
+}
+
+void StagingUploader::Finish()
+{
+  assert(m_deferred);
+  HandOverCurrentChunk();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_finished = true;
+}
+
+uint32_t StagingUploader::SubmitReady()
+{
+  assert(m_deferred);
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // chunks are recycled in submission order, so reported progress never gets ahead of completed copies
+  bool freed = false;
+  while(!m_inFlightChunks.empty())
+  {
+    Chunk &chunk = m_chunks[m_inFlightChunks.front()];
+    if(!ChunkCompleted(chunk))
+      break;
+
+    if(m_pScheduler == nullptr)
+      VK_CHECK_RESULT(vkResetFences(m_device, 1, &chunk.fence));
+    chunk.inFlight = false;
+    chunk.pending.clear();
+    m_completedProgress = chunk.progress;
+    m_inFlightChunks.pop_front();
+    freed = true;
+  }
+
+  for(uint32_t chunkId : m_readyChunks)
+  {
+    Chunk &chunk = m_chunks[chunkId];
+    SubmitChunk(chunk);
+    chunk.ready = false;
+    m_inFlightChunks.push_back(chunkId);
+  }
+  m_readyChunks.clear();
+
+  if(freed)
+    m_chunkFreed.notify_one();
+
+  return m_completedProgress;
+}
+
+bool StagingUploader::Done()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_finished && m_readyChunks.empty() && m_inFlightChunks.empty();
+}
+
+void StagingUploader::Cancel()
+{
+  assert(m_deferred);
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  for(uint32_t chunkId : m_inFlightChunks)
+    WaitChunk(m_chunks[chunkId]);
+  for(uint32_t chunkId : m_readyChunks)
+  {
+    m_chunks[chunkId].ready = false;
+    m_chunks[chunkId].pending.clear();
+  }
+  m_inFlightChunks.clear();
+  m_readyChunks.clear();
+
+  m_cancelled = true;
+  m_chunkFreed.notify_one();
+}
+
+void StagingUploader::TransferOwnership()
+{
+  if(m_dstCmdPool == VK_NULL_HANDLE || m_writtenBuffers.empty())
+    return;
+
+  std::vector<VkBufferMemoryBarrier> barriers(m_writtenBuffers.size());
+  for(size_t i = 0; i < m_writtenBuffers.size(); ++i)
+  {
+    barriers[i] = {};
+    barriers[i].sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barriers[i].srcQueueFamilyIndex = m_queueFamilyIdx;
+    barriers[i].dstQueueFamilyIndex = m_dstQueueFamilyIdx;
+    barriers[i].buffer              = m_writtenBuffers[i];
+    barriers[i].offset              = 0;
+    barriers[i].size                = VK_WHOLE_SIZE;
+  }
+
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  // release on the transfer queue
+  for(auto &barrier : barriers)
+  {
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+  }
+  VK_CHECK_RESULT(vkResetCommandBuffer(m_releaseCmdBuf, 0));
+  VK_CHECK_RESULT(vkBeginCommandBuffer(m_releaseCmdBuf, &beginInfo));
+  vkCmdPipelineBarrier(m_releaseCmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+    0, nullptr, uint32_t(barriers.size()), barriers.data(), 0, nullptr);
+  VK_CHECK_RESULT(vkEndCommandBuffer(m_releaseCmdBuf));
+
+  VkSubmitInfo releaseInfo = {};
+  releaseInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  releaseInfo.commandBufferCount   = 1;
+  releaseInfo.pCommandBuffers      = &m_releaseCmdBuf;
+  releaseInfo.signalSemaphoreCount = 1;
+  releaseInfo.pSignalSemaphores    = &m_releaseSemaphore;
+  VK_CHECK_RESULT(vkQueueSubmit(m_queue, 1, &releaseInfo, VK_NULL_HANDLE));
+
+  // acquire on the destination queue
+  for(auto &barrier : barriers)
+  {
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  }
+  VK_CHECK_RESULT(vkResetCommandBuffer(m_acquireCmdBuf, 0));
+  VK_CHECK_RESULT(vkBeginCommandBuffer(m_acquireCmdBuf, &beginInfo));
+  vkCmdPipelineBarrier(m_acquireCmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+    0, nullptr, uint32_t(barriers.size()), barriers.data(), 0, nullptr);
+  VK_CHECK_RESULT(vkEndCommandBuffer(m_acquireCmdBuf));
+
+  VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  VkSubmitInfo acquireInfo = {};
+  acquireInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  acquireInfo.waitSemaphoreCount = 1;
+  acquireInfo.pWaitSemaphores    = &m_releaseSemaphore;
+  acquireInfo.pWaitDstStageMask  = &waitStage;
+  acquireInfo.commandBufferCount = 1;
+  acquireInfo.pCommandBuffers    = &m_acquireCmdBuf;
+  VK_CHECK_RESULT(vkQueueSubmit(m_dstQueue, 1, &acquireInfo, m_acquireFence));
+
+  VK_CHECK_RESULT(vkWaitForFences(m_device, 1, &m_acquireFence, VK_TRUE, UINT64_MAX));
+  VK_CHECK_RESULT(vkResetFences(m_device, 1, &m_acquireFence));
+}
+
+void StagingUploader::Flush()
+{
+  assert(!m_deferred);
+  SubmitCurrentChunk();
+  TransferOwnership();
+
+  for(auto &chunk : m_chunks)
+    WaitChunk(chunk);
+
+  m_writtenBuffers.clear();
+}
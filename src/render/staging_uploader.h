@@ -0,0 +1,127 @@
+#ifndef VK_GRAPHICS_BASIC_STAGING_UPLOADER_H
+#define VK_GRAPHICS_BASIC_STAGING_UPLOADER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "volk.h"
+#include "frame_scheduler.h"
+
+// Ring of host visible staging chunks that are filled in place by the caller and copied to device local buffers.
+// Unlike ICopyEngine::UpdateBuffer there is no intermediate copy from user memory:
+// Reserve() returns a pointer straight into the mapped staging memory.
+// Full chunk is submitted right away and the caller continues with the next one,
+// so filling staging memory on the CPU overlaps with copies on the GPU.
+//
+class StagingUploader
+{
+public:
+  StagingUploader(VkDevice a_device, VkPhysicalDevice a_physDevice, VkQueue a_queue, uint32_t a_queueFamilyIdx,
+    VkDeviceSize a_chunkSize, uint32_t a_chunksNum = 4);
+  ~StagingUploader();
+
+  StagingUploader(const StagingUploader &) = delete;
+  StagingUploader &operator=(const StagingUploader &) = delete;
+
+  // buffers written by the uploader are released to a_dstQueueFamilyIdx and acquired on a_dstQueue in Flush,
+  // nothing is done if queue families are the same
+  void SetOwnershipTransfer(VkQueue a_dstQueue, uint32_t a_dstQueueFamilyIdx);
+
+  // chunks are submitted on the transfer timeline of a_pScheduler and waited for by their milestones instead of fences,
+  // only for deferred mode, where all submissions and waits happen on the scheduler's thread; nullptr keeps fences
+  void SetScheduler(FrameScheduler *a_pScheduler) { m_pScheduler = a_pScheduler; }
+
+  // returns pointer to a_size bytes of staging memory which will be copied to a_dst at a_dstOffset,
+  // a_size must not exceed Capacity()
+  void *Reserve(VkBuffer a_dst, VkDeviceSize a_dstOffset, VkDeviceSize a_size);
+
+  // submits pending copies, transfers buffers ownership and waits for all of it to complete
+  void Flush();
+
+  VkDeviceSize Capacity() const { return m_chunkSize; }
+
+  // Deferred mode is used when staging memory is filled on a worker thread:
+  // full chunks are handed over to the thread calling SubmitReady() which does all queue and command buffer work.
+  // Flush and ownership transfer are not available in this mode.
+  void EnableDeferredSubmit();
+
+  // worker side: amount of work (e.g. meshes) completely written to staging memory so far
+  void SetProgress(uint32_t a_progress) { m_progress = a_progress; }
+  // worker side: hands over the last partially filled chunk, no Reserve calls are allowed after it
+  void Finish();
+
+  // submitting side: submits handed over chunks, recycles completed ones
+  // and returns progress value for which all copies have completed
+  uint32_t SubmitReady();
+  // submitting side: true when worker has finished and all of its copies have completed
+  bool Done();
+  // submitting side: waits for copies in flight and drops the rest, worker may keep calling Reserve,
+  // but nothing it writes is copied anymore
+  void Cancel();
+
+private:
+  struct PendingCopy
+  {
+    VkBuffer dst;
+    VkBufferCopy region;
+  };
+
+  struct Chunk
+  {
+    VkDeviceSize offset      = 0;
+    VkCommandBuffer cmdBuf   = VK_NULL_HANDLE;
+    VkFence fence            = VK_NULL_HANDLE;
+    Milestone milestone;     // when submitted through the scheduler
+    bool inFlight            = false;
+    bool ready               = false; // handed over for submission in deferred mode
+    uint32_t progress        = 0;
+    std::vector<PendingCopy> pending;
+  };
+
+  void SubmitCurrentChunk();
+  void SubmitChunk(Chunk &a_chunk);
+  void HandOverCurrentChunk();
+  void WaitChunk(Chunk &a_chunk);
+  bool ChunkCompleted(const Chunk &a_chunk) const;
+  void TransferOwnership();
+
+  VkDevice m_device        = VK_NULL_HANDLE;
+  VkQueue m_queue          = VK_NULL_HANDLE;
+  FrameScheduler *m_pScheduler = nullptr;
+  uint32_t m_queueFamilyIdx = 0;
+  VkDeviceSize m_chunkSize = 0;
+
+  VkBuffer m_stagingBuf       = VK_NULL_HANDLE;
+  VkDeviceMemory m_stagingMem = VK_NULL_HANDLE;
+  uint8_t *m_pMapped          = nullptr;
+
+  VkCommandPool m_cmdPool = VK_NULL_HANDLE;
+  std::vector<Chunk> m_chunks;
+  uint32_t m_currentChunk = 0;
+  VkDeviceSize m_used     = 0;
+
+  // queue family ownership transfer
+  VkQueue m_dstQueue              = VK_NULL_HANDLE;
+  uint32_t m_dstQueueFamilyIdx    = 0;
+  VkCommandPool m_dstCmdPool      = VK_NULL_HANDLE;
+  VkCommandBuffer m_releaseCmdBuf = VK_NULL_HANDLE;
+  VkCommandBuffer m_acquireCmdBuf = VK_NULL_HANDLE;
+  VkSemaphore m_releaseSemaphore  = VK_NULL_HANDLE;
+  VkFence m_acquireFence          = VK_NULL_HANDLE;
+  std::vector<VkBuffer> m_writtenBuffers;
+
+  // deferred submission, chunks in m_readyChunks and m_inFlightChunks are owned by the submitting thread
+  bool m_deferred = false;
+  std::mutex m_mutex;
+  std::condition_variable m_chunkFreed;
+  std::deque<uint32_t> m_readyChunks;
+  std::deque<uint32_t> m_inFlightChunks;
+  uint32_t m_progress          = 0;
+  uint32_t m_completedProgress = 0;
+  bool m_finished  = false;
+  bool m_cancelled = false;
+};
+
+#endif// VK_GRAPHICS_BASIC_STAGING_UPLOADER_H
@@ -0,0 +1,65 @@
+#include <cassert>
+#include <cstring>
+
+#include "uniform_ring.h"
+
+#include <vk_buffers.h>
+#include <vk_utils.h>
+
+UniformRing::UniformRing(VkDevice a_device, VkPhysicalDevice a_physDevice, VkDeviceSize a_dataSize, uint32_t a_slicesNum) :
+  m_device(a_device), m_dataSize(a_dataSize), m_slicesNum(a_slicesNum)
+{
+  assert(a_slicesNum > 0);
+
+  VkPhysicalDeviceProperties props = {};
+  vkGetPhysicalDeviceProperties(a_physDevice, &props);
+  const VkDeviceSize alignment = props.limits.minUniformBufferOffsetAlignment > 0 ?
+                                 props.limits.minUniformBufferOffsetAlignment : 1;
+  m_sliceStride = (a_dataSize + alignment - 1) / alignment * alignment;
+
+  VkMemoryRequirements memReq;
+  m_buffer = vk_utils::createBuffer(m_device, m_sliceStride * m_slicesNum, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq);
+
+  VkMemoryAllocateInfo allocateInfo = {};
+  allocateInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocateInfo.allocationSize  = memReq.size;
+  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, a_physDevice);
+  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_memory));
+  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_buffer, m_memory, 0));
+
+  void *pMapped = nullptr;
+  VK_CHECK_RESULT(vkMapMemory(m_device, m_memory, 0, m_sliceStride * m_slicesNum, 0, &pMapped));
+  m_pMapped = static_cast<uint8_t *>(pMapped);
+  memset(m_pMapped, 0, m_sliceStride * m_slicesNum);
+}
+
+UniformRing::~UniformRing()
+{
+  vkUnmapMemory(m_device, m_memory);
+  vkDestroyBuffer(m_device, m_buffer, nullptr);
+  vkFreeMemory(m_device, m_memory, nullptr);
+}
+
+void UniformRing::Write(uint32_t a_slice, const void *a_data, VkDeviceSize a_size)
+{
+  assert(a_slice < m_slicesNum && a_size <= m_dataSize);
+  memcpy(m_pMapped + a_slice * m_sliceStride, a_data, a_size);
+}
+
+void UniformRing::WriteDescriptor(VkDescriptorSet a_set, uint32_t a_binding) const
+{
+  VkDescriptorBufferInfo bufferInfo = {};
+  bufferInfo.buffer = m_buffer;
+  bufferInfo.offset = 0;
+  bufferInfo.range  = m_dataSize;
+
+  VkWriteDescriptorSet write = {};
+  write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet          = a_set;
+  write.dstBinding      = a_binding;
+  write.descriptorCount = 1;
+  write.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  write.pBufferInfo     = &bufferInfo;
+  vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+}
@@ -0,0 +1,45 @@
+#ifndef VK_GRAPHICS_BASIC_UNIFORM_RING_H
+#define VK_GRAPHICS_BASIC_UNIFORM_RING_H
+
+#include <cstdint>
+
+#include "volk.h"
+
+// Uniform data of frames in flight in one host visible, persistently mapped buffer split into a slice per frame,
+// slices are aligned to minUniformBufferOffsetAlignment. The CPU writes the slice of the frame being recorded
+// while the GPU still reads the slices of the previous frames. The buffer is bound once as
+// VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC and a slice is selected by the dynamic offset Offset(slice).
+//
+class UniformRing
+{
+public:
+  UniformRing(VkDevice a_device, VkPhysicalDevice a_physDevice, VkDeviceSize a_dataSize, uint32_t a_slicesNum);
+  ~UniformRing();
+
+  UniformRing(const UniformRing &) = delete;
+  UniformRing &operator=(const UniformRing &) = delete;
+
+  VkBuffer     Buffer()    const { return m_buffer; }
+  VkDeviceSize DataSize()  const { return m_dataSize; }
+  uint32_t     SlicesNum() const { return m_slicesNum; }
+  // dynamic offset of a_slice for vkCmdBindDescriptorSets
+  uint32_t     Offset(uint32_t a_slice) const { return uint32_t(a_slice * m_sliceStride); }
+
+  // a_slice must not be read by command buffers that are still pending, memory is coherent, so no flush is needed
+  void Write(uint32_t a_slice, const void *a_data, VkDeviceSize a_size);
+
+  // points a_binding of a_set to the buffer with the range of one slice;
+  // vk_utils::DescriptorMaker binds whole buffers, which is out of range for any non zero dynamic offset
+  void WriteDescriptor(VkDescriptorSet a_set, uint32_t a_binding) const;
+
+private:
+  VkDevice       m_device      = VK_NULL_HANDLE;
+  VkBuffer       m_buffer      = VK_NULL_HANDLE;
+  VkDeviceMemory m_memory      = VK_NULL_HANDLE;
+  uint8_t       *m_pMapped     = nullptr;
+  VkDeviceSize   m_dataSize    = 0;
+  VkDeviceSize   m_sliceStride = 0;
+  uint32_t       m_slicesNum   = 0;
+};
+
+#endif// VK_GRAPHICS_BASIC_UNIFORM_RING_H
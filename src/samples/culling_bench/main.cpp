@@ -0,0 +1,256 @@
+#include "render/frustum_culler.h"
+#include "render/instance_bvh.h"
+#include "loader_utils/hydraxml.h"
+#include "utils/Camera.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Instances per second of FrustumCuller::QueryFrustum against an AoS scalar loop over Box4f,
+// for one thread and for the query split between threads, and of InstanceBvh build, refit and QueryFrustum.
+// Every query is checked against the scalar loop, the bench fails if ids differ.
+// Also compares hydra_xml::readFloats with std::wstringstream that scene matrices were parsed with before.
+// usage: culling_bench [max threads], all hardware threads by default
+
+using namespace LiteMath;
+
+static bool BoxVisibleScalar(const float4 *a_planes, const Box4f &a_box)
+{
+  for(int p = 0; p < 6; ++p)
+  {
+    const float4 &plane = a_planes[p];
+    const float4 corner(plane.x >= 0.0f ? a_box.boxMax.x : a_box.boxMin.x, plane.y >= 0.0f ? a_box.boxMax.y : a_box.boxMin.y,
+                        plane.z >= 0.0f ? a_box.boxMax.z : a_box.boxMin.z, 1.0f);
+    if(dot(plane, corner) < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+template<typename Func>
+static double AverageMs(int a_repeats, Func &&a_func)
+{
+  a_func(); // warm up caches and the page mapping of the output
+  const auto start = std::chrono::steady_clock::now();
+  for(int r = 0; r < a_repeats; ++r)
+    a_func();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / a_repeats;
+}
+
+// random matrix attributes as they are written to scene files: fixed, exponent and shortest round trip notations
+static std::vector<std::string> RandomMatrixStrings(std::mt19937 &a_rng, uint32_t a_count)
+{
+  std::uniform_real_distribution<float> value(-1000.0f, 1000.0f);
+  std::uniform_int_distribution<uint32_t> bits(0u, 0xFFFFFFFFu), precision(0, 9), format(0, 2);
+  std::vector<std::string> strings(a_count);
+  char number[64];
+  for(auto &str : strings)
+  {
+    for(int i = 0; i < 16; ++i)
+    {
+      const int digits = int(precision(a_rng));
+      switch(format(a_rng))
+      {
+      case 0:
+        snprintf(number, sizeof(number), "%.*f", digits, value(a_rng));
+        break;
+      case 1:
+        snprintf(number, sizeof(number), "%.*e", digits, value(a_rng) * 1e-3f);
+        break;
+      default:
+      {
+        // any finite float, printed so that it reads back exactly
+        uint32_t u = bits(a_rng);
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        if(!std::isfinite(f))
+          f = 0.0f;
+        snprintf(number, sizeof(number), "%.9g", f);
+      }
+      }
+      str += (i == 0 ? "" : " ");
+      str += number;
+    }
+  }
+  return strings;
+}
+
+// returns false if readFloats and std::wstringstream results are not bit identical
+static bool BenchReadFloats(std::mt19937 &a_rng, uint32_t a_matricesNum)
+{
+  const std::vector<std::string> strings = RandomMatrixStrings(a_rng, a_matricesNum);
+  std::vector<pugi::string_t> xmlStrings(a_matricesNum);
+  std::vector<std::wstring> wideStrings(a_matricesNum);
+  for(uint32_t i = 0; i < a_matricesNum; ++i)
+  {
+    xmlStrings[i].assign(strings[i].begin(), strings[i].end());
+    wideStrings[i].assign(strings[i].begin(), strings[i].end());
+  }
+
+  std::vector<float> parsed(16 * a_matricesNum), reference(16 * a_matricesNum);
+  const int repeats = std::max(3, int(1000000 / a_matricesNum));
+  const double streamMs = AverageMs(repeats, [&]()
+  {
+    for(uint32_t i = 0; i < a_matricesNum; ++i)
+    {
+      std::wstringstream inputStream(wideStrings[i]);
+      for(int j = 0; j < 16; ++j)
+        inputStream >> reference[16 * i + j];
+    }
+  });
+  const double parsedMs = AverageMs(repeats, [&]()
+  {
+    for(uint32_t i = 0; i < a_matricesNum; ++i)
+      hydra_xml::readFloats(xmlStrings[i].c_str(), parsed.data() + 16 * i, 16);
+  });
+
+  for(size_t i = 0; i < parsed.size(); ++i)
+  {
+    if(memcmp(&parsed[i], &reference[i], sizeof(float)) != 0)
+    {
+      printf("readFloats gives %.9g instead of %.9g in \"%s\"\n", parsed[i], reference[i], strings[i / 16].c_str());
+      return false;
+    }
+  }
+  printf("%8u %14.3f %14.3f %12.2f %9.2fx\n", a_matricesNum, streamMs, parsedMs, 16.0 * a_matricesNum / parsedMs * 1e-3,
+         streamMs / parsedMs);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  const uint32_t hwThreads  = std::max(1u, std::thread::hardware_concurrency());
+  const uint32_t maxThreads = argc > 1 ? uint32_t(std::max(1, atoi(argv[1]))) : hwThreads;
+
+  std::vector<uint32_t> threadCounts;
+  for(uint32_t t = 1; t < maxThreads; t *= 2)
+    threadCounts.push_back(t);
+  threadCounts.push_back(maxThreads);
+
+  printf("SIMD width %u, hardware threads %u, queries over %u boxes are split\n", FrustumCuller::SIMD_WIDTH, hwThreads,
+         FrustumCuller::THREAD_CHUNK);
+  printf("%8s %8s %10s %10s %12s %14s %10s\n", "boxes", "visible", "threads", "ms", "M inst/s", "M inst/s/core", "vs scalar");
+
+  std::mt19937 rng(1);
+  for(uint32_t boxesNum : {1000u, 10000u, 32768u, 100000u, 1000000u})
+  {
+    // boxes scattered over a square, the camera looks along it, so about a tenth of them is visible
+    const float side = 10.0f * std::sqrt(float(boxesNum));
+    std::uniform_real_distribution<float> pos(0.0f, side), size(0.5f, 3.0f);
+    std::vector<Box4f> boxes(boxesNum);
+    for(auto &box : boxes)
+    {
+      const float3 center(pos(rng), size(rng), pos(rng));
+      const float extent = size(rng);
+      box = Box4f(to_float4(center - float3(extent), 1.0f), to_float4(center + float3(extent), 1.0f));
+    }
+
+    FrustumCuller culler;
+    culler.SetBoxes(boxes.data(), boxesNum);
+    const float4x4 projView = projectionMatrix(60.0f, 16.0f / 9.0f, 0.1f, 1000.0f) *
+      lookAt(float3(side * 0.5f, 20.0f, side * 0.5f), float3(side * 0.5f + 100.0f, 0.0f, side * 0.5f + 50.0f), float3(0, 1, 0));
+
+    const float4 rows[4] = {projView.get_row(0), projView.get_row(1), projView.get_row(2), projView.get_row(3)};
+    const float4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                              rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2]};
+
+    auto scalarQuery = [&](const std::vector<Box4f> &a_boxes, std::vector<uint32_t> &a_ids)
+    {
+      a_ids.clear();
+      for(uint32_t i = 0; i < boxesNum; ++i)
+        if(BoxVisibleScalar(planes, a_boxes[i]))
+          a_ids.push_back(i);
+    };
+
+    const int repeats = std::max(20, int(50000000 / boxesNum));
+    std::vector<uint32_t> reference;
+    const double scalarMs = AverageMs(repeats, [&]() { scalarQuery(boxes, reference); });
+    printf("%8u %8zu %10s %10.3f %12.0f %14.0f %10s\n", boxesNum, reference.size(), "scalar", scalarMs,
+           boxesNum / scalarMs * 1e-3, boxesNum / scalarMs * 1e-3, "1.00x");
+
+    std::vector<uint32_t> ids;
+    for(uint32_t threads : threadCounts)
+    {
+      const double ms = AverageMs(repeats, [&]()
+      {
+        ids.clear();
+        culler.QueryFrustum(projView, ids, UINT32_MAX, threads);
+      });
+      if(ids != reference)
+      {
+        printf("ids differ from the scalar reference with %u threads\n", threads);
+        return 1;
+      }
+      // queries below THREAD_CHUNK boxes are not split, at most one thread per chunk is busy
+      const uint32_t busyThreads = std::min(threads, (boxesNum + FrustumCuller::THREAD_CHUNK - 1) / FrustumCuller::THREAD_CHUNK);
+      printf("%8u %8zu %10u %10.3f %12.0f %14.0f %9.2fx\n", boxesNum, ids.size(), threads, ms, boxesNum / ms * 1e-3,
+             boxesNum / ms * 1e-3 / std::min(busyThreads, hwThreads), scalarMs / ms);
+    }
+
+    // InstanceBvh is single threaded, build and refit are timed per box like the queries
+    InstanceBvh bvh;
+    const int buildRepeats = std::max(3, repeats / 50);
+    const double buildMs   = AverageMs(buildRepeats, [&]() { bvh.Build(boxes.data(), boxesNum); });
+    printf("%8u %8s %10s %10.3f %12.2f %14.2f %10s\n", boxesNum, "", "bvh build", buildMs, boxesNum / buildMs * 1e-3,
+           boxesNum / buildMs * 1e-3, "");
+
+    const double bvhMs = AverageMs(repeats, [&]()
+    {
+      ids.clear();
+      bvh.QueryFrustum(projView, ids);
+    });
+    std::sort(ids.begin(), ids.end());
+    if(ids != reference)
+    {
+      printf("InstanceBvh ids differ from the scalar reference\n");
+      return 1;
+    }
+    printf("%8u %8zu %10s %10.3f %12.0f %14.0f %9.2fx\n", boxesNum, ids.size(), "bvh", bvhMs, boxesNum / bvhMs * 1e-3,
+           boxesNum / bvhMs * 1e-3, scalarMs / bvhMs);
+
+    // every box moved a little, the tree keeps its topology
+    std::uniform_real_distribution<float> shift(-2.0f, 2.0f);
+    std::vector<Box4f> moved(boxes);
+    for(auto &box : moved)
+    {
+      const float4 offset(shift(rng), 0.0f, shift(rng), 0.0f);
+      box = Box4f(box.boxMin + offset, box.boxMax + offset);
+    }
+    scalarQuery(moved, reference);
+
+    const double refitMs = AverageMs(buildRepeats, [&]() { bvh.Refit(moved.data()); });
+    printf("%8u %8s %10s %10.3f %12.2f %14.2f %10s\n", boxesNum, "", "bvh refit", refitMs, boxesNum / refitMs * 1e-3,
+           boxesNum / refitMs * 1e-3, "");
+
+    const double refitQueryMs = AverageMs(repeats, [&]()
+    {
+      ids.clear();
+      bvh.QueryFrustum(projView, ids);
+    });
+    std::sort(ids.begin(), ids.end());
+    if(ids != reference)
+    {
+      printf("InstanceBvh ids differ from the scalar reference after refit\n");
+      return 1;
+    }
+    printf("%8u %8zu %10s %10.3f %12.0f %14.0f %10s\n", boxesNum, ids.size(), "bvh moved", refitQueryMs,
+           boxesNum / refitQueryMs * 1e-3, boxesNum / refitQueryMs * 1e-3, "");
+  }
+
+  printf("\n%8s %14s %14s %12s %10s\n", "matrices", "wstringstream", "readFloats ms", "M floats/s", "speedup");
+  for(uint32_t matricesNum : {1000u, 100000u})
+  {
+    if(!BenchReadFloats(rng, matricesNum))
+      return 1;
+  }
+  return 0;
+}
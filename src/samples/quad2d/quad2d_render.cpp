@@ -18,6 +18,7 @@ Quad2D_Render::Quad2D_Render(uint32_t a_width, uint32_t a_height) : m_width(a_wi
 void Quad2D_Render::SetupDeviceFeatures()
 {
   // m_enabledDeviceFeatures.fillModeNonSolid = VK_TRUE;
+  FrameScheduler::SetupDevice(m_physicalDevice, m_deviceExtensions, m_timelineFeatures);
 }
 
 void Quad2D_Render::SetupDeviceExtensions()
@@ -44,19 +45,17 @@ void Quad2D_Render::InitVulkan(const char** a_instanceExtensions, uint32_t a_ins
 
   CreateDevice(a_deviceId);
   volkLoadDevice(m_device);
+  m_pScheduler = std::make_unique<FrameScheduler>(m_device, m_framesInFlight);
 
   m_commandPool = vk_utils::createCommandPool(m_device, m_queueFamilyIDXs.graphics, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-  m_cmdBuffersDrawMain.reserve(m_framesInFlight);
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
+  // primary command buffers are recorded every frame, their pools are reset instead of the buffers
+  m_framePools.resize(m_framesInFlight);
+  m_cmdBuffersDrawMain.resize(m_framesInFlight);
+  for (uint32_t i = 0; i < m_framesInFlight; ++i)
   {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
+    m_framePools[i]         = vk_utils::createCommandPool(m_device, m_queueFamilyIDXs.graphics, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    m_cmdBuffersDrawMain[i] = vk_utils::createCommandBuffers(m_device, m_framePools[i], 1)[0];
   }
   
   m_pCopyHelper = std::make_shared<vk_utils::SimpleCopyHelper>(m_physicalDevice, m_device, m_transferQueue, m_queueFamilyIDXs.graphics, 8*1024*1024);
@@ -68,12 +67,7 @@ void Quad2D_Render::InitPresentation(VkSurfaceKHR &a_surface, bool)
 
   m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface,
                                                               m_width, m_height, m_framesInFlight, m_vsync);
-  m_presentationResources.currentFrame = 0;
-
-  VkSemaphoreCreateInfo semaphoreInfo = {};
-  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.imageAvailable));
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished));
+  m_pScheduler->CreateSwapchainSync(m_swapchain.GetImageCount());
 
   vk_utils::RenderTargetInfo2D rtargetInfo = {};
   rtargetInfo.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
@@ -119,7 +113,7 @@ void Quad2D_Render::CreateDevice(uint32_t a_deviceId)
   SetupDeviceFeatures();
   m_device = vk_utils::createLogicalDevice(m_physicalDevice, m_validationLayers, m_deviceExtensions,
                                            m_enabledDeviceFeatures, m_queueFamilyIDXs,
-                                           VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT);
+                                           VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT, &m_timelineFeatures);
 
   vkGetDeviceQueue(m_device, m_queueFamilyIDXs.graphics, 0, &m_graphicsQueue);
   vkGetDeviceQueue(m_device, m_queueFamilyIDXs.transfer, 0, &m_transferQueue);
@@ -142,11 +136,10 @@ void Quad2D_Render::SetupSimplePipeline()
 
 void Quad2D_Render::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff, VkImageView a_targetImageView)
 {
-  vkResetCommandBuffer(a_cmdBuff, 0);
-
+  // the buffer was recycled with the pool of its frame
   VkCommandBufferBeginInfo beginInfo = {};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
   VK_CHECK_RESULT(vkBeginCommandBuffer(a_cmdBuff, &beginInfo));
 
@@ -180,17 +173,8 @@ void Quad2D_Render::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFrameb
 
 void Quad2D_Render::CleanupPipelineAndSwapchain()
 {
-  if (!m_cmdBuffersDrawMain.empty())
-  {
-    vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_cmdBuffersDrawMain.size()),
-                         m_cmdBuffersDrawMain.data());
-    m_cmdBuffersDrawMain.clear();
-  }
-
-  for (size_t i = 0; i < m_frameFences.size(); i++)
-  {
-    vkDestroyFence(m_device, m_frameFences[i], nullptr);
-  }
+  if(m_pScheduler != nullptr)
+    m_pScheduler->DestroySwapchainSync();
 
   vkDestroyImageView(m_device, m_imageData.view, nullptr);
   vkDestroyImage(m_device, m_imageData.image, nullptr);
@@ -223,33 +207,23 @@ void Quad2D_Render::RecreateSwapChain()
   m_screenRenderPass = vk_utils::createRenderPass(m_device, rtargetInfo);
   m_frameBuffers     = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass);
 
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
-  {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
-  }
-
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-  for (uint32_t i = 0; i < m_swapchain.GetImageCount(); ++i)
-  {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i], m_swapchain.GetAttachment(i).view);
-  }
+  // the number of swapchain images may change
+  m_pScheduler->CreateSwapchainSync(m_swapchain.GetImageCount());
 }
 
 void Quad2D_Render::Cleanup()
 {
+  // frames may still be in flight
+  vkDeviceWaitIdle(m_device);
+
   m_pFSQuad     = nullptr; // smartptr delete it's resources
   CleanupPipelineAndSwapchain();
 
-
-  if (m_presentationResources.imageAvailable != VK_NULL_HANDLE)
-    vkDestroySemaphore(m_device, m_presentationResources.imageAvailable, nullptr);
-  
-  if (m_presentationResources.renderingFinished != VK_NULL_HANDLE)
-    vkDestroySemaphore(m_device, m_presentationResources.renderingFinished, nullptr);
+  for (auto pool : m_framePools)
+    vkDestroyCommandPool(m_device, pool, nullptr);
+  m_framePools.clear();
+  m_cmdBuffersDrawMain.clear();
+  m_pScheduler = nullptr;
 
   if (m_commandPool != VK_NULL_HANDLE)
   {
@@ -271,13 +245,10 @@ void Quad2D_Render::ProcessInput(const AppInput &input)
     std::system("cd ../resources/shaders && python3 compile_quad_render_shaders.py");
 #endif
 
+    // frames in flight use the old pipeline and descriptor set
+    m_pScheduler->Wait(m_pScheduler->LastFrame());
     SetupQuadRenderer();
     SetupSimplePipeline();
-
-    for (uint32_t i = 0; i < m_framesInFlight; ++i)
-    {
-      BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i], m_swapchain.GetAttachment(i).view);
-    }
   }
 
 }
@@ -342,42 +313,31 @@ void Quad2D_Render::LoadScene(const char*, bool)
   m_imageSampler = vk_utils::createSampler(m_device, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT);
 
   SetupSimplePipeline();
-
-  for (uint32_t i = 0; i < m_framesInFlight; ++i)
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i], m_swapchain.GetAttachment(i).view);
 }
 
-void Quad2D_Render::DrawFrameSimple()
+bool Quad2D_Render::AcquireFrame(uint32_t &a_imageIdx)
 {
-  vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
-  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
-
-  uint32_t imageIdx;
-  m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable, &imageIdx);
-
-  auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
-
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-
-  BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view);
-
-  VkSubmitInfo submitInfo = {};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &currentCmdBuf;
+  auto result = m_pScheduler->AcquireFrame(m_swapchain, a_imageIdx);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR)
+  {
+    RecreateSwapChain();
+    return false;
+  }
+  else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+  {
+    RUN_TIME_ERROR("Failed to acquire the next swapchain image!");
+  }
 
-  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished};
-  submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pSignalSemaphores = signalSemaphores;
+  VK_CHECK_RESULT(vkResetCommandPool(m_device, m_framePools[m_pScheduler->CurrentFrame()], 0));
+  return true;
+}
 
-  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+void Quad2D_Render::SubmitFrame(uint32_t a_imageIdx, VkCommandBuffer a_cmdBuff)
+{
+  // no wait for the queue here, the next frame is recorded while this one is rendered
+  m_pScheduler->SubmitFrame(m_graphicsQueue, a_imageIdx, {a_cmdBuff});
 
-  VkResult presentRes = m_swapchain.QueuePresent(m_presentationResources.queue, imageIdx,
-                                                 m_presentationResources.renderingFinished);
+  VkResult presentRes = m_pScheduler->PresentFrame(m_swapchain, m_presentationResources.queue, a_imageIdx);
 
   if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR)
   {
@@ -387,10 +347,18 @@ void Quad2D_Render::DrawFrameSimple()
   {
     RUN_TIME_ERROR("Failed to present swapchain image");
   }
+}
 
-  m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
+void Quad2D_Render::DrawFrameSimple()
+{
+  uint32_t imageIdx;
+  if (!AcquireFrame(imageIdx))
+    return;
+
+  auto currentCmdBuf = m_cmdBuffersDrawMain[m_pScheduler->CurrentFrame()];
+  BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view);
 
-  vkQueueWaitIdle(m_presentationResources.queue);
+  SubmitFrame(imageIdx, currentCmdBuf);
 }
 
 void Quad2D_Render::DrawFrame(float, DrawMode)
@@ -3,6 +3,7 @@
 
 #define VK_NO_PROTOTYPES
 #include "../../render/render_common.h"
+#include "../../render/frame_scheduler.h"
 #include "../resources/shaders/common.h"
 #include <vk_descriptor_sets.h>
 #include <vk_fbuf_attachment.h>
@@ -71,13 +72,13 @@ private:
 
   struct
   {
-    uint32_t    currentFrame      = 0u;
-    VkQueue     queue             = VK_NULL_HANDLE;
-    VkSemaphore imageAvailable    = VK_NULL_HANDLE;
-    VkSemaphore renderingFinished = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
   } m_presentationResources;
 
-  std::vector<VkFence> m_frameFences;
+  // up to m_framesInFlight frames are recorded by the CPU while the previous ones are rendered,
+  // frame slots, swapchain semaphores and all queue submissions are tracked on the timelines of m_pScheduler
+  std::unique_ptr<FrameScheduler> m_pScheduler;
+  std::vector<VkCommandPool>   m_framePools; // per frame in flight, reset as a whole when the slot is reused
   std::vector<VkCommandBuffer> m_cmdBuffersDrawMain;
   VkRenderPass m_screenRenderPass = VK_NULL_HANDLE; // main renderpass
 
@@ -93,6 +94,7 @@ private:
   bool m_vsync = false;
 
   VkPhysicalDeviceFeatures m_enabledDeviceFeatures = {};
+  VkPhysicalDeviceTimelineSemaphoreFeatures m_timelineFeatures = {};
   std::vector<const char*> m_deviceExtensions      = {};
   std::vector<const char*> m_instanceExtensions    = {};
 
@@ -109,6 +111,11 @@ private:
 
   void DrawFrameSimple();
 
+  // waits until the current frame slot and the acquired image are not used by the GPU anymore;
+  // false if the swapchain was out of date and has been recreated
+  bool AcquireFrame(uint32_t &a_imageIdx);
+  void SubmitFrame(uint32_t a_imageIdx, VkCommandBuffer a_cmdBuff);
+
   void CreateInstance();
   void CreateDevice(uint32_t a_deviceId);
 
@@ -5,6 +5,8 @@
 #include <vk_pipeline.h>
 #include <vk_buffers.h>
 
+#include <chrono>
+
 SimpleShadowmapRender::SimpleShadowmapRender(uint32_t a_width, uint32_t a_height) : m_width(a_width), m_height(a_height)
 {
 #ifdef NDEBUG
@@ -17,6 +19,9 @@ SimpleShadowmapRender::SimpleShadowmapRender(uint32_t a_width, uint32_t a_height
 void SimpleShadowmapRender::SetupDeviceFeatures()
 {
   // m_enabledDeviceFeatures.fillModeNonSolid = VK_TRUE;
+  m_gpuCullingSupported = GpuCuller::SetupDevice(m_physicalDevice, m_enabledDeviceFeatures, m_deviceExtensions, m_drawIndirectCount) &&
+                          GpuCuller::ShadersCompiled();
+  FrameScheduler::SetupDevice(m_physicalDevice, m_deviceExtensions, m_timelineFeatures);
 }
 
 void SimpleShadowmapRender::SetupDeviceExtensions()
@@ -44,22 +49,23 @@ void SimpleShadowmapRender::InitVulkan(const char** a_instanceExtensions, uint32
 
   CreateDevice(a_deviceId);
   volkLoadDevice(m_device);
+  m_pScheduler = std::make_unique<FrameScheduler>(m_device, m_framesInFlight);
 
   m_commandPool = vk_utils::createCommandPool(m_device, m_queueFamilyIDXs.graphics, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-  m_cmdBuffersDrawMain.reserve(m_framesInFlight);
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
+  // primary command buffers are recorded every frame, their pools are reset instead of the buffers
+  m_framePools.resize(m_framesInFlight);
+  m_cmdBuffersDrawMain.resize(m_framesInFlight);
+  for (uint32_t i = 0; i < m_framesInFlight; ++i)
   {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
+    m_framePools[i]         = vk_utils::createCommandPool(m_device, m_queueFamilyIDXs.graphics, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    m_cmdBuffersDrawMain[i] = vk_utils::createCommandBuffers(m_device, m_framePools[i], 1)[0];
   }
+  m_pProfiler = std::make_unique<GpuProfiler>(m_device, m_physicalDevice, m_queueFamilyIDXs.graphics, m_framesInFlight);
+  m_pRecorder = std::make_unique<ParallelRecorder>(m_device, m_queueFamilyIDXs.graphics, m_framesInFlight);
 
   m_pScnMgr = std::make_shared<SceneManager>(m_device, m_physicalDevice, m_queueFamilyIDXs.transfer, m_queueFamilyIDXs.graphics, false);
+  m_pScnMgr->SetFrameScheduler(m_pScheduler.get());
 }
 
 void SimpleShadowmapRender::InitPresentation(VkSurfaceKHR &a_surface, bool)
@@ -68,12 +74,7 @@ void SimpleShadowmapRender::InitPresentation(VkSurfaceKHR &a_surface, bool)
 
   m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface,
                                                               m_width, m_height, m_framesInFlight, m_vsync);
-  m_presentationResources.currentFrame = 0;
-
-  VkSemaphoreCreateInfo semaphoreInfo = {};
-  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.imageAvailable));
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished));
+  m_pScheduler->CreateSwapchainSync(m_swapchain.GetImageCount());
 
   std::vector<VkFormat> depthFormats = {
     VK_FORMAT_D32_SFLOAT,
@@ -146,7 +147,7 @@ void SimpleShadowmapRender::CreateDevice(uint32_t a_deviceId)
   SetupDeviceFeatures();
   m_device = vk_utils::createLogicalDevice(m_physicalDevice, m_validationLayers, m_deviceExtensions,
                                            m_enabledDeviceFeatures, m_queueFamilyIDXs,
-                                           VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT);
+                                           VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT, &m_timelineFeatures);
 
   vkGetDeviceQueue(m_device, m_queueFamilyIDXs.graphics, 0, &m_graphicsQueue);
   vkGetDeviceQueue(m_device, m_queueFamilyIDXs.transfer, 0, &m_transferQueue);
@@ -156,18 +157,22 @@ void SimpleShadowmapRender::CreateDevice(uint32_t a_deviceId)
 void SimpleShadowmapRender::SetupSimplePipeline()
 {
   std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,             1},
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,     1},
       {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,     2}
   };
 
+  // sets of the old pool and the old pipelines may be used by frames in flight
+  if(m_pBindings != nullptr)
+    m_pScheduler->Wait(m_pScheduler->LastFrame());
   m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 2);
   
   auto shadowMap = m_pShadowMap2->m_attachments[m_shadowMapId];
 
   m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
-  m_pBindings->BindBuffer(0, m_ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+  m_pBindings->BindBuffer(0, m_pUniformRing->Buffer(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
   m_pBindings->BindImage (1, shadowMap.view, m_pShadowMap2->m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
   m_pBindings->BindEnd(&m_dSet, &m_dSetLayout);
+  m_pUniformRing->WriteDescriptor(m_dSet, 0);
 
   //m_pBindings->BindImage(0, m_GBufTarget->m_attachments[m_GBuf_idx[GBUF_ATTACHMENT::POS_Z]].view, m_GBufTarget->m_sampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
@@ -198,10 +203,12 @@ void SimpleShadowmapRender::SetupSimplePipeline()
   
   // pipeline for drawing objects
   //
+  const std::string vertexShaderPath = m_pScnMgr->CompactVerticesEnabled() ? "../resources/shaders/simple_compact.vert.spv" :
+                                                                               "../resources/shaders/simple.vert.spv";
   std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
   {
     shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = "../resources/shaders/simple_shadow.frag.spv";
-    shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = "../resources/shaders/simple.vert.spv";
+    shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = vertexShaderPath;
   }
   maker.LoadShaders(m_device, shader_paths);
 
@@ -216,7 +223,7 @@ void SimpleShadowmapRender::SetupSimplePipeline()
   //
   // maker.SetDefaultState(m_width, m_height);
   shader_paths.clear();
-  shader_paths[VK_SHADER_STAGE_VERTEX_BIT] = "../resources/shaders/simple.vert.spv";
+  shader_paths[VK_SHADER_STAGE_VERTEX_BIT] = vertexShaderPath;
   maker.LoadShaders(m_device, shader_paths);
 
   maker.viewport.width  = float(m_pShadowMap2->m_resolution.width);
@@ -226,25 +233,140 @@ void SimpleShadowmapRender::SetupSimplePipeline()
   m_shadowPipeline.layout   = m_basicForwardPipeline.layout;
   m_shadowPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(), 
                                                  m_pShadowMap2->m_renderPass);                                                       
+
+  SetupGpuCulling();
+  SetupInstancing();
 }
 
-void SimpleShadowmapRender::CreateUniformBuffer()
+void SimpleShadowmapRender::SetupGpuCulling()
+{
+  DestroyGpuCulling();
+  if(!m_gpuCulling || !m_gpuCullingSupported)
+    return;
+
+  const std::string vertexShaderPath = m_pScnMgr->CompactVerticesEnabled() ? "../resources/shaders/simple_compact_indirect.vert.spv" :
+                                                                               "../resources/shaders/simple_indirect.vert.spv";
+  if(!ShaderCompiled(vertexShaderPath))
+  {
+    m_gpuCulling = false;
+    return;
+  }
+
+  m_pGpuCuller = std::make_unique<GpuCuller>(m_device, m_physicalDevice, m_drawIndirectCount, CULL_VIEWS_NUM);
+
+  vk_utils::GraphicsPipelineMaker maker;
+
+  std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
+  shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = "../resources/shaders/simple_shadow.frag.spv";
+  shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = vertexShaderPath;
+  maker.LoadShaders(m_device, shader_paths);
+
+  // model matrices come from the culler set, only projView is pushed
+  m_indirectPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout, m_pGpuCuller->GetDescriptorSetLayout()},
+                                               sizeof(pushConst2M.projView));
+  maker.SetDefaultState(m_width, m_height);
+
+  m_indirectPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(),
+                                                   m_screenRenderPass);
+
+  shader_paths.clear();
+  shader_paths[VK_SHADER_STAGE_VERTEX_BIT] = vertexShaderPath;
+  maker.LoadShaders(m_device, shader_paths);
+
+  maker.viewport.width  = float(m_pShadowMap2->m_resolution.width);
+  maker.viewport.height = float(m_pShadowMap2->m_resolution.height);
+  maker.scissor.extent  = VkExtent2D{ uint32_t(m_pShadowMap2->m_resolution.width), uint32_t(m_pShadowMap2->m_resolution.height) };
+
+  m_shadowIndirectPipeline.layout   = m_indirectPipeline.layout;
+  m_shadowIndirectPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(),
+                                                         m_pShadowMap2->m_renderPass);
+}
+
+void SimpleShadowmapRender::DestroyGpuCulling()
+{
+  if(m_pGpuCuller == nullptr)
+    return;
+
+  // command buffers in flight use the culler buffers and the pipelines
+  m_pScheduler->Wait(m_pScheduler->LastFrame());
+  for(auto *pipeline : {&m_indirectPipeline, &m_shadowIndirectPipeline})
+  {
+    if(pipeline->pipeline != VK_NULL_HANDLE)
+    {
+      vkDestroyPipeline(m_device, pipeline->pipeline, nullptr);
+      pipeline->pipeline = VK_NULL_HANDLE;
+    }
+  }
+  if(m_indirectPipeline.layout != VK_NULL_HANDLE)
+  {
+    vkDestroyPipelineLayout(m_device, m_indirectPipeline.layout, nullptr);
+    m_indirectPipeline.layout       = VK_NULL_HANDLE;
+    m_shadowIndirectPipeline.layout = VK_NULL_HANDLE;
+  }
+  m_pGpuCuller = nullptr;
+}
+
+void SimpleShadowmapRender::SetupInstancing()
+{
+  DestroyInstancing();
+  if(!m_hwInstancing)
+    return;
+
+  const std::string vertexShaderPath = m_pScnMgr->CompactVerticesEnabled() ? "../resources/shaders/simple_compact_instanced.vert.spv" :
+                                                                               "../resources/shaders/simple_instanced.vert.spv";
+  if(!ShaderCompiled(vertexShaderPath))
+  {
+    m_hwInstancing = false;
+    return;
+  }
+
+  vk_utils::GraphicsPipelineMaker maker;
+
+  std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
+  shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = "../resources/shaders/simple_shadow.frag.spv";
+  shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = vertexShaderPath;
+  maker.LoadShaders(m_device, shader_paths);
+
+  // model matrices are vertex attributes, only projView is pushed
+  m_instancedPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M.projView));
+  maker.SetDefaultState(m_width, m_height);
+
+  m_instancedPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetInstancedPipelineVertexInputStateCreateInfo(),
+                                                    m_screenRenderPass);
+
+  shader_paths.clear();
+  shader_paths[VK_SHADER_STAGE_VERTEX_BIT] = vertexShaderPath;
+  maker.LoadShaders(m_device, shader_paths);
+
+  maker.viewport.width  = float(m_pShadowMap2->m_resolution.width);
+  maker.viewport.height = float(m_pShadowMap2->m_resolution.height);
+  maker.scissor.extent  = VkExtent2D{ uint32_t(m_pShadowMap2->m_resolution.width), uint32_t(m_pShadowMap2->m_resolution.height) };
+
+  m_shadowInstancedPipeline.layout   = m_instancedPipeline.layout;
+  m_shadowInstancedPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetInstancedPipelineVertexInputStateCreateInfo(),
+                                                          m_pShadowMap2->m_renderPass);
+}
+
+void SimpleShadowmapRender::DestroyInstancing()
 {
-  VkMemoryRequirements memReq;
-  m_ubo = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq);
+  if(m_instancedPipeline.layout == VK_NULL_HANDLE)
+    return;
 
-  VkMemoryAllocateInfo allocateInfo = {};
-  allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocateInfo.pNext = nullptr;
-  allocateInfo.allocationSize = memReq.size;
-  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
-                                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                                          m_physicalDevice);
-  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_uboAlloc));
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_ubo, m_uboAlloc, 0));
+  m_pScheduler->Wait(m_pScheduler->LastFrame());
+  for(auto *pipeline : {&m_instancedPipeline, &m_shadowInstancedPipeline})
+  {
+    if(pipeline->pipeline != VK_NULL_HANDLE)
+      vkDestroyPipeline(m_device, pipeline->pipeline, nullptr);
+    pipeline->pipeline = VK_NULL_HANDLE;
+  }
+  vkDestroyPipelineLayout(m_device, m_instancedPipeline.layout, nullptr);
+  m_instancedPipeline.layout       = VK_NULL_HANDLE;
+  m_shadowInstancedPipeline.layout = VK_NULL_HANDLE;
+}
 
-  vkMapMemory(m_device, m_uboAlloc, 0, sizeof(m_uniforms), 0, &m_uboMappedMem);
+void SimpleShadowmapRender::CreateUniformBuffer()
+{
+  m_pUniformRing = std::make_unique<UniformRing>(m_device, m_physicalDevice, sizeof(UniformParams), m_framesInFlight);
 
   UpdateUniformBuffer(0.0f);
 }
@@ -256,42 +378,236 @@ void SimpleShadowmapRender::UpdateUniformBuffer(float a_time)
   m_uniforms.time        = a_time;
 
   m_uniforms.baseColor = LiteMath::float3(0.9f, 0.92f, 1.0f);
-  memcpy(m_uboMappedMem, &m_uniforms, sizeof(m_uniforms));
 }
 
-void SimpleShadowmapRender::DrawSceneCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp)
+void SimpleShadowmapRender::DrawSceneCmd(VkCommandBuffer a_cmdBuff, VkPipeline a_pipeline, const float4x4& a_wvp,
+                                         const float4 &a_eye, bool a_cullBackFacing, bool a_parallel,
+                                         VkRenderPass a_renderPass, VkFramebuffer a_frameBuff, uint32_t a_frame)
 {
-  VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+  // while the scene is loading only instances with resident geometry are drawn
+  if(m_pScnMgr->ResidentInstancesNum() == 0)
+    return;
+
+  const auto recordStart = std::chrono::high_resolution_clock::now();
+
+  m_clusterCuller.SetView(a_wvp, a_eye);
+  m_clusterCuller.coneCulling = a_cullBackFacing;
+
+  m_visibleInstances.clear();
+  m_pScnMgr->GetVisibleInstances(a_wvp, m_visibleInstances);
+
+  m_drawContexts.resize(a_parallel ? m_pRecorder->ThreadsNum() : 1u);
+  for(auto &ctx : m_drawContexts)
+    ctx.clusterCuller = m_clusterCuller;
+
+  if(a_parallel)
+  {
+    m_pRecorder->CmdExecute(a_cmdBuff, a_frame, a_renderPass, a_frameBuff, (uint32_t)m_visibleInstances.size(),
+      [&](VkCommandBuffer a_secondary, uint32_t a_first, uint32_t a_end, uint32_t a_thread)
+      {
+        vk_utils::setDefaultViewport(a_secondary, static_cast<float>(m_width), static_cast<float>(m_height));
+        vk_utils::setDefaultScissor(a_secondary, m_width, m_height);
+        CmdBindSceneState(a_secondary, a_pipeline, a_frame);
+        CmdDrawInstances(a_secondary, a_wvp, a_first, a_end, m_drawContexts[a_thread]);
+      });
+  }
+  else
+  {
+    CmdBindSceneState(a_cmdBuff, a_pipeline, a_frame);
+    CmdDrawInstances(a_cmdBuff, a_wvp, 0, (uint32_t)m_visibleInstances.size(), m_drawContexts[0]);
+  }
+
+  m_recordMs += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+}
+
+void SimpleShadowmapRender::CmdBindSceneState(VkCommandBuffer a_cmdBuff, VkPipeline a_pipeline, uint32_t a_frame)
+{
+  // the shadow pipeline shares the layout, its shaders just do not read the set
+  const uint32_t uboOffset = m_pUniformRing->Offset(a_frame);
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 1,
+                          &m_dSet, 1, &uboOffset);
 
   VkDeviceSize zero_offset = 0u;
   VkBuffer vertexBuf = m_pScnMgr->GetVertexBuffer();
-  VkBuffer indexBuf  = m_pScnMgr->GetIndexBuffer();
-  
   vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
-  vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, VK_INDEX_TYPE_UINT32);
+}
 
-  pushConst2M.projView = a_wvp;
-  for (uint32_t i = 0; i < m_pScnMgr->InstancesNum(); ++i)
+void SimpleShadowmapRender::CmdDrawInstances(VkCommandBuffer a_cmdBuff, const float4x4 &a_wvp, uint32_t a_first,
+                                             uint32_t a_end, DrawContext &a_ctx)
+{
+  VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+
+  // pushConst2M is shared by all recording threads, the matrices are set in a copy
+  auto pushConst = pushConst2M;
+  pushConst.projView = a_wvp;
+
+  // index buffer depends on index type of the mesh
+  VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+
+  for(uint32_t k = a_first; k < a_end; ++k)
   {
+    const uint32_t i  = m_visibleInstances[k];
     auto inst         = m_pScnMgr->GetInstanceInfo(i);
-    pushConst2M.model = m_pScnMgr->GetInstanceMatrix(i);
-    vkCmdPushConstants(a_cmdBuff, m_basicForwardPipeline.layout, stageFlags, 0, sizeof(pushConst2M), &pushConst2M);
+    auto mesh_info    = m_pScnMgr->GetMeshInfo(inst.mesh_id);
+    const float4x4 model = m_pScnMgr->GetInstanceMatrix(i);
+
+    // only meshlets inside of the view frustum (and facing the viewer if requested) are drawn,
+    // coarser LODs have no meshlets and are drawn whole
+    const LiteMath::uint2 meshlets = m_pScnMgr->GetMeshMeshlets(inst.mesh_id);
+    const uint32_t lod = m_instanceLods[i];
+    a_ctx.clusterCuller.SetInstance(model);
+    a_ctx.visibleRanges.clear();
+    if(a_ctx.clusterCuller.BoxVisible(m_pScnMgr->GetMeshBbox(inst.mesh_id)))
+    {
+      if(lod > 0)
+      {
+        const MeshLodInfo &lodInfo = m_pScnMgr->GetLods()[m_pScnMgr->GetMeshLods(inst.mesh_id).x + lod];
+        a_ctx.visibleRanges.emplace_back(lodInfo.firstIndex, lodInfo.indexCount);
+      }
+      else
+        a_ctx.clusterCuller.AppendVisibleRanges(m_pScnMgr->GetMeshlets() + meshlets.x, meshlets.y, a_ctx.visibleRanges);
+    }
+    if(a_ctx.visibleRanges.empty())
+      continue;
 
-    auto mesh_info = m_pScnMgr->GetMeshInfo(inst.mesh_id);
-    vkCmdDrawIndexed(a_cmdBuff, mesh_info.m_indNum, 1, mesh_info.m_indexOffset, mesh_info.m_vertexOffset, 0);
+    const VkIndexType indexType = m_pScnMgr->GetMeshIndexType(inst.mesh_id);
+    if(indexType != boundIndexType)
+    {
+      vkCmdBindIndexBuffer(a_cmdBuff, m_pScnMgr->GetIndexBuffer(indexType), 0, indexType);
+      boundIndexType = indexType;
+    }
+
+    pushConst.model = model * m_pScnMgr->GetMeshDequantMatrix(inst.mesh_id);
+    vkCmdPushConstants(a_cmdBuff, m_basicForwardPipeline.layout, stageFlags, 0, sizeof(pushConst), &pushConst);
+    for(const auto &range : a_ctx.visibleRanges)
+      vkCmdDrawIndexed(a_cmdBuff, range.y, 1, mesh_info.m_indexOffset + range.x, mesh_info.m_vertexOffset, 0);
   }
 }
 
-void SimpleShadowmapRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff,
-                                                     VkImageView a_targetImageView, VkPipeline a_pipeline)
+void SimpleShadowmapRender::PrintRecordTimes() const
 {
-  vkResetCommandBuffer(a_cmdBuff, 0);
+  std::cout << "parallel recording " << (m_parallelRecording ? "on" : "off") << ", last frame draws recorded in "
+            << m_recordMs << " ms" << std::endl;
+  if(!m_parallelRecording || m_pRecorder == nullptr)
+    return;
+  for(uint32_t t = 0; t < m_pRecorder->ThreadsNum(); ++t)
+    std::cout << "  thread " << t << ": " << m_pRecorder->ThreadRecordMs(t) << " ms" << std::endl;
+}
 
+void SimpleShadowmapRender::PrintGpuTimings()
+{
+  if(!m_pProfiler->Supported())
+  {
+    std::cout << "GPU timings are not supported by the graphics queue" << std::endl;
+    return;
+  }
+
+  std::cout << "GPU timings, ms: avg / p50 / p95 / p99 / max" << std::endl;
+  for(const auto &scope : m_pProfiler->GetStats())
+  {
+    if(scope.samplesNum == 0)
+      continue;
+    std::cout << std::string(2 * (scope.depth + 1), ' ') << scope.name << ": " << scope.avgMs << " / " << scope.p50Ms
+              << " / " << scope.p95Ms << " / " << scope.p99Ms << " / " << scope.maxMs << std::endl;
+  }
+  if(m_pProfiler->Dump(GPU_TIMINGS_SAVE_PATH))
+    std::cout << "GPU timings of the last frames are saved to " << GPU_TIMINGS_SAVE_PATH << std::endl;
+}
+
+void SimpleShadowmapRender::DrawSceneIndirectCmd(VkCommandBuffer a_cmdBuff, const float4x4 &a_wvp, uint32_t a_view)
+{
+  VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+
+  if(m_pScnMgr->GpuInstancesNum() == 0)
+    return;
+
+  VkDeviceSize zero_offset = 0u;
+  VkBuffer vertexBuf = m_pScnMgr->GetVertexBuffer();
+  vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
+
+  vkCmdPushConstants(a_cmdBuff, m_indirectPipeline.layout, stageFlags, 0, sizeof(a_wvp), &a_wvp);
+  m_pGpuCuller->CmdDraw(a_cmdBuff, *m_pScnMgr, a_view, m_indirectPipeline.layout, 1);
+}
+
+void SimpleShadowmapRender::DrawSceneInstancedCmd(VkCommandBuffer a_cmdBuff, const float4x4 &a_wvp)
+{
+  VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+
+  if(m_pScnMgr->ResidentInstancesNum() == 0)
+    return;
+
+  m_visibleInstances.clear();
+  m_pScnMgr->GetVisibleInstances(a_wvp, m_visibleInstances);
+  m_visibleLods.resize(m_visibleInstances.size());
+  for(size_t i = 0; i < m_visibleInstances.size(); ++i)
+    m_visibleLods[i] = m_instanceLods[m_visibleInstances[i]];
+
+  m_instancedDraws.clear();
+  m_pScnMgr->AppendInstancedDraws(m_visibleInstances.data(), m_visibleLods.data(), (uint32_t)m_visibleInstances.size(),
+                                  m_instancedDraws);
+  if(m_instancedDraws.empty())
+    return;
+
+  VkDeviceSize zero_offset = 0u;
+  VkBuffer vertexBuf   = m_pScnMgr->GetVertexBuffer();
+  VkBuffer matricesBuf = m_pScnMgr->GetInstanceMatricesBuffer();
+  vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
+  vkCmdBindVertexBuffers(a_cmdBuff, SceneManager::INSTANCE_MATRIX_BINDING, 1, &matricesBuf, &zero_offset);
+
+  vkCmdPushConstants(a_cmdBuff, m_instancedPipeline.layout, stageFlags, 0, sizeof(a_wvp), &a_wvp);
+
+  VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+  for(const auto &draw : m_instancedDraws)
+  {
+    const VkIndexType indexType = m_pScnMgr->GetMeshIndexType(draw.meshId);
+    if(indexType != boundIndexType)
+    {
+      vkCmdBindIndexBuffer(a_cmdBuff, m_pScnMgr->GetIndexBuffer(indexType), 0, indexType);
+      boundIndexType = indexType;
+    }
+    vkCmdDrawIndexed(a_cmdBuff, draw.indexCount, draw.instanceCount, draw.firstIndex,
+                     m_pScnMgr->GetMeshInfo(draw.meshId).m_vertexOffset, draw.firstInstance);
+  }
+}
+
+void SimpleShadowmapRender::SelectInstanceLods()
+{
+  const uint32_t instancesNum = m_pScnMgr->ResidentInstancesNum();
+  const float screenScale     = mesh_simplifier::ScreenScale(m_cam.fov, m_height);
+
+  m_instanceLods.resize(instancesNum);
+  for(uint32_t i = 0; i < instancesNum; ++i)
+  {
+    const LiteMath::uint2 lods = m_pScnMgr->GetMeshLods(m_pScnMgr->GetInstanceInfo(i).mesh_id);
+    m_instanceLods[i] = m_lodSelection ? mesh_simplifier::SelectLod(m_pScnMgr->GetLods() + lods.x, lods.y,
+      m_pScnMgr->GetInstanceMatrix(i), m_pScnMgr->GetInstanceBbox(i), m_cam.pos, screenScale, m_lodThreshold) : 0u;
+  }
+}
+
+void SimpleShadowmapRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff,
+                                                     VkImageView a_targetImageView, VkPipeline a_pipeline, uint32_t a_frame)
+{
+  const bool gpuDriven = m_gpuCulling && m_pGpuCuller != nullptr;
+  const bool instanced = !gpuDriven && m_hwInstancing && m_instancedPipeline.pipeline != VK_NULL_HANDLE;
+  const bool parallel  = !gpuDriven && !instanced && m_parallelRecording && m_pRecorder != nullptr;
+  const uint32_t uboOffset = m_pUniformRing->Offset(a_frame);
+  if(!gpuDriven)
+    SelectInstanceLods();
+  if(parallel)
+    m_pRecorder->BeginFrame(a_frame);
+  m_recordMs = 0.0f;
+
+  // the GPU is done with the previous frame of this slot, so its ring slice may be overwritten
+  m_pUniformRing->Write(a_frame, &m_uniforms, sizeof(m_uniforms));
+
+  // the buffer was recycled with the pool of its frame
   VkCommandBufferBeginInfo beginInfo = {};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
   VK_CHECK_RESULT(vkBeginCommandBuffer(a_cmdBuff, &beginInfo));
+  m_pProfiler->CmdBeginFrame(a_cmdBuff);
 
   VkViewport viewport{};
   VkRect2D scissor{};
@@ -312,19 +628,54 @@ void SimpleShadowmapRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff,
   vkCmdSetViewport(a_cmdBuff, 0, 1, viewports.data());
   vkCmdSetScissor(a_cmdBuff, 0, 1, scissors.data());
 
+  // moved instances are copied to GPU instance buffers even if they are not drawn from there, so the buffers stay current
+  m_pProfiler->CmdBeginScope(a_cmdBuff, "instance update");
+  m_pScnMgr->CmdUpdateInstances(a_cmdBuff);
+  m_pProfiler->CmdEndScope(a_cmdBuff);
+
+  // both views are culled before the passes, LODs are selected for the main camera in both of them
+  if(gpuDriven)
+  {
+    const float lodScale = m_lodSelection ? mesh_simplifier::ScreenScale(m_cam.fov, m_height) / m_lodThreshold : 0.0f;
+    m_pProfiler->CmdBeginScope(a_cmdBuff, "culling");
+    m_pGpuCuller->CmdCull(a_cmdBuff, *m_pScnMgr, CULL_VIEW_LIGHT,  m_lightMatrix,   m_cam.pos, lodScale);
+    m_pGpuCuller->CmdCull(a_cmdBuff, *m_pScnMgr, CULL_VIEW_CAMERA, m_worldViewProj, m_cam.pos, lodScale);
+    m_pProfiler->CmdEndScope(a_cmdBuff);
+  }
+
   //// draw scene to shadowmap
   //
+  m_pProfiler->CmdBeginScope(a_cmdBuff, "shadow pass");
+  // the shadow map is shared by frames in flight, the previous frame may still sample it
+  vkCmdPipelineBarrier(a_cmdBuff, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                       0, 0, nullptr, 0, nullptr, 0, nullptr);
+
   VkClearValue clearDepth = {};
   clearDepth.depthStencil.depth   = 1.0f;
   clearDepth.depthStencil.stencil = 0;
   std::vector<VkClearValue> clear =  {clearDepth};
   VkRenderPassBeginInfo renderToShadowMap = m_pShadowMap2->GetRenderPassBeginInfo(0, clear);
-  vkCmdBeginRenderPass(a_cmdBuff, &renderToShadowMap, VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(a_cmdBuff, &renderToShadowMap,
+                       parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+  if(gpuDriven)
+  {
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowIndirectPipeline.pipeline);
+    DrawSceneIndirectCmd(a_cmdBuff, m_lightMatrix, CULL_VIEW_LIGHT);
+  }
+  else if(instanced)
+  {
+    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowInstancedPipeline.pipeline);
+    DrawSceneInstancedCmd(a_cmdBuff, m_lightMatrix);
+  }
+  else
   {
-    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadowPipeline.pipeline);
-    DrawSceneCmd(a_cmdBuff, m_lightMatrix);
+    // back faces are kept in the shadow map, the pipeline does not cull them
+    DrawSceneCmd(a_cmdBuff, m_shadowPipeline.pipeline, m_lightMatrix, to_float4(m_light.cam.pos, 1.0f), false, parallel,
+                 renderToShadowMap.renderPass, renderToShadowMap.framebuffer, a_frame);
   }
   vkCmdEndRenderPass(a_cmdBuff);
+  m_pProfiler->CmdEndScope(a_cmdBuff);
 
   //// draw final scene to screen
   //
@@ -342,40 +693,52 @@ void SimpleShadowmapRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff,
     renderPassInfo.clearValueCount = 2;
     renderPassInfo.pClearValues    = &clearValues[0];
 
-    vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    m_pProfiler->CmdBeginScope(a_cmdBuff, "main pass");
+    vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo,
+                         parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
-    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 1, &m_dSet, 0, VK_NULL_HANDLE);
-
-    DrawSceneCmd(a_cmdBuff, m_worldViewProj);
+    if(gpuDriven)
+    {
+      vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_indirectPipeline.pipeline);
+      vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_indirectPipeline.layout, 0, 1,
+                              &m_dSet, 1, &uboOffset);
+      DrawSceneIndirectCmd(a_cmdBuff, m_worldViewProj, CULL_VIEW_CAMERA);
+    }
+    else if(instanced)
+    {
+      vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_instancedPipeline.pipeline);
+      vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_instancedPipeline.layout, 0, 1,
+                              &m_dSet, 1, &uboOffset);
+      DrawSceneInstancedCmd(a_cmdBuff, m_worldViewProj);
+    }
+    else
+    {
+      DrawSceneCmd(a_cmdBuff, a_pipeline, m_worldViewProj, to_float4(m_cam.pos, 1.0f), m_coneCulling, parallel,
+                   m_screenRenderPass, a_frameBuff, a_frame);
+    }
 
     vkCmdEndRenderPass(a_cmdBuff);
+    m_pProfiler->CmdEndScope(a_cmdBuff);
   }
 
   if(m_input.drawFSQuad)
   {
     float scaleAndOffset[4] = {0.5f, 0.5f, -0.5f, +0.5f};
+    m_pProfiler->CmdBeginScope(a_cmdBuff, "fs quad");
     m_pFSQuad->SetRenderTarget(a_targetImageView);
     m_pFSQuad->DrawCmd(a_cmdBuff, m_quadDS, scaleAndOffset);
+    m_pProfiler->CmdEndScope(a_cmdBuff);
   }
 
+  m_pProfiler->CmdEndFrame(a_cmdBuff);
   VK_CHECK_RESULT(vkEndCommandBuffer(a_cmdBuff));
 }
 
 
 void SimpleShadowmapRender::CleanupPipelineAndSwapchain()
 {
-  if (!m_cmdBuffersDrawMain.empty())
-  {
-    vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_cmdBuffersDrawMain.size()),
-                         m_cmdBuffersDrawMain.data());
-    m_cmdBuffersDrawMain.clear();
-  }
-
-  for (size_t i = 0; i < m_frameFences.size(); i++)
-  {
-    vkDestroyFence(m_device, m_frameFences[i], nullptr);
-  }
+  if(m_pScheduler != nullptr)
+    m_pScheduler->DestroySwapchainSync();
 
   vkDestroyImageView(m_device, m_depthBuffer.view, nullptr);
   vkDestroyImage(m_device, m_depthBuffer.image, nullptr);
@@ -411,26 +774,15 @@ void SimpleShadowmapRender::RecreateSwapChain()
   m_depthBuffer      = vk_utils::createDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
   m_frameBuffers     = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass, m_depthBuffer.view);
 
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
-  {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
-  }
-
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-  for (uint32_t i = 0; i < m_swapchain.GetImageCount(); ++i)
-  {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-  }
-
+  // the number of swapchain images may change
+  m_pScheduler->CreateSwapchainSync(m_swapchain.GetImageCount());
 }
 
 void SimpleShadowmapRender::Cleanup()
 {
+  // frames may still be in flight
+  vkDeviceWaitIdle(m_device);
+
   m_pShadowMap2 = nullptr;
   m_pFSQuad     = nullptr; // smartptr delete it's resources
   
@@ -442,6 +794,9 @@ void SimpleShadowmapRender::Cleanup()
 
   CleanupPipelineAndSwapchain();
 
+  DestroyGpuCulling();
+  DestroyInstancing();
+  m_pRecorder = nullptr;
   if (m_basicForwardPipeline.pipeline != VK_NULL_HANDLE)
   {
     vkDestroyPipeline(m_device, m_basicForwardPipeline.pipeline, nullptr);
@@ -451,19 +806,22 @@ void SimpleShadowmapRender::Cleanup()
     vkDestroyPipelineLayout(m_device, m_basicForwardPipeline.layout, nullptr);
   }
 
-  if (m_presentationResources.imageAvailable != VK_NULL_HANDLE)
-  {
-    vkDestroySemaphore(m_device, m_presentationResources.imageAvailable, nullptr);
-  }
-  if (m_presentationResources.renderingFinished != VK_NULL_HANDLE)
-  {
-    vkDestroySemaphore(m_device, m_presentationResources.renderingFinished, nullptr);
-  }
+  m_pUniformRing = nullptr;
+
+  for (auto pool : m_framePools)
+    vkDestroyCommandPool(m_device, pool, nullptr);
+  m_framePools.clear();
+  m_cmdBuffersDrawMain.clear();
+  m_pProfiler = nullptr;
 
   if (m_commandPool != VK_NULL_HANDLE)
   {
     vkDestroyCommandPool(m_device, m_commandPool, nullptr);
   }
+
+  // uploads of the scene manager are tracked on the transfer timeline of the scheduler
+  m_pScnMgr    = nullptr;
+  m_pScheduler = nullptr;
 }
 
 void SimpleShadowmapRender::ProcessInput(const AppInput &input)
@@ -477,6 +835,30 @@ void SimpleShadowmapRender::ProcessInput(const AppInput &input)
   if(input.keyReleased[GLFW_KEY_P])
     m_light.usePerspectiveM = !m_light.usePerspectiveM;
 
+  if(input.keyReleased[GLFW_KEY_G] && m_gpuCullingSupported)
+  {
+    m_gpuCulling = !m_gpuCulling;
+    SetupGpuCulling();
+  }
+
+  if(input.keyReleased[GLFW_KEY_I])
+  {
+    m_hwInstancing = !m_hwInstancing;
+    SetupInstancing();
+  }
+
+  if(input.keyReleased[GLFW_KEY_T])
+  {
+    PrintRecordTimes();
+    m_parallelRecording = !m_parallelRecording;
+  }
+
+  if(input.keyReleased[GLFW_KEY_M])
+    PrintGpuTimings();
+
+  if(input.keyReleased[GLFW_KEY_C])
+    m_coneCulling = !m_coneCulling;
+
   // recreate pipeline to reload shaders
   if(input.keyPressed[GLFW_KEY_B])
   {
@@ -487,12 +869,6 @@ void SimpleShadowmapRender::ProcessInput(const AppInput &input)
 #endif
 
     SetupSimplePipeline();
-
-    for (uint32_t i = 0; i < m_framesInFlight; ++i)
-    {
-      BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                               m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-    }
   }
 }
 
@@ -534,11 +910,24 @@ void SimpleShadowmapRender::UpdateView()
 
 void SimpleShadowmapRender::LoadScene(const char* path, bool transpose_inst_matrices)
 {
-  m_pScnMgr->LoadSceneXML(path, transpose_inst_matrices);
+  m_pScnMgr->SetCompactVerticesEnabled(m_compactVertices && ShaderCompiled("../resources/shaders/simple_compact.vert.spv"));
+  m_pScnMgr->SetMeshLodsEnabled(m_meshLods);
+  if(m_asyncSceneLoading)
+    m_pScnMgr->LoadSceneXMLAsync(path, transpose_inst_matrices);
+  else
+    m_pScnMgr->LoadSceneXML(path, transpose_inst_matrices);
 
   CreateUniformBuffer();
   SetupSimplePipeline();
 
+  if(m_pScnMgr->IsLoading())
+    m_sceneCameraPending = true;
+  else
+    SetCameraFromScene();
+}
+
+void SimpleShadowmapRender::SetCameraFromScene()
+{
   auto loadedCam = m_pScnMgr->GetCamera(0);
   m_cam.fov = loadedCam.fov;
   m_cam.pos = float3(loadedCam.pos);
@@ -546,46 +935,61 @@ void SimpleShadowmapRender::LoadScene(const char* path, bool transpose_inst_matr
   m_cam.lookAt = float3(loadedCam.lookAt);
   m_cam.tdist  = loadedCam.farPlane;
   UpdateView();
+}
 
-  for (uint32_t i = 0; i < m_framesInFlight; ++i)
+void SimpleShadowmapRender::UpdateSceneLoading()
+{
+  // command buffers are recorded every frame, so newly resident instances are picked up by the next one
+  m_pScnMgr->UpdateLoading();
+
+  if(m_sceneCameraPending && m_pScnMgr->GetLoadProgress().stage != SceneLoadStage::IMPORTING)
   {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
+    SetCameraFromScene();
+    m_sceneCameraPending = false;
+    m_cameraReset        = true;
   }
 }
 
-void SimpleShadowmapRender::DrawFrameSimple()
+float SimpleShadowmapRender::GetLoadProgress() const
 {
-  vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
-  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
-
-  uint32_t imageIdx;
-  m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable, &imageIdx);
-
-  auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
-
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+  const SceneLoadProgress progress = m_pScnMgr->GetLoadProgress();
+  if(progress.stage == SceneLoadStage::IMPORTING)
+    return 0.0f;
+  if(progress.stage != SceneLoadStage::UPLOADING || progress.meshesTotal == 0)
+    return 1.0f;
+  return float(progress.meshesResident) / float(progress.meshesTotal);
+}
 
-  BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
-                           m_basicForwardPipeline.pipeline);
+bool SimpleShadowmapRender::CameraWasReset()
+{
+  const bool res = m_cameraReset;
+  m_cameraReset = false;
+  return res;
+}
 
-  VkSubmitInfo submitInfo = {};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &currentCmdBuf;
+bool SimpleShadowmapRender::AcquireFrame(uint32_t &a_imageIdx)
+{
+  auto result = m_pScheduler->AcquireFrame(m_swapchain, a_imageIdx);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR)
+  {
+    RecreateSwapChain();
+    return false;
+  }
+  else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+  {
+    RUN_TIME_ERROR("Failed to acquire the next swapchain image!");
+  }
 
-  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished};
-  submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pSignalSemaphores = signalSemaphores;
+  VK_CHECK_RESULT(vkResetCommandPool(m_device, m_framePools[m_pScheduler->CurrentFrame()], 0));
+  return true;
+}
 
-  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+void SimpleShadowmapRender::SubmitFrame(uint32_t a_imageIdx, VkCommandBuffer a_cmdBuff)
+{
+  // no wait for the queue here, the next frame is recorded while this one is rendered
+  m_pScheduler->SubmitFrame(m_graphicsQueue, a_imageIdx, {a_cmdBuff});
 
-  VkResult presentRes = m_swapchain.QueuePresent(m_presentationResources.queue, imageIdx,
-                                                 m_presentationResources.renderingFinished);
+  VkResult presentRes = m_pScheduler->PresentFrame(m_swapchain, m_presentationResources.queue, a_imageIdx);
 
   if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR)
   {
@@ -595,14 +999,24 @@ void SimpleShadowmapRender::DrawFrameSimple()
   {
     RUN_TIME_ERROR("Failed to present swapchain image");
   }
+}
+
+void SimpleShadowmapRender::DrawFrameSimple()
+{
+  uint32_t imageIdx;
+  if (!AcquireFrame(imageIdx))
+    return;
 
-  m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
+  auto currentCmdBuf = m_cmdBuffersDrawMain[m_pScheduler->CurrentFrame()];
+  BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
+                           m_basicForwardPipeline.pipeline, m_pScheduler->CurrentFrame());
 
-  vkQueueWaitIdle(m_presentationResources.queue);
+  SubmitFrame(imageIdx, currentCmdBuf);
 }
 
 void SimpleShadowmapRender::DrawFrame(float a_time, DrawMode a_mode)
 {
+  UpdateSceneLoading();
   UpdateUniformBuffer(a_time);
   switch (a_mode)
   {
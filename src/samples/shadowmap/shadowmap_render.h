@@ -4,6 +4,13 @@
 #define VK_NO_PROTOTYPES
 #include "../../render/scene_mgr.h"
 #include "../../render/render_common.h"
+#include "../../render/meshlets.h"
+#include "../../render/mesh_simplifier.h"
+#include "../../render/gpu_culler.h"
+#include "../../render/parallel_recorder.h"
+#include "../../render/uniform_ring.h"
+#include "../../render/frame_scheduler.h"
+#include "../../render/gpu_profiler.h"
 #include "../../../resources/shaders/common.h"
 #include <geom/vk_mesh.h>
 #include <vk_descriptor_sets.h>
@@ -36,6 +43,9 @@ public:
   void LoadScene(const char *path, bool transpose_inst_matrices) override;
   void DrawFrame(float a_time, DrawMode a_mode) override;
 
+  float GetLoadProgress() const override;
+  bool CameraWasReset() override;
+
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
   // debugging utils
@@ -74,15 +84,19 @@ private:
 
   struct
   {
-    uint32_t    currentFrame      = 0u;
-    VkQueue     queue             = VK_NULL_HANDLE;
-    VkSemaphore imageAvailable    = VK_NULL_HANDLE;
-    VkSemaphore renderingFinished = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
   } m_presentationResources;
 
-  std::vector<VkFence> m_frameFences;
+  // up to m_framesInFlight frames are recorded by the CPU while the previous ones are rendered,
+  // frame slots, swapchain semaphores and all queue submissions are tracked on the timelines of m_pScheduler
+  std::unique_ptr<FrameScheduler> m_pScheduler;
+  std::vector<VkCommandPool>   m_framePools; // per frame in flight, reset as a whole when the slot is reused
   std::vector<VkCommandBuffer> m_cmdBuffersDrawMain;
 
+  // GPU time of the passes, read back when the frame slot is reused; printed and saved with the M key
+  std::unique_ptr<GpuProfiler> m_pProfiler;
+  const std::string GPU_TIMINGS_SAVE_PATH = "gpu_timings.csv";
+
   struct
   {
     float4x4 projView;
@@ -92,10 +106,9 @@ private:
   float4x4 m_worldViewProj;
   float4x4 m_lightMatrix;    
 
+  // copied to the ring slice of a frame when its command buffer is recorded, m_dSet selects it with a dynamic offset
   UniformParams m_uniforms {};
-  VkBuffer m_ubo = VK_NULL_HANDLE;
-  VkDeviceMemory m_uboAlloc = VK_NULL_HANDLE;
-  void* m_uboMappedMem = nullptr;
+  std::unique_ptr<UniformRing> m_pUniformRing;
 
   pipeline_data_t m_basicForwardPipeline {};
   pipeline_data_t m_shadowPipeline {};
@@ -118,6 +131,7 @@ private:
   bool m_vsync = false;
 
   VkPhysicalDeviceFeatures m_enabledDeviceFeatures = {};
+  VkPhysicalDeviceTimelineSemaphoreFeatures m_timelineFeatures = {};
   std::vector<const char*> m_deviceExtensions      = {};
   std::vector<const char*> m_instanceExtensions    = {};
 
@@ -125,6 +139,18 @@ private:
   std::vector<const char*> m_validationLayers;
 
   std::shared_ptr<SceneManager>     m_pScnMgr;
+
+  // scene is loaded in background and drawn as its meshes arrive
+  bool m_asyncSceneLoading  = true;
+  // 16 byte quantized vertices instead of Mesh8F, Mesh8F is kept if simple_compact.vert.spv is not compiled
+  bool m_compactVertices    = false;
+  // meshes get simplified LODs on import, see mesh_simplifier.h; off by default as the simplifier is the slowest
+  // import stage, when enabled LODs are built on scene cache misses only
+  bool m_meshLods           = false;
+  bool m_sceneCameraPending = false;
+  bool m_cameraReset        = false;
+  void UpdateSceneLoading();
+  void SetCameraFromScene();
   
   // objects and data for shadow map
   //
@@ -167,13 +193,80 @@ private:
  
   void DrawFrameSimple();
 
+  // waits until the current frame slot and the acquired image are not used by the GPU anymore;
+  // false if the swapchain was out of date and has been recreated
+  bool AcquireFrame(uint32_t &a_imageIdx);
+  void SubmitFrame(uint32_t a_imageIdx, VkCommandBuffer a_cmdBuff);
+
   void CreateInstance();
   void CreateDevice(uint32_t a_deviceId);
 
+  // a_frame is the frame in flight slot the command buffer belongs to
   void BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff,
-                                VkImageView a_targetImageView, VkPipeline a_pipeline);
-
-  void DrawSceneCmd(VkCommandBuffer a_cmdBuff, const float4x4& a_wvp);
+                                VkImageView a_targetImageView, VkPipeline a_pipeline, uint32_t a_frame);
+
+  // a_eye is passed to meshlets::ClusterCuller::SetView; if a_parallel, draws are recorded by m_pRecorder
+  // into secondary buffers for a_renderPass, which must be begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+  void DrawSceneCmd(VkCommandBuffer a_cmdBuff, VkPipeline a_pipeline, const float4x4& a_wvp, const float4 &a_eye,
+                    bool a_cullBackFacing, bool a_parallel, VkRenderPass a_renderPass, VkFramebuffer a_frameBuff,
+                    uint32_t a_frame);
+  meshlets::ClusterCuller m_clusterCuller;
+  // back-facing meshlets of the main pass, toggled with the C key; off by default as the pipeline does not cull
+  // back faces and open meshes would lose their back sides
+  bool m_coneCulling = false;
+  // instances inside of the frustum of the current pass, found with the instance BVH of the scene manager
+  std::vector<uint32_t> m_visibleInstances;
+
+  // draws of both passes are recorded into secondary command buffers by several threads, see parallel_recorder.h;
+  // toggled with 'T', which also prints recording times of the last frame
+  bool m_parallelRecording = true;
+  std::unique_ptr<ParallelRecorder> m_pRecorder;
+  float m_recordMs = 0.0f; // recording of instance draws of both passes
+  struct DrawContext
+  {
+    meshlets::ClusterCuller clusterCuller;
+    std::vector<LiteMath::uint2> visibleRanges;
+  };
+  std::vector<DrawContext> m_drawContexts; // one per recording thread
+  void CmdBindSceneState(VkCommandBuffer a_cmdBuff, VkPipeline a_pipeline, uint32_t a_frame);
+  // draws of m_visibleInstances[a_first, a_end), safe to call concurrently with different contexts
+  void CmdDrawInstances(VkCommandBuffer a_cmdBuff, const float4x4 &a_wvp, uint32_t a_first, uint32_t a_end,
+                        DrawContext &a_ctx);
+  void PrintRecordTimes() const;
+  // prints GPU time of the passes and saves the timings of the last frames to GPU_TIMINGS_SAVE_PATH
+  void PrintGpuTimings();
+
+  // LODs are selected once per frame for the main camera and used by both passes,
+  // so shadows are cast by the same geometry that is seen
+  void SelectInstanceLods();
+  bool  m_lodSelection = true;
+  float m_lodThreshold = 1.0f; // pixels
+  std::vector<uint32_t> m_instanceLods;
+
+  // instances are culled for both passes and their LODs selected by a compute shader, see gpu_culler.h;
+  // toggled with 'G', not supported without instance_cull.comp.spv, turned off without simple_(compact_)indirect.vert.spv
+  enum CullView : uint32_t { CULL_VIEW_LIGHT = 0, CULL_VIEW_CAMERA = 1, CULL_VIEWS_NUM = 2 };
+  bool m_gpuCulling          = false;
+  bool m_gpuCullingSupported = false;
+  bool m_drawIndirectCount   = false;
+  std::unique_ptr<GpuCuller> m_pGpuCuller;
+  pipeline_data_t m_indirectPipeline {};
+  pipeline_data_t m_shadowIndirectPipeline {}; // shares the layout with m_indirectPipeline
+  void SetupGpuCulling();
+  void DestroyGpuCulling();
+  void DrawSceneIndirectCmd(VkCommandBuffer a_cmdBuff, const float4x4 &a_wvp, uint32_t a_view);
+
+  // CPU culled instances are drawn with one instanced draw per run of instances of a mesh with the same LOD,
+  // model matrices are per instance vertex attributes, see SceneManager::AppendInstancedDraws;
+  // toggled with 'I', meshlets are not culled in this mode, turned off without simple_(compact_)instanced.vert.spv
+  bool m_hwInstancing = false;
+  pipeline_data_t m_instancedPipeline {};
+  pipeline_data_t m_shadowInstancedPipeline {}; // shares the layout with m_instancedPipeline
+  std::vector<uint32_t> m_visibleLods;
+  std::vector<InstancedDraw> m_instancedDraws;
+  void SetupInstancing();
+  void DestroyInstancing();
+  void DrawSceneInstancedCmd(VkCommandBuffer a_cmdBuff, const float4x4 &a_wvp);
 
   void SetupSimplePipeline();
   void CleanupPipelineAndSwapchain();
@@ -4,6 +4,7 @@
 #include <geom/vk_mesh.h>
 #include <vk_pipeline.h>
 #include <vk_buffers.h>
+#include <chrono>
 #include <fstream>
 
 SimpleRender::SimpleRender(uint32_t a_width, uint32_t a_height) : m_width(a_width), m_height(a_height)
@@ -18,6 +19,9 @@ SimpleRender::SimpleRender(uint32_t a_width, uint32_t a_height) : m_width(a_widt
 void SimpleRender::SetupDeviceFeatures()
 {
   // m_enabledDeviceFeatures.fillModeNonSolid = VK_TRUE;
+  m_gpuCullingSupported = GpuCuller::SetupDevice(m_physicalDevice, m_enabledDeviceFeatures, m_deviceExtensions, m_drawIndirectCount) &&
+                          GpuCuller::ShadersCompiled();
+  FrameScheduler::SetupDevice(m_physicalDevice, m_deviceExtensions, m_timelineFeatures);
 }
 
 void SimpleRender::SetupDeviceExtensions()
@@ -45,24 +49,27 @@ void SimpleRender::InitVulkan(const char** a_instanceExtensions, uint32_t a_inst
 
   CreateDevice(a_deviceId);
   volkLoadDevice(m_device);
+  m_pScheduler = std::make_unique<FrameScheduler>(m_device, m_framesInFlight);
 
   m_commandPool = vk_utils::createCommandPool(m_device, m_queueFamilyIDXs.graphics,
                                               VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-  m_cmdBuffersDrawMain.reserve(m_framesInFlight);
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
+  // primary command buffers are recorded every frame, their pools are reset instead of the buffers
+  m_framePools.resize(m_framesInFlight);
+  m_cmdBuffersDrawMain.resize(m_framesInFlight);
+  m_cmdBuffersFrameEnd.resize(m_framesInFlight);
+  for (uint32_t i = 0; i < m_framesInFlight; ++i)
   {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
+    m_framePools[i]         = vk_utils::createCommandPool(m_device, m_queueFamilyIDXs.graphics, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    m_cmdBuffersDrawMain[i] = vk_utils::createCommandBuffers(m_device, m_framePools[i], 1)[0];
+    m_cmdBuffersFrameEnd[i] = vk_utils::createCommandBuffers(m_device, m_framePools[i], 1)[0];
   }
+  m_pProfiler = std::make_unique<GpuProfiler>(m_device, m_physicalDevice, m_queueFamilyIDXs.graphics, m_framesInFlight);
+  m_pRecorder = std::make_unique<ParallelRecorder>(m_device, m_queueFamilyIDXs.graphics, m_framesInFlight);
 
   m_pScnMgr = std::make_shared<SceneManager>(m_device, m_physicalDevice, m_queueFamilyIDXs.transfer,
                                              m_queueFamilyIDXs.graphics, false);
+  m_pScnMgr->SetFrameScheduler(m_pScheduler.get());
 }
 
 void SimpleRender::InitPresentation(VkSurfaceKHR &a_surface, bool initGUI)
@@ -71,12 +78,7 @@ void SimpleRender::InitPresentation(VkSurfaceKHR &a_surface, bool initGUI)
 
   m_presentationResources.queue = m_swapchain.CreateSwapChain(m_physicalDevice, m_device, m_surface,
                                                               m_width, m_height, m_framesInFlight, m_vsync);
-  m_presentationResources.currentFrame = 0;
-
-  VkSemaphoreCreateInfo semaphoreInfo = {};
-  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.imageAvailable));
-  VK_CHECK_RESULT(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_presentationResources.renderingFinished));
+  m_pScheduler->CreateSwapchainSync(m_swapchain.GetImageCount());
 
   std::vector<VkFormat> depthFormats = {
     VK_FORMAT_D32_SFLOAT,
@@ -87,7 +89,9 @@ void SimpleRender::InitPresentation(VkSurfaceKHR &a_surface, bool initGUI)
   };
   vk_utils::getSupportedDepthFormat(m_physicalDevice, depthFormats, &m_depthBuffer.format);
   m_screenRenderPass = vk_utils::createDefaultRenderPass(m_device, m_swapchain.GetFormat(), m_depthBuffer.format);
-  m_depthBuffer  = vk_utils::createDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
+  m_loadRenderPass   = DepthPyramid::CreateLoadRenderPass(m_device, m_swapchain.GetFormat(), m_depthBuffer.format);
+  // sampled depth, occlusion culling builds the depth pyramid from it
+  m_depthBuffer  = DepthPyramid::CreateDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
   m_frameBuffers = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass, m_depthBuffer.view);
 
   if(initGUI)
@@ -119,7 +123,7 @@ void SimpleRender::CreateDevice(uint32_t a_deviceId)
   SetupDeviceFeatures();
   m_device = vk_utils::createLogicalDevice(m_physicalDevice, m_validationLayers, m_deviceExtensions,
                                            m_enabledDeviceFeatures, m_queueFamilyIDXs,
-                                           VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT);
+                                           VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT, &m_timelineFeatures);
 
   vkGetDeviceQueue(m_device, m_queueFamilyIDXs.graphics, 0, &m_graphicsQueue);
   vkGetDeviceQueue(m_device, m_queueFamilyIDXs.transfer, 0, &m_transferQueue);
@@ -129,15 +133,21 @@ void SimpleRender::CreateDevice(uint32_t a_deviceId)
 void SimpleRender::SetupSimplePipeline()
 {
   std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,             1}
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,     1}
   };
 
   if(m_pBindings == nullptr)
     m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 1);
 
-  m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
-  m_pBindings->BindBuffer(0, m_ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+  // frames in flight use the set and the pipelines that are updated below
+  if(m_basicForwardPipeline.pipeline != VK_NULL_HANDLE)
+    m_pScheduler->Wait(m_pScheduler->LastFrame());
+
+  // vertex shaders of retained command buffers read the camera from the uniform buffer
+  m_pBindings->BindBegin(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+  m_pBindings->BindBuffer(0, m_pUniformRing->Buffer(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
   m_pBindings->BindEnd(&m_dSet, &m_dSetLayout);
+  m_pUniformRing->WriteDescriptor(m_dSet, 0);
 
   // if we are recreating pipeline (for example, to reload shaders)
   // we need to cleanup old pipeline
@@ -156,7 +166,7 @@ void SimpleRender::SetupSimplePipeline()
 
   std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
   shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = FRAGMENT_SHADER_PATH + ".spv";
-  shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = VERTEX_SHADER_PATH + ".spv";
+  shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = (m_pScnMgr->CompactVerticesEnabled() ? VERTEX_SHADER_COMPACT_PATH : VERTEX_SHADER_PATH) + ".spv";
 
   maker.LoadShaders(m_device, shader_paths);
 
@@ -165,26 +175,184 @@ void SimpleRender::SetupSimplePipeline()
 
   m_basicForwardPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(),
                                                        m_screenRenderPass, {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+
+  SetupGpuCulling();
+  SetupInstancing();
+  SetupRetainedRecording();
 }
 
-void SimpleRender::CreateUniformBuffer()
+void SimpleRender::SetupGpuCulling()
+{
+  DestroyGpuCulling();
+  if(!m_gpuCulling || !m_gpuCullingSupported)
+    return;
+
+  const std::string vertexShaderPath = (m_pScnMgr->CompactVerticesEnabled() ? VERTEX_SHADER_COMPACT_INDIRECT_PATH :
+                                                                              VERTEX_SHADER_INDIRECT_PATH) + ".spv";
+  if(!ShaderCompiled(vertexShaderPath))
+  {
+    m_gpuCulling = false;
+    return;
+  }
+
+  m_pGpuCuller = std::make_unique<GpuCuller>(m_device, m_physicalDevice, m_drawIndirectCount);
+
+  vk_utils::GraphicsPipelineMaker maker;
+
+  std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
+  shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = FRAGMENT_SHADER_PATH + ".spv";
+  shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = vertexShaderPath;
+  maker.LoadShaders(m_device, shader_paths);
+
+  // model matrices come from the culler set, only projView is pushed
+  m_indirectPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout, m_pGpuCuller->GetDescriptorSetLayout()},
+                                               sizeof(pushConst2M.projView));
+  maker.SetDefaultState(m_width, m_height);
+
+  m_indirectPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(),
+                                                   m_screenRenderPass, {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+
+  SetupOcclusionCulling();
+}
+
+void SimpleRender::SetupOcclusionCulling()
+{
+  if(m_pDepthPyramid != nullptr)
+  {
+    m_pScheduler->Wait(m_pScheduler->LastFrame());
+    m_pDepthPyramid = nullptr;
+  }
+  if(!m_occlusionCulling || m_pGpuCuller == nullptr)
+    return;
+  if(!DepthPyramid::ShadersCompiled() || !GpuCuller::OcclusionShadersCompiled())
+  {
+    m_occlusionCulling = false;
+    return;
+  }
+
+  m_pDepthPyramid = std::make_unique<DepthPyramid>(m_device, m_physicalDevice);
+  m_pDepthPyramid->SetDepthBuffer(m_depthBuffer, m_width, m_height);
+}
+
+void SimpleRender::DestroyGpuCulling()
+{
+  if(m_pGpuCuller == nullptr)
+    return;
+
+  // command buffers in flight use the culler buffers and the pipeline
+  m_pScheduler->Wait(m_pScheduler->LastFrame());
+  m_pDepthPyramid = nullptr;
+  if(m_indirectPipeline.pipeline != VK_NULL_HANDLE)
+  {
+    vkDestroyPipeline(m_device, m_indirectPipeline.pipeline, nullptr);
+    m_indirectPipeline.pipeline = VK_NULL_HANDLE;
+  }
+  if(m_indirectPipeline.layout != VK_NULL_HANDLE)
+  {
+    vkDestroyPipelineLayout(m_device, m_indirectPipeline.layout, nullptr);
+    m_indirectPipeline.layout = VK_NULL_HANDLE;
+  }
+  m_pGpuCuller = nullptr;
+}
+
+void SimpleRender::SetupInstancing()
+{
+  DestroyInstancing();
+  if(!m_hwInstancing)
+    return;
+
+  const std::string vertexShaderPath = (m_pScnMgr->CompactVerticesEnabled() ? VERTEX_SHADER_COMPACT_INSTANCED_PATH :
+                                                                              VERTEX_SHADER_INSTANCED_PATH) + ".spv";
+  if(!ShaderCompiled(vertexShaderPath))
+  {
+    m_hwInstancing = false;
+    return;
+  }
+
+  vk_utils::GraphicsPipelineMaker maker;
+
+  std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
+  shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = FRAGMENT_SHADER_PATH + ".spv";
+  shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = vertexShaderPath;
+  maker.LoadShaders(m_device, shader_paths);
+
+  // model matrices are vertex attributes, only projView is pushed
+  m_instancedPipeline.layout = maker.MakeLayout(m_device, {m_dSetLayout}, sizeof(pushConst2M.projView));
+  maker.SetDefaultState(m_width, m_height);
+
+  m_instancedPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetInstancedPipelineVertexInputStateCreateInfo(),
+                                                    m_screenRenderPass, {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+}
+
+void SimpleRender::DestroyInstancing()
+{
+  if(m_instancedPipeline.pipeline == VK_NULL_HANDLE)
+    return;
+
+  m_pScheduler->Wait(m_pScheduler->LastFrame());
+  vkDestroyPipeline(m_device, m_instancedPipeline.pipeline, nullptr);
+  vkDestroyPipelineLayout(m_device, m_instancedPipeline.layout, nullptr);
+  m_instancedPipeline = {};
+}
+
+void SimpleRender::SetupRetainedRecording()
 {
-  VkMemoryRequirements memReq;
-  m_ubo = vk_utils::createBuffer(m_device, sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &memReq);
+  DestroyRetainedRecording();
+  // the set or the pipeline layout may be new, draws recorded before use the old ones
+  InvalidateRetainedScene();
+  if(!m_retainedRecording)
+    return;
+
+  const std::string vertexShaderPath = (m_pScnMgr->CompactVerticesEnabled() ? VERTEX_SHADER_COMPACT_RETAINED_PATH :
+                                                                              VERTEX_SHADER_RETAINED_PATH) + ".spv";
+  if(!ShaderCompiled(vertexShaderPath))
+  {
+    m_retainedRecording = false;
+    return;
+  }
+
+  vk_utils::GraphicsPipelineMaker maker;
+
+  std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
+  shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = FRAGMENT_SHADER_PATH + ".spv";
+  shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = vertexShaderPath;
+  maker.LoadShaders(m_device, shader_paths);
 
-  VkMemoryAllocateInfo allocateInfo = {};
-  allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocateInfo.pNext = nullptr;
-  allocateInfo.allocationSize = memReq.size;
-  allocateInfo.memoryTypeIndex = vk_utils::findMemoryType(memReq.memoryTypeBits,
-                                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                                          m_physicalDevice);
-  VK_CHECK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_uboAlloc));
+  // only the model matrix is pushed, projView part of the range is not read
+  m_retainedPipeline.layout = m_basicForwardPipeline.layout;
+  maker.SetDefaultState(m_width, m_height);
 
-  VK_CHECK_RESULT(vkBindBufferMemory(m_device, m_ubo, m_uboAlloc, 0));
+  m_retainedPipeline.pipeline = maker.MakePipeline(m_device, m_pScnMgr->GetPipelineVertexInputStateCreateInfo(),
+                                                   m_screenRenderPass, {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
 
-  vkMapMemory(m_device, m_uboAlloc, 0, sizeof(m_uniforms), 0, &m_uboMappedMem);
+  VkCommandBufferAllocateInfo allocInfo = {};
+  allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool        = m_commandPool;
+  allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+  allocInfo.commandBufferCount = 1;
+
+  m_retainedScenes.resize(m_framesInFlight);
+  for(auto &scene : m_retainedScenes)
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(m_device, &allocInfo, &scene.cmdBuf));
+}
+
+void SimpleRender::DestroyRetainedRecording()
+{
+  if(m_retainedPipeline.pipeline == VK_NULL_HANDLE)
+    return;
+
+  // primary command buffers in flight execute the retained ones
+  m_pScheduler->Wait(m_pScheduler->LastFrame());
+  vkDestroyPipeline(m_device, m_retainedPipeline.pipeline, nullptr);
+  m_retainedPipeline = {};
+  for(auto &scene : m_retainedScenes)
+    vkFreeCommandBuffers(m_device, m_commandPool, 1, &scene.cmdBuf);
+  m_retainedScenes.clear();
+}
+
+void SimpleRender::CreateUniformBuffer()
+{
+  m_pUniformRing = std::make_unique<UniformRing>(m_device, m_physicalDevice, sizeof(UniformParams), m_framesInFlight);
 
   m_uniforms.lightPos = LiteMath::float3(0.0f, 1.0f, 1.0f);
   m_uniforms.baseColor = LiteMath::float3(0.9f, 0.92f, 1.0f);
@@ -196,24 +364,68 @@ void SimpleRender::CreateUniformBuffer()
 void SimpleRender::UpdateUniformBuffer(float a_time)
 {
 // most uniforms are updated in GUI -> SetupGUIElements()
-  m_uniforms.time = a_time;
-  memcpy(m_uboMappedMem, &m_uniforms, sizeof(m_uniforms));
+  m_uniforms.time     = a_time;
+  m_uniforms.projView = pushConst2M.projView;
 }
 
 void SimpleRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebuffer a_frameBuff,
-                                            VkImageView, VkPipeline a_pipeline)
+                                            VkImageView, VkPipeline a_pipeline, uint32_t a_frame, bool a_withGUI)
 {
-  vkResetCommandBuffer(a_cmdBuff, 0);
+  // the GPU is done with the previous frame of this slot, so its ring slice may be overwritten
+  m_pUniformRing->Write(a_frame, &m_uniforms, sizeof(m_uniforms));
 
+  // the buffer was recycled with the pool of its frame
   VkCommandBufferBeginInfo beginInfo = {};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
   VK_CHECK_RESULT(vkBeginCommandBuffer(a_cmdBuff, &beginInfo));
+  m_pProfiler->CmdBeginFrame(a_cmdBuff);
 
   vk_utils::setDefaultViewport(a_cmdBuff, static_cast<float>(m_width), static_cast<float>(m_height));
   vk_utils::setDefaultScissor(a_cmdBuff, m_width, m_height);
 
+  // moved instances are copied to GPU instance buffers even if they are not drawn from there, so the buffers stay current
+  m_pProfiler->CmdBeginScope(a_cmdBuff, "instance update");
+  m_pScnMgr->CmdUpdateInstances(a_cmdBuff);
+  m_pProfiler->CmdEndScope(a_cmdBuff);
+
+  // GPU driven path: instances are culled and their draw commands are written by a compute shader before the render pass
+  const bool gpuDriven = m_gpuCulling && m_indirectPipeline.pipeline != VK_NULL_HANDLE;
+  const bool occlusion = gpuDriven && m_pDepthPyramid != nullptr;
+  const float lodScale = m_lodSelection ? mesh_simplifier::ScreenScale(m_cam.fov, m_height) / m_lodThreshold : 0.0f;
+  if(gpuDriven)
+  {
+    m_pProfiler->CmdBeginScope(a_cmdBuff, "culling");
+    m_pGpuCuller->CmdCull(a_cmdBuff, *m_pScnMgr, 0, pushConst2M.projView, m_cam.pos, lodScale,
+                          occlusion ? GpuCuller::CullPass::OCCLUSION_EARLY : GpuCuller::CullPass::FRUSTUM,
+                          m_pDepthPyramid.get());
+    m_pProfiler->CmdEndScope(a_cmdBuff);
+  }
+
+  // CPU path: instances are culled before the render pass, so that their draws can be recorded by several threads
+  m_cullStats = {};
+  const uint32_t instancesNum = m_pScnMgr->ResidentInstancesNum();
+  const bool retained  = !gpuDriven && m_retainedRecording && m_retainedPipeline.pipeline != VK_NULL_HANDLE;
+  const bool instanced = !gpuDriven && !retained && m_hwInstancing && m_instancedPipeline.pipeline != VK_NULL_HANDLE;
+  const bool parallel  = !gpuDriven && !retained && !instanced && m_parallelRecording && m_pRecorder != nullptr;
+  if(!gpuDriven && !retained)
+  {
+    m_visibleInstances.clear();
+    if(m_instanceCulling)
+    {
+      const auto cullStart = std::chrono::high_resolution_clock::now();
+      m_pScnMgr->GetVisibleInstances(pushConst2M.projView, m_visibleInstances);
+      m_cullStats.instanceCullMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - cullStart).count();
+    }
+    else
+    {
+      for(uint32_t i = 0; i < instancesNum; ++i)
+        m_visibleInstances.push_back(i);
+    }
+    m_cullStats.instancesVisible = (uint32_t)m_visibleInstances.size();
+  }
+
   ///// draw final scene to screen
   {
     VkRenderPassBeginInfo renderPassInfo = {};
@@ -229,54 +441,347 @@ void SimpleRender::BuildCommandBufferSimple(VkCommandBuffer a_cmdBuff, VkFramebu
     renderPassInfo.clearValueCount = 2;
     renderPassInfo.pClearValues = &clearValues[0];
 
-    vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
+    m_pProfiler->CmdBeginScope(a_cmdBuff, "main pass");
+    vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, (parallel || retained) ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS :
+                                                                              VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 1,
-                            &m_dSet, 0, VK_NULL_HANDLE);
+    if(retained)
+    {
+      CmdExecuteRetainedScene(a_cmdBuff, a_frame);
+      vkCmdEndRenderPass(a_cmdBuff);
+      m_pProfiler->CmdEndScope(a_cmdBuff);
+      EndCommandBufferSimple(a_cmdBuff, a_withGUI);
+      return;
+    }
 
-    VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+    if(gpuDriven)
+    {
+      CmdDrawGpuCulled(a_cmdBuff, a_frame);
+      vkCmdEndRenderPass(a_cmdBuff);
+      m_pProfiler->CmdEndScope(a_cmdBuff);
 
-    VkDeviceSize zero_offset = 0u;
-    VkBuffer vertexBuf = m_pScnMgr->GetVertexBuffer();
-    VkBuffer indexBuf = m_pScnMgr->GetIndexBuffer();
+      // instances not drawn above are tested against the depth they were drawn with and drawn over it if visible
+      if(occlusion)
+      {
+        m_pProfiler->CmdBeginScope(a_cmdBuff, "occlusion");
+        m_pDepthPyramid->CmdBuild(a_cmdBuff);
+        m_pGpuCuller->CmdCull(a_cmdBuff, *m_pScnMgr, 0, pushConst2M.projView, m_cam.pos, lodScale,
+                              GpuCuller::CullPass::OCCLUSION_LATE, m_pDepthPyramid.get());
+
+        renderPassInfo.renderPass      = m_loadRenderPass;
+        renderPassInfo.clearValueCount = 0;
+        renderPassInfo.pClearValues    = nullptr;
+        vkCmdBeginRenderPass(a_cmdBuff, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        CmdDrawGpuCulled(a_cmdBuff, a_frame);
+        vkCmdEndRenderPass(a_cmdBuff);
+        m_pProfiler->CmdEndScope(a_cmdBuff);
+      }
 
-    vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
-    vkCmdBindIndexBuffer(a_cmdBuff, indexBuf, 0, VK_INDEX_TYPE_UINT32);
+      EndCommandBufferSimple(a_cmdBuff, a_withGUI);
+      return;
+    }
 
-    for (uint32_t i = 0; i < m_pScnMgr->InstancesNum(); ++i)
+    m_clusterCuller.SetView(pushConst2M.projView, LiteMath::to_float4(m_cam.pos, 1.0f));
+    m_clusterCuller.coneCulling = m_coneCulling;
+
+    const uint32_t threadsNum = parallel ? m_pRecorder->ThreadsNum() : 1u;
+    m_drawContexts.resize(threadsNum);
+    for(auto &ctx : m_drawContexts)
     {
-      auto inst = m_pScnMgr->GetInstanceInfo(i);
+      ctx.clusterCuller = m_clusterCuller;
+      ctx.stats         = {};
+    }
 
-      pushConst2M.model = m_pScnMgr->GetInstanceMatrix(i);
-      vkCmdPushConstants(a_cmdBuff, m_basicForwardPipeline.layout, stageFlags, 0,
-                         sizeof(pushConst2M), &pushConst2M);
+    const auto recordStart = std::chrono::high_resolution_clock::now();
+    if(parallel)
+    {
+      m_pRecorder->BeginFrame(a_frame);
+      m_pRecorder->CmdExecute(a_cmdBuff, a_frame, m_screenRenderPass, a_frameBuff, (uint32_t)m_visibleInstances.size(),
+        [&](VkCommandBuffer a_secondary, uint32_t a_first, uint32_t a_end, uint32_t a_thread)
+        {
+          vk_utils::setDefaultViewport(a_secondary, static_cast<float>(m_width), static_cast<float>(m_height));
+          vk_utils::setDefaultScissor(a_secondary, m_width, m_height);
+          CmdBindForwardState(a_secondary, a_pipeline, a_frame);
+          CmdDrawInstances(a_secondary, a_first, a_end, m_drawContexts[a_thread]);
+        });
+    }
+    else if(instanced)
+    {
+      m_visibleLods.clear();
+      for(uint32_t i : m_visibleInstances)
+        m_visibleLods.push_back(SelectInstanceLod(i, m_drawContexts[0].stats));
+      CmdDrawInstanced(a_cmdBuff, a_frame);
+    }
+    else
+    {
+      CmdBindForwardState(a_cmdBuff, a_pipeline, a_frame);
+      CmdDrawInstances(a_cmdBuff, 0, (uint32_t)m_visibleInstances.size(), m_drawContexts[0]);
+    }
+    m_cullStats.recordMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
 
-      auto mesh_info = m_pScnMgr->GetMeshInfo(inst.mesh_id);
-      vkCmdDrawIndexed(a_cmdBuff, mesh_info.m_indNum, 1, mesh_info.m_indexOffset, mesh_info.m_vertexOffset, 0);
+    for(const auto &ctx : m_drawContexts)
+    {
+      m_cullStats.clustersTotal   += ctx.stats.clustersTotal;
+      m_cullStats.clustersVisible += ctx.stats.clustersVisible;
+      m_cullStats.drawCalls       += ctx.stats.drawCalls;
+      m_cullStats.trianglesFull   += ctx.stats.trianglesFull;
+      m_cullStats.trianglesLod    += ctx.stats.trianglesLod;
     }
 
     vkCmdEndRenderPass(a_cmdBuff);
+    m_pProfiler->CmdEndScope(a_cmdBuff);
   }
 
+  EndCommandBufferSimple(a_cmdBuff, a_withGUI);
+}
+
+void SimpleRender::EndCommandBufferSimple(VkCommandBuffer a_cmdBuff, bool a_withGUI)
+{
+  // GUI is recorded to its own command buffer, its scope is closed by the frame end command buffer submitted after it
+  if(a_withGUI)
+    m_pProfiler->CmdBeginScope(a_cmdBuff, "gui pass");
+  else
+    m_pProfiler->CmdEndFrame(a_cmdBuff);
   VK_CHECK_RESULT(vkEndCommandBuffer(a_cmdBuff));
 }
 
+VkCommandBuffer SimpleRender::BuildFrameEndCommands(uint32_t a_frame)
+{
+  VkCommandBuffer cmdBuff = m_cmdBuffersFrameEnd[a_frame];
 
-void SimpleRender::CleanupPipelineAndSwapchain()
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuff, &beginInfo));
+  m_pProfiler->CmdEndFrame(cmdBuff);
+  VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuff));
+  return cmdBuff;
+}
+
+void SimpleRender::CmdExecuteRetainedScene(VkCommandBuffer a_cmdBuff, uint32_t a_frame)
+{
+  const auto recordStart = std::chrono::high_resolution_clock::now();
+
+  // instances became resident or were moved since the draws were recorded
+  const uint32_t instancesNum = m_pScnMgr->ResidentInstancesNum();
+  if(instancesNum != m_retainedInstancesNum || m_pScnMgr->InstancesVersion() != m_retainedInstancesVersion)
+  {
+    m_retainedInstancesNum     = instancesNum;
+    m_retainedInstancesVersion = m_pScnMgr->InstancesVersion();
+    InvalidateRetainedScene();
+  }
+
+  // the buffer of a frame is only executed by its primary buffer, which is not pending here
+  RetainedScene &scene = m_retainedScenes[a_frame];
+  if(scene.version != m_retainedVersion)
+  {
+    VK_CHECK_RESULT(vkResetCommandBuffer(scene.cmdBuf, 0));
+
+    // framebuffer is left unknown, it differs between swapchain images
+    VkCommandBufferInheritanceInfo inheritance = {};
+    inheritance.sType      = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.renderPass = m_screenRenderPass;
+    inheritance.subpass    = 0;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritance;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(scene.cmdBuf, &beginInfo));
+
+    vk_utils::setDefaultViewport(scene.cmdBuf, static_cast<float>(m_width), static_cast<float>(m_height));
+    vk_utils::setDefaultScissor(scene.cmdBuf, m_width, m_height);
+    CmdBindForwardState(scene.cmdBuf, m_retainedPipeline.pipeline, a_frame);
+
+    const VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+    VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    m_retainedStats = {};
+    m_retainedStats.instancesVisible = instancesNum;
+    for(uint32_t i = 0; i < instancesNum; ++i)
+    {
+      auto inst      = m_pScnMgr->GetInstanceInfo(i);
+      auto mesh_info = m_pScnMgr->GetMeshInfo(inst.mesh_id);
+
+      const VkIndexType indexType = m_pScnMgr->GetMeshIndexType(inst.mesh_id);
+      if(indexType != boundIndexType)
+      {
+        vkCmdBindIndexBuffer(scene.cmdBuf, m_pScnMgr->GetIndexBuffer(indexType), 0, indexType);
+        boundIndexType = indexType;
+      }
+
+      const LiteMath::float4x4 model = m_pScnMgr->GetInstanceMatrix(i) * m_pScnMgr->GetMeshDequantMatrix(inst.mesh_id);
+      vkCmdPushConstants(scene.cmdBuf, m_retainedPipeline.layout, stageFlags, sizeof(pushConst2M.projView),
+                         sizeof(model), &model);
+      vkCmdDrawIndexed(scene.cmdBuf, mesh_info.m_indNum, 1, mesh_info.m_indexOffset, mesh_info.m_vertexOffset, 0);
+
+      m_retainedStats.drawCalls++;
+      m_retainedStats.trianglesFull += mesh_info.m_indNum / 3;
+    }
+    m_retainedStats.trianglesLod = m_retainedStats.trianglesFull;
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(scene.cmdBuf));
+    scene.version = m_retainedVersion;
+    m_retainedRecordsNum++;
+  }
+
+  vkCmdExecuteCommands(a_cmdBuff, 1, &scene.cmdBuf);
+
+  m_cullStats          = m_retainedStats;
+  m_cullStats.recordMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+}
+
+void SimpleRender::CmdBindForwardState(VkCommandBuffer a_cmdBuff, VkPipeline a_pipeline, uint32_t a_frame)
+{
+  const uint32_t uboOffset = m_pUniformRing->Offset(a_frame);
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, a_pipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_basicForwardPipeline.layout, 0, 1,
+                          &m_dSet, 1, &uboOffset);
+
+  // while the scene is loading only instances with resident geometry are drawn,
+  // geometry buffers do not exist until the first of them is ready
+  if(m_pScnMgr->ResidentInstancesNum() > 0)
+  {
+    VkDeviceSize zero_offset = 0u;
+    VkBuffer vertexBuf = m_pScnMgr->GetVertexBuffer();
+    vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
+  }
+}
+
+uint32_t SimpleRender::SelectInstanceLod(uint32_t a_instId, CullStats &a_stats) const
+{
+  const LiteMath::uint2 lodRange = m_pScnMgr->GetMeshLods(m_pScnMgr->GetInstanceInfo(a_instId).mesh_id);
+  const MeshLodInfo *lods = m_pScnMgr->GetLods() + lodRange.x;
+  const uint32_t lod = m_lodSelection ? mesh_simplifier::SelectLod(lods, lodRange.y, m_pScnMgr->GetInstanceMatrix(a_instId),
+    m_pScnMgr->GetInstanceBbox(a_instId), m_cam.pos, mesh_simplifier::ScreenScale(m_cam.fov, m_height), m_lodThreshold) : 0u;
+  a_stats.trianglesFull += lods[0].indexCount / 3;
+  a_stats.trianglesLod  += lods[lod].indexCount / 3;
+  return lod;
+}
+
+void SimpleRender::CmdDrawInstances(VkCommandBuffer a_cmdBuff, uint32_t a_first, uint32_t a_end, DrawContext &a_ctx)
+{
+  const VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+  // pushConst2M is shared by all recording threads, the model matrix is set in a copy
+  auto pushConst = pushConst2M;
+
+  // index buffer depends on index type of the mesh
+  VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+
+  for(uint32_t k = a_first; k < a_end; ++k)
+  {
+    const uint32_t i = m_visibleInstances[k];
+    auto inst = m_pScnMgr->GetInstanceInfo(i);
+    auto mesh_info = m_pScnMgr->GetMeshInfo(inst.mesh_id);
+    const LiteMath::float4x4 model = m_pScnMgr->GetInstanceMatrix(i);
+
+    const MeshLodInfo *lods = m_pScnMgr->GetLods() + m_pScnMgr->GetMeshLods(inst.mesh_id).x;
+    const uint32_t lod = SelectInstanceLod(i, a_ctx.stats);
+
+    // meshlets outside of the frustum or facing away from the camera are skipped,
+    // visible ones are drawn as ranges of the mesh index buffer;
+    // meshlets describe LOD 0 only, coarser LODs are drawn whole if the instance box is visible
+    a_ctx.visibleRanges.clear();
+    if(lod > 0)
+    {
+      a_ctx.clusterCuller.SetInstance(model);
+      if(!m_clusterCulling || a_ctx.clusterCuller.BoxVisible(m_pScnMgr->GetMeshBbox(inst.mesh_id)))
+        a_ctx.visibleRanges.emplace_back(lods[lod].firstIndex, lods[lod].indexCount);
+    }
+    else if(m_clusterCulling)
+    {
+      const LiteMath::uint2 meshlets = m_pScnMgr->GetMeshMeshlets(inst.mesh_id);
+      a_ctx.stats.clustersTotal += meshlets.y;
+
+      a_ctx.clusterCuller.SetInstance(model);
+      if(a_ctx.clusterCuller.BoxVisible(m_pScnMgr->GetMeshBbox(inst.mesh_id)))
+      {
+        a_ctx.stats.clustersVisible += a_ctx.clusterCuller.AppendVisibleRanges(m_pScnMgr->GetMeshlets() + meshlets.x,
+                                                                                meshlets.y, a_ctx.visibleRanges);
+      }
+    }
+    else
+      a_ctx.visibleRanges.emplace_back(0u, mesh_info.m_indNum);
+
+    if(a_ctx.visibleRanges.empty())
+      continue;
+
+    const VkIndexType indexType = m_pScnMgr->GetMeshIndexType(inst.mesh_id);
+    if(indexType != boundIndexType)
+    {
+      vkCmdBindIndexBuffer(a_cmdBuff, m_pScnMgr->GetIndexBuffer(indexType), 0, indexType);
+      boundIndexType = indexType;
+    }
+
+    pushConst.model = model * m_pScnMgr->GetMeshDequantMatrix(inst.mesh_id);
+    vkCmdPushConstants(a_cmdBuff, m_basicForwardPipeline.layout, stageFlags, 0, sizeof(pushConst), &pushConst);
+
+    for(const auto &range : a_ctx.visibleRanges)
+      vkCmdDrawIndexed(a_cmdBuff, range.y, 1, mesh_info.m_indexOffset + range.x, mesh_info.m_vertexOffset, 0);
+    a_ctx.stats.drawCalls += (uint32_t)a_ctx.visibleRanges.size();
+  }
+}
+
+void SimpleRender::CmdDrawInstanced(VkCommandBuffer a_cmdBuff, uint32_t a_frame)
 {
-  if (!m_cmdBuffersDrawMain.empty())
+  m_instancedDraws.clear();
+  m_pScnMgr->AppendInstancedDraws(m_visibleInstances.data(), m_visibleLods.data(), (uint32_t)m_visibleInstances.size(),
+                                  m_instancedDraws);
+  m_drawContexts[0].stats.drawCalls = (uint32_t)m_instancedDraws.size();
+  if(m_instancedDraws.empty())
+    return;
+
+  const VkShaderStageFlags stageFlags = (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+  const uint32_t uboOffset = m_pUniformRing->Offset(a_frame);
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_instancedPipeline.pipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_instancedPipeline.layout, 0, 1,
+                          &m_dSet, 1, &uboOffset);
+  vkCmdPushConstants(a_cmdBuff, m_instancedPipeline.layout, stageFlags, 0, sizeof(pushConst2M.projView),
+                     &pushConst2M.projView);
+
+  VkDeviceSize zero_offset = 0u;
+  VkBuffer vertexBuf   = m_pScnMgr->GetVertexBuffer();
+  VkBuffer matricesBuf = m_pScnMgr->GetInstanceMatricesBuffer();
+  vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
+  vkCmdBindVertexBuffers(a_cmdBuff, SceneManager::INSTANCE_MATRIX_BINDING, 1, &matricesBuf, &zero_offset);
+
+  VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+  for(const auto &draw : m_instancedDraws)
   {
-    vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_cmdBuffersDrawMain.size()),
-                         m_cmdBuffersDrawMain.data());
-    m_cmdBuffersDrawMain.clear();
+    const VkIndexType indexType = m_pScnMgr->GetMeshIndexType(draw.meshId);
+    if(indexType != boundIndexType)
+    {
+      vkCmdBindIndexBuffer(a_cmdBuff, m_pScnMgr->GetIndexBuffer(indexType), 0, indexType);
+      boundIndexType = indexType;
+    }
+    vkCmdDrawIndexed(a_cmdBuff, draw.indexCount, draw.instanceCount, draw.firstIndex,
+                     m_pScnMgr->GetMeshInfo(draw.meshId).m_vertexOffset, draw.firstInstance);
   }
+}
 
-  for (size_t i = 0; i < m_frameFences.size(); i++)
+void SimpleRender::CmdDrawGpuCulled(VkCommandBuffer a_cmdBuff, uint32_t a_frame)
+{
+  if(m_pScnMgr->ResidentInstancesNum() > 0)
   {
-    vkDestroyFence(m_device, m_frameFences[i], nullptr);
+    VkDeviceSize zero_offset = 0u;
+    VkBuffer vertexBuf = m_pScnMgr->GetVertexBuffer();
+    vkCmdBindVertexBuffers(a_cmdBuff, 0, 1, &vertexBuf, &zero_offset);
   }
-  m_frameFences.clear();
+
+  const uint32_t uboOffset = m_pUniformRing->Offset(a_frame);
+  vkCmdBindPipeline(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_indirectPipeline.pipeline);
+  vkCmdBindDescriptorSets(a_cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, m_indirectPipeline.layout, 0, 1,
+                          &m_dSet, 1, &uboOffset);
+  vkCmdPushConstants(a_cmdBuff, m_indirectPipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                     sizeof(pushConst2M.projView), &pushConst2M.projView);
+  m_pGpuCuller->CmdDraw(a_cmdBuff, *m_pScnMgr, 0, m_indirectPipeline.layout, 1);
+}
+
+
+void SimpleRender::CleanupPipelineAndSwapchain()
+{
+  if(m_pScheduler != nullptr)
+    m_pScheduler->DestroySwapchainSync();
 
   vk_utils::deleteImg(m_device, &m_depthBuffer);
   
@@ -298,6 +803,12 @@ void SimpleRender::CleanupPipelineAndSwapchain()
     m_screenRenderPass = VK_NULL_HANDLE;
   }
 
+  if(m_loadRenderPass != VK_NULL_HANDLE)
+  {
+    vkDestroyRenderPass(m_device, m_loadRenderPass, nullptr);
+    m_loadRenderPass = VK_NULL_HANDLE;
+  }
+
   m_swapchain.Cleanup();
 }
 
@@ -320,30 +831,26 @@ void SimpleRender::RecreateSwapChain()
   vk_utils::getSupportedDepthFormat(m_physicalDevice, depthFormats, &m_depthBuffer.format);
   
   m_screenRenderPass = vk_utils::createDefaultRenderPass(m_device, m_swapchain.GetFormat(), m_depthBuffer.format);
-  m_depthBuffer      = vk_utils::createDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
+  m_loadRenderPass   = DepthPyramid::CreateLoadRenderPass(m_device, m_swapchain.GetFormat(), m_depthBuffer.format);
+  m_depthBuffer      = DepthPyramid::CreateDepthTexture(m_device, m_physicalDevice, m_width, m_height, m_depthBuffer.format);
   m_frameBuffers     = vk_utils::createFrameBuffers(m_device, m_swapchain, m_screenRenderPass, m_depthBuffer.view);
+  if(m_pDepthPyramid != nullptr)
+    m_pDepthPyramid->SetDepthBuffer(m_depthBuffer, m_width, m_height);
+  // retained draws were recorded for the old render pass and screen size
+  InvalidateRetainedScene();
 
-  m_frameFences.resize(m_framesInFlight);
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (size_t i = 0; i < m_framesInFlight; i++)
-  {
-    VK_CHECK_RESULT(vkCreateFence(m_device, &fenceInfo, nullptr, &m_frameFences[i]));
-  }
-
-  m_cmdBuffersDrawMain = vk_utils::createCommandBuffers(m_device, m_commandPool, m_framesInFlight);
-  for (uint32_t i = 0; i < m_swapchain.GetImageCount(); ++i)
-  {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-  }
+  // the number of swapchain images may change
+  m_pScheduler->CreateSwapchainSync(m_swapchain.GetImageCount());
 
   m_pGUIRender->OnSwapchainChanged(m_swapchain);
 }
 
 void SimpleRender::Cleanup()
 {
+  // frames may still be in flight
+  if(m_device != VK_NULL_HANDLE)
+    vkDeviceWaitIdle(m_device);
+
   if(m_pGUIRender)
   {
     m_pGUIRender = nullptr;
@@ -356,6 +863,10 @@ void SimpleRender::Cleanup()
     m_surface = VK_NULL_HANDLE;
   }
 
+  DestroyGpuCulling();
+  DestroyInstancing();
+  DestroyRetainedRecording();
+  m_pRecorder = nullptr;
   if (m_basicForwardPipeline.pipeline != VK_NULL_HANDLE)
   {
     vkDestroyPipeline(m_device, m_basicForwardPipeline.pipeline, nullptr);
@@ -367,16 +878,12 @@ void SimpleRender::Cleanup()
     m_basicForwardPipeline.layout = VK_NULL_HANDLE;
   }
 
-  if (m_presentationResources.imageAvailable != VK_NULL_HANDLE)
-  {
-    vkDestroySemaphore(m_device, m_presentationResources.imageAvailable, nullptr);
-    m_presentationResources.imageAvailable = VK_NULL_HANDLE;
-  }
-  if (m_presentationResources.renderingFinished != VK_NULL_HANDLE)
-  {
-    vkDestroySemaphore(m_device, m_presentationResources.renderingFinished, nullptr);
-    m_presentationResources.renderingFinished = VK_NULL_HANDLE;
-  }
+  for (auto pool : m_framePools)
+    vkDestroyCommandPool(m_device, pool, nullptr);
+  m_framePools.clear();
+  m_cmdBuffersDrawMain.clear();
+  m_cmdBuffersFrameEnd.clear();
+  m_pProfiler = nullptr;
 
   if (m_commandPool != VK_NULL_HANDLE)
   {
@@ -384,20 +891,12 @@ void SimpleRender::Cleanup()
     m_commandPool = VK_NULL_HANDLE;
   }
 
-  if(m_ubo != VK_NULL_HANDLE)
-  {
-    vkDestroyBuffer(m_device, m_ubo, nullptr);
-    m_ubo = VK_NULL_HANDLE;
-  }
-
-  if(m_uboAlloc != VK_NULL_HANDLE)
-  {
-    vkFreeMemory(m_device, m_uboAlloc, nullptr);
-    m_uboAlloc = VK_NULL_HANDLE;
-  }
+  m_pUniformRing = nullptr;
 
   m_pBindings = nullptr;
   m_pScnMgr   = nullptr;
+  // after the scene manager, whose uploads are tracked on its transfer timeline
+  m_pScheduler = nullptr;
 
   if(m_device != VK_NULL_HANDLE)
   {
@@ -433,12 +932,6 @@ void SimpleRender::ProcessInput(const AppInput &input)
 #endif
 
     SetupSimplePipeline();
-
-    for (uint32_t i = 0; i < m_framesInFlight; ++i)
-    {
-      BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                               m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-    }
   }
 
 }
@@ -475,11 +968,24 @@ void SimpleRender::UpdateView()
 
 void SimpleRender::LoadScene(const char* path, bool transpose_inst_matrices)
 {
-  m_pScnMgr->LoadSceneXML(path, transpose_inst_matrices);
+  m_pScnMgr->SetCompactVerticesEnabled(m_compactVertices && ShaderCompiled(VERTEX_SHADER_COMPACT_PATH + ".spv"));
+  m_pScnMgr->SetMeshLodsEnabled(m_meshLods);
+  if(m_asyncSceneLoading)
+    m_pScnMgr->LoadSceneXMLAsync(path, transpose_inst_matrices);
+  else
+    m_pScnMgr->LoadSceneXML(path, transpose_inst_matrices);
 
   CreateUniformBuffer();
   SetupSimplePipeline();
 
+  if(m_pScnMgr->IsLoading())
+    m_sceneCameraPending = true;
+  else
+    SetCameraFromScene();
+}
+
+void SimpleRender::SetCameraFromScene()
+{
   auto loadedCam = m_pScnMgr->GetCamera(0);
   m_cam.fov = loadedCam.fov;
   m_cam.pos = float3(loadedCam.pos);
@@ -488,46 +994,62 @@ void SimpleRender::LoadScene(const char* path, bool transpose_inst_matrices)
   m_cam.tdist  = loadedCam.farPlane;
 
   UpdateView();
+}
 
-  for (uint32_t i = 0; i < m_framesInFlight; ++i)
+void SimpleRender::UpdateSceneLoading()
+{
+  // command buffers are recorded every frame, so newly resident instances are picked up by the next one
+  m_pScnMgr->UpdateLoading();
+
+  // scene cameras are known as soon as the scene is imported, before its geometry is resident
+  if(m_sceneCameraPending && m_pScnMgr->GetLoadProgress().stage != SceneLoadStage::IMPORTING)
   {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-                             m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
+    SetCameraFromScene();
+    m_sceneCameraPending = false;
+    m_cameraReset        = true;
   }
 }
 
-void SimpleRender::DrawFrameSimple()
+float SimpleRender::GetLoadProgress() const
 {
-  vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
-  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
-
-  uint32_t imageIdx;
-  m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable, &imageIdx);
-
-  auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
-
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+  const SceneLoadProgress progress = m_pScnMgr->GetLoadProgress();
+  if(progress.stage == SceneLoadStage::IMPORTING)
+    return 0.0f;
+  if(progress.stage != SceneLoadStage::UPLOADING || progress.meshesTotal == 0)
+    return 1.0f;
+  return float(progress.meshesResident) / float(progress.meshesTotal);
+}
 
-  BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
-                           m_basicForwardPipeline.pipeline);
+bool SimpleRender::CameraWasReset()
+{
+  const bool res = m_cameraReset;
+  m_cameraReset = false;
+  return res;
+}
 
-  VkSubmitInfo submitInfo = {};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &currentCmdBuf;
+bool SimpleRender::AcquireFrame(uint32_t &a_imageIdx)
+{
+  auto result = m_pScheduler->AcquireFrame(m_swapchain, a_imageIdx);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR)
+  {
+    RecreateSwapChain();
+    return false;
+  }
+  else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+  {
+    RUN_TIME_ERROR("Failed to acquire the next swapchain image!");
+  }
 
-  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished};
-  submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pSignalSemaphores = signalSemaphores;
+  VK_CHECK_RESULT(vkResetCommandPool(m_device, m_framePools[m_pScheduler->CurrentFrame()], 0));
+  return true;
+}
 
-  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
+void SimpleRender::SubmitFrame(uint32_t a_imageIdx, const std::vector<VkCommandBuffer> &a_cmdBufs)
+{
+  // no wait for the queue here, the next frame is recorded while this one is rendered
+  m_pScheduler->SubmitFrame(m_graphicsQueue, a_imageIdx, a_cmdBufs);
 
-  VkResult presentRes = m_swapchain.QueuePresent(m_presentationResources.queue, imageIdx,
-                                                 m_presentationResources.renderingFinished);
+  VkResult presentRes = m_pScheduler->PresentFrame(m_swapchain, m_presentationResources.queue, a_imageIdx);
 
   if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR)
   {
@@ -537,14 +1059,24 @@ void SimpleRender::DrawFrameSimple()
   {
     RUN_TIME_ERROR("Failed to present swapchain image");
   }
+}
+
+void SimpleRender::DrawFrameSimple()
+{
+  uint32_t imageIdx;
+  if (!AcquireFrame(imageIdx))
+    return;
 
-  m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
+  auto currentCmdBuf = m_cmdBuffersDrawMain[m_pScheduler->CurrentFrame()];
+  BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
+                           m_basicForwardPipeline.pipeline, m_pScheduler->CurrentFrame());
 
-  vkQueueWaitIdle(m_presentationResources.queue);
+  SubmitFrame(imageIdx, {currentCmdBuf});
 }
 
 void SimpleRender::DrawFrame(float a_time, DrawMode a_mode)
 {
+  UpdateSceneLoading();
   UpdateUniformBuffer(a_time);
   switch (a_mode)
   {
@@ -577,6 +1109,103 @@ void SimpleRender::SetupGUIElements()
     ImGui::SliderFloat3("Light source position", m_uniforms.lightPos.M, -10.f, 10.f);
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    SetupGpuTimingsGUI();
+
+    const SceneLoadProgress loadProgress = m_pScnMgr->GetLoadProgress();
+    if(loadProgress.stage == SceneLoadStage::IMPORTING)
+      ImGui::Text("Loading scene: reading files");
+    else if(loadProgress.stage == SceneLoadStage::FAILED)
+      ImGui::TextWrapped("Loading scene failed: %s", m_pScnMgr->GetLoadError().c_str());
+    else if(loadProgress.stage == SceneLoadStage::UPLOADING)
+    {
+      ImGui::ProgressBar(GetLoadProgress());
+      ImGui::Text("Meshes: %u of %u resident, %u packed", loadProgress.meshesResident, loadProgress.meshesTotal,
+                  loadProgress.meshesImported);
+      ImGui::Text("Instances: %u of %u resident", loadProgress.instancesResident, loadProgress.instancesTotal);
+    }
+    if(loadProgress.duplicateMeshes > 0)
+    {
+      ImGui::Text("Duplicate meshes: %u, saved %.1f MB", loadProgress.duplicateMeshes,
+                  double(loadProgress.savedVertexBytes + loadProgress.savedIndexBytes) / (1024.0 * 1024.0));
+    }
+
+    if(m_gpuCullingSupported)
+    {
+      const bool gpuCulling = m_gpuCulling;
+      ImGui::Checkbox("GPU culling and indirect draws", &m_gpuCulling);
+      if(m_gpuCulling != gpuCulling)
+        SetupGpuCulling();
+      if(m_gpuCulling)
+      {
+        ImGui::Text("Instances: %u culled on the GPU, draw count on the GPU: %s", m_pScnMgr->GpuInstancesNum(),
+                    m_drawIndirectCount ? "yes" : "no");
+        const bool occlusionCulling = m_occlusionCulling;
+        ImGui::Checkbox("Occlusion culling (depth pyramid)", &m_occlusionCulling);
+        if(m_occlusionCulling != occlusionCulling)
+          SetupOcclusionCulling();
+        if(m_occlusionCulling && m_pGpuCuller != nullptr)
+          ImGui::Text("Instances occluded: %u", m_pGpuCuller->GetOccludedNum(0));
+      }
+    }
+    if(!m_gpuCulling)
+    {
+      const bool retainedRecording = m_retainedRecording;
+      ImGui::Checkbox("Retained scene recording", &m_retainedRecording);
+      if(m_retainedRecording != retainedRecording)
+        SetupRetainedRecording();
+      if(m_retainedRecording)
+      {
+        ImGui::Text("Draw calls: %u, recorded %u times", m_cullStats.drawCalls, m_retainedRecordsNum);
+        ImGui::Text("Draw recording: %.3f ms", m_cullStats.recordMs);
+      }
+      else
+      {
+        ImGui::Checkbox("Instance frustum culling", &m_instanceCulling);
+        if(m_instanceCulling)
+        {
+          int culling = int(m_pScnMgr->GetInstanceCulling());
+          ImGui::RadioButton("BVH", &culling, int(InstanceCulling::BVH)); ImGui::SameLine();
+          ImGui::RadioButton("SIMD brute force", &culling, int(InstanceCulling::BRUTE_FORCE));
+          m_pScnMgr->SetInstanceCulling(InstanceCulling(culling));
+          ImGui::Text("Instance culling: %.3f ms", m_cullStats.instanceCullMs);
+        }
+        ImGui::Text("Instances: %u of %u drawn", m_cullStats.instancesVisible, m_pScnMgr->ResidentInstancesNum());
+        const bool hwInstancing = m_hwInstancing;
+        ImGui::Checkbox("Hardware instancing", &m_hwInstancing);
+        if(m_hwInstancing != hwInstancing)
+          SetupInstancing();
+        if(m_hwInstancing)
+          ImGui::Text("Instanced draw calls: %u", m_cullStats.drawCalls);
+        else
+        {
+          ImGui::Checkbox("Meshlet culling", &m_clusterCulling);
+          ImGui::Checkbox("Back-facing meshlet culling", &m_coneCulling);
+          ImGui::Checkbox("Parallel command recording", &m_parallelRecording);
+          ImGui::Text("Draw recording: %.3f ms", m_cullStats.recordMs);
+          if(m_parallelRecording && m_pRecorder != nullptr)
+          {
+            for(uint32_t t = 0; t < m_pRecorder->ThreadsNum(); ++t)
+              ImGui::Text("  thread %u: %.3f ms", t, m_pRecorder->ThreadRecordMs(t));
+          }
+        }
+        if(m_clusterCulling && !m_hwInstancing)
+        {
+          ImGui::Text("Meshlets: %u of %u drawn, %u draw calls", m_cullStats.clustersVisible, m_cullStats.clustersTotal,
+                      m_cullStats.drawCalls);
+        }
+      }
+    }
+    ImGui::Checkbox("Level of detail", &m_lodSelection);
+    if(m_lodSelection && !m_meshLods)
+      ImGui::Text("Meshes have no LODs, they are built on import if enabled before the scene is loaded");
+    else if(m_lodSelection)
+    {
+      ImGui::SliderFloat("LOD error threshold, pixels", &m_lodThreshold, 0.1f, 16.0f, "%.1f");
+      const float saved = m_cullStats.trianglesFull > 0 ?
+        100.0f * float(m_cullStats.trianglesFull - m_cullStats.trianglesLod) / float(m_cullStats.trianglesFull) : 0.0f;
+      if(!m_gpuCulling)
+        ImGui::Text("Triangles: %u of %u, %.1f%% saved", m_cullStats.trianglesLod, m_cullStats.trianglesFull, saved);
+    }
 
     ImGui::NewLine();
 
@@ -626,63 +1255,56 @@ void SimpleRender::SetupGUIElements()
   ImGui::Render();
 }
 
-void SimpleRender::DrawFrameWithGUI()
+void SimpleRender::SetupGpuTimingsGUI()
 {
-  vkWaitForFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame], VK_TRUE, UINT64_MAX);
-  vkResetFences(m_device, 1, &m_frameFences[m_presentationResources.currentFrame]);
+  if(!m_pProfiler->Supported() || !ImGui::CollapsingHeader("GPU timings"))
+    return;
 
-  uint32_t imageIdx;
-  auto result = m_swapchain.AcquireNextImage(m_presentationResources.imageAvailable, &imageIdx);
-  if (result == VK_ERROR_OUT_OF_DATE_KHR)
+  const auto &stats = m_pProfiler->GetStats();
+  if(ImGui::BeginTable("gpu timings", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
   {
-    RecreateSwapChain();
-    return;
+    const char *columns[] = {"scope, ms", "avg", "p50", "p95", "p99", "max"};
+    for(const char *column : columns)
+      ImGui::TableSetupColumn(column);
+    ImGui::TableHeadersRow();
+
+    for(const auto &scope : stats)
+    {
+      if(scope.samplesNum == 0)
+        continue;
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::Text("%*s%s", int(2 * scope.depth), "", scope.name.c_str());
+      for(float ms : {scope.avgMs, scope.p50Ms, scope.p95Ms, scope.p99Ms, scope.maxMs})
+      {
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", ms);
+      }
+    }
+    ImGui::EndTable();
   }
-  else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+
+  if(ImGui::Button("Dump GPU timings"))
   {
-    RUN_TIME_ERROR("Failed to acquire the next swapchain image!");
+    m_pProfiler->Dump(GPU_TIMINGS_SAVE_PATH + ".csv");
+    m_pProfiler->Dump(GPU_TIMINGS_SAVE_PATH + ".json");
   }
+  ImGui::SameLine();
+  ImGui::Text("to %s.csv and .json", GPU_TIMINGS_SAVE_PATH.c_str());
+}
 
-  auto currentCmdBuf = m_cmdBuffersDrawMain[m_presentationResources.currentFrame];
-
-  VkSemaphore waitSemaphores[] = {m_presentationResources.imageAvailable};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+void SimpleRender::DrawFrameWithGUI()
+{
+  uint32_t imageIdx;
+  if (!AcquireFrame(imageIdx))
+    return;
 
+  auto currentCmdBuf = m_cmdBuffersDrawMain[m_pScheduler->CurrentFrame()];
   BuildCommandBufferSimple(currentCmdBuf, m_frameBuffers[imageIdx], m_swapchain.GetAttachment(imageIdx).view,
-    m_basicForwardPipeline.pipeline);
+    m_basicForwardPipeline.pipeline, m_pScheduler->CurrentFrame(), true);
 
   ImDrawData* pDrawData = ImGui::GetDrawData();
   auto currentGUICmdBuf = m_pGUIRender->BuildGUIRenderCommand(imageIdx, pDrawData);
 
-  std::vector<VkCommandBuffer> submitCmdBufs = { currentCmdBuf, currentGUICmdBuf};
-
-  VkSubmitInfo submitInfo = {};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
-  submitInfo.commandBufferCount = (uint32_t)submitCmdBufs.size();
-  submitInfo.pCommandBuffers = submitCmdBufs.data();
-
-  VkSemaphore signalSemaphores[] = {m_presentationResources.renderingFinished};
-  submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pSignalSemaphores = signalSemaphores;
-
-  VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_frameFences[m_presentationResources.currentFrame]));
-
-  VkResult presentRes = m_swapchain.QueuePresent(m_presentationResources.queue, imageIdx,
-    m_presentationResources.renderingFinished);
-
-  if (presentRes == VK_ERROR_OUT_OF_DATE_KHR || presentRes == VK_SUBOPTIMAL_KHR)
-  {
-    RecreateSwapChain();
-  }
-  else if (presentRes != VK_SUCCESS)
-  {
-    RUN_TIME_ERROR("Failed to present swapchain image");
-  }
-
-  m_presentationResources.currentFrame = (m_presentationResources.currentFrame + 1) % m_framesInFlight;
-
-  vkQueueWaitIdle(m_presentationResources.queue);
+  SubmitFrame(imageIdx, {currentCmdBuf, currentGUICmdBuf, BuildFrameEndCommands(m_pScheduler->CurrentFrame())});
 }
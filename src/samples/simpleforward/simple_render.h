@@ -6,6 +6,14 @@
 #include "../../render/scene_mgr.h"
 #include "../../render/render_common.h"
 #include "../../render/render_gui.h"
+#include "../../render/meshlets.h"
+#include "../../render/mesh_simplifier.h"
+#include "../../render/gpu_culler.h"
+#include "../../render/depth_pyramid.h"
+#include "../../render/parallel_recorder.h"
+#include "../../render/uniform_ring.h"
+#include "../../render/frame_scheduler.h"
+#include "../../render/gpu_profiler.h"
 #include "../../../resources/shaders/common.h"
 #include <geom/vk_mesh.h>
 #include <vk_descriptor_sets.h>
@@ -19,9 +27,17 @@ class SimpleRender : public IRender
 {
 public:
   const std::string VERTEX_SHADER_PATH = "../resources/shaders/simple.vert";
+  const std::string VERTEX_SHADER_COMPACT_PATH = "../resources/shaders/simple_compact.vert";
+  const std::string VERTEX_SHADER_INDIRECT_PATH = "../resources/shaders/simple_indirect.vert";
+  const std::string VERTEX_SHADER_COMPACT_INDIRECT_PATH = "../resources/shaders/simple_compact_indirect.vert";
+  const std::string VERTEX_SHADER_INSTANCED_PATH = "../resources/shaders/simple_instanced.vert";
+  const std::string VERTEX_SHADER_COMPACT_INSTANCED_PATH = "../resources/shaders/simple_compact_instanced.vert";
+  const std::string VERTEX_SHADER_RETAINED_PATH = "../resources/shaders/simple_retained.vert";
+  const std::string VERTEX_SHADER_COMPACT_RETAINED_PATH = "../resources/shaders/simple_compact_retained.vert";
   const std::string FRAGMENT_SHADER_PATH = "../resources/shaders/simple.frag";
 
   const std::string TRAJECTORY_SAVE_PATH = "trajectory.txt";
+  const std::string GPU_TIMINGS_SAVE_PATH = "gpu_timings";
 
   SimpleRender(uint32_t a_width, uint32_t a_height);
   ~SimpleRender()  { Cleanup(); };
@@ -41,6 +57,9 @@ public:
   void LoadScene(const char *path, bool transpose_inst_matrices) override;
   void DrawFrame(float a_time, DrawMode a_mode) override;
 
+  float GetLoadProgress() const override;
+  bool CameraWasReset() override;
+
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
   // debugging utils
@@ -79,14 +98,18 @@ protected:
 
   struct
   {
-    uint32_t    currentFrame      = 0u;
-    VkQueue     queue             = VK_NULL_HANDLE;
-    VkSemaphore imageAvailable    = VK_NULL_HANDLE;
-    VkSemaphore renderingFinished = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
   } m_presentationResources;
 
-  std::vector<VkFence> m_frameFences;
+  // up to m_framesInFlight frames are recorded by the CPU while the previous ones are rendered,
+  // frame slots, swapchain semaphores and all queue submissions are tracked on the timelines of m_pScheduler
+  std::unique_ptr<FrameScheduler> m_pScheduler;
+  std::vector<VkCommandPool>   m_framePools; // per frame in flight, reset as a whole when the slot is reused
   std::vector<VkCommandBuffer> m_cmdBuffersDrawMain;
+  std::vector<VkCommandBuffer> m_cmdBuffersFrameEnd; // ends the frame for the GPU profiler after the GUI
+
+  // GPU time of the passes, read back when the frame slot is reused
+  std::unique_ptr<GpuProfiler> m_pProfiler;
 
   struct
   {
@@ -94,16 +117,17 @@ protected:
     LiteMath::float4x4 model;
   } pushConst2M;
 
+  // uniforms are copied to the ring slice of a frame when its command buffer is recorded,
+  // m_dSet binds the ring buffer, the slice is selected with the dynamic offset of the frame
   UniformParams m_uniforms {};
-  VkBuffer m_ubo = VK_NULL_HANDLE;
-  VkDeviceMemory m_uboAlloc = VK_NULL_HANDLE;
-  void* m_uboMappedMem = nullptr;
+  std::unique_ptr<UniformRing> m_pUniformRing;
 
   pipeline_data_t m_basicForwardPipeline {};
 
   VkDescriptorSet m_dSet = VK_NULL_HANDLE;
   VkDescriptorSetLayout m_dSetLayout = VK_NULL_HANDLE;
   VkRenderPass m_screenRenderPass = VK_NULL_HANDLE; // main renderpass
+  VkRenderPass m_loadRenderPass   = VK_NULL_HANDLE; // continues drawing of the main one, see DepthPyramid::CreateLoadRenderPass
 
   std::shared_ptr<vk_utils::DescriptorMaker> m_pBindings = nullptr;
 
@@ -117,6 +141,7 @@ protected:
   // *** GUI
   std::shared_ptr<IRenderGUI> m_pGUIRender;
   virtual void SetupGUIElements();
+  void SetupGpuTimingsGUI();
   void DrawFrameWithGUI();
 
   bool m_trackCameraTrajectory = false;
@@ -133,6 +158,7 @@ protected:
   bool m_vsync = false;
 
   VkPhysicalDeviceFeatures m_enabledDeviceFeatures = {};
+  VkPhysicalDeviceTimelineSemaphoreFeatures m_timelineFeatures = {};
   std::vector<const char*> m_deviceExtensions      = {};
   std::vector<const char*> m_instanceExtensions    = {};
 
@@ -141,13 +167,123 @@ protected:
 
   std::shared_ptr<SceneManager> m_pScnMgr;
 
+  // scene is loaded in background and drawn as its meshes arrive
+  bool m_asyncSceneLoading  = true;
+  // 16 byte quantized vertices instead of Mesh8F, Mesh8F is kept if simple_compact.vert.spv is not compiled
+  bool m_compactVertices    = false;
+  // meshes get simplified LODs on import, see mesh_simplifier.h; off by default as the simplifier is the slowest
+  // import stage, when enabled LODs are built on scene cache misses only
+  bool m_meshLods           = false;
+  bool m_sceneCameraPending = false;
+  bool m_cameraReset        = false;
+  void UpdateSceneLoading();
+  void SetCameraFromScene();
+
   void DrawFrameSimple();
 
+  // waits until the current frame slot and the acquired image are not used by the GPU anymore and recycles
+  // command buffers of the slot; false if the swapchain was out of date and has been recreated
+  bool AcquireFrame(uint32_t &a_imageIdx);
+  void SubmitFrame(uint32_t a_imageIdx, const std::vector<VkCommandBuffer> &a_cmdBufs);
+
   void CreateInstance();
   void CreateDevice(uint32_t a_deviceId);
 
+  // a_frame is the frame in flight slot the command buffer belongs to,
+  // with a_withGUI the profiler frame is left open for the GUI and ended by BuildFrameEndCommands
   void BuildCommandBufferSimple(VkCommandBuffer cmdBuff, VkFramebuffer frameBuff,
-                                VkImageView a_targetImageView, VkPipeline a_pipeline);
+                                VkImageView a_targetImageView, VkPipeline a_pipeline, uint32_t a_frame, bool a_withGUI = false);
+  void EndCommandBufferSimple(VkCommandBuffer a_cmdBuff, bool a_withGUI);
+  VkCommandBuffer BuildFrameEndCommands(uint32_t a_frame);
+
+  // instances outside of the view frustum are rejected by the scene manager (instance BVH or SIMD brute force),
+  // meshlets of the remaining ones are culled on the CPU while command buffer is recorded
+  bool m_instanceCulling = true;
+  std::vector<uint32_t> m_visibleInstances;
+  bool m_clusterCulling = true;
+  bool m_coneCulling    = false; // pipeline does not cull back faces, so open meshes would lose their back sides
+  meshlets::ClusterCuller m_clusterCuller;
+  // LOD of every instance is the coarsest one whose error is not larger than m_lodThreshold pixels
+  bool  m_lodSelection = true;
+  float m_lodThreshold = 1.0f;
+  struct CullStats
+  {
+    uint32_t instancesVisible = 0u;
+    float    instanceCullMs   = 0.0f;
+    float    recordMs         = 0.0f; // recording of instance draws
+    uint32_t clustersTotal   = 0u;
+    uint32_t clustersVisible = 0u;
+    uint32_t drawCalls       = 0u;
+    uint32_t trianglesFull   = 0u; // triangles of LOD 0 of all instances
+    uint32_t trianglesLod    = 0u; // triangles of their selected LODs
+  } m_cullStats;
+
+  // draws of CPU culled instances are recorded into secondary command buffers by several threads, see parallel_recorder.h;
+  // every recording thread has its own culler copy, scratch ranges and statistics, summed into m_cullStats after recording
+  bool m_parallelRecording = true;
+  std::unique_ptr<ParallelRecorder> m_pRecorder;
+  struct DrawContext
+  {
+    meshlets::ClusterCuller clusterCuller;
+    std::vector<LiteMath::uint2> visibleRanges;
+    CullStats stats;
+  };
+  std::vector<DrawContext> m_drawContexts;
+  void CmdBindForwardState(VkCommandBuffer a_cmdBuff, VkPipeline a_pipeline, uint32_t a_frame);
+  uint32_t SelectInstanceLod(uint32_t a_instId, CullStats &a_stats) const;
+  // draws of m_visibleInstances[a_first, a_end), safe to call concurrently with different contexts
+  void CmdDrawInstances(VkCommandBuffer a_cmdBuff, uint32_t a_first, uint32_t a_end, DrawContext &a_ctx);
+  void CmdDrawInstanced(VkCommandBuffer a_cmdBuff, uint32_t a_frame);
+
+  // instances are culled, their LODs selected and draw commands written by a compute shader, see gpu_culler.h;
+  // not supported without instance_cull.comp.spv, turned off without simple_(compact_)indirect.vert.spv
+  bool m_gpuCulling          = false;
+  bool m_gpuCullingSupported = false;
+  bool m_drawIndirectCount   = false;
+  std::unique_ptr<GpuCuller> m_pGpuCuller;
+  pipeline_data_t m_indirectPipeline {};
+  void SetupGpuCulling();
+  void DestroyGpuCulling();
+  void CmdDrawGpuCulled(VkCommandBuffer a_cmdBuff, uint32_t a_frame);
+
+  // two pass occlusion culling on top of GPU culling: instances visible in the last frame are drawn first,
+  // the others are tested against the depth pyramid of that pass and the newly visible ones are drawn in m_loadRenderPass;
+  // turned off without depth_pyramid.comp.spv or instance_cull_occlusion.comp.spv
+  bool m_occlusionCulling = false;
+  std::unique_ptr<DepthPyramid> m_pDepthPyramid;
+  void SetupOcclusionCulling();
+
+  // CPU culled instances are drawn with one instanced draw per run of instances of a mesh with the same LOD,
+  // model matrices are per instance vertex attributes from the scene instance buffer, see SceneManager::AppendInstancedDraws;
+  // meshlets are not culled in this mode; turned off without simple_(compact_)instanced.vert.spv
+  bool m_hwInstancing = false;
+  pipeline_data_t m_instancedPipeline {};
+  std::vector<uint32_t> m_visibleLods;
+  std::vector<InstancedDraw> m_instancedDraws;
+  void SetupInstancing();
+  void DestroyInstancing();
+
+  // draws of all resident instances are recorded once into a secondary command buffer per frame in flight and
+  // executed every frame; they are recorded again only when the scene, the pipelines or the swapchain change,
+  // the camera is read from the uniform buffer, so per frame recording does not depend on the number of instances;
+  // instances are not culled and drawn with LOD 0 in this mode; turned off without simple_(compact_)retained.vert.spv
+  bool m_retainedRecording = false;
+  pipeline_data_t m_retainedPipeline {}; // shares the layout with m_basicForwardPipeline
+  struct RetainedScene
+  {
+    VkCommandBuffer cmdBuf = VK_NULL_HANDLE;
+    uint32_t version       = 0u; // of m_retainedVersion the draws were recorded for
+  };
+  std::vector<RetainedScene> m_retainedScenes; // per frame in flight
+  uint32_t m_retainedVersion          = 1u;    // incremented when recorded draws become stale
+  uint32_t m_retainedInstancesNum     = 0u;    // resident instances and SceneManager::InstancesVersion()
+  uint32_t m_retainedInstancesVersion = 0u;    // the current version stands for
+  uint32_t m_retainedRecordsNum       = 0u;
+  CullStats m_retainedStats;
+  void SetupRetainedRecording();
+  void DestroyRetainedRecording();
+  void InvalidateRetainedScene() { ++m_retainedVersion; }
+  void CmdExecuteRetainedScene(VkCommandBuffer a_cmdBuff, uint32_t a_frame);
 
   virtual void SetupSimplePipeline();
   void CleanupPipelineAndSwapchain();
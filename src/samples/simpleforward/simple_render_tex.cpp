@@ -24,12 +24,6 @@ void SimpleRenderTexture::LoadScene(const char* path, bool transpose_inst_matric
   m_cam.lookAt = float3(loadedCam.lookAt);
   m_cam.tdist  = loadedCam.farPlane;
   UpdateView();
-
-  for (uint32_t i = 0; i < m_framesInFlight; ++i)
-  {
-    BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-      m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-  }
 }
 
 void SimpleRenderTexture::LoadTexture()
@@ -68,16 +62,21 @@ void SimpleRenderTexture::SetupSimplePipeline()
   std::vector<std::pair<VkDescriptorType, uint32_t> > dtypes = {
     {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 128},  // overallocate descriptors to allow recreation when texture is updated
                                                        // one alternative would be to recreate descriptor pool when we get VK_OUT_OF_POOL_MEMORY error
-    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1}
+    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 128}
   };
 
   if(m_pBindings == nullptr)
     m_pBindings = std::make_shared<vk_utils::DescriptorMaker>(m_device, dtypes, 128); // new texture -> new set, so need to set this also to a higher value
 
+  // frames in flight use the set and the pipeline that are updated below
+  if(m_basicForwardPipeline.pipeline != VK_NULL_HANDLE)
+    m_pScheduler->Wait(m_pScheduler->LastFrame());
+
   m_pBindings->BindBegin(VK_SHADER_STAGE_FRAGMENT_BIT);
-  m_pBindings->BindBuffer(0, m_ubo, VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+  m_pBindings->BindBuffer(0, m_pUniformRing->Buffer(), VK_NULL_HANDLE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
   m_pBindings->BindImage(1, m_texture.view, m_textureSampler, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
   m_pBindings->BindEnd(&m_dSet, &m_dSetLayout);
+  m_pUniformRing->WriteDescriptor(m_dSet, 0);
 
   // if we are recreating pipeline (for example, to reload shaders)
   // we need to cleanup old pipeline
@@ -96,7 +95,7 @@ void SimpleRenderTexture::SetupSimplePipeline()
 
   std::unordered_map<VkShaderStageFlagBits, std::string> shader_paths;
   shader_paths[VK_SHADER_STAGE_FRAGMENT_BIT] = FRAGMENT_SHADER_PATH + ".spv";
-  shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = VERTEX_SHADER_PATH + ".spv";
+  shader_paths[VK_SHADER_STAGE_VERTEX_BIT]   = (m_pScnMgr->CompactVerticesEnabled() ? VERTEX_SHADER_COMPACT_PATH : VERTEX_SHADER_PATH) + ".spv";
 
   maker.LoadShaders(m_device, shader_paths);
 
@@ -111,6 +110,8 @@ void SimpleRenderTexture::DrawFrame(float a_time, DrawMode a_mode)
 {
   if(m_textureNeedsReload)
   {
+    // frames in flight sample the old texture
+    m_pScheduler->Wait(m_pScheduler->LastFrame());
     LoadTexture();
     SetupSimplePipeline();
     m_textureNeedsReload = false;
@@ -143,12 +144,6 @@ void SimpleRenderTexture::ProcessInput(const AppInput &input)
 #endif
 
     SetupSimplePipeline();
-
-    for (uint32_t i = 0; i < m_framesInFlight; ++i)
-    {
-      BuildCommandBufferSimple(m_cmdBuffersDrawMain[i], m_frameBuffers[i],
-        m_swapchain.GetAttachment(i).view, m_basicForwardPipeline.pipeline);
-    }
   }
 
 }
@@ -184,6 +179,7 @@ void SimpleRenderTexture::SetupGUIElements()
     ImGui::NewLine();
 
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    SetupGpuTimingsGUI();
 
     ImGui::NewLine();
 
@@ -204,6 +204,9 @@ void mainLoop(std::shared_ptr<IRender> &app, GLFWwindow* window, bool displayGUI
     if(g_appInput.keyReleased[GLFW_KEY_L])
       currCam = 1 - currCam;
 
+    if(app->CameraWasReset())
+      g_appInput.cams[0] = app->GetCurrentCamera();
+
     UpdateCamera(window, g_appInput.cams[currCam], static_cast<float>(diffTime));
     
     app->ProcessInput(g_appInput);
@@ -222,6 +225,8 @@ void mainLoop(std::shared_ptr<IRender> &app, GLFWwindow* window, bool displayGUI
       auto title = "test";//app->GetWindowTitle();
       std::stringstream strout;
       strout << "FPS = " << int( 1.0/(avgTime/double(NAverage)) ) << " " << title;
+      if(app->GetLoadProgress() < 1.0f)
+        strout << " loading " << int(app->GetLoadProgress() * 100.0f) << "%";
 
       glfwSetWindowTitle(window, strout.str().c_str());
       avgTime    = 0.0;
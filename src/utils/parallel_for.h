@@ -0,0 +1,52 @@
+#ifndef VK_GRAPHICS_BASIC_PARALLEL_FOR_H
+#define VK_GRAPHICS_BASIC_PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+inline uint32_t DefaultWorkerThreadsNum()
+{
+  const uint32_t hwThreads = std::thread::hardware_concurrency();
+  return hwThreads == 0 ? 1u : hwThreads;
+}
+
+// Calls a_func(i) for every i in [0, a_count) using up to a_threadsNum threads (calling thread included).
+// Items are handed out one at a time, so a_func should do a reasonable amount of work per call
+// and must be safe to run concurrently for different i.
+//
+template<typename Func>
+void ParallelFor(uint32_t a_count, uint32_t a_threadsNum, Func&& a_func)
+{
+  if(a_threadsNum == 0)
+    a_threadsNum = DefaultWorkerThreadsNum();
+  a_threadsNum = std::min(a_threadsNum, a_count);
+
+  if(a_threadsNum <= 1)
+  {
+    for(uint32_t i = 0; i < a_count; ++i)
+      a_func(i);
+    return;
+  }
+
+  std::atomic<uint32_t> nextItem {0u};
+  auto worker = [&]()
+  {
+    for(uint32_t i = nextItem++; i < a_count; i = nextItem++)
+      a_func(i);
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(a_threadsNum - 1);
+  for(uint32_t t = 1; t < a_threadsNum; ++t)
+    threads.emplace_back(worker);
+
+  worker();
+
+  for(auto &t : threads)
+    t.join();
+}
+
+#endif// VK_GRAPHICS_BASIC_PARALLEL_FOR_H